@@ -0,0 +1,146 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "tensors++/autograd/tape.hpp"
+
+namespace tensors {
+namespace autograd {
+
+// Splits a chain of layers into checkpoint segments. activation[i] is what
+// layer i keeps for backward, output[i] the size of its result (both in
+// bytes). With segments only their outputs stay alive during the forward
+// pass and one segment is rebuilt at a time during backward, so the peak is
+// the sum of the segment outputs plus the largest segment's activations.
+//
+// Returns the index of the first layer of every segment. A single segment
+// starting at 0 means no checkpointing is needed. When no split fits the
+// budget the split with the lowest peak is returned.
+inline std::vector<size_t> plan_checkpoints(
+    const std::vector<size_t> &activation, const std::vector<size_t> &output,
+    size_t budget) {
+  size_t layers = activation.size();
+  size_t total = 0;
+  for (auto &a : activation) total += a;
+  if (layers == 0 || total <= budget) return {0};
+
+  // greedy split where no segment keeps more than `cap` bytes
+  auto split = [&](size_t cap, size_t &peak) {
+    std::vector<size_t> starts = {0};
+    size_t current = 0, largest = 0, kept = 0;
+    for (size_t i = 0; i < layers; i++) {
+      if (current > 0 && current + activation[i] > cap) {
+        kept += output[i - 1];
+        largest = std::max(largest, current);
+        starts.push_back(i);
+        current = 0;
+      }
+      current += activation[i];
+    }
+    largest = std::max(largest, current);
+    peak = kept + output[layers - 1] + largest;
+    return starts;
+  };
+
+  // every contiguous range sum is a candidate cap, the largest cap that
+  // fits gives the fewest segments
+  std::vector<size_t> caps;
+  for (size_t i = 0; i < layers; i++) {
+    size_t s = 0;
+    for (size_t j = i; j < layers; j++) caps.push_back(s += activation[j]);
+  }
+  std::sort(caps.begin(), caps.end());
+  caps.erase(std::unique(caps.begin(), caps.end()), caps.end());
+
+  std::vector<size_t> best;
+  size_t best_peak = static_cast<size_t>(-1);
+  for (auto it = caps.rbegin(); it != caps.rend(); ++it) {
+    size_t peak;
+    std::vector<size_t> starts = split(*it, peak);
+    if (peak <= budget) return starts;
+    if (peak < best_peak) {
+      best_peak = peak;
+      best = starts;
+    }
+  }
+  return best;
+}
+
+// A chain of layers run under an activation memory budget. The first call
+// profiles every layer once on a scratch tape and plans the checkpoint
+// boundaries, later calls reuse that plan (a fixed model and batch size keep
+// the same profile). It must outlive the backward pass of the tapes it ran
+// on, their checkpoints replay its layers.
+template <class dtype = float>
+class sequential_checkpoint {
+  std::vector<segment<dtype>> layers;
+  size_t budget;
+  std::vector<size_t> starts;
+
+  void profile(const var<dtype> &x) {
+    std::vector<size_t> activation, output;
+    Tape<dtype> t;
+    var<dtype> h = t.view(x);
+    for (auto &layer : layers) {
+      size_t before = t.activation_elements();
+      h = layer(t, h);
+      activation.push_back((t.activation_elements() - before) *
+                           sizeof(dtype));
+      output.push_back(h.size() * sizeof(dtype));
+    }
+    starts = plan_checkpoints(activation, output, budget);
+  }
+
+ public:
+  sequential_checkpoint(std::vector<segment<dtype>> chain, size_t budget_bytes)
+      : layers(std::move(chain)), budget(budget_bytes) {}
+
+  // first layer of every planned segment, empty before the first call
+  inline const std::vector<size_t> &segments() const { return starts; }
+
+  var<dtype> operator()(Tape<dtype> &tape, const var<dtype> &x) {
+    if (starts.empty()) profile(x);
+    if (starts.size() == 1) {
+      var<dtype> h = x;
+      for (auto &layer : layers) h = layer(tape, h);
+      return h;
+    }
+    var<dtype> h = x;
+    for (size_t s = 0; s < starts.size(); s++) {
+      size_t begin = starts[s];
+      size_t end = s + 1 < starts.size() ? starts[s + 1] : layers.size();
+      const std::vector<segment<dtype>> *chain = &layers;
+      h = tape.checkpoint(
+          [chain, begin, end](Tape<dtype> &t, const var<dtype> &in) {
+            var<dtype> out = in;
+            for (size_t l = begin; l < end; l++) out = (*chain)[l](t, out);
+            return out;
+          },
+          h);
+    }
+    return h;
+  }
+};
+
+}  // namespace autograd
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,617 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef TAPE_HPP
+#define TAPE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/core/arena.hpp"
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+
+namespace tensors {
+namespace autograd {
+
+enum class op_code {
+  leaf,
+  add,
+  sub,
+  mul,
+  div,
+  add_scalar,
+  mul_scalar,
+  add_bias,  // [.., n] + [n], broadcast over the leading dimensions
+  matmul,
+  relu,
+  sigmoid,
+  tanh,
+  exp,
+  log,
+  sum,
+  mean,
+  checkpoint  // a segment recomputed during backward, see Tape::checkpoint
+};
+
+template <class dtype>
+class Tape;
+
+template <class dtype>
+class var;
+
+// a segment of the forward pass that can be replayed on any tape
+template <class dtype>
+using segment = std::function<var<dtype>(Tape<dtype> &, const var<dtype> &)>;
+
+// Handle to one value recorded on a tape.
+template <class dtype = float>
+class var {
+  Tape<dtype> *t;
+  int node_id;
+
+ public:
+  var(Tape<dtype> *tape, int id) : t(tape), node_id(id) {}
+
+  inline int id() const { return node_id; }
+  inline Tape<dtype> *tape() const { return t; }
+  inline const dtype *data() const { return t->value(node_id); }
+  inline size_t size() const { return t->size(node_id); }
+  inline shape::Shape shape() const { return shape::Shape(t->dims(node_id)); }
+  inline bool requires_grad() const { return t->requires_grad(node_id); }
+
+  tensor<dtype> value() const {
+    return tensor<dtype>(std::vector<dtype>(data(), data() + size()), shape());
+  }
+
+  var operator+(const var &that) const {
+    return t->binary(op_code::add, *this, that);
+  }
+  var operator-(const var &that) const {
+    return t->binary(op_code::sub, *this, that);
+  }
+  var operator*(const var &that) const {
+    return t->binary(op_code::mul, *this, that);
+  }
+  var operator/(const var &that) const {
+    return t->binary(op_code::div, *this, that);
+  }
+  var operator+(const dtype &k) const {
+    return t->unary(op_code::add_scalar, *this, k);
+  }
+  var operator-(const dtype &k) const {
+    return t->unary(op_code::add_scalar, *this, -k);
+  }
+  var operator*(const dtype &k) const {
+    return t->unary(op_code::mul_scalar, *this, k);
+  }
+  var operator/(const dtype &k) const {
+    return t->unary(op_code::mul_scalar, *this, dtype(1) / k);
+  }
+};
+
+// Reverse mode automatic differentiation.
+//
+// Values are recorded by watch() and by the operators of var. Only values
+// depending on a tensor whose config has grad_required, and which is not
+// frozen, get a backward record; everything else is a plain constant. Each
+// record keeps pointers to exactly the values its backward needs (nothing
+// for add, the output for relu/sigmoid/tanh/exp, the inputs for mul, ...).
+// Values and gradients live in arenas that reset() recycles between steps.
+template <class dtype = float>
+class Tape {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  typedef Eigen::Map<array> map;
+  typedef Eigen::Map<const array> const_map;
+  typedef Eigen::Matrix<dtype, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      matrix;
+  typedef Eigen::Map<matrix> matrix_map;
+  typedef Eigen::Map<const matrix> const_matrix_map;
+
+  struct record {
+    op_code op;
+    int lhs = -1, rhs = -1;
+    dtype alpha = dtype(0);
+    std::vector<uint> shape;
+    size_t n = 0;
+    const dtype *value = nullptr;
+    const dtype *saved[2] = {nullptr, nullptr};  // what backward reads
+    bool requires_grad = false;
+    const tensor<dtype> *source = nullptr;  // watched leaves only
+    dtype *sink = nullptr;  // replayed checkpoint inputs write here
+    int segment_id = -1;    // checkpoint records only
+  };
+
+  std::vector<record> records;
+  arena<dtype> values;
+  arena<dtype> grads;
+  std::unordered_map<const tensor<dtype> *, std::vector<dtype>> leaf_grads;
+  std::vector<segment<dtype>> segments;
+  Tape *parent = nullptr;  // gradients of watched tensors go to the root
+  std::unique_ptr<Tape> scratch;  // replays checkpoint segments
+
+  std::unordered_map<const tensor<dtype> *, std::vector<dtype>> &grad_store() {
+    return parent ? parent->grad_store() : leaf_grads;
+  }
+
+  Tape &replay_tape() {
+    if (!scratch) {
+      scratch.reset(new Tape());
+      scratch->parent = this;
+    }
+    scratch->reset();
+    return *scratch;
+  }
+
+  var<dtype> leaf_of(const dtype *value, std::vector<uint> shape,
+                     bool requires_grad) {
+    record r;
+    r.op = op_code::leaf;
+    r.n = count(shape);
+    r.shape = std::move(shape);
+    r.value = value;
+    r.requires_grad = requires_grad;
+    return push(std::move(r));
+  }
+
+  static size_t count(const std::vector<uint> &s) {
+    size_t c = 1;
+    for (auto &e : s) c *= e;
+    return c;
+  }
+
+  void check(const var<dtype> &v) const {
+    if (v.tape() != this || v.id() < 0 ||
+        v.id() >= static_cast<int>(records.size()))
+      throw exceptions::operation_undefined(
+          "Variable was not recorded on this tape.");
+  }
+
+  var<dtype> push(record r) {
+    records.push_back(std::move(r));
+    return var<dtype>(this, static_cast<int>(records.size()) - 1);
+  }
+
+  record make(op_code op, int lhs, int rhs, std::vector<uint> shape) {
+    record r;
+    r.op = op;
+    r.lhs = lhs;
+    r.rhs = rhs;
+    r.n = count(shape);
+    r.shape = std::move(shape);
+    r.requires_grad = records[lhs].requires_grad ||
+                      (rhs >= 0 && records[rhs].requires_grad);
+    return r;
+  }
+
+  // A record that needs no gradient is turned into a constant: nothing of
+  // it is kept for backward.
+  var<dtype> finish(record r, const dtype *out) {
+    r.value = out;
+    if (!r.requires_grad) {
+      r.op = op_code::leaf;
+      r.lhs = r.rhs = -1;
+      r.saved[0] = r.saved[1] = nullptr;
+    }
+    return push(std::move(r));
+  }
+
+  dtype *grad_slot(std::vector<dtype *> &g, int id) {
+    if (!g[id]) {
+      const record &r = records[id];
+      if (r.sink)
+        g[id] = r.sink;
+      else if (r.op == op_code::leaf && r.source) {
+        std::vector<dtype> &store = grad_store()[r.source];
+        store.resize(r.n, dtype(0));
+        g[id] = store.data();
+      } else
+        g[id] = grads.allocate_zeroed(r.n);
+    }
+    return g[id];
+  }
+
+  void backward_record(const record &r, const dtype *gout,
+                       std::vector<dtype *> &g) {
+    const_map go(gout, r.n);
+    bool need_a = r.lhs >= 0 && records[r.lhs].requires_grad;
+    bool need_b = r.rhs >= 0 && records[r.rhs].requires_grad;
+    size_t na = need_a ? records[r.lhs].n : 0;
+    switch (r.op) {
+      case op_code::add:
+        if (need_a) map(grad_slot(g, r.lhs), r.n) += go;
+        if (need_b) map(grad_slot(g, r.rhs), r.n) += go;
+        break;
+      case op_code::sub:
+        if (need_a) map(grad_slot(g, r.lhs), r.n) += go;
+        if (need_b) map(grad_slot(g, r.rhs), r.n) -= go;
+        break;
+      case op_code::mul:
+        if (need_a)
+          map(grad_slot(g, r.lhs), r.n) += go * const_map(r.saved[1], r.n);
+        if (need_b)
+          map(grad_slot(g, r.rhs), r.n) += go * const_map(r.saved[0], r.n);
+        break;
+      case op_code::div: {
+        const_map a(r.saved[0], r.n), b(r.saved[1], r.n);
+        if (need_a) map(grad_slot(g, r.lhs), r.n) += go / b;
+        if (need_b) map(grad_slot(g, r.rhs), r.n) -= go * a / b.square();
+        break;
+      }
+      case op_code::add_scalar:
+        map(grad_slot(g, r.lhs), r.n) += go;
+        break;
+      case op_code::mul_scalar:
+        map(grad_slot(g, r.lhs), r.n) += go * r.alpha;
+        break;
+      case op_code::add_bias: {
+        if (need_a) map(grad_slot(g, r.lhs), r.n) += go;
+        if (need_b) {
+          size_t cols = records[r.rhs].n;
+          Eigen::Map<const matrix> gm(gout, r.n / cols, cols);
+          Eigen::Map<Eigen::Matrix<dtype, 1, Eigen::Dynamic>>(
+              grad_slot(g, r.rhs), cols) += gm.colwise().sum();
+        }
+        break;
+      }
+      case op_code::matmul: {
+        size_t m = records[r.lhs].shape[0], k = records[r.lhs].shape[1];
+        size_t n = records[r.rhs].shape[1];
+        const_matrix_map gm(gout, m, n);
+        if (need_a)
+          matrix_map(grad_slot(g, r.lhs), m, k).noalias() +=
+              gm * const_matrix_map(r.saved[1], k, n).transpose();
+        if (need_b)
+          matrix_map(grad_slot(g, r.rhs), k, n).noalias() +=
+              const_matrix_map(r.saved[0], m, k).transpose() * gm;
+        break;
+      }
+      case op_code::relu: {
+        const_map y(r.saved[0], r.n);
+        map(grad_slot(g, r.lhs), r.n) += (y > dtype(0)).select(go, dtype(0));
+        break;
+      }
+      case op_code::sigmoid: {
+        const_map y(r.saved[0], r.n);
+        map(grad_slot(g, r.lhs), r.n) += go * y * (dtype(1) - y);
+        break;
+      }
+      case op_code::tanh: {
+        const_map y(r.saved[0], r.n);
+        map(grad_slot(g, r.lhs), r.n) += go * (dtype(1) - y.square());
+        break;
+      }
+      case op_code::exp:
+        map(grad_slot(g, r.lhs), r.n) += go * const_map(r.saved[0], r.n);
+        break;
+      case op_code::log:
+        map(grad_slot(g, r.lhs), r.n) += go / const_map(r.saved[0], r.n);
+        break;
+      case op_code::sum:
+        map(grad_slot(g, r.lhs), na) += gout[0];
+        break;
+      case op_code::mean:
+        map(grad_slot(g, r.lhs), na) += gout[0] / dtype(na);
+        break;
+      case op_code::checkpoint: {
+        // rebuild the dropped activations, then push the gradient through
+        Tape &t = replay_tape();
+        var<dtype> x = t.leaf_of(records[r.lhs].value, records[r.lhs].shape,
+                                 need_a);
+        if (need_a) t.records[x.id()].sink = grad_slot(g, r.lhs);
+        var<dtype> y = segments[r.segment_id](t, x);
+        t.propagate(y.id(), gout);
+        t.reset();
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  // walks the records backwards from `output`, seeded with `seed` or ones
+  void propagate(int output, const dtype *seed) {
+    if (!records[output].requires_grad) return;
+    std::vector<dtype *> g(records.size(), nullptr);
+    map s(grad_slot(g, output), records[output].n);
+    if (seed)
+      s += const_map(seed, records[output].n);
+    else
+      s += dtype(1);
+    for (int i = output; i >= 0; i--) {
+      const record &r = records[i];
+      if (!g[i] || r.op == op_code::leaf) continue;
+      backward_record(r, g[i], g);
+    }
+    grads.reset();
+  }
+
+ public:
+  Tape() = default;
+  Tape(const Tape &) = delete;  // variables keep a pointer to the tape
+
+  inline const dtype *value(int id) const { return records[id].value; }
+  inline size_t size(int id) const { return records[id].n; }
+  inline const std::vector<uint> &dims(int id) const {
+    return records[id].shape;
+  }
+  inline bool requires_grad(int id) const { return records[id].requires_grad; }
+  inline size_t record_count() const { return records.size(); }
+  // elements currently held for forward values, mostly saved activations
+  inline size_t activation_elements() const { return values.elements_in_use(); }
+
+  // Records `t` without copying it, the tensor must outlive the tape.
+  // Gradients flow into it only if its config asks for them and it is not
+  // frozen.
+  var<dtype> watch(const tensor<dtype> &t) {
+    record r;
+    r.op = op_code::leaf;
+    r.shape = t.shape().d;
+    r.n = t.size();
+    r.value = t.raw_data();
+    r.source = &t;
+    r.requires_grad = t.tensor_config().grad_required && !t.frozen();
+    return push(std::move(r));
+  }
+
+  // read-only view of a value recorded on another tape, no gradient flows
+  // back through it
+  var<dtype> view(const var<dtype> &v) {
+    return leaf_of(v.data(), v.tape()->dims(v.id()), false);
+  }
+
+  var<dtype> binary(op_code op, const var<dtype> &a, const var<dtype> &b) {
+    check(a);
+    check(b);
+    if (records[a.id()].shape != records[b.id()].shape)
+      throw exceptions::operation_undefined(
+          "Element wise operation is not defined when both tensors have "
+          "mismatch shape." +
+          static_cast<std::string>(a.shape()) + " and " +
+          static_cast<std::string>(b.shape()));
+    record r = make(op, a.id(), b.id(), records[a.id()].shape);
+    const_map x(a.data(), r.n), y(b.data(), r.n);
+    dtype *out = values.allocate(r.n);
+    map o(out, r.n);
+    switch (op) {
+      case op_code::add:
+        o = x + y;
+        break;
+      case op_code::sub:
+        o = x - y;
+        break;
+      case op_code::mul:
+        o = x * y;
+        // each side only needs the other one
+        r.saved[0] = records[b.id()].requires_grad ? a.data() : nullptr;
+        r.saved[1] = records[a.id()].requires_grad ? b.data() : nullptr;
+        break;
+      case op_code::div:
+        o = x / y;
+        r.saved[0] = a.data();
+        r.saved[1] = b.data();
+        break;
+      default:
+        throw exceptions::operation_undefined("Not a binary operation.");
+    }
+    return finish(std::move(r), out);
+  }
+
+  var<dtype> unary(op_code op, const var<dtype> &a, dtype alpha = dtype(0)) {
+    check(a);
+    record r = make(op, a.id(), -1, records[a.id()].shape);
+    r.alpha = alpha;
+    if (op == op_code::sum || op == op_code::mean) {
+      r.shape = {1};
+      r.n = 1;
+    }
+    const_map x(a.data(), records[a.id()].n);
+    dtype *out = values.allocate(r.n);
+    map o(out, r.n);
+    switch (op) {
+      case op_code::add_scalar:
+        o = x + alpha;
+        break;
+      case op_code::mul_scalar:
+        o = x * alpha;
+        break;
+      case op_code::relu:
+        o = x.max(dtype(0));
+        r.saved[0] = out;
+        break;
+      case op_code::sigmoid:
+        o = dtype(1) / (dtype(1) + (-x).exp());
+        r.saved[0] = out;
+        break;
+      case op_code::tanh:
+        o = x.tanh();
+        r.saved[0] = out;
+        break;
+      case op_code::exp:
+        o = x.exp();
+        r.saved[0] = out;
+        break;
+      case op_code::log:
+        o = x.log();
+        r.saved[0] = a.data();
+        break;
+      case op_code::sum:
+        out[0] = x.sum();
+        break;
+      case op_code::mean:
+        out[0] = x.mean();
+        break;
+      default:
+        throw exceptions::operation_undefined("Not a unary operation.");
+    }
+    return finish(std::move(r), out);
+  }
+
+  var<dtype> bias(const var<dtype> &a, const var<dtype> &b) {
+    check(a);
+    check(b);
+    const std::vector<uint> &s = records[a.id()].shape;
+    if (records[b.id()].shape.size() != 1 || s.back() != records[b.id()].n)
+      throw exceptions::operation_undefined(
+          "Bias must be 1 dimensional and match the last axis. Got " +
+          static_cast<std::string>(b.shape()) + " for " +
+          static_cast<std::string>(a.shape()));
+    record r = make(op_code::add_bias, a.id(), b.id(), s);
+    size_t cols = records[b.id()].n;
+    dtype *out = values.allocate(r.n);
+    matrix_map(out, r.n / cols, cols) =
+        const_matrix_map(a.data(), r.n / cols, cols).rowwise() +
+        Eigen::Map<const Eigen::Matrix<dtype, 1, Eigen::Dynamic>>(b.data(),
+                                                                   cols);
+    return finish(std::move(r), out);
+  }
+
+  var<dtype> product(const var<dtype> &a, const var<dtype> &b) {
+    check(a);
+    check(b);
+    const std::vector<uint> &sa = records[a.id()].shape;
+    const std::vector<uint> &sb = records[b.id()].shape;
+    if (sa.size() != 2 || sb.size() != 2 || sa[1] != sb[0])
+      throw exceptions::operation_undefined(
+          "Matrix product is not defined for shapes " +
+          static_cast<std::string>(a.shape()) + " and " +
+          static_cast<std::string>(b.shape()));
+    record r = make(op_code::matmul, a.id(), b.id(), {sa[0], sb[1]});
+    dtype *out = values.allocate(r.n);
+    matrix_map(out, sa[0], sb[1]).noalias() =
+        const_matrix_map(a.data(), sa[0], sa[1]) *
+        const_matrix_map(b.data(), sb[0], sb[1]);
+    r.saved[0] = records[b.id()].requires_grad ? a.data() : nullptr;
+    r.saved[1] = records[a.id()].requires_grad ? b.data() : nullptr;
+    return finish(std::move(r), out);
+  }
+
+  // Accumulates d(output)/d(leaf) into every watched tensor that requires a
+  // gradient. A non scalar output is seeded with ones.
+  void backward(const var<dtype> &output) {
+    check(output);
+    propagate(output.id(), nullptr);
+  }
+
+  // Runs `fn` on `x` keeping only its output: the activations inside the
+  // segment are dropped after the forward pass and recomputed by replaying
+  // `fn` when backward reaches it. `fn` must be deterministic and record
+  // everything on the tape it is handed, watching its own parameters.
+  var<dtype> checkpoint(const segment<dtype> &fn, const var<dtype> &x) {
+    check(x);
+    size_t n;
+    std::vector<uint> shape;
+    bool requires_grad;
+    dtype *out;
+    {
+      Tape &t = replay_tape();
+      var<dtype> xi = t.leaf_of(x.data(), records[x.id()].shape,
+                                records[x.id()].requires_grad);
+      var<dtype> yi = fn(t, xi);
+      shape = t.records[yi.id()].shape;
+      n = t.records[yi.id()].n;
+      requires_grad = t.records[yi.id()].requires_grad;
+      out = values.allocate(n);
+      std::copy(yi.data(), yi.data() + n, out);
+      t.reset();
+    }
+    record r;
+    r.op = op_code::checkpoint;
+    r.lhs = x.id();
+    r.n = n;
+    r.shape = std::move(shape);
+    r.requires_grad = requires_grad;
+    r.segment_id = static_cast<int>(segments.size());
+    segments.push_back(fn);
+    return finish(std::move(r), out);
+  }
+
+  // gradient accumulated for `t`, nullptr if nothing has flowed into it
+  const dtype *grad(const tensor<dtype> &t) const {
+    auto it = leaf_grads.find(&t);
+    return it == leaf_grads.end() ? nullptr : it->second.data();
+  }
+
+  void zero_grad() {
+    for (auto &e : leaf_grads)
+      std::fill(e.second.begin(), e.second.end(), dtype(0));
+  }
+
+  // forgets every record so the next step reuses the same arenas
+  void reset() {
+    records.clear();
+    segments.clear();
+    values.reset();
+    grads.reset();
+  }
+};
+
+template <class dtype>
+inline var<dtype> matmul(const var<dtype> &a, const var<dtype> &b) {
+  return a.tape()->product(a, b);
+}
+
+template <class dtype>
+inline var<dtype> add_bias(const var<dtype> &a, const var<dtype> &b) {
+  return a.tape()->bias(a, b);
+}
+
+template <class dtype>
+inline var<dtype> relu(const var<dtype> &a) {
+  return a.tape()->unary(op_code::relu, a);
+}
+
+template <class dtype>
+inline var<dtype> sigmoid(const var<dtype> &a) {
+  return a.tape()->unary(op_code::sigmoid, a);
+}
+
+template <class dtype>
+inline var<dtype> tanh(const var<dtype> &a) {
+  return a.tape()->unary(op_code::tanh, a);
+}
+
+template <class dtype>
+inline var<dtype> exp(const var<dtype> &a) {
+  return a.tape()->unary(op_code::exp, a);
+}
+
+template <class dtype>
+inline var<dtype> log(const var<dtype> &a) {
+  return a.tape()->unary(op_code::log, a);
+}
+
+template <class dtype>
+inline var<dtype> sum(const var<dtype> &a) {
+  return a.tape()->unary(op_code::sum, a);
+}
+
+template <class dtype>
+inline var<dtype> mean(const var<dtype> &a) {
+  return a.tape()->unary(op_code::mean, a);
+}
+
+}  // namespace autograd
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace tensors {
+
+// Bump allocator handing out element buffers from a few large blocks.
+// Pointers stay valid until reset(), which keeps the blocks for reuse so a
+// training loop stops allocating after its first iteration.
+template <class dtype = float>
+class arena {
+  std::vector<std::unique_ptr<dtype[]>> blocks;
+  std::vector<size_t> capacity;
+  size_t current = 0, used = 0, in_use = 0;
+  size_t block_elements;
+
+ public:
+  explicit arena(size_t block = 1 << 16) : block_elements(block) {}
+  arena(const arena &) = delete;
+
+  dtype *allocate(size_t n) {
+    while (current < blocks.size() && used + n > capacity[current]) {
+      current++;
+      used = 0;
+    }
+    if (current == blocks.size()) {
+      size_t size = std::max(n, block_elements);
+      blocks.emplace_back(new dtype[size]);
+      capacity.push_back(size);
+      used = 0;
+    }
+    dtype *p = blocks[current].get() + used;
+    used += n;
+    in_use += n;
+    return p;
+  }
+
+  dtype *allocate_zeroed(size_t n) {
+    dtype *p = allocate(n);
+    std::fill(p, p + n, dtype(0));
+    return p;
+  }
+
+  // every pointer handed out so far becomes invalid
+  void reset() {
+    current = used = in_use = 0;
+  }
+
+  inline size_t elements_in_use() const { return in_use; }
+};
+
+}  // namespace tensors
+
+#endif
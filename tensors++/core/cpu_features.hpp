@@ -0,0 +1,180 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CPU_FEATURES_HPP
+#define CPU_FEATURES_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+// Kernels with several instruction set variants are compiled into one
+// binary with per function target attributes and picked at run time, so a
+// baseline (SSE2) build still runs its hot loops with AVX2 on Haswell and
+// AVX-512 VNNI on Ice Lake. Needs GCC or Clang on x86, everywhere else only
+// the portable variants exist.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define TENSORS_DISPATCH 1
+#include <cpuid.h>
+#include <immintrin.h>
+#define TENSORS_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define TENSORS_TARGET_AVX512 \
+  __attribute__((target("avx2,fma,f16c,avx512f,avx512bw,avx512dq,avx512vl")))
+#define TENSORS_TARGET_AVX512_VNNI                                           \
+  __attribute__((target(                                                     \
+      "avx2,fma,f16c,avx512f,avx512bw,avx512dq,avx512vl,avx512vnni")))
+#endif
+
+namespace tensors {
+namespace cpu {
+
+// Instruction set levels the kernels are specialized for, each one implies
+// the ones before it:
+//   sse2         any x86-64, and the portable code elsewhere
+//   avx2         AVX2 + FMA + F16C (Haswell)
+//   avx512       AVX-512 F/BW/DQ/VL (Skylake-SP)
+//   avx512_vnni  avx512 + VNNI int8 dot products (Cascade Lake, Ice Lake)
+enum class isa { sse2, avx2, avx512, avx512_vnni };
+
+inline const char *isa_name(isa level) {
+  switch (level) {
+    case isa::sse2:
+      return "sse2";
+    case isa::avx2:
+      return "avx2";
+    case isa::avx512:
+      return "avx512";
+    case isa::avx512_vnni:
+      return "avx512_vnni";
+  }
+  return "";
+}
+
+struct features {
+  bool sse2 = false, avx = false, avx2 = false, fma = false, f16c = false;
+  bool avx512f = false, avx512bw = false, avx512dq = false, avx512vl = false;
+  bool avx512vnni = false;
+
+  isa best() const {
+    if (!(avx2 && fma && f16c)) return isa::sse2;
+    if (!(avx512f && avx512bw && avx512dq && avx512vl)) return isa::avx2;
+    return avx512vnni ? isa::avx512_vnni : isa::avx512;
+  }
+};
+
+// CPUID, masked by what the OS saves on a context switch (XCR0): a CPU with
+// AVX-512 under a kernel that does not preserve the zmm state reports avx2.
+inline features detect() {
+  features f;
+#ifdef TENSORS_DISPATCH
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return f;
+  f.sse2 = edx & bit_SSE2;
+  bool osxsave = ecx & bit_OSXSAVE;
+  if (!osxsave || !(ecx & bit_AVX)) return f;
+  uint32_t xcr0_lo, xcr0_hi;
+  __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+  bool ymm_state = (xcr0_lo & 0x6) == 0x6;
+  bool zmm_state = (xcr0_lo & 0xe6) == 0xe6;
+  if (!ymm_state) return f;
+  f.avx = true;
+  f.fma = ecx & bit_FMA;
+  f.f16c = ecx & bit_F16C;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return f;
+  f.avx2 = ebx & bit_AVX2;
+  if (!zmm_state) return f;
+  f.avx512f = ebx & bit_AVX512F;
+  f.avx512bw = ebx & bit_AVX512BW;
+  f.avx512dq = ebx & bit_AVX512DQ;
+  f.avx512vl = ebx & bit_AVX512VL;
+  f.avx512vnni = ecx & (1u << 11);
+#endif
+  return f;
+}
+
+// features of the host, detected once
+inline const features &host() {
+  static const features f = detect();
+  return f;
+}
+
+// The level the code was compiled for: Eigen and everything under #ifdef
+// __AVX2__ already use it, a dispatched variant only pays off above it.
+inline constexpr isa compiled_isa() {
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512DQ__) && \
+    defined(__AVX512VL__)
+#ifdef __AVX512VNNI__
+  return isa::avx512_vnni;
+#else
+  return isa::avx512;
+#endif
+#elif defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+  return isa::avx2;
+#else
+  return isa::sse2;
+#endif
+}
+
+// the level called `name`, or fallback when there is none
+inline isa isa_from_name(const char *name, isa fallback) {
+  if (!name) return fallback;
+  for (isa level : {isa::sse2, isa::avx2, isa::avx512, isa::avx512_vnni})
+    if (std::strcmp(name, isa_name(level)) == 0) return level;
+  return fallback;
+}
+
+// the best level of the host, or a lower one from TENSORS_ISA
+inline std::atomic<int> &active_level() {
+  static std::atomic<int> level([] {
+    isa best = host().best();
+    isa wanted = isa_from_name(std::getenv("TENSORS_ISA"), best);
+    return int(wanted < best ? wanted : best);
+  }());
+  return level;
+}
+
+// Level the dispatched kernels run at. Starts at the best one the host
+// supports, or the one named by the TENSORS_ISA environment variable
+// ("sse2", "avx2", "avx512", "avx512_vnni") when that is lower.
+inline isa active_isa() {
+  return isa(active_level().load(std::memory_order_relaxed));
+}
+
+// Caps the dispatched kernels at `level` (never above what the host
+// supports) and returns the level now active, for benchmarks and tests of
+// the portable paths.
+inline isa set_isa(isa level) {
+  isa best = host().best();
+  isa now = level < best ? level : best;
+  active_level().store(int(now), std::memory_order_relaxed);
+  return now;
+}
+
+// true when a variant for `level` exists in this build and may run now
+inline bool use(isa level) {
+#ifdef TENSORS_DISPATCH
+  return active_isa() >= level;
+#else
+  return level == isa::sse2;
+#endif
+}
+
+}  // namespace cpu
+}  // namespace tensors
+
+#endif
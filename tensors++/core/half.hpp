@@ -0,0 +1,198 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef HALF_HPP
+#define HALF_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "Eigen/Core"
+#include "tensors++/core/cpu_features.hpp"
+
+namespace tensors {
+
+// IEEE binary16, 5 exponent and 10 mantissa bits (Eigen's CPU capable half)
+typedef Eigen::half half;
+
+// Brain floating point: the upper 16 bits of an IEEE float, so the range of
+// float with 8 bits of mantissa. Converts from float rounding to nearest
+// even and, like Eigen::half, only explicitly; arithmetic runs in float.
+struct bfloat16 {
+  uint16_t x = 0;
+
+  bfloat16() = default;
+  explicit bfloat16(float f) : x(round(f)) {}
+  template <class T, class = typename std::enable_if<
+                         std::is_arithmetic<T>::value ||
+                         std::is_same<T, half>::value>::type>
+  explicit bfloat16(const T &value) : bfloat16(static_cast<float>(value)) {}
+
+  explicit operator float() const {
+    uint32_t bits = uint32_t(x) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof f);
+    return f;
+  }
+  explicit operator double() const { return double(float(*this)); }
+
+  static uint16_t round(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof bits);
+    if ((bits & 0x7fffffffu) > 0x7f800000u)  // NaN, kept quiet
+      return uint16_t((bits >> 16) | 0x40);
+    return uint16_t((bits + 0x7fffu + ((bits >> 16) & 1)) >> 16);
+  }
+};
+
+inline bfloat16 operator+(bfloat16 a, bfloat16 b) {
+  return bfloat16(float(a) + float(b));
+}
+inline bfloat16 &operator+=(bfloat16 &a, bfloat16 b) { return a = a + b; }
+inline bfloat16 operator-(bfloat16 a, bfloat16 b) {
+  return bfloat16(float(a) - float(b));
+}
+inline bfloat16 &operator-=(bfloat16 &a, bfloat16 b) { return a = a - b; }
+inline bfloat16 operator*(bfloat16 a, bfloat16 b) {
+  return bfloat16(float(a) * float(b));
+}
+inline bfloat16 &operator*=(bfloat16 &a, bfloat16 b) { return a = a * b; }
+inline bfloat16 operator/(bfloat16 a, bfloat16 b) {
+  return bfloat16(float(a) / float(b));
+}
+inline bfloat16 &operator/=(bfloat16 &a, bfloat16 b) { return a = a / b; }
+inline bool operator==(bfloat16 a, bfloat16 b) { return float(a) == float(b); }
+inline bool operator!=(bfloat16 a, bfloat16 b) { return float(a) != float(b); }
+inline bool operator<(bfloat16 a, bfloat16 b) { return float(a) < float(b); }
+inline bool operator<=(bfloat16 a, bfloat16 b) { return float(a) <= float(b); }
+inline bool operator>(bfloat16 a, bfloat16 b) { return float(a) > float(b); }
+inline bool operator>=(bfloat16 a, bfloat16 b) { return float(a) >= float(b); }
+inline bfloat16 operator-(bfloat16 a) {
+  a.x ^= 0x8000;
+  return a;
+}
+
+// 16-bit storage types that compute in float
+template <class dtype>
+struct is_reduced_precision
+    : std::integral_constant<bool, std::is_same<dtype, half>::value ||
+                                       std::is_same<dtype, bfloat16>::value> {
+};
+
+// type that sums, products and reductions over dtype accumulate in
+template <class dtype>
+struct accumulator {
+  typedef typename std::conditional<is_reduced_precision<dtype>::value, float,
+                                    dtype>::type type;
+};
+
+// Bulk conversions between the 16-bit types and float, used on load and
+// store by the mixed precision kernels. On an AVX2 host (F16C for half)
+// eight values are converted per instruction, otherwise one by one.
+#ifdef TENSORS_DISPATCH
+TENSORS_TARGET_AVX2 inline size_t to_float_avx2(const half *src, float *dst,
+                                                size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(
+                                  reinterpret_cast<const __m128i *>(src + i))));
+  return i;
+}
+
+TENSORS_TARGET_AVX2 inline size_t from_float_avx2(const float *src, half *dst,
+                                                  size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dst + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+  return i;
+}
+
+TENSORS_TARGET_AVX2 inline size_t to_float_avx2(const bfloat16 *src,
+                                                float *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i wide = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+    _mm256_storeu_ps(dst + i,
+                     _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16)));
+  }
+  return i;
+}
+
+TENSORS_TARGET_AVX2 inline size_t from_float_avx2(const float *src,
+                                                  bfloat16 *dst, size_t n) {
+  const __m256i bias = _mm256_set1_epi32(0x7fff), one = _mm256_set1_epi32(1);
+  const __m256i quiet = _mm256_set1_epi32(0x40);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(src + i);
+    __m256i bits = _mm256_castps_si256(v);
+    __m256i upper = _mm256_srli_epi32(bits, 16);
+    __m256i rounded = _mm256_srli_epi32(
+        _mm256_add_epi32(_mm256_add_epi32(bits, bias),
+                         _mm256_and_si256(upper, one)),
+        16);
+    __m256 nan = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+    rounded = _mm256_castps_si256(
+        _mm256_blendv_ps(_mm256_castsi256_ps(rounded),
+                         _mm256_castsi256_ps(_mm256_or_si256(upper, quiet)),
+                         nan));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     _mm_packus_epi32(_mm256_castsi256_si128(rounded),
+                                      _mm256_extracti128_si256(rounded, 1)));
+  }
+  return i;
+}
+#endif
+
+inline void to_float(const half *src, float *dst, size_t n) {
+  size_t i = 0;
+#ifdef TENSORS_DISPATCH
+  if (cpu::use(cpu::isa::avx2)) i = to_float_avx2(src, dst, n);
+#endif
+  for (; i < n; i++) dst[i] = static_cast<float>(src[i]);
+}
+
+inline void from_float(const float *src, half *dst, size_t n) {
+  size_t i = 0;
+#ifdef TENSORS_DISPATCH
+  if (cpu::use(cpu::isa::avx2)) i = from_float_avx2(src, dst, n);
+#endif
+  for (; i < n; i++) dst[i] = half(src[i]);
+}
+
+inline void to_float(const bfloat16 *src, float *dst, size_t n) {
+  size_t i = 0;
+#ifdef TENSORS_DISPATCH
+  if (cpu::use(cpu::isa::avx2)) i = to_float_avx2(src, dst, n);
+#endif
+  for (; i < n; i++) dst[i] = static_cast<float>(src[i]);
+}
+
+inline void from_float(const float *src, bfloat16 *dst, size_t n) {
+  size_t i = 0;
+#ifdef TENSORS_DISPATCH
+  if (cpu::use(cpu::isa::avx2)) i = from_float_avx2(src, dst, n);
+#endif
+  for (; i < n; i++) dst[i] = bfloat16(src[i]);
+}
+
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "unsupported/Eigen/CXX11/ThreadPool"
+
+namespace tensors {
+namespace parallel {
+
+// Process wide pool shared by every kernel, created on first use with one
+// thread per core, or as many as the TENSORS_NUM_THREADS environment
+// variable asks for.
+inline Eigen::NonBlockingThreadPool &thread_pool() {
+  static Eigen::NonBlockingThreadPool pool([] {
+    const char *wanted = std::getenv("TENSORS_NUM_THREADS");
+    int n = wanted ? std::atoi(wanted) : 0;
+    return n > 0 ? n : int(std::max(1u, std::thread::hardware_concurrency()));
+  }());
+  return pool;
+}
+
+// Runs fn(begin, end) over [0, n) split into blocks of at least `grain`
+// items. The calling thread takes the first block. Calls made from inside a
+// pool worker run inline so nested kernels cannot deadlock the pool. When
+// blocks throw, every block still finishes before the first exception is
+// rethrown on the calling thread.
+inline void parallel_for(size_t n, size_t grain,
+                         const std::function<void(size_t, size_t)> &fn) {
+  if (n == 0) return;
+  Eigen::NonBlockingThreadPool &pool = thread_pool();
+  grain = std::max<size_t>(grain, 1);
+  size_t blocks = std::min<size_t>(pool.NumThreads(), (n + grain - 1) / grain);
+  if (blocks <= 1 || pool.CurrentThreadId() != -1) {
+    fn(0, n);
+    return;
+  }
+  // everything the workers touch lives in one struct so the scheduled
+  // closures stay small enough to avoid a heap allocation per block
+  struct join {
+    const std::function<void(size_t, size_t)> &fn;
+    size_t n, step, pending = 0;
+    std::mutex mu;
+    std::condition_variable cv;
+    std::exception_ptr error;
+
+    join(const std::function<void(size_t, size_t)> &fn, size_t n, size_t step)
+        : fn(fn), n(n), step(step) {}
+
+    void run(size_t b) {
+      try {
+        fn(b * step, std::min(n, (b + 1) * step));
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mu);
+        if (!error) error = std::current_exception();
+      }
+    }
+  } state(fn, n, (n + blocks - 1) / blocks);
+  blocks = (n + state.step - 1) / state.step;
+  state.pending = blocks - 1;
+  for (size_t b = 1; b < blocks; b++)
+    pool.Schedule([&state, b] {
+      state.run(b);
+      std::lock_guard<std::mutex> lock(state.mu);
+      if (--state.pending == 0) state.cv.notify_one();
+    });
+  state.run(0);
+  // the workers hold &state until the last one is done
+  std::unique_lock<std::mutex> lock(state.mu);
+  state.cv.wait(lock, [&state] { return state.pending == 0; });
+  if (state.error) std::rethrow_exception(state.error);
+}
+
+}  // namespace parallel
+}  // namespace tensors
+
+#endif
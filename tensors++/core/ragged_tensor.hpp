@@ -0,0 +1,252 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef RAGGED_TENSOR_HPP
+#define RAGGED_TENSOR_HPP
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/segment.hpp"
+
+namespace tensors {
+
+// Sequences of a batch ordered by decreasing length, the layout recurrent
+// layers step through without padding (PyTorch's PackedSequence, but
+// pointing into the ragged values instead of copying them): sequence
+// order[i] starts at row starts[i] of the values, and at timestep t only
+// the first batch_sizes[t] of them are still running.
+struct packed_sequence {
+  std::vector<size_t> order, starts, batch_sizes;
+};
+
+// A batch of sequences of different lengths without padding: the rows of
+// every sequence back to back in one values tensor [total, ...] and the row
+// splits, sequence i being rows [splits[i], splits[i + 1]) (tf.RaggedTensor
+// with a single ragged dimension). Everything past the first dimension of
+// the values is the fixed inner shape of a row.
+template <class dtype = float>
+class ragged_tensor {
+  tensor<dtype> flat;
+  std::vector<size_t> splits;
+  size_t inner;
+
+  static size_t inner_elements(const tensor<dtype> &values) {
+    std::vector<uint> d = values.shape().d;
+    return d.size() > 1 ? values.size() / d[0] : 1;
+  }
+
+  // the inner shape after `leading` dimensions
+  shape::Shape with_rows(std::vector<uint> leading) const {
+    std::vector<uint> d = flat.shape().d;
+    leading.insert(leading.end(), d.begin() + 1, d.end());
+    return shape::Shape(leading);
+  }
+
+  void check_same_splits(const ragged_tensor &that,
+                         const std::string &operation) const {
+    if (that.splits != splits || that.inner != inner)
+      throw exceptions::operation_undefined(
+          operation + " of ragged tensors needs the same row splits and "
+                      "inner shape");
+  }
+
+  typedef Eigen::Map<Eigen::Array<dtype, Eigen::Dynamic, 1>> array_map;
+  typedef Eigen::Map<const Eigen::Array<dtype, Eigen::Dynamic, 1>>
+      const_array_map;
+
+  const_array_map array() const {
+    return const_array_map(flat.raw_data(), flat.size());
+  }
+
+  template <class Op>
+  ragged_tensor elementwise(const Op &op) const {
+    std::vector<dtype> out(flat.size());
+    array_map(out.data(), out.size()) = op(array());
+    return ragged_tensor(tensor<dtype>(out, flat.shape()), splits);
+  }
+
+ public:
+  // values [total, ...] and row_splits, which start at 0, never decrease
+  // and end at total. A tensor cannot be empty, so neither can the values.
+  ragged_tensor(tensor<dtype> values, std::vector<size_t> row_splits)
+      : flat(std::move(values)),
+        splits(std::move(row_splits)),
+        inner(inner_elements(flat)) {
+    size_t total = flat.shape().d[0];
+    bool valid = !splits.empty() && splits.front() == 0 &&
+                 splits.back() == total &&
+                 std::is_sorted(splits.begin(), splits.end());
+    if (!valid)
+      throw exceptions::operation_undefined(
+          "Row splits do not partition the " + std::to_string(total) +
+          " rows of the ragged values");
+  }
+
+  static ragged_tensor from_lengths(tensor<dtype> values,
+                                    const std::vector<size_t> &lengths) {
+    std::vector<size_t> splits(lengths.size() + 1, 0);
+    std::partial_sum(lengths.begin(), lengths.end(), splits.begin() + 1);
+    return ragged_tensor(std::move(values), std::move(splits));
+  }
+
+  // The first lengths[i] rows of every sequence of a padded batch [batch,
+  // max_len, ...], dropping the padding.
+  static ragged_tensor from_padded(const tensor<dtype> &padded,
+                                   const std::vector<size_t> &lengths) {
+    std::vector<uint> d = padded.shape().d;
+    if (d.size() < 2 || d[0] != lengths.size())
+      throw exceptions::operation_undefined(
+          "Padded tensor " + std::string(padded.shape()) + " does not match " +
+          std::to_string(lengths.size()) + " lengths");
+    size_t max_len = d[1], row = padded.size() / (d[0] * max_len);
+    std::vector<dtype> values;
+    const dtype *x = padded.raw_data();
+    for (size_t b = 0; b < lengths.size(); b++) {
+      if (lengths[b] > max_len)
+        throw exceptions::operation_undefined(
+            "Sequence length " + std::to_string(lengths[b]) +
+            " exceeds the padded length " + std::to_string(max_len));
+      const dtype *first = x + b * max_len * row;
+      values.insert(values.end(), first, first + lengths[b] * row);
+    }
+    std::vector<uint> vd(d.begin() + 1, d.end());
+    vd[0] = uint(values.size() / row);
+    return from_lengths(tensor<dtype>(values, shape::Shape(vd)), lengths);
+  }
+
+  // [batch, max_length, ...], the rows past each sequence set to pad
+  tensor<dtype> to_padded(dtype pad = dtype(0)) const {
+    size_t batch = nrows(), max_len = std::max<size_t>(1, max_length());
+    std::vector<dtype> out(batch * max_len * inner, pad);
+    const dtype *x = flat.raw_data();
+    for (size_t b = 0; b < batch; b++)
+      std::copy(x + splits[b] * inner, x + splits[b + 1] * inner,
+                out.begin() + b * max_len * inner);
+    return tensor<dtype>(out, with_rows({uint(batch), uint(max_len)}));
+  }
+
+  // [batch, max_length] with 1 at the real positions and 0 at the padding
+  // of to_padded, the attention / loss mask
+  tensor<dtype> mask() const {
+    size_t batch = nrows(), max_len = std::max<size_t>(1, max_length());
+    std::vector<dtype> out(batch * max_len, dtype(0));
+    for (size_t b = 0; b < batch; b++)
+      std::fill_n(out.begin() + b * max_len, row_length(b), dtype(1));
+    return tensor<dtype>(out, shape::Shape({uint(batch), uint(max_len)}));
+  }
+
+  packed_sequence packed() const {
+    packed_sequence p;
+    p.order.resize(nrows());
+    std::iota(p.order.begin(), p.order.end(), 0);
+    std::stable_sort(p.order.begin(), p.order.end(),
+                     [this](size_t a, size_t b) {
+                       return row_length(a) > row_length(b);
+                     });
+    for (size_t i : p.order) p.starts.push_back(splits[i]);
+    size_t steps = max_length();
+    for (size_t t = 0, running = nrows(); t < steps; t++) {
+      while (running > 0 && row_length(p.order[running - 1]) <= t) running--;
+      p.batch_sizes.push_back(running);
+    }
+    return p;
+  }
+
+  // Segment reductions over the rows of every sequence, [batch, ...].
+  // Empty sequences reduce to zeros.
+  tensor<dtype> segment_sum() const {
+    std::vector<dtype> out(nrows() * inner);
+    kernels::segment_sum(flat.raw_data(), splits.data(), nrows(), inner,
+                         out.data());
+    return tensor<dtype>(out, with_rows({uint(nrows())}));
+  }
+
+  tensor<dtype> segment_mean() const {
+    std::vector<dtype> out(nrows() * inner);
+    kernels::segment_mean(flat.raw_data(), splits.data(), nrows(), inner,
+                          out.data());
+    return tensor<dtype>(out, with_rows({uint(nrows())}));
+  }
+
+  tensor<dtype> segment_max() const {
+    std::vector<dtype> out(nrows() * inner);
+    kernels::segment_max(flat.raw_data(), splits.data(), nrows(), inner,
+                         out.data());
+    return tensor<dtype>(out, with_rows({uint(nrows())}));
+  }
+
+  // the same row splits over new values, e.g. a layer applied row by row
+  ragged_tensor with_values(tensor<dtype> values) const {
+    return ragged_tensor(std::move(values), splits);
+  }
+
+  // Element-wise arithmetic runs over the flat values only, so it costs
+  // the real elements and nothing for padding.
+  ragged_tensor operator+(const ragged_tensor &that) const {
+    check_same_splits(that, "Addition");
+    return elementwise([&that](const const_array_map &x) {
+      return x + that.array();
+    });
+  }
+  ragged_tensor operator-(const ragged_tensor &that) const {
+    check_same_splits(that, "Subtraction");
+    return elementwise([&that](const const_array_map &x) {
+      return x - that.array();
+    });
+  }
+  ragged_tensor operator*(const ragged_tensor &that) const {
+    check_same_splits(that, "Multiplication");
+    return elementwise([&that](const const_array_map &x) {
+      return x * that.array();
+    });
+  }
+  ragged_tensor operator+(dtype k) const {
+    return elementwise([k](const const_array_map &x) { return x + k; });
+  }
+  ragged_tensor operator*(dtype k) const {
+    return elementwise([k](const const_array_map &x) { return x * k; });
+  }
+
+  inline size_t nrows() const { return splits.size() - 1; }
+  inline size_t total_rows() const { return splits.back(); }
+  inline size_t row_length(size_t i) const {
+    return splits[i + 1] - splits[i];
+  }
+  inline size_t max_length() const {
+    size_t m = 0;
+    for (size_t i = 0; i < nrows(); i++) m = std::max(m, row_length(i));
+    return m;
+  }
+  // elements in one row of the values
+  inline size_t inner_size() const { return inner; }
+  inline const std::vector<size_t> &row_splits() const { return splits; }
+  inline const tensor<dtype> &values() const { return flat; }
+  inline const dtype *row_data(size_t i) const {
+    return flat.raw_data() + splits[i] * inner;
+  }
+};
+
+}  // namespace tensors
+
+#endif
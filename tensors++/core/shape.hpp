@@ -57,18 +57,19 @@ struct Shape {
     return res;
   }
 
-  operator std::string() {
+  operator std::string() const {
     std::string res = "(";
-    for (auto &e : d) res += std::to_string(e) + ", ";
+    for (const auto &e : d) res += std::to_string(e) + ", ";
     *(res.end() - 2) = ')';
     res = res.substr(0, res.size() - 1);
     return res;
   }
 
-  uint operator[](size_t a) { return d[a]; }
-  uint operator==(const Shape &other) { return other.d == d; }
+  uint operator[](size_t a) const { return d[a]; }
+  bool operator==(const Shape &other) const { return other.d == d; }
+  bool operator!=(const Shape &other) const { return other.d != d; }
 
-  size_t element_size() {
+  size_t element_size() const {
     size_t s = 1;
     for (auto &e : d) s *= e;
     return s;
@@ -0,0 +1,402 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef SPARSE_TENSOR_HPP
+#define SPARSE_TENSOR_HPP
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/SparseCore"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+
+namespace tensors {
+
+// A [rows, cols] matrix holding only its non-zeros, for inputs such as bag
+// of words or one-hot categories where the dense form would be almost all
+// zeros. Built from coordinates (COO) and kept in compressed sparse row
+// form (CSR): for row r the columns inner[outer[r] .. outer[r + 1]) in
+// ascending order and their values. Those three arrays are laid out
+// exactly like a compressed row major Eigen::SparseMatrix, so eigen()
+// maps them into Eigen without a copy.
+template <class dtype = float>
+class sparse_tensor {
+ public:
+  typedef int index_type;  // Eigen's default StorageIndex
+  typedef Eigen::SparseMatrix<dtype, Eigen::RowMajor, index_type> matrix;
+
+ private:
+  size_t row_count = 0, col_count = 0;
+  std::vector<index_type> outer, inner;
+  std::vector<dtype> vals;
+
+  // whether id is within [0, limit), the sign is only tested for signed
+  // id types
+  template <class index>
+  static bool in_range(index id, size_t limit, std::true_type) {
+    return id >= index(0) && size_t(id) < limit;
+  }
+
+  template <class index>
+  static bool in_range(index id, size_t limit, std::false_type) {
+    return size_t(id) < limit;
+  }
+
+  template <class index>
+  static bool in_range(index id, size_t limit) {
+    return in_range(id, limit, std::is_signed<index>());
+  }
+
+  void check_fits(size_t rows, size_t cols, size_t nnz) const {
+    const size_t limit = std::numeric_limits<index_type>::max();
+    if (rows > limit || cols > limit || nnz > limit)
+      throw exceptions::operation_undefined(
+          "Sparse tensor of " + std::to_string(rows) + "x" +
+          std::to_string(cols) + " with " + std::to_string(nnz) +
+          " non-zeros exceeds its 32-bit indices");
+  }
+
+ public:
+  // rows x cols, all zeros
+  sparse_tensor(size_t rows, size_t cols)
+      : row_count(rows), col_count(cols), outer(rows + 1, 0) {
+    check_fits(rows, cols, 0);
+  }
+
+  // Adopts CSR arrays as they are, after checking them: outer has rows + 1
+  // non-decreasing offsets and every row's columns ascend within [0, cols).
+  sparse_tensor(size_t rows, size_t cols, std::vector<index_type> outer_index,
+                std::vector<index_type> inner_index, std::vector<dtype> values)
+      : row_count(rows),
+        col_count(cols),
+        outer(std::move(outer_index)),
+        inner(std::move(inner_index)),
+        vals(std::move(values)) {
+    check_fits(rows, cols, vals.size());
+    bool valid = outer.size() == rows + 1 && outer[0] == 0 &&
+                 size_t(outer[rows]) == vals.size() &&
+                 inner.size() == vals.size();
+    for (size_t r = 0; valid && r < rows; r++) {
+      valid = outer[r] <= outer[r + 1];
+      for (index_type j = outer[r]; valid && j < outer[r + 1]; j++)
+        valid = inner[j] >= 0 && size_t(inner[j]) < cols &&
+                (j == outer[r] || inner[j - 1] < inner[j]);
+    }
+    if (!valid)
+      throw exceptions::operation_undefined(
+          "Invalid CSR arrays for a sparse tensor of " +
+          std::to_string(rows) + "x" + std::to_string(cols));
+  }
+
+  // From coordinates: the value of entry i is at (row_ids[i], col_ids[i]),
+  // in any order, and duplicates are summed as in
+  // Eigen::SparseMatrix::setFromTriplets. A counting sort on the rows, so
+  // O(nnz + rows) plus sorting the columns within each row.
+  template <class index>
+  static sparse_tensor from_coo(size_t rows, size_t cols,
+                                const std::vector<index> &row_ids,
+                                const std::vector<index> &col_ids,
+                                const std::vector<dtype> &values) {
+    size_t n = values.size();
+    if (row_ids.size() != n || col_ids.size() != n)
+      throw exceptions::operation_undefined(
+          "COO row, column and value arrays differ in length");
+    sparse_tensor s(rows, cols);
+    s.check_fits(rows, cols, n);
+    for (size_t i = 0; i < n; i++)
+      if (!in_range(row_ids[i], rows) || !in_range(col_ids[i], cols))
+        throw exceptions::operation_undefined(
+            "COO entry (" + std::to_string(row_ids[i]) + ", " +
+            std::to_string(col_ids[i]) + ") is outside " +
+            std::to_string(rows) + "x" + std::to_string(cols));
+
+    std::vector<index_type> start(rows + 1, 0);
+    for (size_t i = 0; i < n; i++) start[size_t(row_ids[i]) + 1]++;
+    std::partial_sum(start.begin(), start.end(), start.begin());
+    std::vector<index_type> order(n), next(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < n; i++) order[next[size_t(row_ids[i])]++] = i;
+
+    s.inner.reserve(n);
+    s.vals.reserve(n);
+    for (size_t r = 0; r < rows; r++) {
+      auto first = order.begin() + start[r];
+      auto last = order.begin() + start[r + 1];
+      std::stable_sort(first, last, [&col_ids](index_type a, index_type b) {
+        return col_ids[a] < col_ids[b];
+      });
+      for (auto it = first; it != last; ++it) {
+        index_type c = index_type(col_ids[*it]);
+        if (s.inner.size() > size_t(s.outer[r]) && s.inner.back() == c)
+          s.vals.back() += values[*it];
+        else {
+          s.inner.push_back(c);
+          s.vals.push_back(values[*it]);
+        }
+      }
+      s.outer[r + 1] = index_type(s.inner.size());
+    }
+    return s;
+  }
+
+  // The non-zeros of a dense tensor. A tensor with more than two dimensions
+  // is read as [size / last dimension, last dimension].
+  static sparse_tensor from_dense(const tensor<dtype> &dense) {
+    std::vector<uint> d = dense.shape().d;
+    size_t cols = d.back(), rows = dense.size() / cols;
+    sparse_tensor s(rows, cols);
+    const dtype *x = dense.raw_data();
+    for (size_t r = 0; r < rows; r++) {
+      for (size_t c = 0; c < cols; c++)
+        if (x[r * cols + c] != dtype(0)) {
+          s.inner.push_back(index_type(c));
+          s.vals.push_back(x[r * cols + c]);
+        }
+      s.check_fits(rows, cols, s.vals.size());
+      s.outer[r + 1] = index_type(s.vals.size());
+    }
+    return s;
+  }
+
+  // copies any Eigen sparse matrix or expression, e.g. a column major one
+  template <class Derived>
+  explicit sparse_tensor(const Eigen::SparseMatrixBase<Derived> &m)
+      : sparse_tensor(size_t(m.rows()), size_t(m.cols())) {
+    matrix csr = m;
+    csr.makeCompressed();
+    const index_type *o = csr.outerIndexPtr(), *i = csr.innerIndexPtr();
+    outer.assign(o, o + row_count + 1);
+    inner.assign(i, i + csr.nonZeros());
+    vals.assign(csr.valuePtr(), csr.valuePtr() + csr.nonZeros());
+  }
+
+  tensor<dtype> to_dense() const {
+    std::vector<dtype> x(row_count * col_count, dtype(0));
+    for (size_t r = 0; r < row_count; r++)
+      for (index_type j = outer[r]; j < outer[r + 1]; j++)
+        x[r * col_count + inner[j]] = vals[j];
+    return tensor<dtype>(x, shape());
+  }
+
+  // Zero-copy views for Eigen's sparse algorithms. The mutable one may
+  // change values but not the structure.
+  Eigen::Map<const matrix> eigen() const {
+    return Eigen::Map<const matrix>(rows(), cols(), nnz(), outer.data(),
+                                    inner.data(), vals.data());
+  }
+  Eigen::Map<matrix> eigen() {
+    return Eigen::Map<matrix>(rows(), cols(), nnz(), outer.data(),
+                              inner.data(), vals.data());
+  }
+
+  // the rows ids[0..n) in that order, as a new sparse tensor
+  template <class index>
+  sparse_tensor gather_rows(const index *ids, size_t n) const {
+    sparse_tensor s(n, col_count);
+    for (size_t i = 0; i < n; i++) {
+      if (!in_range(ids[i], row_count))
+        throw exceptions::operation_undefined(
+            "Row index " + std::to_string(ids[i]) +
+            " is out of range for a sparse tensor of " +
+            std::to_string(row_count) + " rows");
+      size_t r = size_t(ids[i]);
+      s.outer[i + 1] = s.outer[i] + outer[r + 1] - outer[r];
+    }
+    s.check_fits(n, col_count, size_t(s.outer[n]));
+    s.inner.resize(s.outer[n]);
+    s.vals.resize(s.outer[n]);
+    for (size_t i = 0; i < n; i++) {
+      size_t r = size_t(ids[i]);
+      std::copy(inner.begin() + outer[r], inner.begin() + outer[r + 1],
+                s.inner.begin() + s.outer[i]);
+      std::copy(vals.begin() + outer[r], vals.begin() + outer[r + 1],
+                s.vals.begin() + s.outer[i]);
+    }
+    return s;
+  }
+
+  // c[rows, n] = this * b[cols, n], b and c dense row major. Each output
+  // row is the sum of the rows of b picked by the non-zeros of the same
+  // row here, one vectorized axpy per non-zero, and rows run in parallel.
+  void multiply(const dtype *b, size_t n, dtype *c) const {
+    typedef Eigen::Map<Eigen::Array<dtype, Eigen::Dynamic, 1>> row_map;
+    typedef Eigen::Map<const Eigen::Array<dtype, Eigen::Dynamic, 1>>
+        const_row_map;
+    size_t per_row = std::max<size_t>(1, nnz() / std::max<size_t>(rows(), 1));
+    size_t work = per_row * std::max<size_t>(n, 1);
+    size_t grain = std::max<size_t>(1, 8192 / work);
+    parallel::parallel_for(row_count, grain, [&](size_t begin, size_t end) {
+      for (size_t r = begin; r < end; r++) {
+        row_map out(c + r * n, n);
+        out.setZero();
+        for (index_type j = outer[r]; j < outer[r + 1]; j++)
+          out += vals[j] * const_row_map(b + size_t(inner[j]) * n, n);
+      }
+    });
+  }
+
+  // this * b for a [cols, n] dense tensor, the result is [rows, n]
+  tensor<dtype> matmul(const tensor<dtype> &b) const {
+    shape::Shape s = b.shape();
+    if (s.dimension() != 2 || s.d[0] != col_count)
+      throw exceptions::operation_undefined(
+          "Cannot multiply a sparse " + std::string(shape()) +
+          " tensor by a " + std::string(s) + " tensor");
+    std::vector<dtype> c(row_count * s.d[1]);
+    multiply(b.raw_data(), s.d[1], c.data());
+    return tensor<dtype>(c, shape::Shape({uint(row_count), s.d[1]}));
+  }
+
+  inline size_t rows() const { return row_count; }
+  inline size_t cols() const { return col_count; }
+  inline size_t nnz() const { return vals.size(); }
+  inline shape::Shape shape() const {
+    return shape::Shape({uint(row_count), uint(col_count)});
+  }
+  // fraction of the entries that are stored
+  inline double density() const {
+    return row_count && col_count
+               ? double(nnz()) / (double(row_count) * col_count)
+               : 0.;
+  }
+
+  // the CSR arrays
+  inline const std::vector<index_type> &outer_index() const { return outer; }
+  inline const std::vector<index_type> &inner_index() const { return inner; }
+  inline const std::vector<dtype> &values() const { return vals; }
+  inline std::vector<dtype> &values() { return vals; }
+};
+
+// Builds a sparse_tensor a row at a time, for producers that stream their
+// rows (feature hashing, categorical encoders) instead of collecting COO
+// coordinates first. Several builders filled in parallel, each with a
+// slice of the rows, are joined in order with append(); add_rows() does
+// exactly that.
+template <class dtype = float>
+class csr_builder {
+  typedef typename sparse_tensor<dtype>::index_type index_type;
+  size_t col_count;
+  std::vector<index_type> outer, inner;
+  std::vector<dtype> vals;
+  std::vector<size_t> order;  // scratch of add_row
+
+ public:
+  explicit csr_builder(size_t cols) : col_count(cols), outer(1, 0) {}
+
+  // One row from n (column, value) pairs in any order. Duplicate columns
+  // are summed and entries that sum to zero dropped.
+  void add_row(const index_type *cols, const dtype *values, size_t n) {
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [cols](size_t a, size_t b) {
+      return cols[a] < cols[b];
+    });
+    size_t row_start = vals.size();
+    for (size_t i : order) {
+      if (cols[i] < 0 || size_t(cols[i]) >= col_count)
+        throw exceptions::operation_undefined(
+            "Column " + std::to_string(cols[i]) +
+            " is out of range for a sparse tensor of " +
+            std::to_string(col_count) + " columns");
+      if (vals.size() > row_start && inner.back() == cols[i])
+        vals.back() += values[i];
+      else {
+        if (vals.size() > row_start && vals.back() == dtype(0)) {
+          inner.pop_back();
+          vals.pop_back();
+        }
+        inner.push_back(cols[i]);
+        vals.push_back(values[i]);
+      }
+    }
+    if (vals.size() > row_start && vals.back() == dtype(0)) {
+      inner.pop_back();
+      vals.pop_back();
+    }
+    if (vals.size() > size_t(std::numeric_limits<index_type>::max()))
+      throw exceptions::operation_undefined(
+          "Sparse tensor exceeds its 32-bit indices");
+    outer.push_back(index_type(vals.size()));
+  }
+
+  // rows built per task by add_rows, enough to amortize scheduling
+  static const size_t rows_per_slice = 2048;
+
+  // Appends `rows` rows, row r given by row(r, cols, values) filling the
+  // empty cols and values with what add_row takes. Slices of
+  // rows_per_slice rows are built in parallel, each into its own builder,
+  // and joined in order.
+  template <class Row>
+  void add_rows(size_t rows, const Row &row) {
+    size_t tasks = (rows + rows_per_slice - 1) / rows_per_slice;
+    std::vector<csr_builder> parts(tasks, csr_builder(col_count));
+    parallel::parallel_for(tasks, 1, [&](size_t begin, size_t end) {
+      std::vector<index_type> cols;
+      std::vector<dtype> values;
+      for (size_t t = begin; t < end; t++)
+        for (size_t r = t * rows_per_slice;
+             r < std::min(rows, (t + 1) * rows_per_slice); r++) {
+          cols.clear();
+          values.clear();
+          row(r, cols, values);
+          parts[t].add_row(cols.data(), values.data(), cols.size());
+        }
+    });
+    for (auto &part : parts) append(std::move(part));
+  }
+
+  // moves the rows of `rest` (same number of columns) after these
+  void append(csr_builder &&rest) {
+    if (rest.col_count != col_count)
+      throw exceptions::operation_undefined(
+          "Cannot join sparse rows of different widths");
+    if (vals.size() + rest.vals.size() >
+        size_t(std::numeric_limits<index_type>::max()))
+      throw exceptions::operation_undefined(
+          "Sparse tensor exceeds its 32-bit indices");
+    index_type base = index_type(vals.size());
+    for (size_t r = 1; r < rest.outer.size(); r++)
+      outer.push_back(base + rest.outer[r]);
+    inner.insert(inner.end(), rest.inner.begin(), rest.inner.end());
+    vals.insert(vals.end(), rest.vals.begin(), rest.vals.end());
+    rest = csr_builder(col_count);
+  }
+
+  // the rows so far as a sparse tensor, the builder starts over empty
+  sparse_tensor<dtype> finish() {
+    size_t n = rows();  // before outer is moved from
+    sparse_tensor<dtype> s(n, col_count, std::move(outer),
+                           std::move(inner), std::move(vals));
+    *this = csr_builder(col_count);
+    return s;
+  }
+
+  inline size_t rows() const { return outer.size() - 1; }
+  inline size_t cols() const { return col_count; }
+  inline size_t nnz() const { return vals.size(); }
+};
+
+}  // namespace tensors
+
+#endif
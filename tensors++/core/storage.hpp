@@ -0,0 +1,203 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef STORAGE_HPP
+#define STORAGE_HPP
+
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace tensors {
+
+// Element buffer behind a tensor.
+//
+// A mutable storage has value semantics, copying it copies the elements.
+// Once frozen the block becomes read-only and copies share it through a
+// reference count instead, so any number of tensors, threads or model
+// replicas read the same memory without copies or locks. unfreeze() on a
+// block that is still shared detaches a private copy first, the others keep
+// seeing the frozen contents.
+template <class dtype>
+class storage {
+  std::shared_ptr<dtype> block;
+  size_t count = 0, capacity = 0;
+  bool shared = false;
+  bool pages = false;  // block sits on read-only pages of its own
+
+  static std::shared_ptr<dtype> allocate(size_t n) {
+    return std::shared_ptr<dtype>(new dtype[std::max<size_t>(n, 1)],
+                                  std::default_delete<dtype[]>());
+  }
+
+  void reallocate(size_t n) {
+    std::shared_ptr<dtype> fresh = allocate(n);
+    std::copy(block.get(), block.get() + count, fresh.get());
+    block = std::move(fresh);
+    capacity = n;
+  }
+
+  // moves a trivially copyable block onto pages of its own and makes them
+  // read-only, a stray write then faults instead of corrupting shared data
+  void protect() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (!std::is_trivially_copyable<dtype>::value || count == 0) return;
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t bytes = (count * sizeof(dtype) + page - 1) / page * page;
+    void *mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) return;
+    std::copy(block.get(), block.get() + count, static_cast<dtype *>(mapping));
+    mprotect(mapping, bytes, PROT_READ);
+    block = std::shared_ptr<dtype>(static_cast<dtype *>(mapping),
+                                   [bytes](dtype *p) { munmap(p, bytes); });
+    capacity = count;
+    pages = true;
+#endif
+  }
+
+  void take(std::vector<dtype> &&values, std::false_type) {
+    count = capacity = values.size();
+    shared = pages = false;
+    if (values.empty()) {
+      block = allocate(0);
+      return;
+    }
+    auto owner = std::make_shared<std::vector<dtype>>(std::move(values));
+    block = std::shared_ptr<dtype>(owner, owner->data());
+  }
+
+  // std::vector<bool> has no element buffer to take over
+  void take(std::vector<dtype> &&values, std::true_type) { *this = values; }
+
+ public:
+  storage() = default;
+
+  storage(const storage &that)
+      : count(that.count), capacity(that.count), shared(that.shared) {
+    if (shared) {
+      block = that.block;
+      pages = that.pages;
+    } else if (count) {
+      block = allocate(count);
+      std::copy(that.block.get(), that.block.get() + count, block.get());
+    }
+  }
+
+  storage(storage &&that) noexcept
+      : block(std::move(that.block)),
+        count(that.count),
+        capacity(that.capacity),
+        shared(that.shared),
+        pages(that.pages) {
+    that.count = that.capacity = 0;
+    that.shared = that.pages = false;
+  }
+
+  storage &operator=(const storage &that) {
+    storage copy(that);
+    *this = std::move(copy);
+    return *this;
+  }
+
+  storage &operator=(storage &&that) noexcept {
+    block = std::move(that.block);
+    count = that.count;
+    capacity = that.capacity;
+    shared = that.shared;
+    pages = that.pages;
+    that.count = that.capacity = 0;
+    that.shared = that.pages = false;
+    return *this;
+  }
+
+  // Read-only storage over a block owned elsewhere (a file mapping), kept
+  // alive by the deleter of `external`. It is frozen from the start and
+  // unfreeze() copies it out like any page protected block.
+  static storage adopt(std::shared_ptr<dtype> external, size_t n) {
+    storage s;
+    s.block = std::move(external);
+    s.count = s.capacity = n;
+    s.shared = s.pages = true;
+    return s;
+  }
+
+  storage &operator=(const std::vector<dtype> &values) {
+    block = allocate(values.size());
+    std::copy(values.begin(), values.end(), block.get());
+    count = capacity = values.size();
+    shared = pages = false;
+    return *this;
+  }
+
+  // takes over the vector's buffer instead of copying it
+  storage &operator=(std::vector<dtype> &&values) {
+    take(std::move(values), std::is_same<dtype, bool>());
+    return *this;
+  }
+
+  inline dtype &operator[](size_t i) { return block.get()[i]; }
+  inline const dtype &operator[](size_t i) const { return block.get()[i]; }
+  inline dtype *data() { return block.get(); }
+  inline const dtype *data() const { return block.get(); }
+  inline dtype *begin() { return block.get(); }
+  inline dtype *end() { return block.get() + count; }
+  inline const dtype *begin() const { return block.get(); }
+  inline const dtype *end() const { return block.get() + count; }
+  inline size_t size() const { return count; }
+  inline bool read_only() const { return shared; }
+  // number of tensors currently sharing this block
+  inline long use_count() const { return block.use_count(); }
+
+  void push_back(const dtype &value) {
+    if (count == capacity) reallocate(std::max<size_t>(2 * capacity, 16));
+    block.get()[count++] = value;
+  }
+
+  void pop_back() { count--; }
+
+  void shrink_to_fit() {
+    if (capacity != count && !shared) reallocate(count);
+  }
+
+  void freeze(bool protect_pages = false) {
+    if (shared) return;
+    shrink_to_fit();
+    if (protect_pages) protect();
+    shared = true;
+  }
+
+  void unfreeze() {
+    if (!shared) return;
+    shared = false;
+    if (block.use_count() == 1 && !pages) return;
+    std::shared_ptr<dtype> mine = allocate(count);
+    std::copy(block.get(), block.get() + count, mine.get());
+    block = std::move(mine);
+    capacity = count;
+    pages = false;
+  }
+};
+
+}  // namespace tensors
+
+#endif
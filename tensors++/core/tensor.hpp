@@ -21,12 +21,14 @@
 #include <initializer_list>
 #include <memory>
 #include <random>
+#include <type_traits>
 #include <typeinfo>
 #include <algorithm>
 #include <vector>
 
 #include "tensors++/core/shape.hpp"
 #include "tensors++/core/slicer.hpp"
+#include "tensors++/core/storage.hpp"
 #include "tensors++/core/tensor_config.hpp"
 #include "tensors++/exceptions/tensor_formation.hpp"
 #include "tensors++/exceptions/tensor_operation.hpp"
@@ -41,9 +43,9 @@ template <class dtype = float>
 class tensor {
   shape::Shape shpe;
   size_t element_count;
-  std::vector<uint> cum_shpe;  // cumulative shape dimension
-  const config::Config &tensor_configuration;
-  std::vector<dtype> data;
+  std::vector<size_t> cum_shpe;  // cumulative shape dimension
+  config::Config tensor_configuration;
+  storage<dtype> data;  // shared read-only between copies once frozen
   initializer init_type;
   bool is_frozen = false;
 
@@ -62,7 +64,7 @@ class tensor {
         }
         case uniform_gaussian: {
           std::random_device rd;
-          std::mt19937 gen(rd);
+          std::mt19937 gen(rd());
           std::normal_distribution<> d(0.0, 1.0);  // mean =0, varience =1
           for (size_t i = 0; i < element_count; i++) {
             dtype K(d(gen));  // this may throw if no constructor with float
@@ -72,7 +74,7 @@ class tensor {
         }
         case random: {
           std::random_device rd;
-          std::mt19937 gen(rd);
+          std::mt19937 gen(rd());
           std::uniform_real_distribution<> dist(0.0, 1.0);  // from [0,1)
           for (size_t i = 0; i < element_count; i++) {
             dtype K(dist(gen));  // this may throw if no constructor with float
@@ -100,32 +102,60 @@ class tensor {
   }
 
   size_t to_flat_index(Indexer &s) {
-    if (s.size() != shpe.element_size())
+    if (s.size() != shpe.dimension())
       throw exceptions::bad_indexer(
           "Cannot flatten this Indexer has dimen " + std::to_string(s.size()) +
-          "and Tensor has dimen " + std::to_string(shpe.element_size()));
+          "and Tensor has dimen " + std::to_string(shpe.dimension()));
     else {
       size_t ssf = 0;
-      for (int t = 0; t < shpe.element_size(); t++) {
-        if (*(s.begin() + t) > shpe[t])
+      for (size_t t = 0; t < shpe.dimension(); t++) {
+        if (*(s.begin() + t) < 0 || uint(*(s.begin() + t)) >= shpe[t])
           throw exceptions::bad_indexer(
               "Index out of range for dimension" + std::to_string(t) +
-              "original tensor has shape index" +
-              std::to_string(shpe[t] + ". Indexer has indexed " +
-                             std::to_string(*(s.begin() + t))));
+              "original tensor has shape index" + std::to_string(shpe[t]) +
+              ". Indexer has indexed " + std::to_string(*(s.begin() + t)));
         ssf += *(s.begin() + t) * (element_count / cum_shpe[t]);
       }
       return ssf;
     }
   }
 
+  // every operation writing the elements goes through here first, a frozen
+  // tensor may be shared with other tensors and threads
+  void ensure_mutable(const std::string &operation) const {
+    if (is_frozen)
+      throw exceptions::frozen_tensor(operation +
+                                      " on a frozen tensor. Call unfreeze() "
+                                      "to get a private mutable copy.");
+  }
+
+  // element products, a logical and for tensor<bool>
+  static dtype product(const dtype &a, const dtype &b, std::false_type) {
+    return a * b;
+  }
+  static dtype product(const dtype &a, const dtype &b, std::true_type) {
+    return a && b;
+  }
+  static dtype product(const dtype &a, const dtype &b) {
+    return product(a, b, std::is_same<dtype, bool>());
+  }
+
+  // reductions run over all the elements, none is defined along an axis
+  void whole_tensor_only(int axis, const std::string &operation) const {
+    if (axis != -1)
+      throw exceptions::operation_undefined(
+          operation + " along axis " + std::to_string(axis) +
+          ", only over the whole tensor (axis = -1)");
+  }
+
   void resize_shape(shape::Shape new_shape) {
+    ensure_mutable("resize");
     size_t old = element_count;
     size_t new_s = new_shape.element_size();
     if (new_s > old)
       for (size_t j = 0; j < (new_s - old); j++) data.push_back(dtype(0));
     if (new_s < old)
-      for (size_t j = 0; j < (new_s - old); j++) data.pop_back();
+      for (size_t j = 0; j < (old - new_s); j++) data.pop_back();
     update_shape(new_shape);
   }
 
@@ -137,7 +167,9 @@ class tensor {
       shape::Shape shape,
       initializer init_method = initializer::uniform_gaussian,
       config::Config tensor_config = config::Config::default_config_instance())
-      : tensor_configuration(tensor_config), init_type(init_method) {
+      : shpe(shape),
+        tensor_configuration(tensor_config),
+        init_type(init_method) {
     if (shape::Shape::is_initial_valid_shape(shape)) {
       update_shape(shape);
       init_initializer();
@@ -150,11 +182,11 @@ class tensor {
   tensor(
       std::vector<dtype> da, shape::Shape shape,
       config::Config tensor_config = config::Config::default_config_instance())
-      : tensor_configuration(tensor_config) {
+      : shpe(shape), tensor_configuration(tensor_config), init_type(zeros) {
     if (shape::Shape::is_initial_valid_shape(shape)) {
       if (shape.element_size() == da.size()) {
         update_shape(shape);
-        data = da;
+        data = std::move(da);
       } else
         throw exceptions::bad_init_shape(
             "Invalid shape. The size of vector and shape do not match "
@@ -165,18 +197,38 @@ class tensor {
           "(i.e > 0 )");
   }
 
+  // tensor over an existing element buffer, a frozen storage (such as a
+  // memory mapped file) gives a frozen tensor sharing it without a copy
+  tensor(
+      storage<dtype> block, shape::Shape shape,
+      config::Config tensor_config = config::Config::default_config_instance())
+      : shpe(shape), tensor_configuration(tensor_config), init_type(zeros) {
+    if (!shape::Shape::is_initial_valid_shape(shape))
+      throw exceptions::bad_init_shape(
+          "Invalid Shape. All dimensions in the shape must be natural numbers "
+          "(i.e > 0 )");
+    if (shape.element_size() != block.size())
+      throw exceptions::bad_init_shape(
+          "Invalid shape. The size of storage and shape do not match "
+          "together.");
+    update_shape(shape);
+    is_frozen = block.read_only();
+    data = std::move(block);
+  }
+
   // tensor: Copy Constructor
   tensor(const tensor &ref) = default;
 
   // tensor: Move Constructor, does not throw any exception
-  tensor(tensor &&that) noexcept {
-    this->element_count = std::move(that.element_count);
-    this->shpe = std::move(that.shpe);
-    this->cum_shpe = std::move(that.cum_shape);
-    this->is_frozen = std::move(that.is_frozen);
-    this->init_type = std::move(that.init_type);
-    this->tensor_configuration = std::move(that.tensor_configuration);
-    this->data = std::move(that.data);
+  tensor(tensor &&that) noexcept
+      : shpe(std::move(that.shpe)),
+        element_count(that.element_count),
+        cum_shpe(std::move(that.cum_shpe)),
+        tensor_configuration(that.tensor_configuration),
+        data(std::move(that.data)),
+        init_type(that.init_type),
+        is_frozen(that.is_frozen) {
+    that.element_count = 0;
   }
 
   // inliners
@@ -184,20 +236,38 @@ class tensor {
   inline size_t size() const { return element_count; }
   inline std::string data_type() const { return typeid(dtype).name(); }
   inline config::Config tensor_config() const { return tensor_configuration; }
-  inline void unfreeze() { is_frozen = false; }
+  inline bool frozen() const { return is_frozen; }
+  inline void unfreeze() {
+    is_frozen = false;
+    data.unfreeze();
+  }
+
+  // raw access to the contiguous element buffer, used by the kernels
+  inline dtype *raw_data() {
+    ensure_mutable("Writable access");
+    return data.data();
+  }
+  inline const dtype *raw_data() const { return data.data(); }
 
   // methods
-  void freeze() {
+
+  // Makes the tensor immutable. Its copies then share the element buffer
+  // instead of duplicating it and any thread may read it without locking.
+  // With protect_pages the buffer is also moved onto read-only pages so a
+  // write through a stale pointer faults.
+  void freeze(bool protect_pages = false) {
     if (this->tensor_configuration.is_freezeable) {
       is_frozen = true;
-      this->data.shrink_to_fit();
+      this->data.freeze(protect_pages);
     } else
       throw exceptions::operation_undefined(
           "Cannot Freeze a tensor that is declared unfreezable by its "
           "configuration.");
   }
 
-  virtual tensor slice(slicer::Slicer &s) {}
+  virtual tensor slice(slicer::Slicer &) {
+    throw exceptions::operation_undefined("Slicing is not implemented yet");
+  }
 
   virtual bool reshape(std::initializer_list<int> &new_shape) {
     size_t ss = 1;
@@ -209,14 +279,13 @@ class tensor {
         throw exceptions::bad_reshape(
             "New shape has an dimension with index ZERO.", 0, element_count);
 
-      if (e < 0 && auto_shape) {
+      if (e < 0 && auto_shape != -1) {
         throw exceptions::bad_reshape(
             "More than one dynamic size (-1) dimension found in reshape.", 0,
             element_count);
       }
 
       if (e < 0) {
-        auto_shape = true;
         auto_shape = running_index;
         running_index++;
         continue;
@@ -238,34 +307,30 @@ class tensor {
             ss * (element_count / ss), element_count);
     } else
       throw exceptions::bad_reshape("Invalid reshape arguments", 0, 0);
+    return true;
   };
 
   virtual bool apply_lambda(std::function<void(dtype &)> op) final {
-    for (int k = 0; k < element_count; k++) op(data[k]);
-  }
-
-  virtual std::vector<std::vector<dtype &>> axis_wise(uint axis) final {
-    std::vector<dtype &> internal;
-    std::vector<std::vector<dtype &>> external;
-    size_t repeat = shpe.reverse_cumulative_shape()[axis] / shpe[axis];
-    size_t epoch = shpe.cumulative_shape()[axis] / shpe[axis];
-    size_t current = shpe[axis];
-    size_t last_repeat =
-        axis == 0 ? 0
-                  : shpe.reverse_cumulative_shape()[axis - 1] / shpe[axis - 1];
-
-    for (size_t r = 0; r < repeat; r++) {
-      for (size_t e = 0; e < epoch; e++) {
-        for (size_t c = 0; c < current; c++) {
-          internal.push_back(data[e * last_repeat + c * repeat + r]);
-        }
-        external.push_back(internal);
-        internal.clear();
-      }
-      external.push_back(internal);
-      internal.clear();
-    }
-    return external;
+    ensure_mutable("apply_lambda");
+    for (size_t k = 0; k < element_count; k++) op(data[k]);
+    return true;
+  }
+
+  // the elements along `axis`, one vector per position of the other axes
+  // in row-major order
+  virtual std::vector<std::vector<dtype>> axis_wise(uint axis) final {
+    if (axis >= shpe.dimension())
+      throw exceptions::axis_error(int(shpe.dimension()) - 1, int(axis));
+    size_t n = shpe[axis], inner = 1;
+    for (size_t t = axis + 1; t < shpe.dimension(); t++) inner *= shpe[t];
+    size_t outer = element_count / (n * inner);
+    std::vector<std::vector<dtype>> lanes(outer * inner,
+                                          std::vector<dtype>(n));
+    for (size_t o = 0; o < outer; o++)
+      for (size_t k = 0; k < n; k++)
+        for (size_t i = 0; i < inner; i++)
+          lanes[o * inner + i][k] = data[(o * n + k) * inner + i];
+    return lanes;
   }
 
   // all operations are element-wise and final
@@ -275,27 +340,30 @@ class tensor {
           "Element wise addition is not defined when both tensors have "
           "mismatch "
           "shape." +
-          shpe + " and " + that.shape());
+          std::string(shpe) + " and " + std::string(that.shape()));
     } else {
-      tensor<dtype> res(that.shape());
+      tensor<dtype> res(that.shape(), initializer::zeros);
       for (size_t i = 0; i < element_count; i++)
         res.data[i] = this->data[i] + that.data[i];
+      return res;
     }
   }
 
   virtual tensor<dtype> operator+(const dtype &k) final {
-    tensor<dtype> result(shpe);
+    tensor<dtype> result(shpe, initializer::zeros);
     for (size_t t = 0; t < element_count; t++)
       result.data[t] = this->data[t] + k;
     return result;
   }
 
   virtual tensor<dtype> operator++() final {
-    for (size_t t = 0; t < element_count; t++) data[t]++;
+    ensure_mutable("Increment");
+    for (size_t t = 0; t < element_count; t++) data[t] += dtype(1);
     return *this;
   }
   virtual tensor<dtype> &operator--() final {
-    for (size_t t = 0; t < element_count; t++) data[t]--;
+    ensure_mutable("Decrement");
+    for (size_t t = 0; t < element_count; t++) data[t] -= dtype(1);
     return *this;
   };
 
@@ -305,15 +373,16 @@ class tensor {
           "Element wise subtraction is not defined when both tensors have "
           "mismatch "
           "shape." +
-          shpe + " and " + that.shape());
+          std::string(shpe) + " and " + std::string(that.shape()));
     } else {
-      tensor<dtype> res(that.shape());
+      tensor<dtype> res(that.shape(), initializer::zeros);
       for (size_t i = 0; i < element_count; i++)
         res.data[i] = this->data[i] - that.data[i];
+      return res;
     }
   }
   virtual tensor<dtype> operator-(const dtype &k) final {
-    tensor<dtype> result(shpe);
+    tensor<dtype> result(shpe, initializer::zeros);
     for (size_t t = 0; t < element_count; t++)
       result.data[t] = this->data[t] - k;
     return result;
@@ -325,17 +394,18 @@ class tensor {
           "Element wise multiplication is not defined when both tensors have "
           "mismatch "
           "shape." +
-          shpe + " and " + that.shape());
+          std::string(shpe) + " and " + std::string(that.shape()));
     } else {
-      tensor<dtype> res(that.shape());
+      tensor<dtype> res(that.shape(), initializer::zeros);
       for (size_t i = 0; i < element_count; i++)
-        res.data[i] = this->data[i] * that.data[i];
+        res.data[i] = product(this->data[i], that.data[i]);
+      return res;
     }
   };
   virtual tensor<dtype> operator*(const dtype &k)final {
-    tensor<dtype> result(shpe);
+    tensor<dtype> result(shpe, initializer::zeros);
     for (size_t t = 0; t < element_count; t++)
-      result.data[t] = this->data[t] * k;
+      result.data[t] = product(this->data[t], k);
     return result;
   }
 
@@ -345,15 +415,16 @@ class tensor {
           "Element wise division is not defined when both tensors have "
           "mismatch "
           "shape." +
-          shpe + " and " + that.shape());
+          std::string(shpe) + " and " + std::string(that.shape()));
     } else {
-      tensor<dtype> res(that.shape());
+      tensor<dtype> res(that.shape(), initializer::zeros);
       for (size_t i = 0; i < element_count; i++)
         res.data[i] = this->data[i] / that.data[i];
+      return res;
     }
   };
   virtual tensor<dtype> operator/(const dtype &k) final {
-    tensor<dtype> result(shpe);
+    tensor<dtype> result(shpe, initializer::zeros);
     for (size_t t = 0; t < element_count; t++)
       result.data[t] = this->data[t] / k;
     return result;
@@ -367,79 +438,89 @@ class tensor {
     return true;
   }
   virtual tensor &operator+=(const tensor &that) final {
+    ensure_mutable("In-place addition");
     if (that.shape() != shpe) {
       throw exceptions::operation_undefined(
           "Element wise addition is not defined when both tensors have "
           "mismatch "
           "shape." +
-          shpe + " and " + that.shape());
+          std::string(shpe) + " and " + std::string(that.shape()));
     } else {
       for (size_t i = 0; i < element_count; i++) this->data[i] += that.data[i];
       return *this;
     }
   };
   virtual tensor &operator-=(const tensor &that) final {
+    ensure_mutable("In-place subtraction");
     if (that.shape() != shpe) {
       throw exceptions::operation_undefined(
           "Element wise subtraction is not defined when both tensors have "
           "mismatch "
           "shape." +
-          shpe + " and " + that.shape());
+          std::string(shpe) + " and " + std::string(that.shape()));
     } else {
       for (size_t i = 0; i < element_count; i++) this->data[i] -= that.data[i];
       return *this;
     }
   };
   virtual tensor &operator*=(const tensor &that) final {
+    ensure_mutable("In-place multiplication");
     if (that.shape() != shpe) {
       throw exceptions::operation_undefined(
           "Element wise multiplication is not defined when both tensors have "
           "mismatch "
           "shape." +
-          shpe + " and " + that.shape());
+          std::string(shpe) + " and " + std::string(that.shape()));
     } else {
-      for (size_t i = 0; i < element_count; i++) this->data[i] *= that.data[i];
+      for (size_t i = 0; i < element_count; i++)
+        this->data[i] = product(this->data[i], that.data[i]);
       return *this;
     }
   };
   virtual tensor &operator/=(const tensor &that) final {
+    ensure_mutable("In-place division");
     if (that.shape() != shpe) {
       throw exceptions::operation_undefined(
           "Element wise division is not defined when both tensors have "
           "mismatch "
           "shape." +
-          shpe + " and " + that.shape());
+          std::string(shpe) + " and " + std::string(that.shape()));
     } else {
       for (size_t i = 0; i < element_count; i++) this->data[i] /= that.data[i];
       return *this;
     }
   };
-  virtual tensor &operator+=(const dtype &t) final {
-    for (size_t t = 0; t < element_count; t++) data[t] += t;
+  virtual tensor &operator+=(const dtype &k) final {
+    ensure_mutable("In-place addition");
+    for (size_t t = 0; t < element_count; t++) data[t] += k;
     return *this;
   }
-  virtual tensor &operator-=(const dtype &t) final {
-    for (size_t t = 0; t < element_count; t++) data[t] -= t;
+  virtual tensor &operator-=(const dtype &k) final {
+    ensure_mutable("In-place subtraction");
+    for (size_t t = 0; t < element_count; t++) data[t] -= k;
     return *this;
   }
-  virtual tensor &operator*=(const dtype &t) final {
-    for (size_t t = 0; t < element_count; t++) data[t] *= t;
+  virtual tensor &operator*=(const dtype &k) final {
+    ensure_mutable("In-place multiplication");
+    for (size_t t = 0; t < element_count; t++) data[t] = product(data[t], k);
     return *this;
   }
   virtual dtype operator[](Indexer &p) final { return data[to_flat_index(p)]; };
+  // gathers the elements at the given flat indices
   virtual std::vector<dtype> operator[](const tensor<uint> &indexList) final {
-    std::vector<dtype> res;
     if (indexList.shape().dimension() != 1)
       throw exceptions::operation_undefined(
           "Indexing tensor must be 1 dimensional");
-    for (int k = 0; k < indexList.shape().element_size(); k++) {
-      if (k > shpe.element_size())
+    const uint *indices = indexList.raw_data();
+    std::vector<dtype> res(indexList.size());
+    for (size_t k = 0; k < res.size(); k++) {
+      if (indices[k] >= element_count)
         throw exceptions::operation_undefined(
             "Indexing tensor has value that is out of range for this tensor. "
             "Tried to access [" +
-            std::to_string(k) + "] when max indexable is " +
-            std::to_string(shpe.element_size()));
-      res.push_back(indexList.data[k]);
+            std::to_string(indices[k]) + "] when max indexable is " +
+            std::to_string(element_count - 1));
+      res[k] = data[indices[k]];
     }
     return res;
   }
@@ -450,25 +531,15 @@ class tensor {
     return true;
   }
   virtual tensor<bool> all(std::function<bool(dtype)> op, int axis) final {
-    if (shpe.dimension() <= axis)
-      throw exceptions::axis_error(shpe.dimension() - 1, axis);
+    if (axis < 0 || shpe.dimension() <= size_t(axis))
+      throw exceptions::axis_error(int(shpe.dimension()) - 1, axis);
     else {
       std::vector<bool> res;
       std::vector<uint> ns;
-      for (int t = 0; t < shpe.dimension(); t++)
-        if (axis != t) ns.push_back(shpe[t]);
-      std::vector<std::vector<dtype &>> s = this->axis_wise(axis);
-      for (auto &k : s) {
-        bool flag_broken = false;        for (int t = 0; t < s; t++) {
-          if (!op(s[t])) {
-            res.push_back(false);
-            flag_broken = true;
-            break;
-          }
-        }
-        if (!flag_broken) res.push_back(true);
-        flag_broken = false;
-      }
+      for (size_t t = 0; t < shpe.dimension(); t++)
+        if (size_t(axis) != t) ns.push_back(shpe[t]);
+      for (auto &lane : this->axis_wise(axis))
+        res.push_back(std::all_of(lane.begin(), lane.end(), op));
       tensor<bool> r(res, shape::Shape(ns));
       return r;
     }
@@ -479,26 +550,15 @@ class tensor {
     return false;
   }
   virtual tensor<bool> any(std::function<bool(dtype)> op, int axis) final {
-    if (shpe.dimension() <= axis)
-      throw exceptions::axis_error(shpe.dimension() - 1, axis);
+    if (axis < 0 || shpe.dimension() <= size_t(axis))
+      throw exceptions::axis_error(int(shpe.dimension()) - 1, axis);
     else {
       std::vector<bool> res;
       std::vector<uint> ns;
-      for (int t = 0; t < shpe.dimension(); t++)
-        if (axis != t) ns.push_back(shpe[t]);
-      std::vector<std::vector<dtype &>> s = this->axis_wise(axis);
-      for (auto &k : s) {
-        bool flag_broken = false;
-        for (int t = 0; t < s; t++) {
-          if (op(s[t])) {
-            res.push_back(true);
-            flag_broken = true;
-            break;
-          }
-        }
-        if (!flag_broken) res.push_back(false);
-        flag_broken = false;
-      }
+      for (size_t t = 0; t < shpe.dimension(); t++)
+        if (size_t(axis) != t) ns.push_back(shpe[t]);
+      for (auto &lane : this->axis_wise(axis))
+        res.push_back(std::any_of(lane.begin(), lane.end(), op));
       tensor<bool> r(res, shape::Shape(ns));
       return r;
     }
@@ -509,47 +569,87 @@ class tensor {
       throw exceptions::operation_undefined(
           "Cannot copy to target tensor this value. The sizes do not match and "
           "resize is set to false." +
-          that.size() + " and " + this->size());
+          std::to_string(that.size()) + " and " + std::to_string(this->size()));
     } else {
+      that.ensure_mutable("copy_to");
       that.resize_shape(shpe);
       for (size_t t = 0; t < element_count; t++) that.data[t] = this->data[t];
     }
   }
-  virtual size_t argmax(int axis = -1) final;
-  virtual size_t argmin(int axis = -1) final;
+  // flat index of the largest element, the first one on ties
+  virtual size_t argmax(int axis = -1) final {
+    whole_tensor_only(axis, "argmax");
+    return size_t(std::max_element(data.begin(), data.end()) - data.begin());
+  }
+  virtual size_t argmin(int axis = -1) final {
+    whole_tensor_only(axis, "argmin");
+    return size_t(std::min_element(data.begin(), data.end()) - data.begin());
+  }
   virtual void clip(dtype max, dtype min) final {
+    ensure_mutable("clip");
     for (auto &e : data) {
       if (e > max) e = max;
       if (e < min) e = min;
     }
   };
-  virtual dtype cumulative_product(int axis = -1) final;
-  virtual dtype cumulative_sum(int axis = -1) final;
-  virtual tensor flatten() final;
-  virtual dtype max(int axis = -1) final;
-  virtual dtype min(int axis = -1) final;
-  virtual dtype mean(int axis = -1) final;
-  virtual dtype peek_to_peek(int axis = -1) final;  // max-min
-  virtual void ravel() final { this->reshape(shape::Shape({element_count})); };
+  virtual dtype cumulative_product(int axis = -1) final {
+    whole_tensor_only(axis, "cumulative_product");
+    dtype p(1);
+    for (const dtype &e : data) p = product(p, e);
+    return p;
+  }
+  virtual dtype cumulative_sum(int axis = -1) final { return sum(axis); }
+  // a one dimensional copy
+  virtual tensor flatten() final {
+    return tensor(std::vector<dtype>(data.begin(), data.end()),
+                  shape::Shape(std::vector<uint>{uint(element_count)}),
+                  tensor_configuration);
+  }
+  virtual dtype max(int axis = -1) final {
+    whole_tensor_only(axis, "max");
+    return *std::max_element(data.begin(), data.end());
+  }
+  virtual dtype min(int axis = -1) final {
+    whole_tensor_only(axis, "min");
+    return *std::min_element(data.begin(), data.end());
+  }
+  virtual dtype mean(int axis = -1) final {
+    return dtype(sum(axis) / dtype(element_count));
+  }
+  virtual dtype peek_to_peek(int axis = -1) final {  // max-min
+    return dtype(max(axis) - min(axis));
+  }
+  virtual void ravel() final {
+    update_shape(shape::Shape(std::vector<uint>{uint(element_count)}));
+  };
   virtual void swap_axis(int axis1, int axis2) final {
-    if (axis1 >= shpe.dimension() || axis2 >= shpe.dimension())
-      exceptions::operation_undefined(
+    if (axis1 < 0 || axis2 < 0 || size_t(axis1) >= shpe.dimension() ||
+        size_t(axis2) >= shpe.dimension())
+      throw exceptions::operation_undefined(
           "Cannot swap axes. Range is out of bound for this tensor of "
           "dimensions" +
           std::to_string(shpe.dimension()));
-    uint x = shpe[axis1];
-    shpe[axis1] = shpe[axis2];
-    shpe[axis2] = x;
+    std::swap(shpe.d[axis1], shpe.d[axis2]);
     update_shape(shpe);
   };
   virtual void squeeze() final {
     std::vector<uint> newShape;
-    for (auto &e : shpe)
+    for (auto &e : shpe.d)
       if (e != 1) newShape.push_back(e);
     update_shape(shape::Shape(newShape));
   };
-  virtual dtype sum(int axis = -1) final;
-  virtual dtype varience(int axis = -1) final;
+  virtual dtype sum(int axis = -1) final {
+    whole_tensor_only(axis, "sum");
+    dtype s(0);
+    for (const dtype &e : data) s += e;
+    return s;
+  }
+  // population variance
+  virtual dtype varience(int axis = -1) final {
+    dtype m = mean(axis), s(0);
+    for (const dtype &e : data) s += dtype((e - m) * (e - m));
+    return dtype(s / dtype(element_count));
+  }
 };
 }  // namespace tensors
 
@@ -0,0 +1,41 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef TENSOR_IO_HPP
+#define TENSOR_IO_HPP
+
+#include <exception>
+#include <string>
+
+namespace tensors {
+namespace exceptions {
+
+class io_error : public std::exception {
+  std::string finalized_message;
+
+ public:
+  io_error(std::string path, std::string s)
+      : finalized_message("Cannot read or write " + path + " : " + s){};
+  virtual const char *what() const noexcept final override {
+    return finalized_message.c_str();
+  };
+};
+
+}  // namespace exceptions
+}  // namespace tensors
+
+#endif
@@ -13,6 +13,10 @@
  *   See the License for the specific language governing permissions and
  *   limitations under the License.
  */
+
+#ifndef TENSOR_OPERATION_HPP
+#define TENSOR_OPERATION_HPP
+
 #include <exception>
 #include <string>
 
@@ -99,5 +103,18 @@ class axis_error : public std::exception {
   };
 };
 
+class frozen_tensor : public std::exception {
+  std::string finalized_message;
+
+ public:
+  frozen_tensor(std::string s)
+      : finalized_message("Cannot modify a frozen tensor : " + s){};
+  virtual const char *what() const noexcept final override {
+    return finalized_message.c_str();
+  };
+};
+
 }  // namespace exceptions
-}  // namespace tensors
\ No newline at end of file
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,531 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef GRAPH_HPP
+#define GRAPH_HPP
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/graph/memory_planner.hpp"
+
+namespace tensors {
+namespace graph {
+
+enum op_code {
+  input,     // bound to a user tensor, read at evaluation time
+  constant,  // owned copy, participates in constant folding
+  add,
+  sub,
+  mul,
+  div,
+  add_scalar,
+  sub_scalar,
+  mul_scalar,
+  div_scalar,
+  clip
+};
+
+template <class dtype>
+struct node {
+  op_code op;
+  int lhs = -1, rhs = -1;
+  dtype alpha = dtype(0), beta = dtype(0);
+  std::vector<uint> shape;
+  const tensor<dtype> *source = nullptr;  // only for op_code::input
+  std::vector<dtype> value;               // only for op_code::constant
+};
+
+// elements processed per register per instruction inside a fused group
+static const size_t lanes = 256;
+// marks the missing operand of a unary instruction while a group is emitted
+static const int no_operand = -1 - (1 << 30);
+// elements handed to one pool task
+static const size_t grain = 16 * lanes;
+
+// one instruction of a fused element-wise group, operands are registers
+template <class dtype>
+struct instruction {
+  op_code op;
+  int dst, a, b;
+  dtype alpha, beta;
+};
+
+template <class dtype>
+inline void run_instruction(const instruction<dtype> &in, dtype *regs,
+                            size_t n) {
+  dtype *d = regs + in.dst * lanes;
+  const dtype *a = regs + in.a * lanes;
+  const dtype *b = in.b < 0 ? nullptr : regs + in.b * lanes;
+  switch (in.op) {
+    case add:
+      for (size_t i = 0; i < n; i++) d[i] = a[i] + b[i];
+      break;
+    case sub:
+      for (size_t i = 0; i < n; i++) d[i] = a[i] - b[i];
+      break;
+    case mul:
+      for (size_t i = 0; i < n; i++) d[i] = a[i] * b[i];
+      break;
+    case div:
+      for (size_t i = 0; i < n; i++) d[i] = a[i] / b[i];
+      break;
+    case add_scalar:
+      for (size_t i = 0; i < n; i++) d[i] = a[i] + in.alpha;
+      break;
+    case sub_scalar:
+      for (size_t i = 0; i < n; i++) d[i] = a[i] - in.alpha;
+      break;
+    case mul_scalar:
+      for (size_t i = 0; i < n; i++) d[i] = a[i] * in.alpha;
+      break;
+    case div_scalar:
+      for (size_t i = 0; i < n; i++) d[i] = a[i] / in.alpha;
+      break;
+    case clip:
+      for (size_t i = 0; i < n; i++)
+        d[i] = a[i] > in.alpha ? in.alpha : (a[i] < in.beta ? in.beta : a[i]);
+      break;
+    default:
+      break;
+  }
+}
+
+// A fused chain of element-wise nodes. Every operand buffer is read once and
+// the root is written once, intermediates only live in the register file.
+template <class dtype>
+struct group {
+  int root;
+  std::vector<int> loads;  // value ids read into registers 0..loads-1
+  std::vector<instruction<dtype>> code;
+  int registers;
+  size_t elements;
+};
+
+// register file size covering every thread that may run a slice of a group
+template <class dtype>
+inline size_t register_file_elements(int registers) {
+  return (parallel::thread_pool().NumThreads() + 1) * registers * lanes;
+}
+
+template <class dtype>
+struct group_task {
+  const group<dtype> *g;
+  const dtype *const *in;
+  dtype *out;
+  dtype *register_file;
+};
+
+// Runs one fused group over its elements. `in` holds one pointer per load
+// and `register_file` register_file_elements() scratch elements.
+template <class dtype>
+inline void execute(const group<dtype> &g, const dtype *const *in, dtype *out,
+                    dtype *register_file) {
+  group_task<dtype> task{&g, in, out, register_file};
+  parallel::parallel_for(g.elements, grain, [&task](size_t begin, size_t end) {
+    const group<dtype> &g = *task.g;
+    int slot = parallel::thread_pool().CurrentThreadId() + 1;
+    dtype *regs = task.register_file + slot * g.registers * lanes;
+    for (size_t s = begin; s < end; s += lanes) {
+      size_t n = std::min(lanes, end - s);
+      for (size_t l = 0; l < g.loads.size(); l++)
+        std::copy(task.in[l] + s, task.in[l] + s + n, regs + l * lanes);
+      for (auto &instr : g.code) run_instruction(instr, regs, n);
+      const dtype *r = regs + g.code.back().dst * lanes;
+      std::copy(r, r + n, task.out + s);
+    }
+  });
+}
+
+template <class dtype>
+class Graph;
+
+template <class dtype>
+class program;
+
+template <class dtype = float>
+class expr {
+  Graph<dtype> *g;
+  int node_id;
+
+ public:
+  expr(Graph<dtype> *graph, int id) : g(graph), node_id(id) {}
+
+  inline int id() const { return node_id; }
+  inline Graph<dtype> *owner() const { return g; }
+  inline shape::Shape shape() const {
+    return shape::Shape(g->at(node_id).shape);
+  }
+
+  // mirrors the element-wise surface of tensor<dtype>
+  expr operator+(const expr &that) const { return g->binary(add, *this, that); }
+  expr operator-(const expr &that) const { return g->binary(sub, *this, that); }
+  expr operator*(const expr &that) const { return g->binary(mul, *this, that); }
+  expr operator/(const expr &that) const { return g->binary(div, *this, that); }
+  expr operator+(const dtype &k) const {
+    return g->scalar(add_scalar, *this, k);
+  }
+  expr operator-(const dtype &k) const {
+    return g->scalar(sub_scalar, *this, k);
+  }
+  expr operator*(const dtype &k) const {
+    return g->scalar(mul_scalar, *this, k);
+  }
+  expr operator/(const dtype &k) const {
+    return g->scalar(div_scalar, *this, k);
+  }
+  expr clip(dtype max, dtype min) const {
+    return g->scalar(graph::clip, *this, max, min);
+  }
+
+  tensor<dtype> evaluate() const { return g->evaluate(*this); }
+};
+
+template <class dtype = float>
+class Graph {
+  std::vector<node<dtype>> nodes;
+
+  expr<dtype> push(node<dtype> n) {
+    nodes.push_back(std::move(n));
+    return expr<dtype>(this, static_cast<int>(nodes.size()) - 1);
+  }
+
+  void check_owner(const expr<dtype> &e) const {
+    if (e.owner() != this)
+      throw exceptions::operation_undefined(
+          "Expression belongs to a different graph.");
+  }
+
+  static bool is_leaf(const node<dtype> &n) {
+    return n.op == graph::input || n.op == graph::constant;
+  }
+
+  static size_t count(const std::vector<uint> &s) {
+    size_t c = 1;
+    for (auto &e : s) c *= e;
+    return c;
+  }
+
+  const dtype *leaf_data(const node<dtype> &n) const {
+    return n.op == graph::input ? n.source->raw_data() : n.value.data();
+  }
+
+  // Marks every node reachable from the requested outputs, anything else is
+  // dead code and never gets compiled.
+  std::vector<bool> live_nodes(const std::vector<int> &outputs) const {
+    std::vector<bool> live(nodes.size(), false);
+    for (auto &o : outputs) live[o] = true;
+    for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; i--) {
+      if (!live[i]) continue;
+      if (nodes[i].lhs >= 0) live[nodes[i].lhs] = true;
+      if (nodes[i].rhs >= 0) live[nodes[i].rhs] = true;
+    }
+    return live;
+  }
+
+  // Nodes whose operands are all constants are computed once and replaced by
+  // a constant, so repeated evaluations never redo them.
+  void fold_constants(const std::vector<bool> &live) {
+    for (size_t i = 0; i < nodes.size(); i++) {
+      node<dtype> &n = nodes[i];
+      if (!live[i] || is_leaf(n)) continue;
+      if (nodes[n.lhs].op != graph::constant) continue;
+      if (n.rhs >= 0 && nodes[n.rhs].op != graph::constant) continue;
+
+      std::vector<dtype> folded(count(n.shape));
+      group<dtype> g;
+      g.root = static_cast<int>(i);
+      g.loads.push_back(n.lhs);
+      if (n.rhs >= 0) g.loads.push_back(n.rhs);
+      int dst = static_cast<int>(g.loads.size());
+      g.code.push_back({n.op, dst, 0, n.rhs >= 0 ? 1 : -1, n.alpha, n.beta});
+      g.registers = dst + 1;
+      g.elements = folded.size();
+      std::vector<const dtype *> in;
+      for (auto &l : g.loads) in.push_back(nodes[l].value.data());
+      std::vector<dtype> regs(register_file_elements<dtype>(g.registers));
+      execute(g, in.data(), folded.data(), regs.data());
+
+      n.op = graph::constant;
+      n.lhs = n.rhs = -1;
+      n.value = std::move(folded);
+    }
+  }
+
+  // Emits the instructions of `id` and of every fused producer feeding it.
+  // Returns the register holding the value of `id`.
+  int emit(int id, const std::vector<bool> &materialized, int root,
+           group<dtype> &g, std::vector<int> &load_reg,
+           std::vector<instruction<dtype>> &body) const {
+    const node<dtype> &n = nodes[id];
+    if (id != root && materialized[id]) {
+      if (load_reg[id] < 0) {
+        load_reg[id] = static_cast<int>(g.loads.size());
+        g.loads.push_back(id);
+      }
+      return -1 - load_reg[id];  // patched once the load count is known
+    }
+    int a = emit(n.lhs, materialized, root, g, load_reg, body);
+    int b = n.rhs >= 0 ? emit(n.rhs, materialized, root, g, load_reg, body)
+                       : no_operand;
+    int dst = static_cast<int>(body.size());
+    body.push_back({n.op, dst, a, b, n.alpha, n.beta});
+    return dst;
+  }
+
+  std::vector<group<dtype>> fuse(const std::vector<int> &outputs,
+                                 const std::vector<bool> &live) const {
+    std::vector<int> uses(nodes.size(), 0);
+    for (size_t i = 0; i < nodes.size(); i++) {
+      if (!live[i]) continue;
+      if (nodes[i].lhs >= 0) uses[nodes[i].lhs]++;
+      if (nodes[i].rhs >= 0) uses[nodes[i].rhs]++;
+    }
+    // a value needs its own buffer when it is a leaf, a requested output or
+    // is shared by several consumers; everything else is fused away
+    std::vector<bool> materialized(nodes.size(), false);
+    for (size_t i = 0; i < nodes.size(); i++)
+      materialized[i] = live[i] && (is_leaf(nodes[i]) || uses[i] != 1);
+    for (auto &o : outputs) materialized[o] = true;
+
+    std::vector<group<dtype>> groups;
+    for (size_t i = 0; i < nodes.size(); i++) {
+      if (!materialized[i] || is_leaf(nodes[i])) continue;
+      group<dtype> g;
+      g.root = static_cast<int>(i);
+      g.elements = count(nodes[i].shape);
+      std::vector<int> load_reg(nodes.size(), -1);
+      std::vector<instruction<dtype>> body;
+      emit(g.root, materialized, g.root, g, load_reg, body);
+
+      // registers [0, loads) hold the operands, the body follows them
+      int base = static_cast<int>(g.loads.size());
+      auto remap = [&](int r) {
+        if (r == no_operand) return -1;
+        return r < 0 ? -1 - r : r + base;
+      };
+      for (auto &in : body) {
+        in.dst += base;
+        in.a = remap(in.a);
+        in.b = remap(in.b);
+      }
+      g.code = std::move(body);
+      g.registers = base + static_cast<int>(g.code.size());
+      groups.push_back(std::move(g));
+    }
+    return groups;
+  }
+
+  friend class program<dtype>;
+
+ public:
+  Graph() = default;
+  Graph(const Graph &) = delete;  // expressions keep a pointer to the graph
+
+  inline const node<dtype> &at(int id) const { return nodes[id]; }
+  inline size_t node_count() const { return nodes.size(); }
+
+  // binds `t` by reference, its contents are read on every evaluate()
+  expr<dtype> input(const tensor<dtype> &t) {
+    node<dtype> n;
+    n.op = graph::input;
+    n.shape = t.shape().d;
+    n.source = &t;
+    return push(std::move(n));
+  }
+
+  // takes a copy of `t`, chains fed only by constants are folded
+  expr<dtype> constant(const tensor<dtype> &t) {
+    node<dtype> n;
+    n.op = graph::constant;
+    n.shape = t.shape().d;
+    n.value.assign(t.raw_data(), t.raw_data() + t.size());
+    return push(std::move(n));
+  }
+
+  expr<dtype> binary(op_code op, const expr<dtype> &a, const expr<dtype> &b) {
+    check_owner(a);
+    check_owner(b);
+    if (nodes[a.id()].shape != nodes[b.id()].shape)
+      throw exceptions::operation_undefined(
+          "Element wise operation is not defined when both tensors have "
+          "mismatch shape." +
+          static_cast<std::string>(a.shape()) + " and " +
+          static_cast<std::string>(b.shape()));
+    node<dtype> n;
+    n.op = op;
+    n.lhs = a.id();
+    n.rhs = b.id();
+    n.shape = nodes[a.id()].shape;
+    return push(std::move(n));
+  }
+
+  expr<dtype> scalar(op_code op, const expr<dtype> &a, dtype alpha,
+                     dtype beta = dtype(0)) {
+    check_owner(a);
+    node<dtype> n;
+    n.op = op;
+    n.lhs = a.id();
+    n.alpha = alpha;
+    n.beta = beta;
+    n.shape = nodes[a.id()].shape;
+    return push(std::move(n));
+  }
+
+  // Optimizes the part of the graph needed for `outputs`: dead nodes are
+  // dropped, constant chains folded and element-wise chains fused into
+  // single passes. The result runs repeatedly without re-planning.
+  program<dtype> compile(const std::vector<expr<dtype>> &outputs) {
+    std::vector<int> out_ids;
+    for (auto &o : outputs) {
+      check_owner(o);
+      out_ids.push_back(o.id());
+    }
+    std::vector<bool> live = live_nodes(out_ids);
+    fold_constants(live);
+    return program<dtype>(this, out_ids, fuse(out_ids, live));
+  }
+
+  tensor<dtype> evaluate(const expr<dtype> &output) {
+    return evaluate(std::vector<expr<dtype>>{output})[0];
+  }
+
+  std::vector<tensor<dtype>> evaluate(const std::vector<expr<dtype>> &outputs) {
+    program<dtype> p = compile(outputs);
+    std::vector<tensor<dtype>> results;
+    for (auto &o : outputs)
+      results.emplace_back(std::vector<dtype>(count(nodes[o.id()].shape)),
+                           o.shape());
+    std::vector<tensor<dtype> *> targets;
+    for (auto &r : results) targets.push_back(&r);
+    p.run(targets);
+    return results;
+  }
+};
+
+// A graph compiled for a fixed set of outputs. Every intermediate buffer has
+// a lifetime known up front, so all of them are bound to offsets inside one
+// workspace sized by plan_memory(). Outputs are written straight into the
+// caller's tensors and run() performs no tensor sized allocation.
+template <class dtype = float>
+class program {
+  Graph<dtype> *g;
+  std::vector<int> outputs;
+  std::vector<group<dtype>> groups;
+  std::vector<size_t> offsets;        // workspace byte offset of every node
+  std::vector<size_t> operand_begin;  // first operand slot of every group
+  std::vector<const dtype *> operands;
+  std::vector<const dtype *> values;  // address of every node for this run
+  size_t register_offset;
+  workspace ws;
+
+ public:
+  program(Graph<dtype> *graph, std::vector<int> outs,
+          std::vector<group<dtype>> grps)
+      : g(graph), outputs(std::move(outs)), groups(std::move(grps)) {
+    size_t nodes = g->node_count();
+    std::vector<bool> is_output(nodes, false);
+    for (auto &o : outputs) is_output[o] = true;
+
+    // a value lives from the group producing it to the last group reading it
+    std::vector<int> last_use(nodes, -1);
+    for (size_t i = 0; i < groups.size(); i++)
+      for (auto &l : groups[i].loads) last_use[l] = static_cast<int>(i);
+
+    std::vector<lifetime> buffers;
+    std::vector<int> owners;
+    int registers = 1;
+    for (size_t i = 0; i < groups.size(); i++) {
+      registers = std::max(registers, groups[i].registers);
+      operand_begin.push_back(operands.size());
+      operands.resize(operands.size() + groups[i].loads.size());
+      int root = groups[i].root;
+      if (is_output[root]) continue;
+      buffers.push_back({groups[i].elements * sizeof(dtype),
+                         static_cast<int>(i),
+                         std::max(last_use[root], static_cast<int>(i))});
+      owners.push_back(root);
+    }
+    memory_plan plan = plan_memory(buffers, workspace::alignment);
+    offsets.assign(nodes, 0);
+    for (size_t b = 0; b < owners.size(); b++)
+      offsets[owners[b]] = plan.offsets[b];
+    register_offset = align_up(plan.workspace_bytes, workspace::alignment);
+    ws.reserve(register_offset +
+               register_file_elements<dtype>(registers) * sizeof(dtype));
+    values.assign(nodes, nullptr);
+  }
+
+  inline size_t workspace_bytes() const { return ws.size(); }
+  // number of fused passes run() makes
+  inline size_t group_count() const { return groups.size(); }
+
+  // results[i] receives outputs[i] and must already hold as many elements
+  void run(const std::vector<tensor<dtype> *> &results) {
+    if (results.size() != outputs.size())
+      throw exceptions::operation_undefined(
+          "Compiled graph expects " + std::to_string(outputs.size()) +
+          " output tensors, got " + std::to_string(results.size()));
+    for (size_t i = 0; i < outputs.size(); i++)
+      if (results[i]->size() != Graph<dtype>::count(g->at(outputs[i]).shape))
+        throw exceptions::operation_undefined(
+            "Output tensor size does not match the compiled graph.");
+
+    for (size_t i = 0; i < groups.size(); i++)
+      for (auto &l : groups[i].loads) {
+        const node<dtype> &n = g->at(l);
+        if (!Graph<dtype>::is_leaf(n)) continue;
+        if (n.op == graph::input &&
+            n.source->size() != Graph<dtype>::count(n.shape))
+          throw exceptions::operation_undefined(
+              "Bound input changed size since the graph was compiled.");
+        values[l] = g->leaf_data(n);
+      }
+
+    dtype *register_file = ws.template at<dtype>(register_offset);
+    for (size_t i = 0; i < groups.size(); i++) {
+      const group<dtype> &grp = groups[i];
+      dtype *out = nullptr;
+      for (size_t o = 0; o < outputs.size() && !out; o++)
+        if (outputs[o] == grp.root) out = results[o]->raw_data();
+      if (!out) out = ws.template at<dtype>(offsets[grp.root]);
+      const dtype **in = operands.data() + operand_begin[i];
+      for (size_t l = 0; l < grp.loads.size(); l++)
+        in[l] = values[grp.loads[l]];
+      execute(grp, in, out, register_file);
+      values[grp.root] = out;
+    }
+
+    // leaves and outputs requested twice still need their copy
+    for (size_t o = 0; o < outputs.size(); o++) {
+      const node<dtype> &n = g->at(outputs[o]);
+      const dtype *src = Graph<dtype>::is_leaf(n) ? g->leaf_data(n)
+                                                  : values[outputs[o]];
+      if (src != results[o]->raw_data())
+        std::copy(src, src + results[o]->size(), results[o]->raw_data());
+    }
+  }
+};
+
+}  // namespace graph
+}  // namespace tensors
+
+#endif
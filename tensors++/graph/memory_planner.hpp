@@ -0,0 +1,128 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef MEMORY_PLANNER_HPP
+#define MEMORY_PLANNER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+namespace tensors {
+namespace graph {
+
+// A buffer live over the execution steps [first_use, last_use], both ends
+// inclusive: a buffer read in step s cannot be handed to the value written
+// in that same step.
+struct lifetime {
+  size_t bytes;
+  int first_use, last_use;
+
+  bool overlaps(const lifetime &that) const {
+    return first_use <= that.last_use && that.first_use <= last_use;
+  }
+};
+
+struct memory_plan {
+  std::vector<size_t> offsets;  // byte offset of every lifetime
+  size_t workspace_bytes = 0;
+};
+
+inline size_t align_up(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+// Packs the buffers into one workspace. This is offset assignment on the
+// interval graph of the lifetimes: buffers are placed largest first, each
+// into the tightest gap left between the already placed buffers it overlaps
+// in time, or above all of them when no gap fits.
+inline memory_plan plan_memory(const std::vector<lifetime> &buffers,
+                               size_t alignment = 64) {
+  memory_plan plan;
+  plan.offsets.assign(buffers.size(), 0);
+
+  std::vector<size_t> order(buffers.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return buffers[a].bytes > buffers[b].bytes;
+  });
+
+  std::vector<size_t> placed;
+  for (auto &id : order) {
+    size_t need = align_up(buffers[id].bytes, alignment);
+    std::vector<size_t> conflicts;
+    for (auto &p : placed)
+      if (buffers[p].overlaps(buffers[id])) conflicts.push_back(p);
+    std::sort(conflicts.begin(), conflicts.end(), [&](size_t a, size_t b) {
+      return plan.offsets[a] < plan.offsets[b];
+    });
+
+    size_t best = static_cast<size_t>(-1), best_gap = static_cast<size_t>(-1);
+    size_t cursor = 0;
+    for (auto &c : conflicts) {
+      if (plan.offsets[c] >= cursor + need &&
+          plan.offsets[c] - cursor < best_gap) {
+        best = cursor;
+        best_gap = plan.offsets[c] - cursor;
+      }
+      cursor = std::max(cursor, plan.offsets[c] +
+                                    align_up(buffers[c].bytes, alignment));
+    }
+    plan.offsets[id] = best != static_cast<size_t>(-1) ? best : cursor;
+    plan.workspace_bytes =
+        std::max(plan.workspace_bytes, plan.offsets[id] + need);
+    placed.push_back(id);
+  }
+  return plan;
+}
+
+// One preallocated, aligned block that planned buffers are bound into.
+class workspace {
+  // over-allocated by alignment - 1 bytes, `aligned` is the first boundary
+  std::unique_ptr<unsigned char[]> block;
+  unsigned char *aligned = nullptr;
+  size_t bytes = 0;
+
+ public:
+  static const size_t alignment = 64;
+
+  workspace() = default;
+  explicit workspace(size_t size) { reserve(size); }
+
+  // grows the block when needed, never shrinks it
+  void reserve(size_t size) {
+    if (size <= bytes) return;
+    block.reset(new unsigned char[size + alignment - 1]);
+    aligned = block.get() +
+              (align_up(reinterpret_cast<uintptr_t>(block.get()), alignment) -
+               reinterpret_cast<uintptr_t>(block.get()));
+    bytes = size;
+  }
+
+  inline size_t size() const { return bytes; }
+
+  template <class dtype>
+  inline dtype *at(size_t offset) {
+    return reinterpret_cast<dtype *>(aligned + offset);
+  }
+};
+
+}  // namespace graph
+}  // namespace tensors
+
+#endif
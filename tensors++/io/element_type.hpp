@@ -0,0 +1,111 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef ELEMENT_TYPE_HPP
+#define ELEMENT_TYPE_HPP
+
+#include <cstdint>
+
+#include "tensors++/core/half.hpp"
+
+namespace tensors {
+namespace io {
+
+// Element types a file can hold, with fixed codes stored on disk. Loading
+// never converts, the file's type has to be the tensor's dtype.
+enum class element_type : uint32_t {
+  unknown = 0,
+  float32 = 1,
+  float64 = 2,
+  float16 = 3,
+  bfloat16 = 4,
+  int8 = 5,
+  uint8 = 6,
+  int16 = 7,
+  uint16 = 8,
+  int32 = 9,
+  uint32 = 10,
+  int64 = 11,
+  uint64 = 12,
+  boolean = 13,
+};
+
+template <class dtype>
+struct element_type_of {
+  static constexpr element_type value = element_type::unknown;
+};
+
+#define TENSORS_ELEMENT_TYPE(T, code)                         \
+  template <>                                                 \
+  struct element_type_of<T> {                                 \
+    static constexpr element_type value = element_type::code; \
+  };
+
+TENSORS_ELEMENT_TYPE(float, float32)
+TENSORS_ELEMENT_TYPE(double, float64)
+TENSORS_ELEMENT_TYPE(half, float16)
+TENSORS_ELEMENT_TYPE(bfloat16, bfloat16)
+TENSORS_ELEMENT_TYPE(int8_t, int8)
+TENSORS_ELEMENT_TYPE(uint8_t, uint8)
+TENSORS_ELEMENT_TYPE(int16_t, int16)
+TENSORS_ELEMENT_TYPE(uint16_t, uint16)
+TENSORS_ELEMENT_TYPE(int32_t, int32)
+TENSORS_ELEMENT_TYPE(uint32_t, uint32)
+TENSORS_ELEMENT_TYPE(int64_t, int64)
+TENSORS_ELEMENT_TYPE(uint64_t, uint64)
+TENSORS_ELEMENT_TYPE(bool, boolean)
+
+#undef TENSORS_ELEMENT_TYPE
+
+inline const char *element_type_name(element_type t) {
+  switch (t) {
+    case element_type::float32:
+      return "float32";
+    case element_type::float64:
+      return "float64";
+    case element_type::float16:
+      return "float16";
+    case element_type::bfloat16:
+      return "bfloat16";
+    case element_type::int8:
+      return "int8";
+    case element_type::uint8:
+      return "uint8";
+    case element_type::int16:
+      return "int16";
+    case element_type::uint16:
+      return "uint16";
+    case element_type::int32:
+      return "int32";
+    case element_type::uint32:
+      return "uint32";
+    case element_type::int64:
+      return "int64";
+    case element_type::uint64:
+      return "uint64";
+    case element_type::boolean:
+      return "bool";
+    case element_type::unknown:
+      break;
+  }
+  return "unknown";
+}
+
+}  // namespace io
+}  // namespace tensors
+
+#endif
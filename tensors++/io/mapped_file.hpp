@@ -0,0 +1,126 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tensors++/exceptions/tensor_io.hpp"
+
+namespace tensors {
+namespace io {
+
+// A whole file in memory, read-only. Where mmap exists it is a shared
+// mapping: nothing is read up front, pages come in on first touch and
+// every process mapping the file shares them in the page cache. Tensors
+// built on it hold `bytes` (or an alias of it), which unmaps once the last
+// one is gone. Elsewhere the file is read into a buffer.
+struct mapped_file {
+  std::shared_ptr<char> bytes;
+  uint64_t size = 0;
+
+  // asks the kernel to start reading [offset, offset + length) now
+  void prefetch(uint64_t offset, uint64_t length) const {
+#if defined(__unix__) || defined(__APPLE__)
+    const uint64_t page = uint64_t(sysconf(_SC_PAGESIZE));
+    uint64_t start = offset / page * page;
+    if (length && start < size)
+      madvise(bytes.get() + start, size_t(offset + length - start),
+              MADV_WILLNEED);
+#else
+    (void)offset;
+    (void)length;
+#endif
+  }
+};
+
+inline mapped_file map_file(const std::string &path) {
+  mapped_file f;
+#if defined(__unix__) || defined(__APPLE__)
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw exceptions::io_error(path, "cannot open for reading");
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw exceptions::io_error(path, "cannot stat");
+  }
+  f.size = uint64_t(st.st_size);
+  if (f.size == 0) {
+    ::close(fd);
+    throw exceptions::io_error(path, "file is empty");
+  }
+  void *mapping = mmap(nullptr, size_t(f.size), PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);  // the mapping keeps the file open
+  if (mapping == MAP_FAILED) throw exceptions::io_error(path, "cannot map");
+  size_t length = size_t(f.size);
+  f.bytes = std::shared_ptr<char>(
+      static_cast<char *>(mapping),
+      [length](char *p) { munmap(p, length); });
+#else
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) throw exceptions::io_error(path, "cannot open for reading");
+  f.size = uint64_t(in.tellg());
+  if (f.size == 0) throw exceptions::io_error(path, "file is empty");
+  in.seekg(0);
+  f.bytes = std::shared_ptr<char>(new char[size_t(f.size)],
+                                  std::default_delete<char[]>());
+  in.read(f.bytes.get(), std::streamsize(f.size));
+  if (!in) throw exceptions::io_error(path, "read failed");
+#endif
+  return f;
+}
+
+// elements at `offset` into the file, owning the whole mapping with the
+// other blocks of it
+template <class dtype>
+std::shared_ptr<dtype> mapped_block(const mapped_file &f, uint64_t offset) {
+  return std::shared_ptr<dtype>(f.bytes,
+                                reinterpret_cast<dtype *>(f.bytes.get() +
+                                                          offset));
+}
+
+// Writers fill temporary_path(path) and rename it over path once complete,
+// as io::save does for tensor files: readers mapping the old file keep
+// valid pages, and a failed write leaves the old file as it was.
+inline std::string temporary_path(const std::string &path) {
+  return path + ".tmp";
+}
+
+inline void replace_file(const std::string &path) {
+  std::string temporary = temporary_path(path);
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw exceptions::io_error(path, "cannot replace with " + temporary);
+  }
+}
+
+}  // namespace io
+}  // namespace tensors
+
+#endif
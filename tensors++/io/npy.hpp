@@ -0,0 +1,440 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef NPY_HPP
+#define NPY_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/core/storage.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_io.hpp"
+#include "tensors++/io/element_type.hpp"
+#include "tensors++/io/mapped_file.hpp"
+#include "tensors++/io/zip.hpp"
+
+namespace tensors {
+namespace io {
+
+// NumPy .npy files and .npz archives of them (np.save, np.savez).
+//
+// Files are memory mapped (see mapped_file). An array in the byte order of
+// the host and in C order becomes a frozen tensor over the mapping itself,
+// so reading it copies nothing and pages in only what is touched; the same
+// holds for any range of its rows, which is how arrays larger than memory
+// stream through a model. Arrays of the other byte order, or Fortran
+// order ones, are copied into row-major tensors, swapped and transposed on
+// the way.
+
+inline bool host_little_endian() {
+  const uint16_t one = 1;
+  return *reinterpret_cast<const uint8_t *>(&one) == 1;
+}
+
+struct npy_info {
+  element_type type;
+  size_t word;         // bytes per element
+  bool swap;           // stored in the other byte order
+  bool fortran_order;  // column major
+  std::vector<uint64_t> shape;
+  std::vector<uint64_t> strides;  // in elements, for the order above
+  uint64_t data_offset;           // from the start of the .npy bytes
+
+  // element count, UINT64_MAX if the product of the shape overflows
+  uint64_t count() const {
+    uint64_t n = 1;
+    for (uint64_t d : shape) {
+      if (d != 0 && n > UINT64_MAX / d) return UINT64_MAX;
+      n *= d;
+    }
+    return n;
+  }
+};
+
+// position after `'key':` in a header dict, npos if it is missing
+inline size_t npy_field(const std::string &header, const std::string &key) {
+  for (char quote : {'\'', '"'}) {
+    size_t at = header.find(quote + key + quote);
+    if (at == std::string::npos) continue;
+    at = header.find(':', at + key.size() + 2);
+    if (at == std::string::npos) break;
+    return header.find_first_not_of(" \t", at + 1);
+  }
+  return std::string::npos;
+}
+
+// Parses the header of the .npy bytes [data, data + size).
+inline npy_info parse_npy_header(const char *data, uint64_t size,
+                                 const std::string &path) {
+  if (size < 10 || std::memcmp(data, "\x93NUMPY", 6) != 0)
+    throw exceptions::io_error(path, "not a .npy array");
+  int major = uint8_t(data[6]);
+  uint64_t prefix = major == 1 ? 10 : 12;
+  if (major < 1 || major > 3 || size < prefix)
+    throw exceptions::io_error(
+        path, "unsupported .npy version " + std::to_string(major));
+  uint64_t length = 0;
+  for (uint64_t i = prefix; i-- > 8;) length = length << 8 | uint8_t(data[i]);
+  if (size - prefix < length)
+    throw exceptions::io_error(path, "truncated .npy header");
+  std::string header(data + prefix, size_t(length));
+
+  npy_info info;
+  info.data_offset = prefix + length;
+  size_t at = npy_field(header, "descr");
+  if (at == std::string::npos || (header[at] != '\'' && header[at] != '"'))
+    throw exceptions::io_error(
+        path, "only plain numeric dtypes are supported, not structured ones");
+  size_t close = header.find(header[at], at + 1);
+  std::string descr = header.substr(at + 1, close - at - 1);
+  if (descr.size() < 3)
+    throw exceptions::io_error(path, "unsupported dtype " + descr);
+  char order = descr[0], kind = descr[1];
+  info.word = size_t(std::atoi(descr.c_str() + 2));
+  struct kind_size {
+    char kind;
+    size_t word;
+    element_type type;
+  };
+  static const kind_size known[] = {
+      {'f', 2, element_type::float16}, {'f', 4, element_type::float32},
+      {'f', 8, element_type::float64}, {'i', 1, element_type::int8},
+      {'i', 2, element_type::int16},   {'i', 4, element_type::int32},
+      {'i', 8, element_type::int64},   {'u', 1, element_type::uint8},
+      {'u', 2, element_type::uint16},  {'u', 4, element_type::uint32},
+      {'u', 8, element_type::uint64},  {'b', 1, element_type::boolean}};
+  info.type = element_type::unknown;
+  for (const kind_size &k : known)
+    if (k.kind == kind && k.word == info.word) info.type = k.type;
+  if (info.type == element_type::unknown ||
+      std::string("<>|=").find(order) == std::string::npos)
+    throw exceptions::io_error(path, "unsupported dtype " + descr);
+  info.swap = info.word > 1 && (order == '<' || order == '>') &&
+              (order == '<') != host_little_endian();
+
+  at = npy_field(header, "fortran_order");
+  if (at == std::string::npos)
+    throw exceptions::io_error(path, ".npy header has no fortran_order");
+  info.fortran_order = header.compare(at, 4, "True") == 0;
+
+  at = npy_field(header, "shape");
+  if (at == std::string::npos || header[at] != '(')
+    throw exceptions::io_error(path, ".npy header has no shape");
+  for (at++; at < header.size() && header[at] != ')';) {
+    if (std::isdigit(static_cast<unsigned char>(header[at]))) {
+      size_t end;
+      try {
+        info.shape.push_back(std::stoull(header.substr(at), &end));
+      } catch (const std::out_of_range &) {
+        throw exceptions::io_error(path, ".npy shape is out of range");
+      }
+      at += end;
+    } else
+      at++;
+  }
+  info.strides.resize(info.shape.size());
+  uint64_t stride = 1;
+  for (size_t k = 0; k < info.shape.size(); k++) {
+    size_t axis = info.fortran_order ? k : info.shape.size() - 1 - k;
+    info.strides[axis] = stride;
+    if (info.shape[axis] != 0 && stride > UINT64_MAX / info.shape[axis])
+      throw exceptions::io_error(path, "element count overflows");
+    stride *= info.shape[axis];
+  }
+  if ((size - info.data_offset) / info.word < info.count())
+    throw exceptions::io_error(path, "truncated .npy data");
+  return info;
+}
+
+// One array in a mapped .npy file or .npz member.
+class npy_array {
+  mapped_file file;
+  uint64_t base;  // of the .npy bytes in the file
+  npy_info meta;
+  std::string path;
+
+  template <class dtype>
+  void check_type() const {
+    static_assert(element_type_of<dtype>::value != element_type::unknown,
+                  "No file element type for this dtype");
+    if (meta.type != element_type_of<dtype>::value)
+      throw exceptions::io_error(
+          path, std::string("holds ") + element_type_name(meta.type) +
+                    " elements, not " +
+                    element_type_name(element_type_of<dtype>::value));
+  }
+
+  template <class dtype>
+  std::unique_ptr<tensor<dtype>> make(uint64_t first, uint64_t count,
+                                      std::vector<uint> dims) const {
+    for (uint d : dims)
+      if (d == 0)
+        throw exceptions::io_error(path, "tensor has no empty arrays");
+    const char *data = file.bytes.get() + base + meta.data_offset;
+    uint64_t row = meta.shape.empty() ? 1 : meta.count() / meta.shape[0];
+    size_t n = size_t(count * row);
+    // with at most one axis longer than 1 both orders are the same
+    size_t long_axes = std::count_if(meta.shape.begin(), meta.shape.end(),
+                                     [](uint64_t d) { return d > 1; });
+    bool contiguous = !meta.fortran_order || long_axes < 2;
+    uint64_t offset = base + meta.data_offset + first * row * meta.word;
+    if (contiguous && !meta.swap && offset % alignof(dtype) == 0)
+      return std::unique_ptr<tensor<dtype>>(new tensor<dtype>(
+          storage<dtype>::adopt(mapped_block<dtype>(file, offset), n),
+          shape::Shape(dims)));
+
+    std::vector<dtype> values(n);
+    char *out = reinterpret_cast<char *>(values.data());
+    const size_t word = meta.word;
+    if (contiguous)
+      std::memcpy(out, data + first * row * word, n * word);
+    else {
+      // odometer over the row-major output, walking the column major input
+      std::vector<uint64_t> index(meta.shape.size(), 0);
+      std::vector<uint64_t> extent(meta.shape);
+      extent[0] = count;
+      uint64_t source = first * meta.strides[0];
+      for (size_t i = 0; i < n; i++) {
+        std::memcpy(out + i * word, data + source * word, word);
+        for (size_t k = extent.size(); k-- > 0;) {
+          source += meta.strides[k];
+          if (++index[k] < extent[k]) break;
+          source -= extent[k] * meta.strides[k];
+          index[k] = 0;
+        }
+      }
+    }
+    if (meta.swap)
+      parallel::parallel_for(n, 1 << 16, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+          std::reverse(out + i * word, out + (i + 1) * word);
+      });
+    std::unique_ptr<tensor<dtype>> t(
+        new tensor<dtype>(std::move(values), shape::Shape(dims)));
+    t->freeze();
+    return t;
+  }
+
+ public:
+  // the .npy bytes [base, base + size) of a mapped file
+  npy_array(mapped_file file, uint64_t base, uint64_t size, std::string path)
+      : file(std::move(file)),
+        base(base),
+        meta(parse_npy_header(this->file.bytes.get() + base, size, path)),
+        path(std::move(path)) {}
+
+  inline const npy_info &info() const { return meta; }
+  // length of the first axis
+  inline uint64_t rows() const {
+    return meta.shape.empty() ? 1 : meta.shape[0];
+  }
+
+  // The whole array as a frozen tensor, over the mapping when the array is
+  // in C order and host byte order.
+  template <class dtype>
+  std::unique_ptr<tensor<dtype>> read() const {
+    check_type<dtype>();
+    if (meta.shape.empty()) return make<dtype>(0, 1, {});
+    return read<dtype>(0, rows());
+  }
+
+  // Rows [first, first + count) of the first axis as a frozen tensor of
+  // shape [count, ...], mapped or copied like read(). Only the pages of
+  // those rows are touched.
+  template <class dtype>
+  std::unique_ptr<tensor<dtype>> read(uint64_t first, uint64_t count) const {
+    check_type<dtype>();
+    if (meta.shape.empty() || first > rows() || rows() - first < count)
+      throw exceptions::io_error(
+          path, "rows [" + std::to_string(first) + ", " +
+                    std::to_string(first + count) + ") out of range");
+    std::vector<uint> dims;
+    for (uint64_t d : meta.shape) {
+      if (d > UINT32_MAX)
+        throw exceptions::io_error(path, "dimension out of range");
+      dims.push_back(uint(d));
+    }
+    dims[0] = uint(count);
+    return make<dtype>(first, count, dims);
+  }
+
+  // asks the kernel to start reading rows [first, first + count)
+  void prefetch(uint64_t first, uint64_t count) const {
+    uint64_t row = meta.count() / std::max<uint64_t>(rows(), 1) * meta.word;
+    if (meta.fortran_order && meta.shape.size() > 1) {
+      first = 0;
+      count = rows();
+    }
+    file.prefetch(base + meta.data_offset + first * row, count * row);
+  }
+};
+
+inline npy_array open_npy(const std::string &path) {
+  mapped_file file = map_file(path);
+  uint64_t size = file.size;
+  return npy_array(std::move(file), 0, size, path);
+}
+
+template <class dtype>
+std::unique_ptr<tensor<dtype>> load_npy(const std::string &path) {
+  return open_npy(path).read<dtype>();
+}
+
+// .npy header (version 1.0, C order, host byte order) of an array of
+// `shape`, padded so the data starts on a 64 byte boundary
+template <class dtype>
+std::string npy_header(const std::vector<uint64_t> &shape,
+                       const std::string &path) {
+  static const char *const kinds[] = {"",   "f4", "f8", "f2", "",
+                                      "i1", "u1", "i2", "u2", "i4",
+                                      "u4", "i8", "u8", "b1"};
+  const char *kind = kinds[uint32_t(element_type_of<dtype>::value)];
+  if (!*kind)
+    throw exceptions::io_error(path, "no NumPy dtype for this tensor type");
+  std::string dict = "{'descr': '";
+  dict += sizeof(dtype) == 1 ? '|' : host_little_endian() ? '<' : '>';
+  dict += kind;
+  dict += "', 'fortran_order': False, 'shape': (";
+  for (uint64_t d : shape) dict += std::to_string(d) + ", ";
+  if (shape.size() > 1) dict.erase(dict.size() - 2);
+  if (shape.size() == 1) dict.pop_back();
+  dict += "), }";
+  bool v2 = dict.size() + 11 > 65535;
+  size_t prefix = v2 ? 12 : 10;
+  size_t total = (prefix + dict.size() + 1 + 63) / 64 * 64;
+  dict.append(total - prefix - dict.size() - 1, ' ');
+  dict += '\n';
+  std::string header("\x93NUMPY", 6);
+  header += char(v2 ? 2 : 1);
+  header += char(0);
+  for (size_t i = 0; i < prefix - 8; i++)
+    header += char(uint8_t(dict.size() >> (8 * i)));
+  return header + dict;
+}
+
+template <class dtype>
+std::string npy_header(const tensor<dtype> &t, const std::string &path) {
+  std::vector<uint64_t> shape;
+  for (uint d : t.shape().d) shape.push_back(d);
+  return npy_header<dtype>(shape, path);
+}
+
+// Writes a .npy file through a temporary, see replace_file.
+template <class dtype>
+void save_npy(const tensor<dtype> &t, const std::string &path) {
+  std::string header = npy_header(t, path);
+  std::string temporary = temporary_path(path);
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out)
+      throw exceptions::io_error(temporary, "cannot open for writing");
+    out.write(header.data(), std::streamsize(header.size()));
+    out.write(reinterpret_cast<const char *>(t.raw_data()),
+              std::streamsize(t.size() * sizeof(dtype)));
+    out.close();
+    if (!out) {
+      std::remove(temporary.c_str());
+      throw exceptions::io_error(temporary, "write failed");
+    }
+  }
+  replace_file(path);
+}
+
+// An np.savez archive, mapped. Members have to be stored, the compressed
+// ones of np.savez_compressed cannot be mapped and are refused.
+class npz_file {
+  mapped_file file;
+  std::vector<zip_entry> entries;
+  std::string path;
+
+  const zip_entry *find(const std::string &name) const {
+    for (const zip_entry &e : entries)
+      if (e.name == name || e.name == name + ".npy") return &e;
+    return nullptr;
+  }
+
+ public:
+  explicit npz_file(const std::string &path)
+      : file(map_file(path)),
+        entries(zip_entries(file.bytes.get(), file.size, path)),
+        path(path) {}
+
+  // array names, without the .npy suffix
+  std::vector<std::string> names() const {
+    std::vector<std::string> n;
+    for (const zip_entry &e : entries) {
+      std::string name = e.name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".npy") == 0)
+        name.erase(name.size() - 4);
+      n.push_back(name);
+    }
+    return n;
+  }
+
+  inline bool contains(const std::string &name) const {
+    return find(name) != nullptr;
+  }
+
+  npy_array operator[](const std::string &name) const {
+    const zip_entry *e = find(name);
+    if (!e) throw exceptions::io_error(path, "has no array " + name);
+    if (e->method != 0 || e->size != e->uncompressed_size)
+      throw exceptions::io_error(
+          path, "array " + name +
+                    " is compressed (np.savez_compressed), only stored "
+                    "archives (np.savez) can be mapped");
+    return npy_array(file, e->offset, e->size, path + ":" + e->name);
+  }
+};
+
+// Writes an np.savez archive one array at a time, through a temporary
+// like save_npy.
+class npz_writer {
+  zip_writer zip;
+  std::string path;
+
+ public:
+  explicit npz_writer(const std::string &path) : zip(path), path(path) {}
+
+  template <class dtype>
+  void add(const std::string &name, const tensor<dtype> &t) {
+    std::string header = npy_header(t, path);
+    uint64_t bytes = uint64_t(t.size()) * sizeof(dtype);
+    zip.begin(name + ".npy", header.size() + bytes);
+    zip.write(header.data(), header.size());
+    zip.write(t.raw_data(), size_t(bytes));
+    zip.end();
+  }
+
+  inline void close() { zip.close(); }
+};
+
+}  // namespace io
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,257 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef TENSOR_FILE_HPP
+#define TENSOR_FILE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/storage.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_io.hpp"
+#include "tensors++/io/element_type.hpp"
+#include "tensors++/io/mapped_file.hpp"
+
+namespace tensors {
+namespace io {
+
+// Binary tensor file, made to be memory mapped:
+//
+//   header        tensor_file_header, 56 bytes
+//   dims          uint64 x rank
+//   strides       int64 x rank, in elements
+//   zero padding  up to payload_offset, a multiple of the alignment
+//   payload       the elements, raw, in the byte order of the writer
+//
+// The payload starts on a page boundary by default, so load() maps the
+// file and hands the pages straight to a frozen tensor: nothing is read
+// until an element is touched, the kernel pages in only what is used, and
+// every process loading the same file shares one copy in the page cache.
+struct tensor_file_header {
+  char magic[8];        // "TENSORS\0"
+  uint32_t version;     // 1
+  uint32_t byte_order;  // 0x01020304 as stored by the writer
+  uint32_t type;        // element_type
+  uint32_t element_bytes;
+  uint32_t rank;
+  uint32_t reserved;
+  uint64_t alignment;
+  uint64_t payload_offset;
+  uint64_t payload_bytes;
+};
+
+static_assert(sizeof(tensor_file_header) == 56,
+              "tensor_file_header has to stay 56 bytes");
+
+static const char tensor_file_magic[8] = {'T', 'E', 'N', 'S',
+                                          'O', 'R', 'S', '\0'};
+static const uint32_t tensor_file_version = 1;
+static const uint32_t tensor_file_byte_order = 0x01020304;
+static const size_t tensor_file_page = 4096;
+
+// what a tensor file holds, without its payload
+struct tensor_file_info {
+  element_type type;
+  std::vector<uint64_t> dims;
+  std::vector<int64_t> strides;
+  uint64_t alignment, payload_offset, payload_bytes;
+};
+
+// Parses and checks the header of a file of `size` bytes starting at
+// `bytes`, that must hold at least the header, dims and strides.
+inline tensor_file_info parse_tensor_file(const char *bytes, uint64_t size,
+                                          const std::string &path) {
+  tensor_file_header h;
+  if (size < sizeof(h)) throw exceptions::io_error(path, "file is truncated");
+  std::memcpy(&h, bytes, sizeof(h));
+  if (std::memcmp(h.magic, tensor_file_magic, sizeof(h.magic)) != 0)
+    throw exceptions::io_error(path, "not a tensor file");
+  if (h.version != tensor_file_version)
+    throw exceptions::io_error(
+        path, "unsupported tensor file version " + std::to_string(h.version));
+  if (h.byte_order != tensor_file_byte_order)
+    throw exceptions::io_error(path,
+                               "written on a machine of the other byte order");
+  uint64_t table = sizeof(h) + 16 * uint64_t(h.rank);
+  if (h.rank > 64 || size < table)
+    throw exceptions::io_error(path, "file is truncated");
+  tensor_file_info info;
+  info.type = element_type(h.type);
+  info.dims.resize(h.rank);
+  info.strides.resize(h.rank);
+  std::memcpy(info.dims.data(), bytes + sizeof(h), 8 * h.rank);
+  std::memcpy(info.strides.data(), bytes + sizeof(h) + 8 * h.rank,
+              8 * h.rank);
+  info.alignment = h.alignment;
+  info.payload_offset = h.payload_offset;
+  info.payload_bytes = h.payload_bytes;
+  // a header that overflows the element count cannot describe a payload
+  uint64_t count = 1;
+  for (uint64_t d : info.dims) {
+    if (d != 0 && count > UINT64_MAX / d)
+      throw exceptions::io_error(path, "element count overflows");
+    count *= d;
+  }
+  if (h.element_bytes == 0 || count > UINT64_MAX / h.element_bytes ||
+      count * h.element_bytes != h.payload_bytes)
+    throw exceptions::io_error(path, "payload does not match the shape");
+  if (h.payload_offset < table || h.payload_offset > size ||
+      size - h.payload_offset < h.payload_bytes)
+    throw exceptions::io_error(path, "file is truncated");
+  return info;
+}
+
+// Writes a tensor file. The payload offset is a multiple of alignment, a
+// power of two, by default the page size so it can be mapped.
+//
+// The file is written next to the target as path + ".tmp" and renamed over
+// it once complete. A process that has the old file mapped keeps reading
+// the old pages, whereas truncating the file in place would make its next
+// access to them fault with SIGBUS.
+template <class dtype>
+void save(const tensor<dtype> &t, const std::string &path,
+          size_t alignment = tensor_file_page) {
+  static_assert(element_type_of<dtype>::value != element_type::unknown,
+                "No file element type for this dtype");
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    throw exceptions::io_error(path, "alignment has to be a power of two");
+  std::vector<uint64_t> dims;
+  for (uint d : t.shape().d) dims.push_back(d);
+  std::vector<int64_t> strides(dims.size());
+  int64_t stride = 1;
+  for (size_t i = dims.size(); i-- > 0;) {
+    strides[i] = stride;
+    stride *= int64_t(dims[i]);
+  }
+
+  tensor_file_header h;
+  std::memcpy(h.magic, tensor_file_magic, sizeof(h.magic));
+  h.version = tensor_file_version;
+  h.byte_order = tensor_file_byte_order;
+  h.type = uint32_t(element_type_of<dtype>::value);
+  h.element_bytes = sizeof(dtype);
+  h.rank = uint32_t(dims.size());
+  h.reserved = 0;
+  h.alignment = alignment;
+  uint64_t table = sizeof(h) + 16 * uint64_t(dims.size());
+  h.payload_offset = (table + alignment - 1) / alignment * alignment;
+  h.payload_bytes = uint64_t(t.size()) * sizeof(dtype);
+
+  std::vector<char> head(h.payload_offset, 0);
+  std::memcpy(head.data(), &h, sizeof(h));
+  std::memcpy(head.data() + sizeof(h), dims.data(), 8 * dims.size());
+  std::memcpy(head.data() + sizeof(h) + 8 * dims.size(), strides.data(),
+              8 * dims.size());
+
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out)
+      throw exceptions::io_error(temporary, "cannot open for writing");
+    out.write(head.data(), std::streamsize(head.size()));
+    out.write(reinterpret_cast<const char *>(t.raw_data()),
+              std::streamsize(h.payload_bytes));
+    out.close();
+    if (!out) {
+      std::remove(temporary.c_str());
+      throw exceptions::io_error(temporary, "write failed");
+    }
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw exceptions::io_error(path, "cannot replace with " + temporary);
+  }
+}
+
+// header of a tensor file, reading only the first bytes
+inline tensor_file_info inspect(const std::string &path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) throw exceptions::io_error(path, "cannot open for reading");
+  uint64_t size = uint64_t(in.tellg());
+  in.seekg(0);
+  std::vector<char> head(std::min<uint64_t>(size, sizeof(tensor_file_header)));
+  in.read(head.data(), std::streamsize(head.size()));
+  tensor_file_header h;
+  if (head.size() == sizeof(h)) {
+    std::memcpy(&h, head.data(), sizeof(h));
+    if (h.rank <= 64) {
+      head.resize(std::min<uint64_t>(size, sizeof(h) + 16 * uint64_t(h.rank)));
+      in.read(head.data() + sizeof(h),
+              std::streamsize(head.size() - sizeof(h)));
+    }
+  }
+  if (!in) throw exceptions::io_error(path, "read failed");
+  return parse_tensor_file(head.data(), size, path);
+}
+
+// Loads a tensor file as a frozen tensor reading the file mapping itself
+// (see mapped_file), so loading costs the same for any file size and pages
+// come in on first touch; prefetch asks the kernel to start reading all of
+// them in the background. unfreeze() copies the elements out.
+template <class dtype>
+std::unique_ptr<tensor<dtype>> load(const std::string &path,
+                                    bool prefetch = false) {
+  static_assert(element_type_of<dtype>::value != element_type::unknown,
+                "No file element type for this dtype");
+  mapped_file file = map_file(path);
+  tensor_file_info info = parse_tensor_file(file.bytes.get(), file.size, path);
+  if (info.type != element_type_of<dtype>::value)
+    throw exceptions::io_error(
+        path, std::string("holds ") + element_type_name(info.type) +
+                  " elements, not " +
+                  element_type_name(element_type_of<dtype>::value));
+  std::vector<uint> dims;
+  int64_t stride = 1;
+  for (size_t i = info.dims.size(); i-- > 0;) {
+    if (info.strides[i] != stride)
+      throw exceptions::io_error(path, "payload is not row major contiguous");
+    stride *= int64_t(info.dims[i]);
+  }
+  for (uint64_t d : info.dims) {
+    if (d == 0 || d > UINT32_MAX)
+      throw exceptions::io_error(path, "dimension out of range");
+    dims.push_back(uint(d));
+  }
+  size_t count = size_t(info.payload_bytes / sizeof(dtype));
+  if (prefetch) file.prefetch(info.payload_offset, info.payload_bytes);
+
+  if (info.payload_offset % alignof(dtype) == 0)
+    return std::unique_ptr<tensor<dtype>>(new tensor<dtype>(
+        storage<dtype>::adopt(
+            mapped_block<dtype>(file, info.payload_offset), count),
+        shape::Shape(dims)));
+  // payload written with an alignment below the element's
+  std::vector<dtype> values(count);
+  std::memcpy(values.data(), file.bytes.get() + info.payload_offset,
+              info.payload_bytes);
+  std::unique_ptr<tensor<dtype>> t(
+      new tensor<dtype>(std::move(values), shape::Shape(dims)));
+  t->freeze();
+  return t;
+}
+
+}  // namespace io
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,344 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef ZIP_HPP
+#define ZIP_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "tensors++/exceptions/tensor_io.hpp"
+#include "tensors++/io/mapped_file.hpp"
+
+namespace tensors {
+namespace io {
+
+// Just enough of the zip format for .npz archives: the central directory
+// of an archive in memory, and a writer of stored (uncompressed) members,
+// with the zip64 extensions numpy uses past 4 GB.
+
+// CRC-32 (IEEE) of a buffer, continuing from a previous crc
+inline uint32_t crc32(const void *data, size_t len, uint32_t crc = 0) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> t(256);
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++)
+    crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+struct zip_entry {
+  std::string name;
+  uint16_t method;  // 0 for stored
+  uint32_t crc;
+  uint64_t offset;  // of the member's data in the archive
+  uint64_t size;    // compressed, the stored bytes
+  uint64_t uncompressed_size;
+};
+
+// little endian fields, whatever the host
+inline uint64_t zip_read(const char *p, int bytes) {
+  uint64_t v = 0;
+  for (int i = bytes; i-- > 0;) v = v << 8 | uint8_t(p[i]);
+  return v;
+}
+
+inline void zip_write(std::vector<char> &out, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) out.push_back(char(uint8_t(v >> (8 * i))));
+}
+
+// a 32-bit size or offset at this value is found in the zip64 fields
+const uint64_t zip_saturated = 0xffffffff;
+
+// members of the archive of `size` bytes at `data`
+inline std::vector<zip_entry> zip_entries(const char *data, uint64_t size,
+                                          const std::string &path) {
+  const uint32_t eocd_sig = 0x06054b50, locator_sig = 0x07064b50,
+                 eocd64_sig = 0x06064b50, central_sig = 0x02014b50,
+                 local_sig = 0x04034b50;
+  if (size < 22) throw exceptions::io_error(path, "not a zip archive");
+  // end of central directory, followed by a comment of up to 64 KB
+  uint64_t eocd = size - 22;
+  for (;; eocd--) {
+    if (zip_read(data + eocd, 4) == eocd_sig) break;
+    if (eocd == 0 || size - eocd > 22 + 0xffff)
+      throw exceptions::io_error(path, "not a zip archive");
+  }
+  uint64_t count = zip_read(data + eocd + 10, 2);
+  uint64_t dir_size = zip_read(data + eocd + 12, 4);
+  uint64_t dir = zip_read(data + eocd + 16, 4);
+  if (eocd >= 20 && zip_read(data + eocd - 20, 4) == locator_sig) {
+    // the 56 byte zip64 record must end before its locator
+    uint64_t eocd64 = zip_read(data + eocd - 12, 8), locator = eocd - 20;
+    if (locator < 56 || eocd64 > locator - 56 ||
+        zip_read(data + eocd64, 4) != eocd64_sig)
+      throw exceptions::io_error(path, "corrupt zip64 directory");
+    count = zip_read(data + eocd64 + 32, 8);
+    dir_size = zip_read(data + eocd64 + 40, 8);
+    dir = zip_read(data + eocd64 + 48, 8);
+  }
+  if (dir > size || size - dir < dir_size)
+    throw exceptions::io_error(path, "corrupt zip directory");
+
+  std::vector<zip_entry> entries;
+  uint64_t at = dir, end = dir + dir_size;
+  for (uint64_t n = 0; n < count; n++) {
+    if (end - at < 46 || zip_read(data + at, 4) != central_sig)
+      throw exceptions::io_error(path, "corrupt zip directory");
+    const char *h = data + at;
+    zip_entry e;
+    e.method = uint16_t(zip_read(h + 10, 2));
+    e.crc = uint32_t(zip_read(h + 16, 4));
+    e.size = zip_read(h + 20, 4);
+    e.uncompressed_size = zip_read(h + 24, 4);
+    uint64_t name_len = zip_read(h + 28, 2), extra_len = zip_read(h + 30, 2),
+             comment_len = zip_read(h + 32, 2);
+    uint64_t local = zip_read(h + 42, 4);
+    if (end - at < 46 + name_len + extra_len + comment_len)
+      throw exceptions::io_error(path, "corrupt zip directory");
+    e.name.assign(h + 46, size_t(name_len));
+    // zip64 extra field: 8 byte values of the fields saturated above
+    const char *x = h + 46 + name_len, *x_end = x + extra_len;
+    while (x_end - x >= 4) {
+      uint64_t id = zip_read(x, 2), len = zip_read(x + 2, 2);
+      if (uint64_t(x_end - x - 4) < len) break;
+      if (id == 1) {
+        const char *v = x + 4, *v_end = v + len;
+        if (e.uncompressed_size == 0xffffffff && v_end - v >= 8) {
+          e.uncompressed_size = zip_read(v, 8);
+          v += 8;
+        }
+        if (e.size == 0xffffffff && v_end - v >= 8) {
+          e.size = zip_read(v, 8);
+          v += 8;
+        }
+        if (local == 0xffffffff && v_end - v >= 8) local = zip_read(v, 8);
+      }
+      x += 4 + len;
+    }
+    at += 46 + name_len + extra_len + comment_len;
+    if (local > size || size - local < 30 ||
+        zip_read(data + local, 4) != local_sig)
+      throw exceptions::io_error(path, "corrupt zip member " + e.name);
+    e.offset = local + 30 + zip_read(data + local + 26, 2) +
+               zip_read(data + local + 28, 2);
+    if (e.offset > size || size - e.offset < e.size)
+      throw exceptions::io_error(path, "truncated zip member " + e.name);
+    entries.push_back(e);
+  }
+  return entries;
+}
+
+// Writes a zip archive of stored members, each one streamed in pieces:
+// begin() with its final size, write() the bytes, end(). The local header
+// goes out first with a zero crc, end() patches the real one in.
+class zip_writer {
+  struct member {
+    std::string name;
+    uint32_t crc;
+    uint64_t size, local;
+  };
+  std::ofstream out;
+  std::string path;
+  std::vector<member> members;
+  uint64_t position = 0, expected = 0, written = 0;
+  uint64_t crc_position = 0;  // crc field of the open member's local header
+  uint32_t crc = 0;
+  bool open = false;
+
+  static const uint16_t dos_date = 0x21;  // 1980-01-01, no timestamps
+
+  void put(const std::vector<char> &bytes) { put(bytes.data(), bytes.size()); }
+  void put(const char *bytes, size_t n) {
+    out.write(bytes, std::streamsize(n));
+    if (!out) throw exceptions::io_error(path, "write failed");
+    position += n;
+  }
+
+  // drops the unfinished archive, the file at path is left as it was
+  void discard() {
+    if (!out.is_open()) return;
+    out.close();
+    std::remove(temporary_path(path).c_str());
+  }
+
+ public:
+  // The archive is written to a temporary and only replaces the file at
+  // path on close(), see replace_file.
+  explicit zip_writer(const std::string &path)
+      : out(temporary_path(path), std::ios::binary | std::ios::trunc),
+        path(path) {
+    if (!out)
+      throw exceptions::io_error(temporary_path(path),
+                                 "cannot open for writing");
+  }
+
+  // closes the archive unless close() did, errors go unreported then and
+  // a failed archive is discarded
+  ~zip_writer() {
+    try {
+      close();
+    } catch (...) {
+      discard();
+    }
+  }
+
+  void begin(const std::string &name, uint64_t size) {
+    if (open) throw exceptions::io_error(path, "zip member still open");
+    bool zip64 = size >= zip_saturated;  // the offset is only in the directory
+    std::vector<char> h;
+    zip_write(h, 0x04034b50, 4);
+    zip_write(h, zip64 ? 45 : 20, 2);  // version needed
+    zip_write(h, 0, 2);                // flags
+    zip_write(h, 0, 2);                // stored
+    zip_write(h, 0, 2);
+    zip_write(h, dos_date, 2);
+    zip_write(h, 0, 4);  // crc, patched by end()
+    zip_write(h, zip64 ? zip_saturated : size, 4);
+    zip_write(h, zip64 ? zip_saturated : size, 4);
+    zip_write(h, name.size(), 2);
+    zip_write(h, zip64 ? 20 : 0, 2);
+    h.insert(h.end(), name.begin(), name.end());
+    if (zip64) {
+      zip_write(h, 1, 2);
+      zip_write(h, 16, 2);
+      zip_write(h, size, 8);
+      zip_write(h, size, 8);
+    }
+    members.push_back({name, 0, size, position});
+    crc_position = position + 14;
+    put(h);
+    expected = size;
+    written = 0;
+    crc = 0;
+    open = true;
+  }
+
+  void write(const void *bytes, size_t n) {
+    if (!open || expected - written < n)
+      throw exceptions::io_error(path, "zip member overflows its size");
+    crc = crc32(bytes, n, crc);
+    put(static_cast<const char *>(bytes), n);
+    written += n;
+  }
+
+  void end() {
+    if (!open || written != expected)
+      throw exceptions::io_error(path, "zip member is short of its size");
+    members.back().crc = crc;
+    std::vector<char> c;
+    zip_write(c, crc, 4);
+    out.seekp(std::streamoff(crc_position));
+    out.write(c.data(), 4);
+    out.seekp(std::streamoff(position));
+    if (!out) throw exceptions::io_error(path, "write failed");
+    open = false;
+  }
+
+  // writes the central directory, the archive is complete
+  void close() {
+    if (!out.is_open()) return;
+    if (open) throw exceptions::io_error(path, "zip member still open");
+    uint64_t dir = position;
+    std::vector<char> d;
+    for (const member &m : members) {
+      bool big = m.size >= zip_saturated, far = m.local >= zip_saturated;
+      uint64_t extra = 8 * (2 * big + far);
+      zip_write(d, 0x02014b50, 4);
+      zip_write(d, extra ? 45 : 20, 2);  // version made by
+      zip_write(d, extra ? 45 : 20, 2);  // version needed
+      zip_write(d, 0, 2);
+      zip_write(d, 0, 2);
+      zip_write(d, 0, 2);
+      zip_write(d, dos_date, 2);
+      zip_write(d, m.crc, 4);
+      zip_write(d, big ? zip_saturated : m.size, 4);
+      zip_write(d, big ? zip_saturated : m.size, 4);
+      zip_write(d, m.name.size(), 2);
+      zip_write(d, extra ? 4 + extra : 0, 2);
+      zip_write(d, 0, 2);  // comment
+      zip_write(d, 0, 2);  // disk
+      zip_write(d, 0, 2);  // internal attributes
+      zip_write(d, 0, 4);  // external attributes
+      zip_write(d, far ? zip_saturated : m.local, 4);
+      d.insert(d.end(), m.name.begin(), m.name.end());
+      if (extra) {
+        zip_write(d, 1, 2);
+        zip_write(d, extra, 2);
+        if (big) {
+          zip_write(d, m.size, 8);
+          zip_write(d, m.size, 8);
+        }
+        if (far) zip_write(d, m.local, 8);
+      }
+    }
+    uint64_t dir_size = d.size(), count = members.size();
+    if (count >= 0xffff || dir >= zip_saturated || dir_size >= zip_saturated) {
+      uint64_t eocd64 = dir + dir_size;
+      zip_write(d, 0x06064b50, 4);
+      zip_write(d, 44, 8);
+      zip_write(d, 45, 2);
+      zip_write(d, 45, 2);
+      zip_write(d, 0, 4);
+      zip_write(d, 0, 4);
+      zip_write(d, count, 8);
+      zip_write(d, count, 8);
+      zip_write(d, dir_size, 8);
+      zip_write(d, dir, 8);
+      zip_write(d, 0x07064b50, 4);
+      zip_write(d, 0, 4);
+      zip_write(d, eocd64, 8);
+      zip_write(d, 1, 4);
+      count = std::min<uint64_t>(count, 0xffff);
+      dir = std::min(dir, zip_saturated);
+      dir_size = std::min(dir_size, zip_saturated);
+    }
+    zip_write(d, 0x06054b50, 4);
+    zip_write(d, 0, 2);
+    zip_write(d, 0, 2);
+    zip_write(d, count, 2);
+    zip_write(d, count, 2);
+    zip_write(d, dir_size, 4);
+    zip_write(d, dir, 4);
+    zip_write(d, 0, 2);
+    put(d);
+    out.close();
+    if (!out) {
+      std::remove(temporary_path(path).c_str());
+      throw exceptions::io_error(path, "write failed");
+    }
+    replace_file(path);
+  }
+};
+
+}  // namespace io
+}  // namespace tensors
+
+#endif
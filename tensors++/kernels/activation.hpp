@@ -0,0 +1,81 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef ACTIVATION_HPP
+#define ACTIVATION_HPP
+
+#include <cmath>
+#include <string>
+#include <type_traits>
+
+#include "Eigen/Core"
+#include "tensors++/exceptions/tensor_operation.hpp"
+
+namespace tensors {
+namespace kernels {
+
+enum class activation { linear, relu, gelu, sigmoid, tanh };
+
+// Keras style names, "linear" or an empty string mean no activation
+inline activation activation_from_name(const std::string &name) {
+  if (name.empty() || name == "linear") return activation::linear;
+  if (name == "relu") return activation::relu;
+  if (name == "gelu") return activation::gelu;
+  if (name == "sigmoid") return activation::sigmoid;
+  if (name == "tanh") return activation::tanh;
+  throw exceptions::operation_undefined("Unknown activation " + name);
+}
+
+// dst = act(src) for Eigen array expressions. src may be a lazy expression
+// (a panel plus a broadcast bias, ...) so everything is computed in the
+// single pass that writes dst; dst may alias src element for element.
+template <class Dst, class Src>
+inline void activate(activation act, Dst &&dst, const Src &src) {
+  typedef typename std::decay<Dst>::type::Scalar dtype;
+  switch (act) {
+    case activation::linear:
+      dst = src;
+      break;
+    case activation::relu:
+      dst = src.max(dtype(0));
+      break;
+    case activation::gelu: {
+      // tanh approximation, as used by BERT and GPT
+      const dtype c = dtype(std::sqrt(2.0 / M_PI));
+      dst = dtype(0.5) * src *
+            (dtype(1) + (c * (src + dtype(0.044715) * src.cube())).tanh());
+      break;
+    }
+    case activation::sigmoid:
+      dst = dtype(1) / (dtype(1) + (-src).exp());
+      break;
+    case activation::tanh:
+      dst = src.tanh();
+      break;
+  }
+}
+
+template <class dtype>
+inline void apply_activation(activation act, dtype *x, size_t n) {
+  if (act == activation::linear) return;
+  Eigen::Map<Eigen::Array<dtype, Eigen::Dynamic, 1>> v(x, n);
+  activate(act, v, v);
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef ATTENTION_HPP
+#define ATTENTION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Eigen/Core"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/kernels/gemm.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Geometry of a scaled dot-product attention over several heads. Queries,
+// keys, values and the output are rows of head_count * dim elements, head h
+// at columns [h * dim, (h + 1) * dim), laid out with the given row and
+// batch strides so they can point straight into a fused QKV projection or
+// a KV cache.
+struct attention_params {
+  size_t batch = 1, heads = 1;
+  size_t q_len = 0, kv_len = 0;
+  size_t key_dim = 0, value_dim = 0;
+  size_t q_stride = 0, k_stride = 0, v_stride = 0, out_stride = 0;
+  size_t q_batch = 0, k_batch = 0, v_batch = 0, out_batch = 0;
+  // with causal set query i only sees keys up to q_start + i, q_start being
+  // the position of the first query among the keys (the cached length
+  // during incremental decoding)
+  bool causal = false;
+  size_t q_start = 0;
+};
+
+// query rows and keys of one tile, the score tile plus a query, key and
+// value tile of 64 wide heads stay within the L2 cache
+const size_t attention_block_q = 64;
+const size_t attention_block_kv = 64;
+
+// softmax(q k^T / sqrt(key_dim)) v without ever holding the [q_len, kv_len]
+// scores. Every task takes one tile of queries of one head and walks the
+// keys a tile at a time, keeping a running row maximum m and sum l of the
+// exponentials (online softmax): when a new tile raises m, the output
+// accumulated so far and l are rescaled by exp(m_old - m_new). Memory is
+// O(tile) per task and the key tiles past the diagonal of a causal
+// attention are skipped entirely.
+template <class dtype>
+void flash_attention(const attention_params &p, const dtype *q,
+                     const dtype *k, const dtype *v, dtype *out) {
+  typedef Eigen::Map<const row_major<dtype>, 0, Eigen::OuterStride<>>
+      const_strided;
+  typedef Eigen::Map<row_major<dtype>, 0, Eigen::OuterStride<>> strided;
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> column;
+  const dtype inf = std::numeric_limits<dtype>::infinity();
+  const dtype scale = dtype(1) / std::sqrt(dtype(p.key_dim));
+  size_t tiles = (p.q_len + attention_block_q - 1) / attention_block_q;
+
+  parallel::parallel_for(
+      p.batch * p.heads * tiles, 1, [&](size_t begin, size_t end) {
+        row_major<dtype> Q, S, O;
+        column m, l, m_new, correction;
+        for (size_t task = begin; task < end; task++) {
+          size_t tile = task % tiles, h = task / tiles % p.heads;
+          size_t b = task / tiles / p.heads;
+          size_t r0 = tile * attention_block_q;
+          size_t rows = std::min(attention_block_q, p.q_len - r0);
+          strided result(out + b * p.out_batch + r0 * p.out_stride +
+                             h * p.value_dim,
+                         rows, p.value_dim, Eigen::OuterStride<>(p.out_stride));
+          // keys visible to the last query of the tile
+          size_t limit = p.causal ? std::min(p.kv_len, p.q_start + r0 + rows)
+                                  : p.kv_len;
+          if (limit == 0) {
+            result.setZero();
+            continue;
+          }
+
+          Q = scale * const_strided(q + b * p.q_batch + r0 * p.q_stride +
+                                        h * p.key_dim,
+                                    rows, p.key_dim,
+                                    Eigen::OuterStride<>(p.q_stride));
+          O.setZero(rows, p.value_dim);
+          m.setConstant(rows, -inf);
+          l.setZero(rows);
+          for (size_t c0 = 0; c0 < limit; c0 += attention_block_kv) {
+            size_t cols = std::min(attention_block_kv, limit - c0);
+            S.noalias() =
+                Q * const_strided(k + b * p.k_batch + c0 * p.k_stride +
+                                      h * p.key_dim,
+                                  cols, p.key_dim,
+                                  Eigen::OuterStride<>(p.k_stride))
+                        .transpose();
+            // only the tiles crossing the diagonal need a mask
+            if (p.causal && c0 + cols > p.q_start + r0 + 1)
+              for (size_t i = 0; i < rows; i++)
+                for (size_t j = std::max(c0, p.q_start + r0 + i + 1);
+                     j < c0 + cols; j++)
+                  S(i, j - c0) = -inf;
+            // key 0 is visible to every query, so m is finite after the
+            // first tile and rows masked out of a later tile add nothing
+            m_new = m.max(S.rowwise().maxCoeff().array());
+            correction = (m - m_new).exp();
+            S = (S.array().colwise() - m_new).exp().matrix();
+            l = l * correction + S.rowwise().sum().array();
+            O.array().colwise() *= correction;
+            O.noalias() +=
+                S * const_strided(v + b * p.v_batch + c0 * p.v_stride +
+                                      h * p.value_dim,
+                                  cols, p.value_dim,
+                                  Eigen::OuterStride<>(p.v_stride));
+            m.swap(m_new);
+          }
+          result = (O.array().colwise() / l).matrix();
+        }
+      });
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef BATCH_NORM_KERNELS_HPP
+#define BATCH_NORM_KERNELS_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/core/parallel.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Per channel mean and (biased) variance of [rows, channels] in a single
+// pass over the data. Every block of rows accumulates the sum and the sum
+// of squares of x - x[0], vectorized over the channels; shifting by the
+// first row keeps the E[x^2] - E[x]^2 form from cancelling badly when the
+// mean is large next to the spread. Blocks run in parallel and their
+// partial sums are added at the end.
+template <class dtype>
+void channel_moments(const dtype *x, size_t rows, size_t channels,
+                     dtype *mean, dtype *variance) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  typedef Eigen::Map<const array> const_map;
+  if (rows == 0) return;
+  size_t block = std::max<size_t>(1, 4096 / std::max<size_t>(channels, 1));
+  size_t blocks = (rows + block - 1) / block;
+  std::vector<dtype> partial(2 * blocks * channels, dtype(0));
+  const_map shift(x, channels);
+
+  parallel::parallel_for(blocks, 1, [&](size_t begin, size_t end) {
+    array d(channels);
+    for (size_t b = begin; b < end; b++) {
+      Eigen::Map<array> s1(partial.data() + 2 * b * channels, channels);
+      Eigen::Map<array> s2(partial.data() + (2 * b + 1) * channels,
+                           channels);
+      for (size_t r = b * block; r < std::min(rows, (b + 1) * block); r++) {
+        d = const_map(x + r * channels, channels) - shift;
+        s1 += d;
+        s2 += d.square();
+      }
+    }
+  });
+
+  array s1 = array::Zero(channels), s2 = array::Zero(channels);
+  for (size_t b = 0; b < blocks; b++) {
+    s1 += const_map(partial.data() + 2 * b * channels, channels);
+    s2 += const_map(partial.data() + (2 * b + 1) * channels, channels);
+  }
+  s1 /= dtype(rows);
+  Eigen::Map<array>(mean, channels) = shift + s1;
+  Eigen::Map<array>(variance, channels) =
+      (s2 / dtype(rows) - s1.square()).max(dtype(0));
+}
+
+// out = x * scale + shift per channel, the whole normalization in one pass
+template <class dtype>
+void channel_affine(const dtype *x, size_t rows, size_t channels,
+                    const dtype *scale, const dtype *shift, dtype *out) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  typedef Eigen::Map<const array> const_map;
+  const_map a(scale, channels), b(shift, channels);
+  size_t grain = std::max<size_t>(1, 16384 / std::max<size_t>(channels, 1));
+  parallel::parallel_for(rows, grain, [&](size_t begin, size_t end) {
+    for (size_t r = begin; r < end; r++)
+      Eigen::Map<array>(out + r * channels, channels) =
+          const_map(x + r * channels, channels) * a + b;
+  });
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
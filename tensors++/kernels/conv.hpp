@@ -0,0 +1,255 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CONV_HPP
+#define CONV_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "Eigen/Core"
+#include "unsupported/Eigen/CXX11/Tensor"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/kernels/activation.hpp"
+#include "tensors++/kernels/gemm.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Geometry of a 2-D convolution. Images are NHWC, filters HWIO
+// ([kernel_h, kernel_w, in_c / groups, out_c]) and outputs NHWC.
+struct conv2d_params {
+  size_t batch = 1, in_h = 0, in_w = 0, in_c = 0;
+  size_t out_c = 0, kernel_h = 1, kernel_w = 1;
+  size_t stride_h = 1, stride_w = 1;
+  size_t dilation_h = 1, dilation_w = 1;
+  size_t pad_top = 0, pad_bottom = 0, pad_left = 0, pad_right = 0;
+  size_t groups = 1;
+
+  inline size_t out_h() const {
+    return (in_h + pad_top + pad_bottom - dilation_h * (kernel_h - 1) - 1) /
+               stride_h +
+           1;
+  }
+  inline size_t out_w() const {
+    return (in_w + pad_left + pad_right - dilation_w * (kernel_w - 1) - 1) /
+               stride_w +
+           1;
+  }
+  inline size_t group_in() const { return in_c / groups; }
+  inline size_t group_out() const { return out_c / groups; }
+  // length of one im2col row, the reduction dimension of the GEMM
+  inline size_t patch_size() const { return kernel_h * kernel_w * group_in(); }
+  inline bool pointwise() const {
+    return kernel_h == 1 && kernel_w == 1 && stride_h == 1 && stride_w == 1 &&
+           pad_top + pad_bottom + pad_left + pad_right == 0 && groups == 1;
+  }
+};
+
+enum class conv_algorithm { automatic, im2col, direct, winograd, fft };
+
+// Winograd (kernels/winograd.hpp) applies to 3x3 kernels with unit stride
+// and dilation. Grouped convolutions are left to the other kernels.
+inline bool winograd_applicable(const conv2d_params &p) {
+  return p.kernel_h == 3 && p.kernel_w == 3 && p.stride_h == 1 &&
+         p.stride_w == 1 && p.dilation_h == 1 && p.dilation_w == 1 &&
+         p.groups == 1;
+}
+
+// im2col turns the convolution into one large GEMM, which wins whenever the
+// reduction dimension is long enough to keep the GEMM efficient. With few
+// input channels per group the patch matrix is mostly replicated input for
+// little arithmetic, there the direct kernel does better. 3x3 layers with
+// enough channels to amortize the tile transforms go to Winograd, and
+// kernels of 7x7 and up to the FFT (kernels/fft_conv.hpp) as long as their
+// filter spectra, one padded image per channel pair, stay below 64 MB.
+// The spectra only pay off when they are reused, allow_fft is false for a
+// filter that may change between calls.
+template <class dtype = float>
+inline conv_algorithm choose_conv_algorithm(const conv2d_params &p,
+                                            bool allow_fft = true) {
+  if (p.pointwise()) return conv_algorithm::im2col;
+  size_t padded = (p.in_h + p.pad_top + p.pad_bottom) *
+                  (p.in_w + p.pad_left + p.pad_right);
+  if (allow_fft && p.groups == 1 && p.stride_h == 1 && p.stride_w == 1 &&
+      p.kernel_h * p.kernel_w >= 49 &&
+      p.in_c * p.out_c * padded * sizeof(dtype) <= (size_t(64) << 20))
+    return conv_algorithm::fft;
+  if (winograd_applicable(p) && p.in_c >= 16 && p.out_c >= 16)
+    return conv_algorithm::winograd;
+  if (p.group_in() <= 16 || p.patch_size() < 64) return conv_algorithm::direct;
+  return conv_algorithm::im2col;
+}
+
+// Filters as one contiguous [patch_size, group_out] matrix per group, the
+// right hand side of the im2col GEMM. With a single group that is the HWIO
+// filter as is.
+template <class dtype>
+std::vector<dtype> pack_im2col_filter(const conv2d_params &p,
+                                      const dtype *filter) {
+  size_t k = p.patch_size(), og = p.group_out();
+  std::vector<dtype> packed(p.groups * k * og);
+  for (size_t g = 0; g < p.groups; g++)
+    for (size_t r = 0; r < k; r++)
+      std::copy(filter + r * p.out_c + g * og,
+                filter + r * p.out_c + (g + 1) * og,
+                packed.begin() + (g * k + r) * og);
+  return packed;
+}
+
+// Convolution as patch extraction (Eigen's extract_image_patches) followed
+// by a GEMM with the bias and activation epilogue. `filter` comes from
+// pack_im2col_filter unless groups == 1, where the plain HWIO filter works.
+template <class dtype>
+void conv2d_im2col(const conv2d_params &p, const dtype *input,
+                   const dtype *filter, const dtype *bias, dtype *output,
+                   activation act = activation::linear) {
+  typedef Eigen::TensorMap<const Eigen::Tensor<dtype, 4, Eigen::RowMajor>>
+      image_map;
+  typedef Eigen::TensorMap<Eigen::Tensor<dtype, 2, Eigen::RowMajor>>
+      matrix_map;
+  size_t oh = p.out_h(), ow = p.out_w(), pixels = oh * ow;
+  size_t k = p.patch_size(), og = p.group_out();
+
+  // a 1x1 convolution is a GEMM over the pixels, nothing to extract
+  if (p.pointwise()) {
+    gemm_bias_activation(input, filter, bias, output,
+                         p.batch * p.in_h * p.in_w, p.in_c, p.out_c, act);
+    return;
+  }
+
+  auto image = [&](size_t n, dtype *cols, dtype *result) {
+    // this Eigen version takes a mutable pointer even for const maps
+    image_map x(const_cast<dtype *>(input) + n * p.in_h * p.in_w * p.in_c,
+                Eigen::Index(1), Eigen::Index(p.in_h), Eigen::Index(p.in_w),
+                Eigen::Index(p.in_c));
+    for (size_t g = 0; g < p.groups; g++) {
+      Eigen::array<Eigen::Index, 4> offsets{0, 0, 0,
+                                            Eigen::Index(g * p.group_in())};
+      Eigen::array<Eigen::Index, 4> extents{1, Eigen::Index(p.in_h),
+                                            Eigen::Index(p.in_w),
+                                            Eigen::Index(p.group_in())};
+      Eigen::array<Eigen::Index, 2> dims{Eigen::Index(pixels),
+                                         Eigen::Index(k)};
+      // in row major NHWC Eigen calls the width "rows" and the height
+      // "cols", hence the swapped arguments
+      matrix_map(cols, Eigen::Index(pixels), Eigen::Index(k)) =
+          x.slice(offsets, extents)
+              .extract_image_patches(p.kernel_w, p.kernel_h, p.stride_w,
+                                     p.stride_h, p.dilation_w, p.dilation_h,
+                                     1, 1, p.pad_left, p.pad_right,
+                                     p.pad_top, p.pad_bottom, dtype(0))
+              .reshape(dims);
+      dtype *dst = p.groups == 1 ? output + n * pixels * p.out_c : result;
+      gemm_bias_activation(cols, filter + g * k * og,
+                           bias ? bias + g * og : nullptr, dst, pixels, k, og,
+                           act);
+      if (p.groups > 1)
+        for (size_t px = 0; px < pixels; px++)
+          std::copy(result + px * og, result + (px + 1) * og,
+                    output + (n * pixels + px) * p.out_c + g * og);
+    }
+  };
+
+  // a batch is spread over the pool one image per task, a single image
+  // gets its parallelism from the GEMM panels instead
+  parallel::parallel_for(p.batch, 1, [&](size_t begin, size_t end) {
+    std::vector<dtype> cols(pixels * k);
+    std::vector<dtype> result(p.groups > 1 ? pixels * og : 0);
+    for (size_t n = begin; n < end; n++)
+      image(n, cols.data(), result.data());
+  });
+}
+
+// output channels computed together by the direct kernel, one vector
+// register of floats with AVX
+const size_t conv_block = 8;
+
+// Filters for the direct kernel in blocked layout
+// [groups][blocks][kernel_h][kernel_w][group_in][conv_block], the output
+// channels of a block contiguous and the last block zero padded.
+template <class dtype>
+std::vector<dtype> pack_direct_filter(const conv2d_params &p,
+                                      const dtype *filter) {
+  size_t og = p.group_out(), ig = p.group_in();
+  size_t blocks = (og + conv_block - 1) / conv_block;
+  size_t taps = p.kernel_h * p.kernel_w;
+  std::vector<dtype> packed(p.groups * blocks * taps * ig * conv_block,
+                            dtype(0));
+  for (size_t g = 0; g < p.groups; g++)
+    for (size_t b = 0; b < blocks; b++)
+      for (size_t t = 0; t < taps; t++)
+        for (size_t c = 0; c < ig; c++)
+          for (size_t j = 0; j < conv_block && b * conv_block + j < og; j++)
+            packed[(((g * blocks + b) * taps + t) * ig + c) * conv_block + j] =
+                filter[(t * ig + c) * p.out_c + g * og + b * conv_block + j];
+  return packed;
+}
+
+// Direct convolution over NHWC input. Every output pixel accumulates a
+// block of output channels in registers, the input channels of each tap
+// are read once per block and broadcast against the packed filter, which
+// stays in L1. Output rows are distributed over the pool.
+template <class dtype>
+void conv2d_direct(const conv2d_params &p, const dtype *input,
+                   const dtype *packed, const dtype *bias, dtype *output,
+                   activation act = activation::linear) {
+  size_t oh = p.out_h(), ow = p.out_w();
+  size_t og = p.group_out(), ig = p.group_in();
+  size_t blocks = (og + conv_block - 1) / conv_block;
+  size_t taps = p.kernel_h * p.kernel_w;
+
+  parallel::parallel_for(p.batch * oh, 1, [&](size_t begin, size_t end) {
+    dtype acc[conv_block];
+    for (size_t row = begin; row < end; row++) {
+      size_t n = row / oh, y = row % oh;
+      const dtype *image = input + n * p.in_h * p.in_w * p.in_c;
+      dtype *out_row = output + row * ow * p.out_c;
+      for (size_t g = 0; g < p.groups; g++)
+        for (size_t b = 0; b < blocks; b++) {
+          const dtype *w = packed + (g * blocks + b) * taps * ig * conv_block;
+          size_t first = g * og + b * conv_block;
+          size_t width = std::min(conv_block, og - b * conv_block);
+          for (size_t x = 0; x < ow; x++) {
+            for (size_t j = 0; j < conv_block; j++)
+              acc[j] = bias && j < width ? bias[first + j] : dtype(0);
+            for (size_t ky = 0; ky < p.kernel_h; ky++) {
+              long iy = long(y * p.stride_h + ky * p.dilation_h) -
+                        long(p.pad_top);
+              if (iy < 0 || iy >= long(p.in_h)) continue;
+              for (size_t kx = 0; kx < p.kernel_w; kx++) {
+                long ix = long(x * p.stride_w + kx * p.dilation_w) -
+                          long(p.pad_left);
+                if (ix < 0 || ix >= long(p.in_w)) continue;
+                const dtype *in = image + (iy * p.in_w + ix) * p.in_c + g * ig;
+                const dtype *wt = w + (ky * p.kernel_w + kx) * ig * conv_block;
+                for (size_t c = 0; c < ig; c++)
+                  for (size_t j = 0; j < conv_block; j++)
+                    acc[j] += in[c] * wt[c * conv_block + j];
+              }
+            }
+            apply_activation(act, acc, conv_block);
+            std::copy(acc, acc + width, out_row + x * p.out_c + first);
+          }
+        }
+    }
+  });
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
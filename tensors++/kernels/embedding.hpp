@@ -0,0 +1,121 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef EMBEDDING_HPP
+#define EMBEDDING_HPP
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// A gradient that touches only some rows of a [rows, dim] table: the
+// distinct row indices in ascending order and one dim wide row of values
+// for each.
+template <class dtype>
+struct sparse_rows {
+  size_t dim = 0;
+  std::vector<size_t> indices;
+  std::vector<dtype> values;
+
+  inline size_t size() const { return indices.size(); }
+  inline dtype *row(size_t i) { return values.data() + i * dim; }
+  inline const dtype *row(size_t i) const { return values.data() + i * dim; }
+};
+
+// whether `id` addresses one of `rows` rows, the sign is only tested for
+// signed id types
+template <class index>
+inline bool row_in_range(index id, size_t rows, std::true_type) {
+  return id >= index(0) && size_t(id) < rows;
+}
+
+template <class index>
+inline bool row_in_range(index id, size_t rows, std::false_type) {
+  return size_t(id) < rows;
+}
+
+// throws unless every id addresses a row of a table with `rows` rows
+template <class index>
+void check_row_ids(const index *ids, size_t n, size_t rows) {
+  for (size_t i = 0; i < n; i++)
+    if (!row_in_range(ids[i], rows, std::is_signed<index>()))
+      throw exceptions::operation_undefined(
+          "Row index " + std::to_string(ids[i]) +
+          " is out of range for a table of " + std::to_string(rows) +
+          " rows");
+}
+
+// out[i] = table[ids[i]] for n rows of dim elements into a preallocated
+// [n, dim] output. The ids are checked first; the copies then run in
+// parallel, each row one contiguous (vectorized) copy.
+template <class dtype, class index>
+void gather_rows(const dtype *table, size_t rows, size_t dim,
+                 const index *ids, size_t n, dtype *out) {
+  check_row_ids(ids, n, rows);
+  size_t grain = std::max<size_t>(1, 8192 / std::max<size_t>(dim, 1));
+  parallel::parallel_for(n, grain, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      std::copy_n(table + size_t(ids[i]) * dim, dim, out + i * dim);
+  });
+}
+
+// Gradient of gather_rows: the rows of grad ([n, dim]) summed per distinct
+// id. Only the looked up rows are produced, never a table sized gradient.
+template <class dtype, class index>
+sparse_rows<dtype> scatter_rows(const index *ids, size_t n,
+                                const dtype *grad, size_t dim) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [ids](size_t a, size_t b) { return ids[a] < ids[b]; });
+
+  sparse_rows<dtype> result;
+  result.dim = dim;
+  std::vector<size_t> starts;  // first position in order of every id
+  for (size_t i = 0; i < n; i++)
+    if (i == 0 || ids[order[i]] != ids[order[i - 1]]) {
+      starts.push_back(i);
+      result.indices.push_back(size_t(ids[order[i]]));
+    }
+  starts.push_back(n);
+  result.values.assign(result.indices.size() * dim, dtype(0));
+
+  size_t grain = std::max<size_t>(1, 8192 / std::max<size_t>(dim, 1));
+  parallel::parallel_for(
+      result.indices.size(), grain, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+          Eigen::Map<array> sum(result.row(r), dim);
+          for (size_t i = starts[r]; i < starts[r + 1]; i++)
+            sum += Eigen::Map<const array>(grad + order[i] * dim, dim);
+        }
+      });
+  return result;
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,397 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef FFT_CONV_HPP
+#define FFT_CONV_HPP
+
+#include <algorithm>
+#include <complex>
+#include <memory>
+#include <vector>
+
+#include "Eigen/Core"
+#include "unsupported/Eigen/FFT"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/kernels/activation.hpp"
+#include "tensors++/kernels/conv.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Convolution through the frequency domain. A correlation with a K tap
+// filter costs O(N K) directly but O(N log N) as a product of spectra, which
+// wins for long kernels. Filters are transformed once into spectra that are
+// reused for every input; the 1/N scaling of the inverse transform is folded
+// into them. All transforms are real: only the n / 2 + 1 non redundant bins
+// are stored and multiplied.
+
+// smallest size >= n that factors into 2, 3 and 5 (the radices kissfft
+// handles fastest), even so the real transforms take the fast path
+inline size_t fft_size(size_t n) {
+  for (size_t s = std::max<size_t>(n, 2);; s++) {
+    if (s % 2) continue;
+    size_t r = s;
+    for (size_t f : {2, 3, 5})
+      while (r % f == 0) r /= f;
+    if (r == 1) return s;
+  }
+}
+
+template <class dtype>
+inline Eigen::FFT<dtype> make_fft() {
+  Eigen::FFT<dtype> fft;
+  fft.SetFlag(Eigen::FFT<dtype>::HalfSpectrum);
+  fft.SetFlag(Eigen::FFT<dtype>::Unscaled);
+  return fft;
+}
+
+// Filter spectra of a 1-D convolution (in_h == 1 and kernel_h == 1 in the
+// conv2d_params), for overlap-add blocks of `block` frames transformed at
+// size n = block + span - 1, span being the dilated filter length.
+template <class dtype>
+struct conv1d_spectra {
+  size_t span = 0, in_c = 0, out_c = 0, n = 0, block = 0;
+  std::vector<std::complex<dtype>> w;  // [in_c][out_c][n / 2 + 1]
+
+  inline size_t bins() const { return n / 2 + 1; }
+  inline const std::complex<dtype> *at(size_t c, size_t o) const {
+    return w.data() + (c * out_c + o) * bins();
+  }
+};
+
+// The filter is [kernel_w, in_c, out_c] (the HWIO filter of a 1 row
+// convolution). Correlation is a convolution with the reversed filter, so
+// the taps are stored reversed.
+template <class dtype>
+conv1d_spectra<dtype> fft_conv1d_spectra(const conv2d_params &p,
+                                         const dtype *filter) {
+  conv1d_spectra<dtype> s;
+  s.span = p.dilation_w * (p.kernel_w - 1) + 1;
+  s.in_c = p.in_c;
+  s.out_c = p.out_c;
+  // four times the span keeps the overlap, the part of every transform
+  // spent on the previous block, at a quarter
+  s.n = fft_size(4 * s.span);
+  s.block = s.n - s.span + 1;
+  s.w.resize(s.in_c * s.out_c * s.bins());
+
+  Eigen::FFT<dtype> fft = make_fft<dtype>();
+  std::vector<dtype> taps(s.n);
+  dtype scale = dtype(1) / dtype(s.n);
+  for (size_t c = 0; c < s.in_c; c++)
+    for (size_t o = 0; o < s.out_c; o++) {
+      std::fill(taps.begin(), taps.end(), dtype(0));
+      for (size_t k = 0; k < p.kernel_w; k++)
+        taps[s.span - 1 - k * p.dilation_w] =
+            scale * filter[(k * s.in_c + c) * s.out_c + o];
+      fft.fwd(s.w.data() + (c * s.out_c + o) * s.bins(), taps.data(), s.n);
+    }
+  return s;
+}
+
+// per thread buffers of the 1-D overlap-add
+template <class dtype>
+struct conv1d_scratch {
+  Eigen::FFT<dtype> fft = make_fft<dtype>();
+  std::vector<dtype> real;
+  std::vector<std::complex<dtype>> x, acc;
+
+  explicit conv1d_scratch(const conv1d_spectra<dtype> &s)
+      : real(s.n), x(s.in_c * s.bins()), acc(s.bins()) {}
+};
+
+// Adds the full convolution of `count` <= block frames of x ([count, in_c])
+// with the reversed filters to z ([count + span - 1, out_c]).
+template <class dtype>
+void fft_conv1d_block(const conv1d_spectra<dtype> &s, conv1d_scratch<dtype> &b,
+                      const dtype *x, size_t count, dtype *z) {
+  typedef Eigen::Array<std::complex<dtype>, Eigen::Dynamic, 1> spectrum;
+  typedef Eigen::Map<spectrum> spectrum_map;
+  typedef Eigen::Map<const spectrum> const_spectrum_map;
+  size_t bins = s.bins();
+  for (size_t c = 0; c < s.in_c; c++) {
+    std::fill(b.real.begin(), b.real.end(), dtype(0));
+    for (size_t t = 0; t < count; t++) b.real[t] = x[t * s.in_c + c];
+    b.fft.fwd(b.x.data() + c * bins, b.real.data(), s.n);
+  }
+  size_t produced = count + s.span - 1;
+  for (size_t o = 0; o < s.out_c; o++) {
+    spectrum_map acc(b.acc.data(), bins);
+    acc = const_spectrum_map(b.x.data(), bins) *
+          const_spectrum_map(s.at(0, o), bins);
+    for (size_t c = 1; c < s.in_c; c++)
+      acc += const_spectrum_map(b.x.data() + c * bins, bins) *
+             const_spectrum_map(s.at(c, o), bins);
+    b.fft.inv(b.real.data(), b.acc.data(), s.n);
+    for (size_t t = 0; t < produced; t++) z[t * s.out_c + o] += b.real[t];
+  }
+}
+
+// 1-D convolution of NWC input through overlap-add, with padding, stride
+// and the bias and activation epilogue. Every signal is cut into blocks
+// whose convolutions overlap by span - 1 frames and are summed. Signals of
+// a batch run in parallel.
+template <class dtype>
+void conv1d_fft(const conv2d_params &p, const conv1d_spectra<dtype> &s,
+                const dtype *input, const dtype *bias, dtype *output,
+                activation act = activation::linear) {
+  size_t length = p.in_w + p.pad_left + p.pad_right, ow = p.out_w();
+  parallel::parallel_for(p.batch, 1, [&](size_t begin, size_t end) {
+    conv1d_scratch<dtype> scratch(s);
+    std::vector<dtype> padded(length * p.in_c);
+    std::vector<dtype> z((length + s.span - 1) * p.out_c);
+    for (size_t n = begin; n < end; n++) {
+      std::fill(padded.begin(), padded.end(), dtype(0));
+      const dtype *signal = input + n * p.in_w * p.in_c;
+      std::copy(signal, signal + p.in_w * p.in_c,
+                padded.begin() + p.pad_left * p.in_c);
+      std::fill(z.begin(), z.end(), dtype(0));
+      for (size_t t = 0; t < length; t += s.block)
+        fft_conv1d_block(s, scratch, padded.data() + t * p.in_c,
+                         std::min(s.block, length - t),
+                         z.data() + t * p.out_c);
+      // the valid correlation starts span - 1 frames into z
+      dtype *out = output + n * ow * p.out_c;
+      for (size_t t = 0; t < ow; t++) {
+        const dtype *src = z.data() + (t * p.stride_w + s.span - 1) * p.out_c;
+        for (size_t o = 0; o < p.out_c; o++)
+          out[t * p.out_c + o] = src[o] + (bias ? bias[o] : dtype(0));
+      }
+      apply_activation(act, out, ow * p.out_c);
+    }
+  });
+}
+
+// Streaming valid correlation (unit stride) of one signal that arrives in
+// chunks of any size. Each push convolves the new frames with the cached
+// spectra and emits every output that has become complete, the last
+// span - 1 frames of partial sums are carried over to the next push.
+template <class dtype>
+class conv1d_stream {
+  std::shared_ptr<const conv1d_spectra<dtype>> spectra;
+  conv1d_scratch<dtype> scratch;
+  const dtype *bias;
+  activation act;
+  std::vector<dtype> z;  // carried partial sums, then the current chunk
+  size_t warmup;         // frames still needed before the first output
+
+ public:
+  conv1d_stream(std::shared_ptr<const conv1d_spectra<dtype>> s,
+                const dtype *bias = nullptr,
+                activation act = activation::linear)
+      : spectra(std::move(s)),
+        scratch(*spectra),
+        bias(bias),
+        act(act),
+        z((spectra->span - 1) * spectra->out_c, dtype(0)),
+        warmup(spectra->span - 1) {}
+
+  // frames is [count, in_c], complete outputs are appended to out as
+  // [frames, out_c]
+  void push(const dtype *frames, size_t count, std::vector<dtype> &out) {
+    const conv1d_spectra<dtype> &s = *spectra;
+    size_t carry = (s.span - 1) * s.out_c;
+    for (size_t t = 0; t < count; t += s.block) {
+      size_t chunk = std::min(s.block, count - t);
+      z.resize(carry + chunk * s.out_c);
+      std::fill(z.begin() + carry, z.end(), dtype(0));
+      fft_conv1d_block(s, scratch, frames + t * s.in_c, chunk, z.data());
+      // the first `chunk` frames of z are complete now
+      size_t skip = std::min(warmup, chunk);
+      warmup -= skip;
+      size_t first = out.size();
+      out.insert(out.end(), z.begin() + skip * s.out_c,
+                 z.begin() + chunk * s.out_c);
+      if (bias)
+        for (size_t i = first; i < out.size(); i++)
+          out[i] += bias[(i - first) % s.out_c];
+      apply_activation(act, out.data() + first, out.size() - first);
+      std::copy(z.begin() + chunk * s.out_c, z.end(), z.begin());
+      z.resize(carry);
+    }
+  }
+
+  // forgets the signal seen so far, the spectra stay
+  void reset() {
+    std::fill(z.begin(), z.end(), dtype(0));
+    warmup = spectra->span - 1;
+  }
+};
+
+// Filter spectra of a 2-D convolution at the transform size of the padded
+// input. Only the valid part of the correlation is kept, so the transform
+// only has to be as large as the padded image: the circular wrap of the
+// full convolution lands in rows and columns that are discarded.
+template <class dtype>
+struct conv2d_spectra {
+  size_t nh = 0, nw = 0, in_c = 0, out_c = 0;
+  std::vector<std::complex<dtype>> w;  // [in_c][out_c][nh][nw / 2 + 1]
+
+  inline size_t bins() const { return nh * (nw / 2 + 1); }
+  inline const std::complex<dtype> *at(size_t c, size_t o) const {
+    return w.data() + (c * out_c + o) * bins();
+  }
+  bool matches(const conv2d_params &p) const {
+    return nh == fft_size(p.in_h + p.pad_top + p.pad_bottom) &&
+           nw == fft_size(p.in_w + p.pad_left + p.pad_right) &&
+           in_c == p.in_c && out_c == p.out_c;
+  }
+};
+
+// bytes held by the spectra of a convolution, they grow with the image and
+// with in_c * out_c
+template <class dtype>
+inline size_t fft_conv2d_spectra_bytes(const conv2d_params &p) {
+  return p.in_c * p.out_c * fft_size(p.in_h + p.pad_top + p.pad_bottom) *
+         (fft_size(p.in_w + p.pad_left + p.pad_right) / 2 + 1) *
+         sizeof(std::complex<dtype>);
+}
+
+// real 2-D transform of [nh, nw] into [nh, nw / 2 + 1]: the rows as real
+// transforms, then the columns of bins as complex ones
+template <class dtype>
+void fft2_forward(Eigen::FFT<dtype> &fft, const dtype *src,
+                  std::complex<dtype> *dst, size_t nh, size_t nw,
+                  std::vector<std::complex<dtype>> &column) {
+  size_t cols = nw / 2 + 1;
+  for (size_t r = 0; r < nh; r++) fft.fwd(dst + r * cols, src + r * nw, nw);
+  if (nh == 1) return;
+  column.resize(2 * nh);
+  for (size_t c = 0; c < cols; c++) {
+    for (size_t r = 0; r < nh; r++) column[r] = dst[r * cols + c];
+    fft.fwd(column.data() + nh, column.data(), nh);
+    for (size_t r = 0; r < nh; r++) dst[r * cols + c] = column[nh + r];
+  }
+}
+
+// inverse of fft2_forward, unscaled; src is overwritten
+template <class dtype>
+void fft2_inverse(Eigen::FFT<dtype> &fft, std::complex<dtype> *src,
+                  dtype *dst, size_t nh, size_t nw,
+                  std::vector<std::complex<dtype>> &column) {
+  size_t cols = nw / 2 + 1;
+  if (nh > 1) {
+    column.resize(2 * nh);
+    for (size_t c = 0; c < cols; c++) {
+      for (size_t r = 0; r < nh; r++) column[r] = src[r * cols + c];
+      fft.inv(column.data() + nh, column.data(), nh);
+      for (size_t r = 0; r < nh; r++) src[r * cols + c] = column[nh + r];
+    }
+  }
+  for (size_t r = 0; r < nh; r++) fft.inv(dst + r * nw, src + r * cols, nw);
+}
+
+// HWIO filter to spectra at the transform size of the input of p. Dilation
+// is applied by spreading the taps, groups are not supported.
+template <class dtype>
+conv2d_spectra<dtype> fft_conv2d_spectra(const conv2d_params &p,
+                                         const dtype *filter) {
+  conv2d_spectra<dtype> s;
+  s.nh = fft_size(p.in_h + p.pad_top + p.pad_bottom);
+  s.nw = fft_size(p.in_w + p.pad_left + p.pad_right);
+  s.in_c = p.in_c;
+  s.out_c = p.out_c;
+  s.w.resize(s.in_c * s.out_c * s.bins());
+  size_t span_h = p.dilation_h * (p.kernel_h - 1) + 1;
+  size_t span_w = p.dilation_w * (p.kernel_w - 1) + 1;
+  dtype scale = dtype(1) / dtype(s.nh * s.nw);
+
+  parallel::parallel_for(s.in_c, 1, [&](size_t begin, size_t end) {
+    Eigen::FFT<dtype> fft = make_fft<dtype>();
+    std::vector<dtype> taps(s.nh * s.nw);
+    std::vector<std::complex<dtype>> column;
+    for (size_t c = begin; c < end; c++)
+      for (size_t o = 0; o < s.out_c; o++) {
+        std::fill(taps.begin(), taps.end(), dtype(0));
+        for (size_t ky = 0; ky < p.kernel_h; ky++)
+          for (size_t kx = 0; kx < p.kernel_w; kx++)
+            taps[(span_h - 1 - ky * p.dilation_h) * s.nw + span_w - 1 -
+                 kx * p.dilation_w] =
+                scale *
+                filter[((ky * p.kernel_w + kx) * s.in_c + c) * s.out_c + o];
+        fft2_forward(fft, taps.data(),
+                     s.w.data() + (c * s.out_c + o) * s.bins(), s.nh, s.nw,
+                     column);
+      }
+  });
+  return s;
+}
+
+// 2-D convolution of NHWC input as a product of whole image spectra, for
+// large kernels. Per image all input channels are transformed, then every
+// output channel sums its products and transforms back; both steps are
+// spread over the pool. Strides are taken by subsampling the valid
+// correlation.
+template <class dtype>
+void conv2d_fft(const conv2d_params &p, const conv2d_spectra<dtype> &s,
+                const dtype *input, const dtype *bias, dtype *output,
+                activation act = activation::linear) {
+  typedef Eigen::Array<std::complex<dtype>, Eigen::Dynamic, 1> spectrum;
+  typedef Eigen::Map<spectrum> spectrum_map;
+  typedef Eigen::Map<const spectrum> const_spectrum_map;
+  size_t oh = p.out_h(), ow = p.out_w(), bins = s.bins();
+  size_t span_h = p.dilation_h * (p.kernel_h - 1) + 1;
+  size_t span_w = p.dilation_w * (p.kernel_w - 1) + 1;
+  std::vector<std::complex<dtype>> x(p.in_c * bins);
+
+  for (size_t n = 0; n < p.batch; n++) {
+    const dtype *image = input + n * p.in_h * p.in_w * p.in_c;
+    dtype *out = output + n * oh * ow * p.out_c;
+
+    parallel::parallel_for(p.in_c, 1, [&](size_t begin, size_t end) {
+      Eigen::FFT<dtype> fft = make_fft<dtype>();
+      std::vector<dtype> plane(s.nh * s.nw);
+      std::vector<std::complex<dtype>> column;
+      for (size_t c = begin; c < end; c++) {
+        std::fill(plane.begin(), plane.end(), dtype(0));
+        for (size_t y = 0; y < p.in_h; y++)
+          for (size_t v = 0; v < p.in_w; v++)
+            plane[(y + p.pad_top) * s.nw + v + p.pad_left] =
+                image[(y * p.in_w + v) * p.in_c + c];
+        fft2_forward(fft, plane.data(), x.data() + c * bins, s.nh, s.nw,
+                     column);
+      }
+    });
+
+    parallel::parallel_for(p.out_c, 1, [&](size_t begin, size_t end) {
+      Eigen::FFT<dtype> fft = make_fft<dtype>();
+      std::vector<dtype> plane(s.nh * s.nw);
+      std::vector<std::complex<dtype>> acc(bins), column;
+      spectrum_map a(acc.data(), bins);
+      for (size_t o = begin; o < end; o++) {
+        a = const_spectrum_map(x.data(), bins) *
+            const_spectrum_map(s.at(0, o), bins);
+        for (size_t c = 1; c < p.in_c; c++)
+          a += const_spectrum_map(x.data() + c * bins, bins) *
+               const_spectrum_map(s.at(c, o), bins);
+        fft2_inverse(fft, acc.data(), plane.data(), s.nh, s.nw, column);
+        dtype b = bias ? bias[o] : dtype(0);
+        for (size_t y = 0; y < oh; y++)
+          for (size_t v = 0; v < ow; v++)
+            out[(y * ow + v) * p.out_c + o] =
+                plane[(y * p.stride_h + span_h - 1) * s.nw +
+                      v * p.stride_w + span_w - 1] +
+                b;
+      }
+    });
+    apply_activation(act, out, oh * ow * p.out_c);
+  }
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,478 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/core/cpu_features.hpp"
+#include "tensors++/core/half.hpp"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/kernels/activation.hpp"
+
+namespace tensors {
+namespace kernels {
+
+template <class dtype>
+using row_major =
+    Eigen::Matrix<dtype, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// Rows of the output computed per panel, sized so a panel of C stays in the
+// L2 cache between the multiply and the epilogue.
+template <class dtype>
+inline size_t gemm_panel_rows(size_t n) {
+  const size_t l2_elements = (256 * 1024) / sizeof(dtype);
+  return std::max<size_t>(4, std::min<size_t>(256, l2_elements / (4 * n + 1)));
+}
+
+// c[m, n] = act(a[m, k] * b[k, n] + bias[n]), every matrix row major and
+// bias optional. The output is produced one row panel at a time: the
+// multiply writes the panel and the bias and activation are applied to it
+// in one pass while it is still cache resident, so the activations never
+// take another trip through main memory. Panels run in parallel on the
+// shared pool. The last argument, b as laid out by pack_gemm_b, only
+// matters to the float kernel.
+template <class dtype>
+void gemm_bias_activation(const dtype *a, const dtype *b, const dtype *bias,
+                          dtype *c, size_t m, size_t k, size_t n,
+                          activation act = activation::linear,
+                          const dtype * = nullptr) {
+  typedef Eigen::Map<const row_major<dtype>> const_matrix_map;
+  typedef Eigen::Map<row_major<dtype>> matrix_map;
+  typedef Eigen::Map<const Eigen::Array<dtype, 1, Eigen::Dynamic>> bias_map;
+  if (m == 0 || n == 0) return;
+
+  const_matrix_map B(b, k, n);
+  size_t panel = gemm_panel_rows<dtype>(n);
+  size_t panels = (m + panel - 1) / panel;
+  parallel::parallel_for(panels, 1, [&](size_t begin, size_t end) {
+    for (size_t p = begin; p < end; p++) {
+      size_t row = p * panel, rows = std::min(panel, m - row);
+      matrix_map C(c + row * n, rows, n);
+      C.noalias() = const_matrix_map(a + row * k, rows, k) * B;
+      if (bias)
+        activate(act, C.array(), C.array().rowwise() + bias_map(bias, n));
+      else if (act != activation::linear)
+        activate(act, C.array(), C.array());
+    }
+  });
+}
+
+// Packed float GEMM for hosts above the instruction set the binary was
+// built for, where Eigen's product is stuck with the compile time packet
+// size. b is repacked into panels of gemm_micro_cols columns, stored depth
+// after depth, and a register tile of rows x gemm_micro_cols of c is
+// accumulated from one depth block of a panel (16 KB, L1 resident) at a
+// time: 6 rows with AVX2 + FMA, 12 with AVX-512.
+const size_t gemm_micro_cols = 16;
+const size_t gemm_micro_depth = 256;
+// below this many rows the product is a matrix-vector one, bound by
+// reading b, and packing would only add a second pass over it
+const size_t gemm_packed_min_rows = 16;
+
+#ifdef TENSORS_DISPATCH
+// tile[rows][16] = a[rows][depth] * panel[depth][16], a given by row
+TENSORS_TARGET_AVX2 inline void gemm_micro_avx2(const float *const *a,
+                                                size_t depth,
+                                                const float *panel,
+                                                float *tile) {
+  const size_t rows = 6;
+  __m256 acc[rows][2];
+#pragma GCC unroll 6
+  for (size_t r = 0; r < rows; r++)
+    acc[r][0] = acc[r][1] = _mm256_setzero_ps();
+  for (size_t d = 0; d < depth; d++) {
+    __m256 b0 = _mm256_loadu_ps(panel + d * 16);
+    __m256 b1 = _mm256_loadu_ps(panel + d * 16 + 8);
+#pragma GCC unroll 6
+    for (size_t r = 0; r < rows; r++) {
+      __m256 x = _mm256_broadcast_ss(a[r] + d);
+      acc[r][0] = _mm256_fmadd_ps(x, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_ps(x, b1, acc[r][1]);
+    }
+  }
+#pragma GCC unroll 6
+  for (size_t r = 0; r < rows; r++) {
+    _mm256_storeu_ps(tile + r * 16, acc[r][0]);
+    _mm256_storeu_ps(tile + r * 16 + 8, acc[r][1]);
+  }
+}
+
+TENSORS_TARGET_AVX512 inline void gemm_micro_avx512(const float *const *a,
+                                                    size_t depth,
+                                                    const float *panel,
+                                                    float *tile) {
+  const size_t rows = 12;
+  __m512 acc[rows];
+#pragma GCC unroll 12
+  for (size_t r = 0; r < rows; r++) acc[r] = _mm512_setzero_ps();
+  for (size_t d = 0; d < depth; d++) {
+    __m512 b = _mm512_loadu_ps(panel + d * 16);
+#pragma GCC unroll 12
+    for (size_t r = 0; r < rows; r++)
+      acc[r] = _mm512_fmadd_ps(_mm512_set1_ps(a[r][d]), b, acc[r]);
+  }
+#pragma GCC unroll 12
+  for (size_t r = 0; r < rows; r++) _mm512_storeu_ps(tile + r * 16, acc[r]);
+}
+#endif
+
+// the packed kernel's instruction set for this call, sse2 for Eigen's
+inline cpu::isa packed_gemm_isa(size_t m) {
+  cpu::isa level = cpu::active_isa();
+  if (m < gemm_packed_min_rows || level <= cpu::compiled_isa() ||
+      !cpu::use(cpu::isa::avx2))
+    return cpu::isa::sse2;
+  return level >= cpu::isa::avx512 ? cpu::isa::avx512 : cpu::isa::avx2;
+}
+
+// b[k, n] as panels of gemm_micro_cols columns, zero padded
+inline std::vector<float> pack_gemm_panels(const float *b, size_t k,
+                                           size_t n) {
+  size_t panels = (n + gemm_micro_cols - 1) / gemm_micro_cols;
+  std::vector<float> packed(panels * k * gemm_micro_cols, 0.f);
+  for (size_t p = 0; p < panels; p++) {
+    size_t c0 = p * gemm_micro_cols;
+    size_t cols = std::min(gemm_micro_cols, n - c0);
+    float *dst = packed.data() + p * k * gemm_micro_cols;
+    for (size_t d = 0; d < k; d++)
+      std::copy(b + d * n + c0, b + d * n + c0 + cols,
+                dst + d * gemm_micro_cols);
+  }
+  return packed;
+}
+
+// b[k, n] laid out for gemm_bias_activation, for callers multiplying the
+// same b many times. Empty when the kernel reads b as it is.
+template <class dtype>
+inline std::vector<dtype> pack_gemm_b(const dtype *, size_t, size_t) {
+  return {};
+}
+
+inline std::vector<float> pack_gemm_b(const float *b, size_t k, size_t n) {
+  if (packed_gemm_isa(gemm_packed_min_rows) == cpu::isa::sse2) return {};
+  return pack_gemm_panels(b, k, n);
+}
+
+// c[rows, n] = a[rows, k] * b with b from pack_gemm_panels
+inline void gemm_packed_panel(cpu::isa level, const float *a, size_t rows,
+                              size_t k, const float *packed, float *c,
+                              size_t n) {
+#ifdef TENSORS_DISPATCH
+  const size_t tile_rows = level == cpu::isa::avx512 ? 12 : 6;
+  float tile[12 * gemm_micro_cols];
+  const float *row[12];
+  size_t panels = (n + gemm_micro_cols - 1) / gemm_micro_cols;
+  for (size_t d0 = 0; d0 < k; d0 += gemm_micro_depth) {
+    size_t depth = std::min(gemm_micro_depth, k - d0);
+    for (size_t p = 0; p < panels; p++) {
+      const float *panel = packed + (p * k + d0) * gemm_micro_cols;
+      size_t c0 = p * gemm_micro_cols;
+      size_t cols = std::min(gemm_micro_cols, n - c0);
+      for (size_t r0 = 0; r0 < rows; r0 += tile_rows) {
+        size_t tr = std::min(tile_rows, rows - r0);
+        // a partial tile repeats its last row, which is never stored
+        for (size_t r = 0; r < tile_rows; r++)
+          row[r] = a + (r0 + std::min(r, tr - 1)) * k + d0;
+        if (level == cpu::isa::avx512)
+          gemm_micro_avx512(row, depth, panel, tile);
+        else
+          gemm_micro_avx2(row, depth, panel, tile);
+        for (size_t r = 0; r < tr; r++) {
+          float *dst = c + (r0 + r) * n + c0;
+          const float *src = tile + r * gemm_micro_cols;
+          if (d0 == 0)
+            std::copy(src, src + cols, dst);
+          else
+            for (size_t j = 0; j < cols; j++) dst[j] += src[j];
+        }
+      }
+    }
+  }
+#endif
+}
+
+// float c = act(a * b + bias): the packed kernel when the host is ahead of
+// the build, Eigen's product otherwise, with the same panels and epilogue.
+// b is packed on every call unless packed_b from pack_gemm_b is given.
+inline void gemm_bias_activation(const float *a, const float *b,
+                                 const float *bias, float *c, size_t m,
+                                 size_t k, size_t n,
+                                 activation act = activation::linear,
+                                 const float *packed_b = nullptr) {
+  typedef Eigen::Map<row_major<float>> matrix_map;
+  typedef Eigen::Map<const Eigen::Array<float, 1, Eigen::Dynamic>> bias_map;
+  cpu::isa level = packed_gemm_isa(m);
+  if (level == cpu::isa::sse2 || n == 0 || k == 0) {
+    gemm_bias_activation<float>(a, b, bias, c, m, k, n, act);
+    return;
+  }
+  std::vector<float> packed;
+  if (!packed_b) {
+    packed = pack_gemm_panels(b, k, n);
+    packed_b = packed.data();
+  }
+  // whole register tiles of both kernels, a partial one is wasted work
+  size_t panel = std::max<size_t>(12, gemm_panel_rows<float>(n) / 12 * 12);
+  size_t panels = (m + panel - 1) / panel;
+  parallel::parallel_for(panels, 1, [&](size_t begin, size_t end) {
+    for (size_t p = begin; p < end; p++) {
+      size_t row = p * panel, rows = std::min(panel, m - row);
+      gemm_packed_panel(level, a + row * k, rows, k, packed_b, c + row * n,
+                        n);
+      matrix_map C(c + row * n, rows, n);
+      if (bias)
+        activate(act, C.array(), C.array().rowwise() + bias_map(bias, n));
+      else if (act != activation::linear)
+        activate(act, C.array(), C.array());
+    }
+  });
+}
+
+// Tiles of the 16-bit GEMM: a [gemm_tile_rows, gemm_tile_depth] tile of a,
+// a [gemm_tile_depth, gemm_tile_cols] tile of b and the fp32 accumulators
+// stay within the L2 cache.
+const size_t gemm_tile_rows = 64;
+const size_t gemm_tile_cols = 256;
+const size_t gemm_tile_depth = 256;
+
+// gemm_bias_activation over 16-bit storage (half, bfloat16). The operands
+// are widened to float tile by tile as they are loaded, so they cross the
+// memory bus at half the width; products accumulate in float and every
+// output is rounded once, after the bias and activation, when it is
+// stored. Tiles of the output run in parallel.
+template <class dtype>
+void gemm_bias_activation_reduced(const dtype *a, const dtype *b,
+                                  const dtype *bias, dtype *c, size_t m,
+                                  size_t k, size_t n, activation act) {
+  typedef Eigen::Map<row_major<float>> matrix_map;
+  typedef Eigen::Map<const Eigen::Array<float, 1, Eigen::Dynamic>> bias_map;
+  if (m == 0 || n == 0) return;
+  std::vector<float> wide_bias(bias ? n : 0);
+  if (bias) to_float(bias, wide_bias.data(), n);
+
+  size_t row_tiles = (m + gemm_tile_rows - 1) / gemm_tile_rows;
+  size_t col_tiles = (n + gemm_tile_cols - 1) / gemm_tile_cols;
+  parallel::parallel_for(
+      row_tiles * col_tiles, 1, [&](size_t begin, size_t end) {
+        std::vector<float> at(gemm_tile_rows * gemm_tile_depth),
+            bt(gemm_tile_depth * gemm_tile_cols),
+            ct(gemm_tile_rows * gemm_tile_cols);
+        for (size_t t = begin; t < end; t++) {
+          size_t r0 = t / col_tiles * gemm_tile_rows;
+          size_t c0 = t % col_tiles * gemm_tile_cols;
+          size_t rows = std::min(gemm_tile_rows, m - r0);
+          size_t cols = std::min(gemm_tile_cols, n - c0);
+          matrix_map C(ct.data(), rows, cols);
+          C.setZero();
+          for (size_t d0 = 0; d0 < k; d0 += gemm_tile_depth) {
+            size_t depth = std::min(gemm_tile_depth, k - d0);
+            for (size_t i = 0; i < rows; i++)
+              to_float(a + (r0 + i) * k + d0, at.data() + i * depth, depth);
+            for (size_t i = 0; i < depth; i++)
+              to_float(b + (d0 + i) * n + c0, bt.data() + i * cols, cols);
+            C.noalias() += matrix_map(at.data(), rows, depth) *
+                           matrix_map(bt.data(), depth, cols);
+          }
+          if (bias)
+            activate(act, C.array(),
+                     C.array().rowwise() + bias_map(wide_bias.data() + c0,
+                                                    cols));
+          else if (act != activation::linear)
+            activate(act, C.array(), C.array());
+          for (size_t i = 0; i < rows; i++)
+            from_float(ct.data() + i * cols, c + (r0 + i) * n + c0, cols);
+        }
+      });
+}
+
+inline void gemm_bias_activation(const half *a, const half *b,
+                                 const half *bias, half *c, size_t m,
+                                 size_t k, size_t n,
+                                 activation act = activation::linear,
+                                 const half * = nullptr) {
+  gemm_bias_activation_reduced(a, b, bias, c, m, k, n, act);
+}
+
+inline void gemm_bias_activation(const bfloat16 *a, const bfloat16 *b,
+                                 const bfloat16 *bias, bfloat16 *c, size_t m,
+                                 size_t k, size_t n,
+                                 activation act = activation::linear,
+                                 const bfloat16 * = nullptr) {
+  gemm_bias_activation_reduced(a, b, bias, c, m, k, n, act);
+}
+
+// copies into the accumulation type, to_float for the 16-bit types
+template <class dtype>
+inline void widen(const dtype *src, typename accumulator<dtype>::type *dst,
+                  size_t n) {
+  std::copy(src, src + n, dst);
+}
+inline void widen(const half *src, float *dst, size_t n) {
+  to_float(src, dst, n);
+}
+inline void widen(const bfloat16 *src, float *dst, size_t n) {
+  to_float(src, dst, n);
+}
+
+#ifdef TENSORS_DISPATCH
+// four independent accumulators hide the latency of the adds
+TENSORS_TARGET_AVX2 inline float sum_avx2(const float *x, size_t n) {
+  __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(),
+                   _mm256_setzero_ps(), _mm256_setzero_ps()};
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32)
+#pragma GCC unroll 4
+    for (size_t j = 0; j < 4; j++)
+      acc[j] = _mm256_add_ps(acc[j], _mm256_loadu_ps(x + i + 8 * j));
+  for (; i + 8 <= n; i += 8)
+    acc[0] = _mm256_add_ps(acc[0], _mm256_loadu_ps(x + i));
+  __m256 v = _mm256_add_ps(_mm256_add_ps(acc[0], acc[1]),
+                           _mm256_add_ps(acc[2], acc[3]));
+  __m128 h = _mm_add_ps(_mm256_castps256_ps128(v),
+                        _mm256_extractf128_ps(v, 1));
+  h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+  float total = _mm_cvtss_f32(_mm_add_ss(h, _mm_movehdup_ps(h)));
+  for (; i < n; i++) total += x[i];
+  return total;
+}
+
+TENSORS_TARGET_AVX2 inline float dot_avx2(const float *x, const float *y,
+                                          size_t n) {
+  __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(),
+                   _mm256_setzero_ps(), _mm256_setzero_ps()};
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32)
+#pragma GCC unroll 4
+    for (size_t j = 0; j < 4; j++)
+      acc[j] = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8 * j),
+                               _mm256_loadu_ps(y + i + 8 * j), acc[j]);
+  for (; i + 8 <= n; i += 8)
+    acc[0] = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i),
+                             acc[0]);
+  __m256 v = _mm256_add_ps(_mm256_add_ps(acc[0], acc[1]),
+                           _mm256_add_ps(acc[2], acc[3]));
+  __m128 h = _mm_add_ps(_mm256_castps256_ps128(v),
+                        _mm256_extractf128_ps(v, 1));
+  h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+  float total = _mm_cvtss_f32(_mm_add_ss(h, _mm_movehdup_ps(h)));
+  for (; i < n; i++) total += x[i] * y[i];
+  return total;
+}
+
+// the tail is a masked load, so there is no scalar loop
+TENSORS_TARGET_AVX512 inline float sum_avx512(const float *x, size_t n) {
+  __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(),
+                   _mm512_setzero_ps(), _mm512_setzero_ps()};
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64)
+#pragma GCC unroll 4
+    for (size_t j = 0; j < 4; j++)
+      acc[j] = _mm512_add_ps(acc[j], _mm512_loadu_ps(x + i + 16 * j));
+  for (; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? 0xffff : (1u << (n - i)) - 1;
+    acc[0] = _mm512_add_ps(acc[0], _mm512_maskz_loadu_ps(mask, x + i));
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc[0], acc[1]),
+                                            _mm512_add_ps(acc[2], acc[3])));
+}
+
+TENSORS_TARGET_AVX512 inline float dot_avx512(const float *x,
+                                              const float *y, size_t n) {
+  __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(),
+                   _mm512_setzero_ps(), _mm512_setzero_ps()};
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64)
+#pragma GCC unroll 4
+    for (size_t j = 0; j < 4; j++)
+      acc[j] = _mm512_fmadd_ps(_mm512_loadu_ps(x + i + 16 * j),
+                               _mm512_loadu_ps(y + i + 16 * j), acc[j]);
+  for (; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? 0xffff : (1u << (n - i)) - 1;
+    acc[0] = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x + i),
+                             _mm512_maskz_loadu_ps(mask, y + i), acc[0]);
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc[0], acc[1]),
+                                            _mm512_add_ps(acc[2], acc[3])));
+}
+#endif
+
+// float sum and dot product at the widest instruction set of the host
+inline float sum(const float *x, size_t n) {
+#ifdef TENSORS_DISPATCH
+  if (cpu::use(cpu::isa::avx512)) return sum_avx512(x, n);
+  if (cpu::use(cpu::isa::avx2)) return sum_avx2(x, n);
+#endif
+  return Eigen::Map<const Eigen::ArrayXf>(x, n).sum();
+}
+
+inline float dot(const float *x, const float *y, size_t n) {
+#ifdef TENSORS_DISPATCH
+  if (cpu::use(cpu::isa::avx512)) return dot_avx512(x, y, n);
+  if (cpu::use(cpu::isa::avx2)) return dot_avx2(x, y, n);
+#endif
+  return (Eigen::Map<const Eigen::ArrayXf>(x, n) *
+          Eigen::Map<const Eigen::ArrayXf>(y, n))
+      .sum();
+}
+
+// sum and dot product accumulated in accumulator<dtype>::type, float for
+// the 16-bit types, which are widened a chunk at a time
+template <class dtype>
+typename accumulator<dtype>::type sum(const dtype *x, size_t n) {
+  typedef typename accumulator<dtype>::type acc;
+  typedef Eigen::Array<acc, Eigen::Dynamic, 1> array;
+  if (!is_reduced_precision<dtype>::value)
+    return Eigen::Map<const array>(reinterpret_cast<const acc *>(x), n).sum();
+  const size_t chunk = 1024;
+  acc buffer[chunk];
+  acc total = acc(0);
+  for (size_t i = 0; i < n; i += chunk) {
+    size_t len = std::min(chunk, n - i);
+    widen(x + i, buffer, len);
+    total += sum(buffer, len);
+  }
+  return total;
+}
+
+template <class dtype>
+typename accumulator<dtype>::type dot(const dtype *x, const dtype *y,
+                                      size_t n) {
+  typedef typename accumulator<dtype>::type acc;
+  typedef Eigen::Array<acc, Eigen::Dynamic, 1> array;
+  if (!is_reduced_precision<dtype>::value)
+    return (Eigen::Map<const array>(reinterpret_cast<const acc *>(x), n) *
+            Eigen::Map<const array>(reinterpret_cast<const acc *>(y), n))
+        .sum();
+  const size_t chunk = 1024;
+  acc bx[chunk], by[chunk];
+  acc total = acc(0);
+  for (size_t i = 0; i < n; i += chunk) {
+    size_t len = std::min(chunk, n - i);
+    widen(x + i, bx, len);
+    widen(y + i, by, len);
+    total += dot(bx, by, len);
+  }
+  return total;
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
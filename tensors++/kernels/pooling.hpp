@@ -0,0 +1,245 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef POOLING_HPP
+#define POOLING_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/core/parallel.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Geometry of a 2-D pooling over NHWC images. Padded positions never take
+// part: they are skipped by max pooling and not counted by average pooling.
+struct pool2d_params {
+  size_t batch = 1, in_h = 0, in_w = 0, channels = 0;
+  size_t pool_h = 2, pool_w = 2, stride_h = 2, stride_w = 2;
+  size_t pad_top = 0, pad_bottom = 0, pad_left = 0, pad_right = 0;
+
+  inline size_t out_h() const {
+    return (in_h + pad_top + pad_bottom - pool_h) / stride_h + 1;
+  }
+  inline size_t out_w() const {
+    return (in_w + pad_left + pad_right - pool_w) / stride_w + 1;
+  }
+};
+
+// Pooling is separable, so every output row is computed in two passes. The
+// input rows under the window are first reduced into one row buffer, one
+// vectorized pass over [in_w * channels] per row; the windows then slide
+// over that cache resident buffer, vectorized over the channels. With the
+// usual stride == pool every input element is read exactly once. Output
+// rows are spread over the pool.
+template <class dtype, class Row, class Window>
+void pool2d_rows(const pool2d_params &p, Row row, Window window) {
+  size_t oh = p.out_h();
+  parallel::parallel_for(p.batch * oh, 1, [&](size_t begin, size_t end) {
+    std::vector<dtype> reduced(p.in_w * p.channels);
+    std::vector<size_t> from(p.in_w * p.channels);
+    for (size_t r = begin; r < end; r++) {
+      size_t n = r / oh, y = r % oh;
+      long top = long(y * p.stride_h) - long(p.pad_top);
+      size_t first = size_t(std::max(top, 0L));
+      size_t last = size_t(std::min(top + long(p.pool_h), long(p.in_h)));
+      row(n, first, last, reduced.data(), from.data());
+      window(r, last - first, reduced.data(), from.data());
+    }
+  });
+}
+
+// Max pooling. When `indices` is given it receives, for every output, the
+// flat position of the maximum in the input (batch included), which lets
+// the backward pass scatter in O(output).
+template <class dtype>
+void max_pool2d(const pool2d_params &p, const dtype *input, dtype *output,
+                size_t *indices = nullptr) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  size_t ow = p.out_w(), C = p.channels, width = p.in_w * C;
+
+  auto row = [&](size_t n, size_t first, size_t last, dtype *reduced,
+                 size_t *from) {
+    const dtype *image = input + n * p.in_h * width;
+    Eigen::Map<array> m(reduced, width);
+    m = Eigen::Map<const array>(image + first * width, width);
+    if (!indices) {
+      for (size_t y = first + 1; y < last; y++)
+        m = m.max(Eigen::Map<const array>(image + y * width, width));
+      return;
+    }
+    std::fill(from, from + width, first);
+    for (size_t y = first + 1; y < last; y++) {
+      const dtype *src = image + y * width;
+      for (size_t i = 0; i < width; i++)
+        if (src[i] > reduced[i]) {
+          reduced[i] = src[i];
+          from[i] = y;
+        }
+    }
+  };
+
+  auto window = [&](size_t r, size_t, const dtype *reduced,
+                    const size_t *from) {
+    size_t n = r / p.out_h();
+    dtype *out = output + r * ow * C;
+    size_t *idx = indices ? indices + r * ow * C : nullptr;
+    for (size_t x = 0; x < ow; x++) {
+      long left = long(x * p.stride_w) - long(p.pad_left);
+      size_t first = size_t(std::max(left, 0L));
+      size_t last = size_t(std::min(left + long(p.pool_w), long(p.in_w)));
+      Eigen::Map<array> o(out + x * C, C);
+      o = Eigen::Map<const array>(reduced + first * C, C);
+      if (!idx) {
+        for (size_t c = first + 1; c < last; c++)
+          o = o.max(Eigen::Map<const array>(reduced + c * C, C));
+        continue;
+      }
+      size_t *best = idx + x * C;
+      for (size_t c = 0; c < C; c++) best[c] = first;
+      for (size_t col = first + 1; col < last; col++)
+        for (size_t c = 0; c < C; c++)
+          if (reduced[col * C + c] > out[x * C + c]) {
+            out[x * C + c] = reduced[col * C + c];
+            best[c] = col;
+          }
+      for (size_t c = 0; c < C; c++)
+        best[c] = ((n * p.in_h + from[best[c] * C + c]) * p.in_w + best[c]) *
+                      C +
+                  c;
+    }
+  };
+
+  pool2d_rows<dtype>(p, row, window);
+}
+
+// Average pooling, padded positions excluded from the count.
+template <class dtype>
+void avg_pool2d(const pool2d_params &p, const dtype *input, dtype *output) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  size_t ow = p.out_w(), C = p.channels, width = p.in_w * C;
+
+  auto row = [&](size_t n, size_t first, size_t last, dtype *reduced,
+                 size_t *) {
+    const dtype *image = input + n * p.in_h * width;
+    Eigen::Map<array> m(reduced, width);
+    m = Eigen::Map<const array>(image + first * width, width);
+    for (size_t y = first + 1; y < last; y++)
+      m += Eigen::Map<const array>(image + y * width, width);
+  };
+
+  auto window = [&](size_t r, size_t rows, const dtype *reduced,
+                    const size_t *) {
+    dtype *out = output + r * ow * C;
+    for (size_t x = 0; x < ow; x++) {
+      long left = long(x * p.stride_w) - long(p.pad_left);
+      size_t first = size_t(std::max(left, 0L));
+      size_t last = size_t(std::min(left + long(p.pool_w), long(p.in_w)));
+      Eigen::Map<array> o(out + x * C, C);
+      o = Eigen::Map<const array>(reduced + first * C, C);
+      for (size_t c = first + 1; c < last; c++)
+        o += Eigen::Map<const array>(reduced + c * C, C);
+      o /= dtype(rows * (last - first));
+    }
+  };
+
+  pool2d_rows<dtype>(p, row, window);
+}
+
+// Gradient of max pooling from the recorded argmax indices: every output
+// gradient is added to its maximum, nothing else is touched, so grad_input
+// has to be zeroed (or hold gradients to accumulate into). Images are
+// independent so they are scattered in parallel.
+template <class dtype>
+void max_pool2d_backward(const pool2d_params &p, const size_t *indices,
+                         const dtype *grad_output, dtype *grad_input) {
+  size_t out = p.out_h() * p.out_w() * p.channels;
+  parallel::parallel_for(p.batch, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin * out; i < end * out; i++)
+      grad_input[indices[i]] += grad_output[i];
+  });
+}
+
+// Gradient of average pooling, every output spreads its gradient evenly
+// over the input positions it averaged. Like max_pool2d_backward it adds
+// into grad_input.
+template <class dtype>
+void avg_pool2d_backward(const pool2d_params &p, const dtype *grad_output,
+                         dtype *grad_input) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  size_t oh = p.out_h(), ow = p.out_w(), C = p.channels;
+  size_t in = p.in_h * p.in_w * C;
+  parallel::parallel_for(p.batch, 1, [&](size_t begin, size_t end) {
+    for (size_t n = begin; n < end; n++)
+      for (size_t y = 0; y < oh; y++) {
+        long top = long(y * p.stride_h) - long(p.pad_top);
+        size_t y0 = size_t(std::max(top, 0L));
+        size_t y1 = size_t(std::min(top + long(p.pool_h), long(p.in_h)));
+        for (size_t x = 0; x < ow; x++) {
+          long left = long(x * p.stride_w) - long(p.pad_left);
+          size_t x0 = size_t(std::max(left, 0L));
+          size_t x1 = size_t(std::min(left + long(p.pool_w), long(p.in_w)));
+          array g = Eigen::Map<const array>(
+                        grad_output + ((n * oh + y) * ow + x) * C, C) /
+                    dtype((y1 - y0) * (x1 - x0));
+          for (size_t iy = y0; iy < y1; iy++)
+            for (size_t ix = x0; ix < x1; ix++)
+              Eigen::Map<array>(grad_input + n * in + (iy * p.in_w + ix) * C,
+                                C) += g;
+        }
+      }
+  });
+}
+
+// Global pooling of [batch, pixels, channels] into [batch, channels], one
+// vectorized pass over every image.
+template <class dtype>
+void global_avg_pool(const dtype *input, dtype *output, size_t batch,
+                     size_t pixels, size_t channels) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  parallel::parallel_for(batch, 1, [&](size_t begin, size_t end) {
+    for (size_t n = begin; n < end; n++) {
+      const dtype *image = input + n * pixels * channels;
+      Eigen::Map<array> o(output + n * channels, channels);
+      o = Eigen::Map<const array>(image, channels);
+      for (size_t i = 1; i < pixels; i++)
+        o += Eigen::Map<const array>(image + i * channels, channels);
+      o /= dtype(pixels);
+    }
+  });
+}
+
+template <class dtype>
+void global_max_pool(const dtype *input, dtype *output, size_t batch,
+                     size_t pixels, size_t channels) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  parallel::parallel_for(batch, 1, [&](size_t begin, size_t end) {
+    for (size_t n = begin; n < end; n++) {
+      const dtype *image = input + n * pixels * channels;
+      Eigen::Map<array> o(output + n * channels, channels);
+      o = Eigen::Map<const array>(image, channels);
+      for (size_t i = 1; i < pixels; i++)
+        o = o.max(Eigen::Map<const array>(image + i * channels, channels));
+    }
+  });
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
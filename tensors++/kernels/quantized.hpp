@@ -0,0 +1,293 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef QUANTIZED_HPP
+#define QUANTIZED_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "tensors++/core/cpu_features.hpp"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/kernels/activation.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Affine quantization, real = scale * (q - zero_point).
+struct qparams {
+  float scale = 1.f;
+  int32_t zero_point = 0;
+};
+
+// Activations are quantized to unsigned 7 bits. With both pairs of a
+// vpmaddubsw at the maximum, 2 * 127 * 127 still fits the int16 it
+// saturates to (fbgemm's reduce_range), so the AVX2, VNNI and portable
+// kernels give identical results on every host.
+const int32_t activation_qmax = 127;
+// weights are symmetric signed 8 bits, zero point 0
+const int32_t weight_qmax = 127;
+
+// parameters mapping [min, max] (widened to include 0, which must be exact
+// for zero padding) onto [0, activation_qmax]
+inline qparams choose_qparams(float min, float max) {
+  min = std::min(min, 0.f);
+  max = std::max(max, 0.f);
+  qparams p;
+  if (max == min) return p;
+  p.scale = (max - min) / float(activation_qmax);
+  p.zero_point = int32_t(std::lround(-min / p.scale));
+  p.zero_point = std::min(std::max(p.zero_point, 0), activation_qmax);
+  return p;
+}
+
+inline uint8_t quantize_value(float x, const qparams &p) {
+  long q = std::lround(x / p.scale) + p.zero_point;
+  return uint8_t(std::min<long>(std::max<long>(q, 0), activation_qmax));
+}
+
+inline void quantize(const float *x, size_t n, const qparams &p,
+                     uint8_t *out) {
+  size_t grain = 1 << 14;
+  parallel::parallel_for(n, grain, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) out[i] = quantize_value(x[i], p);
+  });
+}
+
+// Calibration: tracks the range of the sample batches it sees, for the
+// whole tensor or per channel (the last axis), and turns it into qparams.
+class minmax_observer {
+  std::vector<float> lo, hi;
+
+ public:
+  explicit minmax_observer(size_t channels = 1)
+      : lo(channels, std::numeric_limits<float>::max()),
+        hi(channels, std::numeric_limits<float>::lowest()) {}
+
+  // x is [n / channels, channels]
+  void observe(const float *x, size_t n) {
+    size_t c = lo.size();
+    for (size_t i = 0; i < n; i++) {
+      lo[i % c] = std::min(lo[i % c], x[i]);
+      hi[i % c] = std::max(hi[i % c], x[i]);
+    }
+  }
+
+  inline bool empty() const { return lo[0] > hi[0]; }
+  inline size_t channels() const { return lo.size(); }
+
+  // parameters of channel c
+  qparams params(size_t c = 0) const {
+    return empty() ? qparams() : choose_qparams(lo[c], hi[c]);
+  }
+
+  // one set of parameters covering every channel
+  qparams merged() const {
+    if (empty()) return qparams();
+    return choose_qparams(*std::min_element(lo.begin(), lo.end()),
+                          *std::max_element(hi.begin(), hi.end()));
+  }
+};
+
+// Weights [k, n] quantized per output column (channel) and packed for
+// qgemm: columns in blocks of 8, the depth in groups of 4, so one 32 byte
+// load holds 4 consecutive depths of 8 columns ([n8 / 8][k4 / 4][8][4],
+// zero padded).
+struct qweights {
+  size_t k = 0, n = 0;
+  std::vector<int8_t> packed;
+  std::vector<float> scales;       // per column
+  std::vector<int32_t> col_sums;   // sum over the depth of every column
+
+  inline size_t depth_groups() const { return (k + 3) / 4; }
+  inline size_t col_blocks() const { return (n + 7) / 8; }
+};
+
+inline qweights quantize_weights(const float *w, size_t k, size_t n) {
+  qweights q;
+  q.k = k;
+  q.n = n;
+  q.scales.assign(n, 1.f);
+  q.col_sums.assign(n, 0);
+  size_t groups = q.depth_groups();
+  q.packed.assign(q.col_blocks() * groups * 32, 0);
+  for (size_t j = 0; j < n; j++) {
+    float range = 0;
+    for (size_t l = 0; l < k; l++)
+      range = std::max(range, std::fabs(w[l * n + j]));
+    if (range > 0) q.scales[j] = range / float(weight_qmax);
+    for (size_t l = 0; l < k; l++) {
+      long v = std::lround(w[l * n + j] / q.scales[j]);
+      v = std::min<long>(std::max<long>(v, -weight_qmax), weight_qmax);
+      q.packed[((j / 8 * groups + l / 4) * 8 + j % 8) * 4 + l % 4] =
+          int8_t(v);
+      q.col_sums[j] += int32_t(v);
+    }
+  }
+  return q;
+}
+
+// Epilogue of qgemm: real results plus bias and activation, written as
+// float or, when `requantize` is set, requantized to uint8 with it.
+struct qgemm_output {
+  float *real = nullptr;
+  uint8_t *quantized = nullptr;
+  const qparams *requantize = nullptr;
+  const float *bias = nullptr;
+  activation act = activation::linear;
+};
+
+// A qgemm tile: acc[4][8] = rows a[0..3] (4 * groups bytes each) times one
+// column block b of qweights::packed.
+typedef void (*qgemm_tile)(const uint8_t *const *a, size_t groups,
+                           const int8_t *b, int32_t *acc);
+
+inline void qgemm_tile_portable(const uint8_t *const *a, size_t groups,
+                                const int8_t *b, int32_t *acc) {
+  for (size_t r = 0; r < 4; r++) {
+    int32_t *row = acc + r * 8;
+    std::fill(row, row + 8, 0);
+    for (size_t g = 0; g < groups; g++)
+      for (size_t c = 0; c < 8; c++)
+        for (size_t d = 0; d < 4; d++)
+          row[c] += int32_t(a[r][4 * g + d]) *
+                    int32_t(b[(g * 8 + c) * 4 + d]);
+  }
+}
+
+#ifdef TENSORS_DISPATCH
+// the 4 bytes at p in every 32-bit lane
+TENSORS_TARGET_AVX2 inline __m256i broadcast4(const uint8_t *p) {
+  int32_t quad;
+  std::memcpy(&quad, p, 4);
+  return _mm256_set1_epi32(quad);
+}
+
+// vpmaddubsw + vpmaddwd: 4 depths x 8 columns per pair, the four rows by
+// hand so the accumulators stay in registers
+TENSORS_TARGET_AVX2 inline void qgemm_tile_avx2(const uint8_t *const *a,
+                                                size_t groups,
+                                                const int8_t *b,
+                                                int32_t *acc) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+  for (size_t g = 0; g < groups; g++) {
+    __m256i bv =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + g * 32));
+    __m256i p0 = _mm256_maddubs_epi16(broadcast4(a[0] + 4 * g), bv);
+    __m256i p1 = _mm256_maddubs_epi16(broadcast4(a[1] + 4 * g), bv);
+    __m256i p2 = _mm256_maddubs_epi16(broadcast4(a[2] + 4 * g), bv);
+    __m256i p3 = _mm256_maddubs_epi16(broadcast4(a[3] + 4 * g), bv);
+    s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(p0, ones));
+    s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(p1, ones));
+    s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(p2, ones));
+    s3 = _mm256_add_epi32(s3, _mm256_madd_epi16(p3, ones));
+  }
+  __m256i *dst = reinterpret_cast<__m256i *>(acc);
+  _mm256_storeu_si256(dst, s0);
+  _mm256_storeu_si256(dst + 1, s1);
+  _mm256_storeu_si256(dst + 2, s2);
+  _mm256_storeu_si256(dst + 3, s3);
+}
+
+// vpdpbusd does the same multiply-add in one instruction
+TENSORS_TARGET_AVX512_VNNI inline void qgemm_tile_vnni(
+    const uint8_t *const *a, size_t groups, const int8_t *b, int32_t *acc) {
+  __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+  for (size_t g = 0; g < groups; g++) {
+    __m256i bv =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + g * 32));
+    s0 = _mm256_dpbusd_epi32(s0, broadcast4(a[0] + 4 * g), bv);
+    s1 = _mm256_dpbusd_epi32(s1, broadcast4(a[1] + 4 * g), bv);
+    s2 = _mm256_dpbusd_epi32(s2, broadcast4(a[2] + 4 * g), bv);
+    s3 = _mm256_dpbusd_epi32(s3, broadcast4(a[3] + 4 * g), bv);
+  }
+  __m256i *dst = reinterpret_cast<__m256i *>(acc);
+  _mm256_storeu_si256(dst, s0);
+  _mm256_storeu_si256(dst + 1, s1);
+  _mm256_storeu_si256(dst + 2, s2);
+  _mm256_storeu_si256(dst + 3, s3);
+}
+#endif
+
+// the tile for the host, picked once per qgemm call
+inline qgemm_tile select_qgemm_tile() {
+#ifdef TENSORS_DISPATCH
+  if (cpu::use(cpu::isa::avx512_vnni)) return qgemm_tile_vnni;
+  if (cpu::use(cpu::isa::avx2)) return qgemm_tile_avx2;
+#endif
+  return qgemm_tile_portable;
+}
+
+// C[m, n] = A[m, k] * W[k, n] with A quantized uint8 activations (row
+// stride lda, readable up to 3 bytes past the end of the last row) and W
+// from quantize_weights. Products accumulate exactly in int32, with AVX-512
+// VNNI (vpdpbusd) or AVX2 (vpmaddubsw + vpmaddwd) on 4 depths x 8 columns
+// per instruction when the host has them, then every tile is dequantized,
+// biased, activated and optionally requantized in one pass:
+//   real = a.scale * w.scale[j] * (acc - a.zero_point * col_sum[j])
+// A task keeps one block of W in the L1 cache while it streams its rows of
+// A past it.
+inline void qgemm(const uint8_t *a, size_t m, size_t lda, const qparams &ap,
+                  const qweights &w, const qgemm_output &out) {
+  const size_t rows_per_tile = 4;
+  size_t groups = w.depth_groups(), blocks = w.col_blocks();
+  size_t tiles = (m + rows_per_tile - 1) / rows_per_tile;
+  size_t work = std::max<size_t>(1, rows_per_tile * groups * blocks * 32);
+  size_t grain = std::max<size_t>(1, (1 << 16) / work);
+  qgemm_tile tile = select_qgemm_tile();
+
+  parallel::parallel_for(tiles, grain, [&](size_t begin, size_t end) {
+    int32_t acc[rows_per_tile][8];
+    float real[8];
+    for (size_t jb = 0; jb < blocks; jb++) {
+      const int8_t *b = w.packed.data() + jb * groups * 32;
+      for (size_t t = begin; t < end; t++) {
+        size_t r0 = t * rows_per_tile;
+        size_t rows = std::min(rows_per_tile, m - r0);
+        // a partial tile repeats its last row, which is never stored
+        const uint8_t *rows_a[rows_per_tile];
+        for (size_t r = 0; r < rows_per_tile; r++)
+          rows_a[r] = a + (r0 + std::min(r, rows - 1)) * lda;
+        tile(rows_a, groups, b, acc[0]);
+        size_t c0 = jb * 8, cols = std::min<size_t>(8, w.n - c0);
+        for (size_t r = 0; r < rows; r++) {
+          for (size_t c = 0; c < cols; c++) {
+            real[c] = ap.scale * w.scales[c0 + c] *
+                      float(acc[r][c] - ap.zero_point * w.col_sums[c0 + c]);
+            if (out.bias) real[c] += out.bias[c0 + c];
+          }
+          apply_activation(out.act, real, cols);
+          size_t at = (r0 + r) * w.n + c0;
+          if (out.requantize)
+            for (size_t c = 0; c < cols; c++)
+              out.quantized[at + c] = quantize_value(real[c], *out.requantize);
+          else
+            std::copy(real, real + cols, out.real + at);
+        }
+      }
+    }
+  });
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
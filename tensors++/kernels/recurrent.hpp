@@ -0,0 +1,189 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef RECURRENT_HPP
+#define RECURRENT_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/kernels/gemm.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Recurrent cells keep their gates side by side in one matrix, Keras style
+// ([rows, gates * units], gate g of unit u in column g * units + u). The
+// kernels below work on a packed copy where the units are cut into blocks
+// of recurrent_block_units and every block keeps all of its gates next to
+// each other: [i(block 0), f(block 0), ..., i(block 1), ...]. A timestep
+// then splits into independent column panels, each one small GEMM against
+// the previous hidden state followed by the gate math of its units while
+// the panel is still in cache.
+const size_t recurrent_block_units = 16;
+
+// column of gate g of unit u in the packed layout
+inline size_t packed_gate_column(size_t g, size_t u, size_t gates,
+                                 size_t units) {
+  size_t first = u / recurrent_block_units * recurrent_block_units;
+  size_t width = std::min(recurrent_block_units, units - first);
+  return gates * first + g * width + (u - first);
+}
+
+// repacks [rows, gates * units] (a bias is a single row) into block layout
+template <class dtype>
+std::vector<dtype> pack_gates(const dtype *w, size_t rows, size_t gates,
+                              size_t units) {
+  size_t cols = gates * units;
+  std::vector<dtype> packed(rows * cols);
+  for (size_t g = 0; g < gates; g++)
+    for (size_t u = 0; u < units; u++) {
+      size_t to = packed_gate_column(g, u, gates, units);
+      for (size_t r = 0; r < rows; r++)
+        packed[r * cols + to] = w[r * cols + g * units + u];
+    }
+  return packed;
+}
+
+template <class Array>
+inline auto sigmoid(const Array &x)
+    -> decltype((typename Array::Scalar(1) + (-x).exp()).inverse()) {
+  return (typename Array::Scalar(1) + (-x).exp()).inverse();
+}
+
+// Where the rows of a batch of sequences of different lengths are:
+// sequence b starts at row starts[b] of xproj (and of sequence), counted
+// in timesteps, and with the sequences ordered by decreasing length only
+// the first active[t] of them still run at step t. Null pointers mean the
+// dense [batch, steps] layout where every sequence runs every step.
+struct recurrent_layout {
+  const size_t *starts = nullptr;
+  const size_t *active = nullptr;
+};
+
+// Runs every timestep of a recurrent layer.
+//
+// xproj holds the input projections of all steps, [batch, steps, gates *
+// units] in packed layout, computed up front by one large GEMM. h is the
+// [batch, units] state and is updated in place. For every block of units
+// and batch row, cell(x, r, width, offset, h, next) gets the input part x
+// and the recurrent part r (previous h times the recurrent kernel plus the
+// recurrent bias, writable scratch) of the block's gates, both gates *
+// width long, and writes the new state of units [offset, offset + width)
+// to next. sequence, when given, receives h of every step as [batch, steps,
+// units]. With a ragged layout a step only computes the sequences still
+// running, and a finished sequence keeps its last state in h.
+template <class dtype, class Cell>
+void run_recurrent(const dtype *xproj, const dtype *recurrent,
+                   const dtype *recurrent_bias, size_t batch, size_t steps,
+                   size_t units, size_t gates, dtype *h, dtype *sequence,
+                   const Cell &cell,
+                   const recurrent_layout &layout = recurrent_layout()) {
+  typedef Eigen::Map<const row_major<dtype>, 0, Eigen::OuterStride<>>
+      strided_map;
+  typedef Eigen::Map<const Eigen::Array<dtype, 1, Eigen::Dynamic>> bias_map;
+  size_t cols = gates * units;
+  size_t blocks = (units + recurrent_block_units - 1) / recurrent_block_units;
+  // keep a few hundred thousand flops per task
+  size_t block_flops = batch * units * gates * recurrent_block_units;
+  size_t grain =
+      std::max<size_t>(1, (1 << 18) / std::max<size_t>(block_flops, 1));
+  std::vector<dtype> next(batch * units);
+  auto start = [&](size_t b) {
+    return layout.starts ? layout.starts[b] : b * steps;
+  };
+
+  for (size_t t = 0; t < steps; t++) {
+    size_t rows = layout.active ? layout.active[t] : batch;
+    parallel::parallel_for(blocks, grain, [&](size_t begin, size_t end) {
+      row_major<dtype> r;
+      for (size_t j = begin; j < end; j++) {
+        size_t first = j * recurrent_block_units;
+        size_t width = std::min(recurrent_block_units, units - first);
+        size_t col = gates * first, n = gates * width;
+        r.noalias() =
+            strided_map(h, rows, units, Eigen::OuterStride<>(units)) *
+            strided_map(recurrent + col, units, n, Eigen::OuterStride<>(cols));
+        if (recurrent_bias)
+          r.array().rowwise() += bias_map(recurrent_bias + col, n);
+        for (size_t b = 0; b < rows; b++)
+          cell(xproj + (start(b) + t) * cols + col, r.data() + b * n, width,
+               b * units + first, h, next.data());
+      }
+    });
+    std::copy(next.begin(), next.begin() + rows * units, h);
+    if (sequence)
+      for (size_t b = 0; b < rows; b++)
+        std::copy(h + b * units, h + (b + 1) * units,
+                  sequence + (start(b) + t) * units);
+  }
+}
+
+// LSTM over the packed gates i, f, c, o (the Keras order). The bias is part
+// of xproj. h and c are the [batch, units] states, updated in place.
+template <class dtype>
+void lstm_forward(const dtype *xproj, const dtype *recurrent, size_t batch,
+                  size_t steps, size_t units, dtype *h, dtype *c,
+                  dtype *sequence = nullptr,
+                  const recurrent_layout &layout = recurrent_layout()) {
+  typedef Eigen::Array<dtype, 1, Eigen::Dynamic> row_array;
+  run_recurrent(xproj, recurrent, static_cast<const dtype *>(nullptr), batch,
+                steps, units, 4, h, sequence,
+                [c](const dtype *x, dtype *r, size_t w, size_t offset,
+                    const dtype *, dtype *next) {
+                  Eigen::Map<row_array> z(r, 4 * w);
+                  z += Eigen::Map<const row_array>(x, 4 * w);
+                  Eigen::Map<row_array> cell(c + offset, w);
+                  cell = sigmoid(z.segment(w, w)) * cell +
+                         sigmoid(z.segment(0, w)) * z.segment(2 * w, w).tanh();
+                  Eigen::Map<row_array>(next + offset, w) =
+                      sigmoid(z.segment(3 * w, w)) * cell.tanh();
+                },
+                layout);
+}
+
+// GRU over the packed gates z, r, h with the reset gate applied after the
+// recurrent projection (Keras reset_after, the cuDNN formulation), which
+// keeps all three gates in the one hidden GEMM:
+//   h' = z * h + (1 - z) * tanh(x_h + r * (h U_h + b_h))
+// The input bias is part of xproj, recurrent_bias is added to h U.
+template <class dtype>
+void gru_forward(const dtype *xproj, const dtype *recurrent,
+                 const dtype *recurrent_bias, size_t batch, size_t steps,
+                 size_t units, dtype *h, dtype *sequence = nullptr,
+                 const recurrent_layout &layout = recurrent_layout()) {
+  typedef Eigen::Array<dtype, 1, Eigen::Dynamic> row_array;
+  run_recurrent(xproj, recurrent, recurrent_bias, batch, steps, units, 3, h,
+                sequence,
+                [](const dtype *x, dtype *r, size_t w, size_t offset,
+                   const dtype *prev, dtype *next) {
+                  Eigen::Map<const row_array> in(x, 3 * w);
+                  Eigen::Map<row_array> z(r, 3 * w);
+                  z.head(2 * w) = sigmoid(z.head(2 * w) + in.head(2 * w));
+                  z.tail(w) = (in.tail(w) + z.segment(w, w) * z.tail(w)).tanh();
+                  Eigen::Map<const row_array> h(prev + offset, w);
+                  Eigen::Map<row_array>(next + offset, w) =
+                      z.head(w) * h + (dtype(1) - z.head(w)) * z.tail(w);
+                },
+                layout);
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef SEGMENT_HPP
+#define SEGMENT_HPP
+
+#include <algorithm>
+
+#include "Eigen/Core"
+#include "tensors++/core/parallel.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Segment reductions over rows of `inner` elements: segment s covers rows
+// [splits[s], splits[s + 1]) of values and reduces to row s of out
+// ([segments, inner]). Each segment is one pass of vectorized row
+// operations, finish(result, length) then completes it while it is still
+// in cache (the division of a mean), and segments run in parallel, about
+// 8K elements per task. Empty segments produce zeros, as in
+// tf.math.segment_max.
+template <class dtype, class Reduce, class Finish>
+void segment_reduce(const dtype *values, const size_t *splits,
+                    size_t segments, size_t inner, dtype *out,
+                    const Reduce &reduce, const Finish &finish) {
+  typedef Eigen::Map<Eigen::Array<dtype, Eigen::Dynamic, 1>> row_map;
+  typedef Eigen::Map<const Eigen::Array<dtype, Eigen::Dynamic, 1>>
+      const_row_map;
+  size_t rows = segments ? splits[segments] : 0;
+  size_t per_segment =
+      std::max<size_t>(1, rows / std::max<size_t>(segments, 1));
+  size_t grain = std::max<size_t>(
+      1, 8192 / (per_segment * std::max<size_t>(inner, 1)));
+  parallel::parallel_for(segments, grain, [&](size_t begin, size_t end) {
+    for (size_t s = begin; s < end; s++) {
+      row_map result(out + s * inner, inner);
+      size_t first = splits[s], last = splits[s + 1];
+      if (first == last) {
+        result.setZero();
+        continue;
+      }
+      result = const_row_map(values + first * inner, inner);
+      for (size_t r = first + 1; r < last; r++)
+        reduce(result, const_row_map(values + r * inner, inner));
+      finish(result, last - first);
+    }
+  });
+}
+
+template <class dtype, class Reduce>
+void segment_reduce(const dtype *values, const size_t *splits,
+                    size_t segments, size_t inner, dtype *out,
+                    const Reduce &reduce) {
+  typedef Eigen::Map<Eigen::Array<dtype, Eigen::Dynamic, 1>> row_map;
+  segment_reduce(values, splits, segments, inner, out, reduce,
+                 [](row_map &, size_t) {});
+}
+
+template <class dtype>
+void segment_sum(const dtype *values, const size_t *splits, size_t segments,
+                 size_t inner, dtype *out) {
+  typedef Eigen::Map<Eigen::Array<dtype, Eigen::Dynamic, 1>> row_map;
+  typedef Eigen::Map<const Eigen::Array<dtype, Eigen::Dynamic, 1>>
+      const_row_map;
+  segment_reduce(values, splits, segments, inner, out,
+                 [](row_map &acc, const const_row_map &x) { acc += x; });
+}
+
+template <class dtype>
+void segment_max(const dtype *values, const size_t *splits, size_t segments,
+                 size_t inner, dtype *out) {
+  typedef Eigen::Map<Eigen::Array<dtype, Eigen::Dynamic, 1>> row_map;
+  typedef Eigen::Map<const Eigen::Array<dtype, Eigen::Dynamic, 1>>
+      const_row_map;
+  segment_reduce(values, splits, segments, inner, out,
+                 [](row_map &acc, const const_row_map &x) {
+                   acc = acc.max(x);
+                 });
+}
+
+// the sum divided by the segment length, zeros for an empty segment
+template <class dtype>
+void segment_mean(const dtype *values, const size_t *splits,
+                  size_t segments, size_t inner, dtype *out) {
+  typedef Eigen::Map<Eigen::Array<dtype, Eigen::Dynamic, 1>> row_map;
+  typedef Eigen::Map<const Eigen::Array<dtype, Eigen::Dynamic, 1>>
+      const_row_map;
+  segment_reduce(
+      values, splits, segments, inner, out,
+      [](row_map &acc, const const_row_map &x) { acc += x; },
+      [](row_map &acc, size_t length) {
+        if (length > 1) acc /= dtype(length);
+      });
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,187 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef SOFTMAX_HPP
+#define SOFTMAX_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+#include "Eigen/Core"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Row wise softmax family over [rows, classes]. Every row is read once to
+// find its maximum m and s = sum(exp(x - m)) together (online softmax: a
+// chunk with a larger maximum rescales the running sum by exp(m_old - m))
+// and written once. The exponentials go through Eigen's vectorized exp.
+
+const size_t softmax_chunk = 1024;  // floats of a chunk stay in L1
+
+template <class dtype>
+struct softmax_stats {
+  dtype max = -std::numeric_limits<dtype>::infinity();
+  dtype sum = dtype(0);
+
+  // folds the next chunk of the row in
+  void add(const dtype *x, size_t n) {
+    typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+    Eigen::Map<const array> c(x, n);
+    dtype m = c.maxCoeff();
+    if (m > max) {
+      sum *= std::exp(max - m);
+      max = m;
+    }
+    if (max != -std::numeric_limits<dtype>::infinity())
+      sum += (c - max).exp().sum();
+  }
+
+  // log(sum(exp(x))) of the row
+  inline dtype log_sum_exp() const { return max + std::log(sum); }
+};
+
+template <class dtype>
+softmax_stats<dtype> online_softmax_stats(const dtype *x, size_t n) {
+  softmax_stats<dtype> s;
+  for (size_t i = 0; i < n; i += softmax_chunk)
+    s.add(x + i, std::min(softmax_chunk, n - i));
+  return s;
+}
+
+// rows are independent, wide rows get a thread of their own
+inline size_t softmax_grain(size_t classes) {
+  return std::max<size_t>(1, 16384 / std::max<size_t>(classes, 1));
+}
+
+template <class dtype>
+void softmax(const dtype *x, size_t rows, size_t classes, dtype *out) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  parallel::parallel_for(
+      rows, softmax_grain(classes), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+          const dtype *row = x + r * classes;
+          softmax_stats<dtype> s = online_softmax_stats(row, classes);
+          Eigen::Map<array>(out + r * classes, classes) =
+              (Eigen::Map<const array>(row, classes) - s.max).exp() /
+              s.sum;
+        }
+      });
+}
+
+template <class dtype>
+void log_softmax(const dtype *x, size_t rows, size_t classes, dtype *out) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  parallel::parallel_for(
+      rows, softmax_grain(classes), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+          const dtype *row = x + r * classes;
+          dtype lse = online_softmax_stats(row, classes).log_sum_exp();
+          Eigen::Map<array>(out + r * classes, classes) =
+              Eigen::Map<const array>(row, classes) - lse;
+        }
+      });
+}
+
+// whether `label` is one of `classes` class indices, the sign is only
+// tested for signed label types
+template <class index>
+inline bool label_in_range(index label, size_t classes, std::true_type) {
+  return label >= index(0) && static_cast<size_t>(label) < classes;
+}
+
+template <class index>
+inline bool label_in_range(index label, size_t classes, std::false_type) {
+  return static_cast<size_t>(label) < classes;
+}
+
+// Cross-entropy of softmax(logits) against class indices, one loss per row.
+// When grad is given the backward, softmax - onehot, is written in the same
+// sweep, the probabilities are never stored on their own. The labels are
+// checked before any row is computed.
+template <class dtype, class index>
+void sparse_softmax_cross_entropy_with_logits(const dtype *logits,
+                                              const index *labels, size_t rows,
+                                              size_t classes, dtype *loss,
+                                              dtype *grad = nullptr) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  for (size_t r = 0; r < rows; r++)
+    if (!label_in_range(labels[r], classes, std::is_signed<index>()))
+      throw exceptions::operation_undefined(
+          "Label " + std::to_string(labels[r]) + " of row " +
+          std::to_string(r) + " is out of range for " +
+          std::to_string(classes) + " classes");
+  parallel::parallel_for(
+      rows, softmax_grain(classes), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+          const dtype *row = logits + r * classes;
+          size_t label = static_cast<size_t>(labels[r]);
+          softmax_stats<dtype> s = online_softmax_stats(row, classes);
+          loss[r] = s.log_sum_exp() - row[label];
+          if (!grad) continue;
+          dtype *g = grad + r * classes;
+          Eigen::Map<array>(g, classes) =
+              (Eigen::Map<const array>(row, classes) - s.max).exp() /
+              s.sum;
+          g[label] -= dtype(1);
+        }
+      });
+}
+
+// Cross-entropy against a distribution over the classes (labels has the
+// shape of logits). The label sums needed by the loss are gathered in the
+// read pass, the backward is softmax * sum(labels) - labels, which is
+// softmax - labels for normalized labels. Classes with a zero label add
+// nothing to the loss, even where their logit is -inf.
+template <class dtype>
+void softmax_cross_entropy_with_logits(const dtype *logits,
+                                       const dtype *labels, size_t rows,
+                                       size_t classes, dtype *loss,
+                                       dtype *grad = nullptr) {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  typedef Eigen::Map<const array> const_map;
+  parallel::parallel_for(
+      rows, softmax_grain(classes), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+          const dtype *row = logits + r * classes;
+          const dtype *y = labels + r * classes;
+          softmax_stats<dtype> s;
+          dtype total = dtype(0), dot = dtype(0);
+          for (size_t i = 0; i < classes; i += softmax_chunk) {
+            size_t n = std::min(softmax_chunk, classes - i);
+            const_map c(row + i, n), l(y + i, n);
+            total += l.sum();
+            dot += (l == dtype(0)).select(dtype(0), c * l).sum();
+            s.add(row + i, n);
+          }
+          loss[r] = total * s.log_sum_exp() - dot;
+          if (!grad) continue;
+          Eigen::Map<array>(grad + r * classes, classes) =
+              (const_map(row, classes) - s.max).exp() * (total / s.sum) -
+              const_map(y, classes);
+        }
+      });
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
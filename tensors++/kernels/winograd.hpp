@@ -0,0 +1,250 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef WINOGRAD_HPP
+#define WINOGRAD_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/kernels/activation.hpp"
+#include "tensors++/kernels/conv.hpp"
+#include "tensors++/kernels/gemm.hpp"
+
+namespace tensors {
+namespace kernels {
+
+// Transform matrices of the minimal filtering algorithm F(m x m, 3 x 3)
+// (Lavin and Gray, "Fast Algorithms for Convolutional Neural Networks"),
+// every tile covers m + 2 input pixels per side. F(2x2) needs 2.25 times
+// fewer multiplies than direct convolution, F(4x4) 4 times fewer at a
+// somewhat larger rounding error.
+struct winograd_transform {
+  size_t m, a;         // output and input tile size
+  const double *bt;    // [a][a]
+  const double *g;     // [a][3]
+  const double *at;    // [m][a]
+
+  static winograd_transform get(size_t m) {
+    static const double bt2[] = {1, 0, -1, 0,  //
+                                 0, 1, 1,  0,  //
+                                 0, -1, 1, 0,  //
+                                 0, 1, 0,  -1};
+    static const double g2[] = {1,   0,    0,    //
+                                0.5, 0.5,  0.5,  //
+                                0.5, -0.5, 0.5,  //
+                                0,   0,    1};
+    static const double at2[] = {1, 1, 1,  0,  //
+                                 0, 1, -1, -1};
+    static const double bt4[] = {4, 0,  -5, 0,  1, 0,  //
+                                 0, -4, -4, 1,  1, 0,  //
+                                 0, 4,  -4, -1, 1, 0,  //
+                                 0, -2, -1, 2,  1, 0,  //
+                                 0, 2,  -1, -2, 1, 0,  //
+                                 0, 4,  0,  -5, 0, 1};
+    static const double g4[] = {1.0 / 4,   0,         0,          //
+                                -1.0 / 6,  -1.0 / 6,  -1.0 / 6,   //
+                                -1.0 / 6,  1.0 / 6,   -1.0 / 6,   //
+                                1.0 / 24,  1.0 / 12,  1.0 / 6,    //
+                                1.0 / 24,  -1.0 / 12, 1.0 / 6,    //
+                                0,         0,         1};
+    static const double at4[] = {1, 1, 1,  1, 1,  0,  //
+                                 0, 1, -1, 2, -2, 0,  //
+                                 0, 1, 1,  4, 4,  0,  //
+                                 0, 1, -1, 8, -8, 1};
+    if (m == 4) return {4, 6, bt4, g4, at4};
+    return {2, 4, bt2, g2, at2};
+  }
+};
+
+// The larger tile only pays off when the output holds enough whole tiles.
+inline size_t winograd_tile(const conv2d_params &p) {
+  return p.out_h() >= 8 && p.out_w() >= 8 ? 4 : 2;
+}
+
+// U = G g G^T for every (input, output) channel pair of the HWIO filter,
+// laid out as a * a matrices of [in_c, out_c], the right hand sides of the
+// batched GEMMs. Computing it is as costly as a small convolution, frozen
+// layers keep it.
+template <class dtype>
+std::vector<dtype> winograd_filter_transform(const conv2d_params &p,
+                                             const dtype *filter, size_t m) {
+  winograd_transform t = winograd_transform::get(m);
+  size_t a = t.a, ck = p.in_c * p.out_c;
+  std::vector<dtype> u(a * a * ck);
+  std::vector<dtype> tmp(a * 3 * p.out_c);
+  for (size_t c = 0; c < p.in_c; c++) {
+    // tmp = G g, vectorized over the output channels
+    std::fill(tmp.begin(), tmp.end(), dtype(0));
+    for (size_t i = 0; i < a; i++)
+      for (size_t r = 0; r < 3; r++) {
+        dtype gi = dtype(t.g[i * 3 + r]);
+        if (gi == dtype(0)) continue;
+        for (size_t q = 0; q < 3; q++) {
+          const dtype *src = filter + ((r * 3 + q) * p.in_c + c) * p.out_c;
+          dtype *dst = tmp.data() + (i * 3 + q) * p.out_c;
+          for (size_t k = 0; k < p.out_c; k++) dst[k] += gi * src[k];
+        }
+      }
+    // U = tmp G^T
+    for (size_t i = 0; i < a; i++)
+      for (size_t j = 0; j < a; j++) {
+        dtype *dst = u.data() + (i * a + j) * ck + c * p.out_c;
+        std::fill(dst, dst + p.out_c, dtype(0));
+        for (size_t q = 0; q < 3; q++) {
+          dtype gj = dtype(t.g[j * 3 + q]);
+          if (gj == dtype(0)) continue;
+          const dtype *src = tmp.data() + (i * 3 + q) * p.out_c;
+          for (size_t k = 0; k < p.out_c; k++) dst[k] += gj * src[k];
+        }
+      }
+  }
+  return u;
+}
+
+// tiles transformed and multiplied together, small enough that the
+// transformed inputs and products of a block stay in L2
+const size_t winograd_tile_block = 64;
+
+// Winograd convolution with tile size m (2 or 4) over NHWC input, `u` from
+// winograd_filter_transform. Tiles are processed in blocks: the input
+// transform V = B^T d B of a block is written as a * a matrices of
+// [tiles, in_c], each multiplied by its U in one GEMM, and the output
+// transform A^T M A adds the bias and applies the activation on the way to
+// the output. Blocks run in parallel.
+template <class dtype>
+void conv2d_winograd(const conv2d_params &p, const dtype *input,
+                     const dtype *u, const dtype *bias, dtype *output,
+                     activation act = activation::linear, size_t m = 4) {
+  typedef Eigen::Map<const row_major<dtype>> const_matrix_map;
+  typedef Eigen::Map<row_major<dtype>> matrix_map;
+  winograd_transform t = winograd_transform::get(m);
+  size_t a = t.a;
+  size_t oh = p.out_h(), ow = p.out_w();
+  size_t tiles_h = (oh + m - 1) / m, tiles_w = (ow + m - 1) / m;
+  size_t tiles = p.batch * tiles_h * tiles_w;
+  size_t blocks = (tiles + winograd_tile_block - 1) / winograd_tile_block;
+  size_t C = p.in_c, K = p.out_c;
+
+  parallel::parallel_for(blocks, 1, [&](size_t begin, size_t end) {
+    const size_t tb = winograd_tile_block;
+    std::vector<dtype> v(a * a * tb * C), prod(a * a * tb * K);
+    std::vector<dtype> d(a * a * C), tmp(a * a * std::max(C, K));
+    std::vector<dtype> y(m * m * K);
+
+    for (size_t blk = begin; blk < end; blk++) {
+      size_t first = blk * tb, count = std::min(tb, tiles - first);
+
+      // input transform, vectorized over the channels
+      for (size_t i = 0; i < count; i++) {
+        size_t tile = first + i;
+        size_t n = tile / (tiles_h * tiles_w);
+        size_t ty = tile / tiles_w % tiles_h, tx = tile % tiles_w;
+        long y0 = long(ty * m) - long(p.pad_top);
+        long x0 = long(tx * m) - long(p.pad_left);
+        for (size_t r = 0; r < a; r++)
+          for (size_t q = 0; q < a; q++) {
+            long iy = y0 + long(r), ix = x0 + long(q);
+            dtype *dst = d.data() + (r * a + q) * C;
+            if (iy < 0 || ix < 0 || iy >= long(p.in_h) || ix >= long(p.in_w))
+              std::fill(dst, dst + C, dtype(0));
+            else {
+              const dtype *src =
+                  input + ((n * p.in_h + iy) * p.in_w + ix) * C;
+              std::copy(src, src + C, dst);
+            }
+          }
+        // tmp = B^T d
+        for (size_t r = 0; r < a; r++)
+          for (size_t q = 0; q < a; q++) {
+            dtype *dst = tmp.data() + (r * a + q) * C;
+            std::fill(dst, dst + C, dtype(0));
+            for (size_t s = 0; s < a; s++) {
+              dtype b = dtype(t.bt[r * a + s]);
+              if (b == dtype(0)) continue;
+              const dtype *src = d.data() + (s * a + q) * C;
+              for (size_t c = 0; c < C; c++) dst[c] += b * src[c];
+            }
+          }
+        // V = tmp B, scattered into the per (r, q) GEMM operands
+        for (size_t r = 0; r < a; r++)
+          for (size_t q = 0; q < a; q++) {
+            dtype *dst = v.data() + ((r * a + q) * tb + i) * C;
+            std::fill(dst, dst + C, dtype(0));
+            for (size_t s = 0; s < a; s++) {
+              dtype b = dtype(t.bt[q * a + s]);
+              if (b == dtype(0)) continue;
+              const dtype *src = tmp.data() + (r * a + s) * C;
+              for (size_t c = 0; c < C; c++) dst[c] += b * src[c];
+            }
+          }
+      }
+
+      // the element-wise products of all tiles and channels, as a * a GEMMs
+      for (size_t e = 0; e < a * a; e++)
+        matrix_map(prod.data() + e * tb * K, count, K).noalias() =
+            const_matrix_map(v.data() + e * tb * C, count, C) *
+            const_matrix_map(u + e * C * K, C, K);
+
+      // output transform, bias and activation
+      for (size_t i = 0; i < count; i++) {
+        size_t tile = first + i;
+        size_t n = tile / (tiles_h * tiles_w);
+        size_t ty = tile / tiles_w % tiles_h, tx = tile % tiles_w;
+        // tmp = A^T M, [m][a][K]
+        for (size_t r = 0; r < m; r++)
+          for (size_t q = 0; q < a; q++) {
+            dtype *dst = tmp.data() + (r * a + q) * K;
+            std::fill(dst, dst + K, dtype(0));
+            for (size_t s = 0; s < a; s++) {
+              dtype at = dtype(t.at[r * a + s]);
+              if (at == dtype(0)) continue;
+              const dtype *src = prod.data() + ((s * a + q) * tb + i) * K;
+              for (size_t k = 0; k < K; k++) dst[k] += at * src[k];
+            }
+          }
+        // Y = tmp A
+        for (size_t r = 0; r < m; r++)
+          for (size_t q = 0; q < m; q++) {
+            dtype *dst = y.data() + (r * m + q) * K;
+            if (bias)
+              std::copy(bias, bias + K, dst);
+            else
+              std::fill(dst, dst + K, dtype(0));
+            for (size_t s = 0; s < a; s++) {
+              dtype at = dtype(t.at[q * a + s]);
+              if (at == dtype(0)) continue;
+              const dtype *src = tmp.data() + (r * a + s) * K;
+              for (size_t k = 0; k < K; k++) dst[k] += at * src[k];
+            }
+          }
+        apply_activation(act, y.data(), m * m * K);
+        for (size_t r = 0; r < m && ty * m + r < oh; r++)
+          for (size_t q = 0; q < m && tx * m + q < ow; q++)
+            std::copy(y.data() + (r * m + q) * K,
+                      y.data() + (r * m + q + 1) * K,
+                      output + ((n * oh + ty * m + r) * ow + tx * m + q) * K);
+      }
+    }
+  });
+}
+
+}  // namespace kernels
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,347 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef ATTENTION_LAYERS_HPP
+#define ATTENTION_LAYERS_HPP
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/ragged_tensor.hpp"
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/attention.hpp"
+#include "tensors++/kernels/gemm.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace layers {
+
+// Keys and values of the positions decoded so far, [batch, capacity, width]
+// each, grown by doubling. One cache belongs to one layer and one batch of
+// sequences; clear() starts new sequences.
+template <class dtype = float>
+class kv_cache {
+  std::vector<dtype> k, v;
+  size_t batch = 0, rows = 0, count = 0, reserved;
+  size_t key_width = 0, value_width = 0;
+
+  void grow(size_t needed) {
+    size_t fresh = std::max({needed, 2 * rows, reserved});
+    std::vector<dtype> nk(batch * fresh * key_width);
+    std::vector<dtype> nv(batch * fresh * value_width);
+    for (size_t b = 0; b < batch; b++) {
+      std::copy_n(k.data() + b * rows * key_width, count * key_width,
+                  nk.data() + b * fresh * key_width);
+      std::copy_n(v.data() + b * rows * value_width, count * value_width,
+                  nv.data() + b * fresh * value_width);
+    }
+    k.swap(nk);
+    v.swap(nv);
+    rows = fresh;
+  }
+
+ public:
+  // reserve positions up front to avoid regrowing while decoding
+  explicit kv_cache(size_t reserve = 0) : reserved(reserve) {}
+
+  // appends `steps` positions of every sequence, keys and values being rows
+  // of [batch, steps, row_stride]
+  void append(const dtype *keys, const dtype *values, size_t row_stride,
+              size_t batch_size, size_t steps, size_t key_w, size_t value_w) {
+    if (batch != batch_size || key_width != key_w || value_width != value_w) {
+      if (count)
+        throw exceptions::operation_undefined(
+            "kv_cache holds a different batch or attention layer");
+      batch = batch_size;
+      key_width = key_w;
+      value_width = value_w;
+      rows = 0;
+    }
+    if (count + steps > rows) grow(count + steps);
+    for (size_t b = 0; b < batch; b++)
+      for (size_t s = 0; s < steps; s++) {
+        const dtype *from = keys + (b * steps + s) * row_stride;
+        std::copy_n(from, key_width,
+                    k.data() + (b * rows + count + s) * key_width);
+        from = values + (b * steps + s) * row_stride;
+        std::copy_n(from, value_width,
+                    v.data() + (b * rows + count + s) * value_width);
+      }
+    count += steps;
+  }
+
+  inline void clear() { count = 0; }
+  inline size_t length() const { return count; }
+  inline size_t capacity() const { return rows; }
+  inline const dtype *keys() const { return k.data(); }
+  inline const dtype *values() const { return v.data(); }
+};
+
+// Multi-head self-attention over [batch, seq, features] (Keras
+// MultiHeadAttention with query, key and value all the input).
+//
+// The query, key and value projections run as one GEMM over a fused
+// [features, heads * (2 * key_dim + value_dim)] kernel, packed on every
+// call or once by freeze(). Attention itself is computed tile by tile with
+// an online softmax (kernels::flash_attention), so memory stays O(seq)
+// instead of the O(seq^2) score matrix. causal masks the future positions,
+// and step() decodes incrementally against a kv_cache.
+template <class dtype = float>
+class MultiHeadAttention : public Layer<dtype> {
+  size_t heads, key_dim, value_dim;
+  bool causal, use_bias;
+  size_t features = 0;
+  std::unique_ptr<tensor<dtype>> query_kernel, query_bias, key_kernel,
+      key_bias, value_kernel, value_bias, output_kernel, output_bias;
+  std::vector<dtype> packed_qkv, packed_qkv_bias;
+  std::vector<dtype> gemm_qkv, gemm_output;  // GEMM panels while frozen
+  bool packed_frozen = false;  // packed from frozen weights, still valid
+
+  static const dtype *read(const std::unique_ptr<tensor<dtype>> &t) {
+    return t ? static_cast<const tensor<dtype> &>(*t).raw_data() : nullptr;
+  }
+
+  inline size_t qkv_width() const { return heads * (2 * key_dim + value_dim); }
+
+  const dtype *panels(const std::vector<dtype> &gemm) const {
+    return packed_frozen && !gemm.empty() ? gemm.data() : nullptr;
+  }
+
+  void pack() {
+    size_t qk = heads * key_dim, vw = heads * value_dim, width = qkv_width();
+    packed_qkv.resize(features * width);
+    const dtype *wq = read(query_kernel), *wk = read(key_kernel),
+                *wv = read(value_kernel);
+    for (size_t e = 0; e < features; e++) {
+      dtype *row = packed_qkv.data() + e * width;
+      std::copy_n(wq + e * qk, qk, row);
+      std::copy_n(wk + e * qk, qk, row + qk);
+      std::copy_n(wv + e * vw, vw, row + 2 * qk);
+    }
+    packed_qkv_bias.clear();
+    if (use_bias) {
+      packed_qkv_bias.resize(width);
+      std::copy_n(read(query_bias), qk, packed_qkv_bias.data());
+      std::copy_n(read(key_bias), qk, packed_qkv_bias.data() + qk);
+      std::copy_n(read(value_bias), vw, packed_qkv_bias.data() + 2 * qk);
+    }
+  }
+
+  void check(const shape::Shape &s) const {
+    if (s.dimension() != 3 || s.d[2] != features)
+      throw exceptions::operation_undefined(
+          "MultiHeadAttention layer " + this->name() + " was built for " +
+          std::to_string(features) + " features, got " +
+          std::string(shape::Shape(s)));
+  }
+
+  // fused query, key and value projection of every row of x
+  std::vector<dtype> project(const tensor<dtype> &x, size_t rows) {
+    if (!packed_frozen) pack();
+    std::vector<dtype> qkv(rows * qkv_width());
+    kernels::gemm_bias_activation(
+        x.raw_data(), packed_qkv.data(),
+        packed_qkv_bias.empty() ? nullptr : packed_qkv_bias.data(),
+        qkv.data(), rows, features, qkv_width(), kernels::activation::linear,
+        panels(gemm_qkv));
+    return qkv;
+  }
+
+  kernels::attention_params geometry(size_t batch, size_t q_len) const {
+    kernels::attention_params p;
+    p.batch = batch;
+    p.heads = heads;
+    p.q_len = p.kv_len = q_len;
+    p.key_dim = key_dim;
+    p.value_dim = value_dim;
+    p.q_stride = p.k_stride = p.v_stride = qkv_width();
+    p.q_batch = p.k_batch = p.v_batch = q_len * qkv_width();
+    p.out_stride = heads * value_dim;
+    p.out_batch = q_len * heads * value_dim;
+    p.causal = causal;
+    return p;
+  }
+
+  tensor<dtype> output(const std::vector<dtype> &attended, size_t batch,
+                       size_t seq) {
+    std::vector<dtype> out(batch * seq * features);
+    kernels::gemm_bias_activation(
+        attended.data(), read(output_kernel), read(output_bias), out.data(),
+        batch * seq, heads * value_dim, features, kernels::activation::linear,
+        panels(gemm_output));
+    return tensor<dtype>(
+        std::move(out),
+        shape::Shape({uint(batch), uint(seq), uint(features)}));
+  }
+
+ protected:
+  void build(const shape::Shape &input_shape) override {
+    if (input_shape.dimension() != 3)
+      throw exceptions::operation_undefined(
+          "MultiHeadAttention expects [batch, seq, features] inputs");
+    features = input_shape.d[2];
+    size_t qk = heads * key_dim, vw = heads * value_dim;
+    auto make = [](size_t rows, size_t cols) {
+      return new tensor<dtype>(glorot_uniform<dtype>(rows, cols, rows * cols),
+                               shape::Shape({uint(rows), uint(cols)}));
+    };
+    auto zeros = [](size_t n) {
+      return new tensor<dtype>(std::vector<dtype>(n, dtype(0)),
+                               shape::Shape({uint(n)}));
+    };
+    query_kernel.reset(make(features, qk));
+    key_kernel.reset(make(features, qk));
+    value_kernel.reset(make(features, vw));
+    output_kernel.reset(make(vw, features));
+    if (use_bias) {
+      query_bias.reset(zeros(qk));
+      key_bias.reset(zeros(qk));
+      value_bias.reset(zeros(vw));
+      output_bias.reset(zeros(features));
+    }
+  }
+
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    shape::Shape s = input.shape();
+    check(s);
+    size_t batch = s.d[0], seq = s.d[1], qk = heads * key_dim;
+    std::vector<dtype> qkv = project(input, batch * seq);
+    std::vector<dtype> attended(batch * seq * heads * value_dim);
+    kernels::flash_attention(geometry(batch, seq), qkv.data(),
+                             qkv.data() + qk, qkv.data() + 2 * qk,
+                             attended.data());
+    return output(attended, batch, seq);
+  }
+
+ public:
+  // value_dim 0 means key_dim
+  MultiHeadAttention(size_t num_heads, size_t key_dim, size_t value_dim = 0,
+                     bool causal = false, bool use_bias = true,
+                     std::string name = "multi_head_attention")
+      : Layer<dtype>(std::move(name)),
+        heads(num_heads),
+        key_dim(key_dim),
+        value_dim(value_dim ? value_dim : key_dim),
+        causal(causal),
+        use_bias(use_bias) {
+    if (heads == 0 || key_dim == 0)
+      throw exceptions::operation_undefined(
+          "MultiHeadAttention needs at least one head and key dimension");
+  }
+
+  using Layer<dtype>::operator();
+
+  // Sequences of different lengths, values [total, features]: the fused
+  // projections run over the real rows only, each sequence attends within
+  // itself (sequences in parallel) and the result keeps the row splits.
+  // Nothing is padded, so there are no masked scores to compute.
+  ragged_tensor<dtype> operator()(const ragged_tensor<dtype> &input) {
+    const tensor<dtype> &x = input.values();
+    size_t total = input.total_rows(), batch = input.nrows();
+    uint width = x.shape().d.back();
+    this->ensure_built(
+        shape::Shape({uint(batch), uint(input.max_length()), width}));
+    if (x.shape().dimension() != 2)
+      throw exceptions::operation_undefined(
+          "MultiHeadAttention expects ragged values [total, features]");
+    check(shape::Shape({1, uint(total), width}));
+    size_t qk = heads * key_dim, hv = heads * value_dim;
+    std::vector<dtype> qkv = project(x, total);
+    std::vector<dtype> attended(total * hv);
+    const std::vector<size_t> &splits = input.row_splits();
+    parallel::parallel_for(batch, 1, [&](size_t begin, size_t end) {
+      for (size_t b = begin; b < end; b++) {
+        size_t len = input.row_length(b);
+        if (len == 0) continue;
+        const dtype *rows = qkv.data() + splits[b] * qkv_width();
+        kernels::flash_attention(geometry(1, len), rows, rows + qk,
+                                 rows + 2 * qk,
+                                 attended.data() + splits[b] * hv);
+      }
+    });
+    std::vector<dtype> out(total * features);
+    kernels::gemm_bias_activation(attended.data(), read(output_kernel),
+                                  read(output_bias), out.data(), total, hv,
+                                  features);
+    return input.with_values(tensor<dtype>(
+        out, shape::Shape({uint(total), uint(features)})));
+  }
+
+  // Incremental decoding: x holds the next positions [batch, steps,
+  // features] of sequences whose earlier keys and values are in cache. They
+  // are appended to the cache and attend to every cached position (with
+  // causal set, the new positions among themselves only to earlier ones).
+  tensor<dtype> step(const tensor<dtype> &x, kv_cache<dtype> &cache) {
+    this->ensure_built(x.shape());
+    shape::Shape s = x.shape();
+    check(s);
+    size_t batch = s.d[0], steps = s.d[1], qk = heads * key_dim;
+    std::vector<dtype> qkv = project(x, batch * steps);
+    cache.append(qkv.data() + qk, qkv.data() + 2 * qk, qkv_width(), batch,
+                 steps, qk, heads * value_dim);
+
+    kernels::attention_params p = geometry(batch, steps);
+    p.kv_len = cache.length();
+    p.q_start = cache.length() - steps;
+    p.k_stride = qk;
+    p.v_stride = heads * value_dim;
+    p.k_batch = cache.capacity() * p.k_stride;
+    p.v_batch = cache.capacity() * p.v_stride;
+    std::vector<dtype> attended(batch * steps * heads * value_dim);
+    kernels::flash_attention(p, qkv.data(), cache.keys(), cache.values(),
+                             attended.data());
+    return output(attended, batch, steps);
+  }
+
+  // query, key, value and output kernels, each followed by its bias
+  std::vector<tensor<dtype> *> weights() override {
+    std::vector<tensor<dtype> *> w;
+    for (auto *t : {&query_kernel, &query_bias, &key_kernel, &key_bias,
+                    &value_kernel, &value_bias, &output_kernel, &output_bias})
+      if (*t) w.push_back(t->get());
+    return w;
+  }
+
+  // packs the frozen projections once for every later call
+  void freeze() override {
+    Layer<dtype>::freeze();
+    packed_frozen = false;
+    if (query_kernel) {
+      pack();
+      gemm_qkv = kernels::pack_gemm_b(packed_qkv.data(), features, qkv_width());
+      gemm_output = kernels::pack_gemm_b(read(output_kernel),
+                                         heads * value_dim, features);
+      packed_frozen = true;
+    }
+  }
+
+  void unfreeze() override {
+    Layer<dtype>::unfreeze();
+    packed_frozen = false;
+  }
+
+  inline size_t num_heads() const { return heads; }
+  inline bool is_causal() const { return causal; }
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
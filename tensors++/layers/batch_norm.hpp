@@ -0,0 +1,129 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef BATCH_NORM_HPP
+#define BATCH_NORM_HPP
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/batch_norm.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace layers {
+
+// Batch normalization over the last (channel) axis.
+//
+// While training the batch statistics come from one fused pass
+// (kernels::channel_moments) and update the moving averages; at inference
+// the moving statistics are used. Either way the output is written by a
+// single x * scale + shift pass. After a Conv2D, Conv1D or Dense layer the
+// inference transform can be folded into that layer's weights, see
+// models::Sequential::fold_batch_norm.
+template <class dtype = float>
+class BatchNormalization : public Layer<dtype> {
+  dtype momentum, epsilon;
+  size_t channels = 0;
+  std::unique_ptr<tensor<dtype>> gamma, beta, moving_mean, moving_variance;
+
+  const dtype *read(const std::unique_ptr<tensor<dtype>> &t) const {
+    return static_cast<const tensor<dtype> &>(*t).raw_data();
+  }
+
+ protected:
+  void build(const shape::Shape &input_shape) override {
+    if (input_shape.dimension() == 0)
+      throw exceptions::operation_undefined(
+          "BatchNormalization expects inputs with a channel axis");
+    channels = input_shape.d.back();
+    shape::Shape s({uint(channels)});
+    gamma.reset(new tensor<dtype>(std::vector<dtype>(channels, dtype(1)), s));
+    beta.reset(new tensor<dtype>(std::vector<dtype>(channels, dtype(0)), s));
+    moving_mean.reset(
+        new tensor<dtype>(std::vector<dtype>(channels, dtype(0)), s));
+    moving_variance.reset(
+        new tensor<dtype>(std::vector<dtype>(channels, dtype(1)), s));
+  }
+
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    if (input.shape().d.back() != channels)
+      throw exceptions::operation_undefined(
+          "BatchNormalization layer " + this->name() + " was built for " +
+          std::to_string(channels) + " channels");
+    size_t rows = input.size() / channels;
+    std::vector<dtype> scale, shift;
+    if (this->training()) {
+      std::vector<dtype> mean(channels), variance(channels);
+      kernels::channel_moments(input.raw_data(), rows, channels, mean.data(),
+                               variance.data());
+      affine(mean.data(), variance.data(), scale, shift);
+      if (!moving_mean->frozen() && !moving_variance->frozen()) {
+        dtype *m = moving_mean->raw_data(), *v = moving_variance->raw_data();
+        for (size_t c = 0; c < channels; c++) {
+          m[c] = momentum * m[c] + (dtype(1) - momentum) * mean[c];
+          v[c] = momentum * v[c] + (dtype(1) - momentum) * variance[c];
+        }
+      }
+    } else
+      inference_affine(scale, shift);
+
+    std::vector<dtype> output(input.size());
+    kernels::channel_affine(input.raw_data(), rows, channels, scale.data(),
+                            shift.data(), output.data());
+    return tensor<dtype>(std::move(output), input.shape());
+  }
+
+  void affine(const dtype *mean, const dtype *variance,
+              std::vector<dtype> &scale, std::vector<dtype> &shift) const {
+    const dtype *g = read(gamma), *b = read(beta);
+    scale.resize(channels);
+    shift.resize(channels);
+    for (size_t c = 0; c < channels; c++) {
+      scale[c] = g[c] / std::sqrt(variance[c] + epsilon);
+      shift[c] = b[c] - mean[c] * scale[c];
+    }
+  }
+
+ public:
+  explicit BatchNormalization(dtype momentum = dtype(0.99),
+                              dtype epsilon = dtype(1e-3),
+                              std::string name = "batch_normalization")
+      : Layer<dtype>(std::move(name)), momentum(momentum), epsilon(epsilon) {}
+
+  // gamma, beta, moving mean and moving variance, in the Keras order
+  std::vector<tensor<dtype> *> weights() override {
+    if (!gamma) return {};
+    return {gamma.get(), beta.get(), moving_mean.get(),
+            moving_variance.get()};
+  }
+
+  // the transform applied at inference, y = x * scale + shift per channel
+  void inference_affine(std::vector<dtype> &scale,
+                        std::vector<dtype> &shift) const {
+    affine(read(moving_mean), read(moving_variance), scale, shift);
+  }
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,254 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CONV1D_HPP
+#define CONV1D_HPP
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/activation.hpp"
+#include "tensors++/kernels/conv.hpp"
+#include "tensors++/kernels/fft_conv.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace layers {
+
+// 1-D convolution over NWC signals ([batch, steps, channels]), kernel
+// [kernel_size, in_c / groups, filters].
+//
+// padding is "valid", "same" or "causal" (the output at step t only sees
+// inputs up to t). Short kernels run on the 2-D kernels as a single row
+// image, long ones (see kernels::choose_conv_algorithm) through FFT
+// overlap-add with filter spectra cached while the layer is frozen. An
+// automatically chosen FFT waits for the layer to be frozen, until then the
+// 2-D kernels run. stream() convolves a signal that arrives in chunks.
+template <class dtype = float>
+class Conv1D : public Layer<dtype> {
+  size_t filters, kernel_size, stride, dilation;
+  std::string padding;
+  size_t groups;
+  kernels::activation act;
+  bool use_bias;
+  kernels::conv_algorithm algorithm;
+  bool automatic;  // algorithm picked by choose_conv_algorithm
+  std::unique_ptr<tensor<dtype>> kernel, bias;
+  std::vector<dtype> packed;
+  std::shared_ptr<const kernels::conv1d_spectra<dtype>> spectra;
+  kernels::conv_algorithm packed_for = kernels::conv_algorithm::automatic;
+  bool packed_frozen = false;
+  size_t in_c = 0;
+
+ protected:
+  kernels::conv2d_params geometry(size_t batch, size_t steps) const {
+    kernels::conv2d_params p;
+    p.batch = batch;
+    p.in_h = 1;
+    p.in_w = steps;
+    p.in_c = in_c;
+    p.out_c = filters;
+    p.kernel_w = kernel_size;
+    p.stride_w = stride;
+    p.dilation_w = dilation;
+    p.groups = groups;
+    size_t span = dilation * (kernel_size - 1) + 1;
+    if (padding == "causal") {
+      p.pad_left = span - 1;
+    } else if (padding == "same") {
+      size_t out = (steps + stride - 1) / stride;
+      long total = long((out - 1) * stride + span) - long(steps);
+      total = std::max(total, 0L);
+      p.pad_left = size_t(total / 2);
+      p.pad_right = size_t(total) - p.pad_left;
+    }
+    return p;
+  }
+
+  // the kernel this call runs on
+  kernels::conv_algorithm running(const kernels::conv2d_params &p) const {
+    if (automatic && algorithm == kernels::conv_algorithm::fft &&
+        !kernel->frozen())
+      return kernels::choose_conv_algorithm<dtype>(p, false);
+    return algorithm;
+  }
+
+  void pack(const kernels::conv2d_params &p, kernels::conv_algorithm run) {
+    const dtype *w = static_cast<const tensor<dtype> &>(*kernel).raw_data();
+    packed_for = run;
+    packed.clear();
+    spectra.reset();
+    if (run == kernels::conv_algorithm::fft)
+      spectra = std::make_shared<const kernels::conv1d_spectra<dtype>>(
+          kernels::fft_conv1d_spectra(p, w));
+    else if (run == kernels::conv_algorithm::direct)
+      packed = kernels::pack_direct_filter(p, w);
+    else if (groups > 1)
+      packed = kernels::pack_im2col_filter(p, w);
+  }
+
+  void build(const shape::Shape &input_shape) override {
+    if (input_shape.dimension() != 3)
+      throw exceptions::operation_undefined(
+          "Conv1D expects [batch, steps, channels] inputs");
+    in_c = input_shape.d[2];
+    if (in_c % groups != 0 || filters % groups != 0)
+      throw exceptions::operation_undefined(
+          "Conv1D groups must divide both the input channels and the filters");
+    kernels::conv2d_params p = geometry(input_shape.d[0], input_shape.d[1]);
+    if (algorithm == kernels::conv_algorithm::automatic)
+      algorithm = kernels::choose_conv_algorithm<dtype>(p);
+    if (algorithm == kernels::conv_algorithm::winograd)
+      throw exceptions::operation_undefined(
+          "Winograd convolution is only available for 3x3 Conv2D");
+    if (algorithm == kernels::conv_algorithm::fft && groups != 1)
+      throw exceptions::operation_undefined(
+          "FFT convolution does not support groups");
+
+    size_t fan_in = kernel_size * (in_c / groups);
+    size_t fan_out = kernel_size * filters / groups;
+    kernel.reset(new tensor<dtype>(
+        glorot_uniform<dtype>(fan_in, fan_out, fan_in * filters),
+        shape::Shape(
+            {uint(kernel_size), uint(in_c / groups), uint(filters)})));
+    if (use_bias)
+      bias.reset(new tensor<dtype>(std::vector<dtype>(filters, dtype(0)),
+                                   shape::Shape({uint(filters)})));
+  }
+
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    shape::Shape s = input.shape();
+    if (s.dimension() != 3 || s.d[2] != in_c)
+      throw exceptions::operation_undefined(
+          "Conv1D layer " + this->name() + " was built for " +
+          std::to_string(in_c) + " input channels, got " + std::string(s));
+    kernels::conv2d_params p = geometry(s.d[0], s.d[1]);
+    if (p.in_w + p.pad_left + p.pad_right < dilation * (kernel_size - 1) + 1)
+      throw exceptions::operation_undefined(
+          "Conv1D input is shorter than the kernel " + std::string(s));
+    kernels::conv_algorithm run = running(p);
+    if (!packed_frozen || packed_for != run) {
+      pack(p, run);
+      packed_frozen = kernel->frozen();
+    }
+
+    std::vector<dtype> output(p.batch * p.out_w() * filters);
+    const dtype *x = input.raw_data();
+    const dtype *b =
+        bias ? static_cast<const tensor<dtype> &>(*bias).raw_data() : nullptr;
+    const dtype *w =
+        packed.empty() ? static_cast<const tensor<dtype> &>(*kernel).raw_data()
+                       : packed.data();
+    if (run == kernels::conv_algorithm::fft)
+      kernels::conv1d_fft(p, *spectra, x, b, output.data(), act);
+    else if (run == kernels::conv_algorithm::direct)
+      kernels::conv2d_direct(p, x, w, b, output.data(), act);
+    else
+      kernels::conv2d_im2col(p, x, w, b, output.data(), act);
+    return tensor<dtype>(
+        std::move(output),
+        shape::Shape({uint(p.batch), uint(p.out_w()), uint(filters)}));
+  }
+
+ public:
+  Conv1D(size_t filters, size_t kernel_size, size_t stride = 1,
+         std::string padding = "valid", size_t dilation = 1, size_t groups = 1,
+         const std::string &activation = "linear", bool use_bias = true,
+         kernels::conv_algorithm algorithm = kernels::conv_algorithm::automatic,
+         std::string name = "conv1d")
+      : Layer<dtype>(std::move(name)),
+        filters(filters),
+        kernel_size(kernel_size),
+        stride(stride),
+        dilation(dilation),
+        padding(std::move(padding)),
+        groups(groups),
+        act(kernels::activation_from_name(activation)),
+        use_bias(use_bias),
+        algorithm(algorithm),
+        automatic(algorithm == kernels::conv_algorithm::automatic) {
+    if (this->padding != "valid" && this->padding != "same" &&
+        this->padding != "causal")
+      throw exceptions::operation_undefined("Unknown padding " +
+                                            this->padding);
+    if (groups == 0 || filters == 0 || kernel_size == 0)
+      throw exceptions::operation_undefined(
+          "Conv1D needs at least one filter, one tap and one group");
+  }
+
+  std::vector<tensor<dtype> *> weights() override {
+    std::vector<tensor<dtype> *> w;
+    if (kernel) w.push_back(kernel.get());
+    if (bias) w.push_back(bias.get());
+    return w;
+  }
+
+  void freeze() override {
+    Layer<dtype>::freeze();
+    packed_frozen = false;
+  }
+
+  void unfreeze() override {
+    Layer<dtype>::unfreeze();
+    packed_frozen = false;
+  }
+
+  bool fold_affine(const std::vector<dtype> &scale,
+                   const std::vector<dtype> &shift) override {
+    if (!kernel || act != kernels::activation::linear ||
+        scale.size() != filters)
+      return false;
+    fold_affine_into(*kernel, bias, scale, shift);
+    packed_frozen = false;
+    return true;
+  }
+
+  // Streaming form of this layer for a single signal: each push returns
+  // the outputs that its frames complete, as a "causal" layer would, minus
+  // the zero history. Needs a built and frozen layer without groups or
+  // strides; the stream shares the filter spectra and reads the bias in
+  // place, so the layer has to outlive it.
+  kernels::conv1d_stream<dtype> stream() {
+    if (!this->is_built() || !kernel->frozen())
+      throw exceptions::operation_undefined(
+          "Conv1D streams need a built and frozen layer");
+    if (groups != 1 || stride != 1)
+      throw exceptions::operation_undefined(
+          "Conv1D streams do not support groups or strides");
+    std::shared_ptr<const kernels::conv1d_spectra<dtype>> s = spectra;
+    if (!s || !packed_frozen)
+      s = std::make_shared<const kernels::conv1d_spectra<dtype>>(
+          kernels::fft_conv1d_spectra(
+              geometry(1, dilation * (kernel_size - 1) + 1),
+              static_cast<const tensor<dtype> &>(*kernel).raw_data()));
+    return kernels::conv1d_stream<dtype>(
+        s, bias ? static_cast<const tensor<dtype> &>(*bias).raw_data()
+                : nullptr,
+        act);
+  }
+
+  inline kernels::conv_algorithm conv_algorithm() const { return algorithm; }
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
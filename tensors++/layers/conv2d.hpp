@@ -0,0 +1,265 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CONV2D_HPP
+#define CONV2D_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/activation.hpp"
+#include "tensors++/kernels/conv.hpp"
+#include "tensors++/kernels/fft_conv.hpp"
+#include "tensors++/kernels/winograd.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace layers {
+
+class QuantizedConv2D;
+
+// 2-D convolution over NHWC images, kernel HWIO
+// ([kernel_h, kernel_w, in_c / groups, filters]).
+//
+// padding is "valid" or "same" (TensorFlow semantics, the extra row or
+// column of an odd total goes to the bottom and right). The algorithm is
+// picked once the input channels are known, see
+// kernels::choose_conv_algorithm; passing one explicitly overrides that.
+// The filter is repacked (or Winograd or Fourier transformed) for the
+// chosen kernel on every call, or once for as long as the layer is frozen.
+// An automatically chosen FFT only runs while the layer is frozen, before
+// that the filter spectra would be rebuilt on every call and the layer
+// runs the best of the other kernels.
+template <class dtype = float>
+class Conv2D : public Layer<dtype> {
+  friend class QuantizedConv2D;  // copies the configuration and weights
+
+  size_t filters;
+  window kernel_size, strides, dilation;
+  std::string padding;
+  size_t groups;
+  kernels::activation act;
+  bool use_bias;
+  kernels::conv_algorithm algorithm;
+  bool automatic;  // algorithm picked by choose_conv_algorithm
+  std::unique_ptr<tensor<dtype>> kernel, bias;
+  std::vector<dtype> packed;
+  kernels::conv_algorithm packed_for = kernels::conv_algorithm::automatic;
+  bool packed_frozen = false;  // packed from frozen weights, still valid
+  size_t packed_tile = 0;      // Winograd tile size of the packed filter
+  std::unique_ptr<kernels::conv2d_spectra<dtype>> spectra;
+  size_t in_c = 0;
+
+  static void same_padding(size_t in, size_t k, size_t stride, size_t dilation,
+                           size_t &before, size_t &after) {
+    size_t out = (in + stride - 1) / stride;
+    long total = long((out - 1) * stride + dilation * (k - 1) + 1) - long(in);
+    total = std::max(total, 0L);
+    before = size_t(total / 2);
+    after = size_t(total) - before;
+  }
+
+ protected:
+  kernels::conv2d_params geometry(const shape::Shape &input_shape) const {
+    kernels::conv2d_params p;
+    p.batch = input_shape.d[0];
+    p.in_h = input_shape.d[1];
+    p.in_w = input_shape.d[2];
+    p.in_c = input_shape.d[3];
+    p.out_c = filters;
+    p.kernel_h = kernel_size.h;
+    p.kernel_w = kernel_size.w;
+    p.stride_h = strides.h;
+    p.stride_w = strides.w;
+    p.dilation_h = dilation.h;
+    p.dilation_w = dilation.w;
+    p.groups = groups;
+    if (padding == "same") {
+      same_padding(p.in_h, p.kernel_h, p.stride_h, p.dilation_h, p.pad_top,
+                   p.pad_bottom);
+      same_padding(p.in_w, p.kernel_w, p.stride_w, p.dilation_w, p.pad_left,
+                   p.pad_right);
+    }
+    return p;
+  }
+
+  // the kernel this call runs on
+  kernels::conv_algorithm running(const kernels::conv2d_params &p) const {
+    if (automatic && algorithm == kernels::conv_algorithm::fft &&
+        !kernel->frozen())
+      return kernels::choose_conv_algorithm<dtype>(p, false);
+    return algorithm;
+  }
+
+  void pack(const kernels::conv2d_params &p, kernels::conv_algorithm run) {
+    const dtype *w = static_cast<const tensor<dtype> &>(*kernel).raw_data();
+    packed_for = run;
+    packed_tile = 0;
+    packed.clear();
+    spectra.reset();
+    if (run == kernels::conv_algorithm::fft)
+      spectra.reset(new kernels::conv2d_spectra<dtype>(
+          kernels::fft_conv2d_spectra(p, w)));
+    else if (run == kernels::conv_algorithm::winograd) {
+      packed_tile = kernels::winograd_tile(p);
+      packed = kernels::winograd_filter_transform(p, w, packed_tile);
+    } else if (run == kernels::conv_algorithm::direct)
+      packed = kernels::pack_direct_filter(p, w);
+    else if (groups > 1)
+      packed = kernels::pack_im2col_filter(p, w);
+    // otherwise im2col uses the HWIO kernel as is
+  }
+
+  void build(const shape::Shape &input_shape) override {
+    if (input_shape.dimension() != 4)
+      throw exceptions::operation_undefined(
+          "Conv2D expects NHWC inputs of 4 dimensions");
+    in_c = input_shape.d[3];
+    if (in_c % groups != 0 || filters % groups != 0)
+      throw exceptions::operation_undefined(
+          "Conv2D groups must divide both the input channels and the filters");
+    kernels::conv2d_params p = geometry(input_shape);
+    if (algorithm == kernels::conv_algorithm::automatic)
+      algorithm = kernels::choose_conv_algorithm<dtype>(p);
+    if (algorithm == kernels::conv_algorithm::winograd &&
+        !kernels::winograd_applicable(p))
+      throw exceptions::operation_undefined(
+          "Winograd convolution needs a 3x3 kernel with unit stride and "
+          "dilation and a single group");
+    if (algorithm == kernels::conv_algorithm::fft && groups != 1)
+      throw exceptions::operation_undefined(
+          "FFT convolution does not support groups");
+
+    size_t taps = kernel_size.h * kernel_size.w;
+    size_t fan_in = taps * (in_c / groups), fan_out = taps * filters / groups;
+    kernel.reset(new tensor<dtype>(
+        glorot_uniform<dtype>(fan_in, fan_out, fan_in * filters),
+        shape::Shape({uint(kernel_size.h), uint(kernel_size.w),
+                         uint(in_c / groups), uint(filters)})));
+    if (use_bias)
+      bias.reset(new tensor<dtype>(std::vector<dtype>(filters, dtype(0)),
+                                   shape::Shape({uint(filters)})));
+  }
+
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    shape::Shape s = input.shape();
+    if (s.dimension() != 4 || s.d[3] != in_c)
+      throw exceptions::operation_undefined(
+          "Conv2D layer " + this->name() + " was built for " +
+          std::to_string(in_c) + " input channels, got " +
+          std::string(s));
+    kernels::conv2d_params p = geometry(s);
+    if (p.in_h + p.pad_top + p.pad_bottom <
+            p.dilation_h * (p.kernel_h - 1) + 1 ||
+        p.in_w + p.pad_left + p.pad_right <
+            p.dilation_w * (p.kernel_w - 1) + 1)
+      throw exceptions::operation_undefined(
+          "Conv2D input is smaller than the kernel " + std::string(s));
+    // the Winograd tile and the transform size of the spectra follow the
+    // input size, which may change between calls
+    kernels::conv_algorithm run = running(p);
+    if (!packed_frozen || packed_for != run ||
+        (packed_tile && packed_tile != kernels::winograd_tile(p)) ||
+        (spectra && !spectra->matches(p))) {
+      pack(p, run);
+      packed_frozen = kernel->frozen();
+    }
+
+    std::vector<dtype> output(p.batch * p.out_h() * p.out_w() * filters);
+    const dtype *x = input.raw_data();
+    const dtype *b =
+        bias ? static_cast<const tensor<dtype> &>(*bias).raw_data() : nullptr;
+    const dtype *w =
+        packed.empty() ? static_cast<const tensor<dtype> &>(*kernel).raw_data()
+                       : packed.data();
+    if (run == kernels::conv_algorithm::fft)
+      kernels::conv2d_fft(p, *spectra, x, b, output.data(), act);
+    else if (run == kernels::conv_algorithm::winograd)
+      kernels::conv2d_winograd(p, x, w, b, output.data(), act, packed_tile);
+    else if (run == kernels::conv_algorithm::direct)
+      kernels::conv2d_direct(p, x, w, b, output.data(), act);
+    else
+      kernels::conv2d_im2col(p, x, w, b, output.data(), act);
+    return tensor<dtype>(
+        std::move(output),
+        shape::Shape({uint(p.batch), uint(p.out_h()), uint(p.out_w()),
+                      uint(filters)}));
+  }
+
+ public:
+  Conv2D(size_t filters, window kernel_size, window strides = 1,
+         std::string padding = "valid", window dilation = 1, size_t groups = 1,
+         const std::string &activation = "linear", bool use_bias = true,
+         kernels::conv_algorithm algorithm = kernels::conv_algorithm::automatic,
+         std::string name = "conv2d")
+      : Layer<dtype>(std::move(name)),
+        filters(filters),
+        kernel_size(kernel_size),
+        strides(strides),
+        dilation(dilation),
+        padding(std::move(padding)),
+        groups(groups),
+        act(kernels::activation_from_name(activation)),
+        use_bias(use_bias),
+        algorithm(algorithm),
+        automatic(algorithm == kernels::conv_algorithm::automatic) {
+    if (this->padding != "valid" && this->padding != "same")
+      throw exceptions::operation_undefined("Unknown padding " +
+                                            this->padding);
+    if (groups == 0 || filters == 0)
+      throw exceptions::operation_undefined(
+          "Conv2D needs at least one filter and one group");
+  }
+
+  std::vector<tensor<dtype> *> weights() override {
+    std::vector<tensor<dtype> *> w;
+    if (kernel) w.push_back(kernel.get());
+    if (bias) w.push_back(bias.get());
+    return w;
+  }
+
+  void freeze() override {
+    Layer<dtype>::freeze();
+    packed_frozen = false;  // repacked from the frozen weights on next call
+  }
+
+  void unfreeze() override {
+    Layer<dtype>::unfreeze();
+    packed_frozen = false;
+  }
+
+  bool fold_affine(const std::vector<dtype> &scale,
+                   const std::vector<dtype> &shift) override {
+    if (!kernel || act != kernels::activation::linear ||
+        scale.size() != filters)
+      return false;
+    fold_affine_into(*kernel, bias, scale, shift);
+    packed_frozen = false;
+    return true;
+  }
+
+  inline kernels::conv_algorithm conv_algorithm() const { return algorithm; }
+  inline kernels::activation activation() const { return act; }
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
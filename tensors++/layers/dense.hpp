@@ -0,0 +1,169 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef DENSE_HPP
+#define DENSE_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/sparse_tensor.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/activation.hpp"
+#include "tensors++/kernels/gemm.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace layers {
+
+// Densely connected layer, output = activation(input * kernel + bias).
+//
+// The input is [..., in_features] and every leading dimension is treated as
+// batch, the output is [..., units]. The forward pass is one GEMM whose
+// epilogue adds the bias and applies the activation while each output panel
+// is still in cache, see kernels::gemm_bias_activation. While the layer is
+// frozen the kernel is packed for the GEMM once instead of on every call.
+// A sparse_tensor input [batch, in_features] (bag of words, one-hot
+// features) is multiplied as it is, never densified.
+template <class dtype = float>
+class Dense : public Layer<dtype> {
+  size_t units, in_features = 0;
+  kernels::activation act;
+  bool use_bias;
+  std::unique_ptr<tensor<dtype>> kernel, bias;
+  std::vector<dtype> packed;
+  bool packed_frozen = false;  // packed from frozen weights, still valid
+
+ protected:
+  void build(const shape::Shape &input_shape) override {
+    if (input_shape.dimension() == 0)
+      throw exceptions::operation_undefined(
+          "Dense expects inputs with at least one dimension");
+    in_features = input_shape.d.back();
+
+    kernel.reset(new tensor<dtype>(
+        glorot_uniform<dtype>(in_features, units, in_features * units),
+        shape::Shape({uint(in_features), uint(units)})));
+    if (use_bias)
+      bias.reset(new tensor<dtype>(std::vector<dtype>(units, dtype(0)),
+                                   shape::Shape({uint(units)})));
+  }
+
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    std::vector<uint> out_shape = input.shape().d;
+    if (out_shape.back() != in_features)
+      throw exceptions::operation_undefined(
+          "Dense layer " + this->name() + " was built for " +
+          std::to_string(in_features) + " input features, got " +
+          std::to_string(out_shape.back()));
+    size_t rows = input.size() / in_features;
+    out_shape.back() = uint(units);
+
+    const tensor<dtype> &w = *kernel;
+    if (!kernel->frozen())
+      packed_frozen = false;
+    else if (!packed_frozen) {
+      packed = kernels::pack_gemm_b(w.raw_data(), in_features, units);
+      packed_frozen = true;
+    }
+    std::vector<dtype> output(rows * units);
+    kernels::gemm_bias_activation(
+        input.raw_data(), w.raw_data(),
+        bias ? static_cast<const tensor<dtype> &>(*bias).raw_data() : nullptr,
+        output.data(), rows, in_features, units, act,
+        packed_frozen && !packed.empty() ? packed.data() : nullptr);
+    return tensor<dtype>(std::move(output), shape::Shape(out_shape));
+  }
+
+ public:
+  Dense(size_t units, kernels::activation fn = kernels::activation::linear,
+        bool use_bias = true, std::string name = "dense")
+      : Layer<dtype>(std::move(name)),
+        units(units),
+        act(fn),
+        use_bias(use_bias) {}
+
+  Dense(size_t units, const std::string &fn, bool use_bias = true,
+        std::string name = "dense")
+      : Dense(units, kernels::activation_from_name(fn), use_bias,
+              std::move(name)) {}
+
+  using Layer<dtype>::operator();
+
+  tensor<dtype> operator()(const sparse_tensor<dtype> &input) {
+    this->ensure_built(input.shape());
+    if (input.cols() != in_features)
+      throw exceptions::operation_undefined(
+          "Dense layer " + this->name() + " was built for " +
+          std::to_string(in_features) + " input features, got " +
+          std::to_string(input.cols()));
+    typedef Eigen::Map<Eigen::Array<dtype, Eigen::Dynamic, Eigen::Dynamic,
+                                    Eigen::RowMajor>>
+        matrix_map;
+    typedef Eigen::Map<const Eigen::Array<dtype, 1, Eigen::Dynamic>> bias_map;
+    std::vector<dtype> out(input.rows() * units);
+    const tensor<dtype> &w = *kernel;
+    input.multiply(w.raw_data(), units, out.data());
+    matrix_map y(out.data(), input.rows(), units);
+    if (bias)
+      kernels::activate(
+          act, y,
+          y.rowwise() +
+              bias_map(static_cast<const tensor<dtype> &>(*bias).raw_data(),
+                       units));
+    else if (act != kernels::activation::linear)
+      kernels::activate(act, y, y);
+    return tensor<dtype>(std::move(out),
+                         shape::Shape({uint(input.rows()), uint(units)}));
+  }
+
+  std::vector<tensor<dtype> *> weights() override {
+    std::vector<tensor<dtype> *> w;
+    if (kernel) w.push_back(kernel.get());
+    if (bias) w.push_back(bias.get());
+    return w;
+  }
+
+  void freeze() override {
+    Layer<dtype>::freeze();
+    packed_frozen = false;  // repacked from the frozen weights on next call
+  }
+
+  void unfreeze() override {
+    Layer<dtype>::unfreeze();
+    packed_frozen = false;
+  }
+
+  bool fold_affine(const std::vector<dtype> &scale,
+                   const std::vector<dtype> &shift) override {
+    if (!kernel || act != kernels::activation::linear || scale.size() != units)
+      return false;
+    fold_affine_into(*kernel, bias, scale, shift);
+    packed_frozen = false;
+    return true;
+  }
+
+  inline size_t output_units() const { return units; }
+  inline kernels::activation activation() const { return act; }
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef EMBEDDING_LAYERS_HPP
+#define EMBEDDING_LAYERS_HPP
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/embedding.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace layers {
+
+// Lookup table of input_dim rows of output_dim, as the Keras Embedding.
+// Inputs of any shape hold row ids (integral values, in dtype or as a
+// tensor<uint>); the output appends an output_dim axis. The rows are
+// gathered straight into the output buffer. backward() returns the
+// gradient of the table as kernels::sparse_rows, just the rows the last
+// call looked up, so tables with millions of rows never need a dense
+// gradient.
+template <class dtype = float>
+class Embedding : public Layer<dtype> {
+  size_t input_dim, output_dim;
+  std::unique_ptr<tensor<dtype>> table;
+  std::vector<size_t> last_ids;
+
+  template <class index>
+  tensor<dtype> lookup(const index *ids, size_t n, const shape::Shape &s) {
+    std::vector<uint> dims = s.d;
+    dims.push_back(uint(output_dim));
+    std::vector<dtype> output(n * output_dim);
+    kernels::gather_rows(
+        static_cast<const tensor<dtype> &>(*table).raw_data(), input_dim,
+        output_dim, ids, n, output.data());
+    last_ids.assign(ids, ids + n);
+    return tensor<dtype>(std::move(output), shape::Shape(dims));
+  }
+
+ protected:
+  void build(const shape::Shape &) override {
+    // Keras' default uniform(-0.05, 0.05)
+    std::mt19937 engine(std::random_device{}());
+    std::uniform_real_distribution<double> uniform(-0.05, 0.05);
+    std::vector<dtype> w(input_dim * output_dim);
+    for (auto &x : w) x = dtype(uniform(engine));
+    table.reset(new tensor<dtype>(
+        std::move(w), shape::Shape({uint(input_dim), uint(output_dim)})));
+  }
+
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    const dtype *x = input.raw_data();
+    kernels::check_row_ids(x, input.size(), input_dim);
+    for (size_t i = 0; i < input.size(); i++)
+      if (x[i] != dtype(size_t(x[i])))
+        throw exceptions::operation_undefined(
+            "Embedding ids must be integral, got " + std::to_string(x[i]));
+    return lookup(x, input.size(), input.shape());
+  }
+
+ public:
+  Embedding(size_t input_dim, size_t output_dim,
+            std::string name = "embedding")
+      : Layer<dtype>(std::move(name)),
+        input_dim(input_dim),
+        output_dim(output_dim) {
+    if (input_dim == 0 || output_dim == 0)
+      throw exceptions::operation_undefined(
+          "Embedding needs at least one row and one column");
+  }
+
+  using Layer<dtype>::operator();
+
+  // lookup of integer ids
+  tensor<dtype> operator()(const tensor<uint> &ids) {
+    shape::Shape s = ids.shape();
+    this->ensure_built(s);
+    return lookup(ids.raw_data(), ids.size(), s);
+  }
+
+  // Gradient of the table given the gradient of the last output: the
+  // distinct ids it looked up, each with the sum of its rows of grad.
+  kernels::sparse_rows<dtype> backward(const tensor<dtype> &grad_output) {
+    if (grad_output.size() != last_ids.size() * output_dim)
+      throw exceptions::operation_undefined(
+          "Embedding gradient does not match the last output");
+    return kernels::scatter_rows(last_ids.data(), last_ids.size(),
+                                 grad_output.raw_data(), output_dim);
+  }
+
+  std::vector<tensor<dtype> *> weights() override {
+    if (!table) return {};
+    return {table.get()};
+  }
+
+  inline size_t rows() const { return input_dim; }
+  inline size_t dim() const { return output_dim; }
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,142 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LAYER_HPP
+#define LAYER_HPP
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+
+namespace tensors {
+namespace layers {
+
+// Height and width of a kernel, stride or dilation. A single number is
+// used for both, as in Keras.
+struct window {
+  size_t h, w;
+  window(size_t size) : h(size), w(size) {}
+  window(size_t h, size_t w) : h(h), w(w) {}
+};
+
+// Glorot (Xavier) uniform initial weights, the Keras default
+template <class dtype>
+std::vector<dtype> glorot_uniform(size_t fan_in, size_t fan_out,
+                                  size_t count) {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  double limit = std::sqrt(6.0 / (fan_in + fan_out));
+  std::uniform_real_distribution<> dist(-limit, limit);
+  std::vector<dtype> w(count);
+  for (auto &e : w) e = dtype(dist(gen));
+  return w;
+}
+
+// Folds y * scale + shift over the last (output channel) axis of `kernel`
+// into the kernel and bias of a layer, creating the bias when the layer has
+// none. Frozen weights are rewritten and frozen again.
+template <class dtype>
+void fold_affine_into(tensor<dtype> &kernel,
+                      std::unique_ptr<tensor<dtype>> &bias,
+                      const std::vector<dtype> &scale,
+                      const std::vector<dtype> &shift) {
+  size_t channels = scale.size();
+  if (!bias)
+    bias.reset(new tensor<dtype>(std::vector<dtype>(channels, dtype(0)),
+                                 shape::Shape({uint(channels)})));
+  bool frozen = kernel.frozen() || bias->frozen();
+  kernel.unfreeze();
+  bias->unfreeze();
+  dtype *w = kernel.raw_data();
+  for (size_t i = 0; i < kernel.size(); i++) w[i] *= scale[i % channels];
+  dtype *b = bias->raw_data();
+  for (size_t o = 0; o < channels; o++) b[o] = b[o] * scale[o] + shift[o];
+  if (frozen) {
+    kernel.freeze();
+    bias->freeze();
+  }
+}
+
+// Base of every layer. As in Keras a layer creates its weights lazily, on
+// the first call, once the shape of its input is known.
+template <class dtype = float>
+class Layer {
+  std::string layer_name;
+  bool built = false;
+  bool training_mode = false;
+
+ protected:
+  // creates the weights for inputs of this shape, called once
+  virtual void build(const shape::Shape &input_shape) = 0;
+  virtual tensor<dtype> forward(const tensor<dtype> &input) = 0;
+
+  // for entry points other than operator(), such as incremental decoding
+  void ensure_built(const shape::Shape &input_shape) {
+    if (!built) {
+      build(input_shape);
+      built = true;
+    }
+  }
+
+ public:
+  explicit Layer(std::string name) : layer_name(std::move(name)) {}
+  Layer(const Layer &) = delete;
+  Layer &operator=(const Layer &) = delete;
+  virtual ~Layer() = default;
+
+  tensor<dtype> operator()(const tensor<dtype> &input) {
+    ensure_built(input.shape());
+    return forward(input);
+  }
+
+  // trainable weights in a fixed order, empty before the layer is built
+  virtual std::vector<tensor<dtype> *> weights() { return {}; }
+
+  // Freezes every weight. Layers that keep a repacked or transformed copy of
+  // their weights for inference override this to build it.
+  virtual void freeze() {
+    for (auto &w : weights()) w->freeze();
+  }
+
+  virtual void unfreeze() {
+    for (auto &w : weights()) w->unfreeze();
+  }
+
+  // Absorbs a per output channel affine transform y * scale + shift that
+  // directly follows this layer into its weights (batch norm folding).
+  // Returns false when the layer cannot, the default.
+  virtual bool fold_affine(const std::vector<dtype> &,
+                           const std::vector<dtype> &) {
+    return false;
+  }
+
+  // layers such as BatchNormalization behave differently while training
+  virtual void set_training(bool on) { training_mode = on; }
+  inline bool training() const { return training_mode; }
+
+  inline const std::string &name() const { return layer_name; }
+  inline bool is_built() const { return built; }
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
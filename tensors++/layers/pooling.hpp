@@ -0,0 +1,236 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef POOLING_LAYERS_HPP
+#define POOLING_LAYERS_HPP
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/pooling.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace layers {
+
+// Shared geometry of MaxPool2D and AvgPool2D over NHWC images. strides
+// default to the pool size, padding is "valid" or "same".
+template <class dtype>
+class Pool2D : public Layer<dtype> {
+  window pool_size, strides;
+  std::string padding;
+
+ protected:
+  void build(const shape::Shape &input_shape) override {
+    if (input_shape.dimension() != 4)
+      throw exceptions::operation_undefined(
+          this->name() + " expects NHWC inputs of 4 dimensions");
+  }
+
+  kernels::pool2d_params geometry(const shape::Shape &s) const {
+    if (s.dimension() != 4)
+      throw exceptions::operation_undefined(
+          this->name() + " expects NHWC inputs of 4 dimensions");
+    kernels::pool2d_params p;
+    p.batch = s.d[0];
+    p.in_h = s.d[1];
+    p.in_w = s.d[2];
+    p.channels = s.d[3];
+    p.pool_h = pool_size.h;
+    p.pool_w = pool_size.w;
+    p.stride_h = strides.h;
+    p.stride_w = strides.w;
+    if (padding == "same") {
+      size_t oh = (p.in_h + p.stride_h - 1) / p.stride_h;
+      size_t ow = (p.in_w + p.stride_w - 1) / p.stride_w;
+      size_t th = std::max<long>(
+          long((oh - 1) * p.stride_h + p.pool_h) - long(p.in_h), 0);
+      size_t tw = std::max<long>(
+          long((ow - 1) * p.stride_w + p.pool_w) - long(p.in_w), 0);
+      p.pad_top = th / 2;
+      p.pad_bottom = th - p.pad_top;
+      p.pad_left = tw / 2;
+      p.pad_right = tw - p.pad_left;
+    }
+    if (p.in_h + p.pad_top + p.pad_bottom < p.pool_h ||
+        p.in_w + p.pad_left + p.pad_right < p.pool_w)
+      throw exceptions::operation_undefined(
+          this->name() + " input is smaller than the pool");
+    return p;
+  }
+
+  static shape::Shape output_shape(const kernels::pool2d_params &p) {
+    return shape::Shape({uint(p.batch), uint(p.out_h()), uint(p.out_w()),
+                         uint(p.channels)});
+  }
+
+ public:
+  Pool2D(window pool_size, window strides, std::string padding,
+         std::string name)
+      : Layer<dtype>(std::move(name)),
+        pool_size(pool_size),
+        strides(strides.h ? strides : pool_size),
+        padding(std::move(padding)) {
+    if (this->padding != "valid" && this->padding != "same")
+      throw exceptions::operation_undefined("Unknown padding " +
+                                            this->padding);
+    if (!pool_size.h || !pool_size.w || !this->strides.h || !this->strides.w)
+      throw exceptions::operation_undefined(
+          "Pool sizes and strides must be positive");
+  }
+};
+
+// Max pooling. With keep_indices the positions of the maxima of the last
+// call are kept and backward() scatters the gradient through them in
+// O(output) instead of searching the windows again.
+template <class dtype = float>
+class MaxPool2D : public Pool2D<dtype> {
+  bool keep_indices;
+  std::vector<size_t> argmax;
+  std::vector<uint> input_dims;
+
+ protected:
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    kernels::pool2d_params p = this->geometry(input.shape());
+    shape::Shape out = this->output_shape(p);
+    std::vector<dtype> output(out.element_size());
+    if (keep_indices) {
+      argmax.resize(output.size());
+      input_dims = input.shape().d;
+    }
+    kernels::max_pool2d(p, input.raw_data(), output.data(),
+                        keep_indices ? argmax.data() : nullptr);
+    return tensor<dtype>(std::move(output), out);
+  }
+
+ public:
+  MaxPool2D(window pool_size = 2, window strides = 0,
+            std::string padding = "valid", bool keep_indices = false,
+            std::string name = "max_pool2d")
+      : Pool2D<dtype>(pool_size, strides, std::move(padding),
+                      std::move(name)),
+        keep_indices(keep_indices) {}
+
+  // flat input position of every output of the last call
+  inline const std::vector<size_t> &indices() const { return argmax; }
+
+  // gradient with respect to the input of the last call
+  tensor<dtype> backward(const tensor<dtype> &grad_output) {
+    if (!keep_indices || input_dims.empty())
+      throw exceptions::operation_undefined(
+          "MaxPool2D backward needs keep_indices and a forward call");
+    if (grad_output.size() != argmax.size())
+      throw exceptions::operation_undefined(
+          "MaxPool2D gradient does not match the last output");
+    shape::Shape s(input_dims);
+    std::vector<dtype> grad(s.element_size());
+    kernels::max_pool2d_backward(this->geometry(s), argmax.data(),
+                                 grad_output.raw_data(), grad.data());
+    return tensor<dtype>(std::move(grad), s);
+  }
+};
+
+template <class dtype = float>
+class AvgPool2D : public Pool2D<dtype> {
+ protected:
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    kernels::pool2d_params p = this->geometry(input.shape());
+    shape::Shape out = this->output_shape(p);
+    std::vector<dtype> output(out.element_size());
+    kernels::avg_pool2d(p, input.raw_data(), output.data());
+    return tensor<dtype>(std::move(output), out);
+  }
+
+ public:
+  AvgPool2D(window pool_size = 2, window strides = 0,
+            std::string padding = "valid", std::string name = "avg_pool2d")
+      : Pool2D<dtype>(pool_size, strides, std::move(padding),
+                      std::move(name)) {}
+
+  // gradient with respect to an input of this shape
+  tensor<dtype> backward(const tensor<dtype> &grad_output,
+                         const shape::Shape &input_shape) {
+    kernels::pool2d_params p = this->geometry(input_shape);
+    if (grad_output.size() != p.batch * p.out_h() * p.out_w() * p.channels)
+      throw exceptions::operation_undefined(
+          "AvgPool2D gradient does not match the output shape");
+    std::vector<dtype> grad(input_shape.element_size());
+    kernels::avg_pool2d_backward(p, grad_output.raw_data(), grad.data());
+    return tensor<dtype>(std::move(grad), input_shape);
+  }
+};
+
+// Shared input check of the global poolings. It runs on every call, the
+// layer is not tied to the shape it was built with.
+template <class dtype>
+class GlobalPool2D : public Layer<dtype> {
+ protected:
+  void build(const shape::Shape &input_shape) override { check(input_shape); }
+
+  void check(const shape::Shape &s) const {
+    if (s.dimension() != 4)
+      throw exceptions::operation_undefined(
+          this->name() + " expects NHWC inputs of 4 dimensions, got " +
+          std::string(s));
+  }
+
+ public:
+  explicit GlobalPool2D(std::string name) : Layer<dtype>(std::move(name)) {}
+};
+
+// [batch, height, width, channels] to [batch, channels]
+template <class dtype = float>
+class GlobalAvgPool2D : public GlobalPool2D<dtype> {
+ protected:
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    this->check(input.shape());
+    std::vector<uint> d = input.shape().d;
+    std::vector<dtype> output(size_t(d[0]) * d[3]);
+    kernels::global_avg_pool(input.raw_data(), output.data(), d[0],
+                             size_t(d[1]) * d[2], d[3]);
+    return tensor<dtype>(std::move(output), shape::Shape({d[0], d[3]}));
+  }
+
+ public:
+  explicit GlobalAvgPool2D(std::string name = "global_avg_pool2d")
+      : GlobalPool2D<dtype>(std::move(name)) {}
+};
+
+template <class dtype = float>
+class GlobalMaxPool2D : public GlobalPool2D<dtype> {
+ protected:
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    this->check(input.shape());
+    std::vector<uint> d = input.shape().d;
+    std::vector<dtype> output(size_t(d[0]) * d[3]);
+    kernels::global_max_pool(input.raw_data(), output.data(), d[0],
+                             size_t(d[1]) * d[2], d[3]);
+    return tensor<dtype>(std::move(output), shape::Shape({d[0], d[3]}));
+  }
+
+ public:
+  explicit GlobalMaxPool2D(std::string name = "global_max_pool2d")
+      : GlobalPool2D<dtype>(std::move(name)) {}
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
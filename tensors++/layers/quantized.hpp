@@ -0,0 +1,297 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef QUANTIZED_LAYERS_HPP
+#define QUANTIZED_LAYERS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "unsupported/Eigen/CXX11/Tensor"
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/quantized.hpp"
+#include "tensors++/layers/conv2d.hpp"
+#include "tensors++/layers/dense.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace layers {
+
+// uint8 activations with the parameters they were quantized with, passed
+// from one quantized layer to the next without going through float.
+struct quantized_tensor {
+  // qgemm may read up to this many bytes past the last row
+  static const size_t padding = 3;
+
+  std::vector<uint> dims;
+  kernels::qparams params;
+  std::vector<uint8_t> values;  // size() elements, then the padding
+
+  inline size_t size() const { return values.size() - padding; }
+};
+
+// Post-training int8 quantization of a trained layer for inference.
+//
+// The weights are quantized per output channel to signed 8 bits, a quarter
+// of their float size, and packed for kernels::qgemm. Inputs are quantized
+// to 7-bit unsigned with parameters from calibrate(), called on sample
+// batches before serving (static quantization); an uncalibrated layer
+// quantizes every batch with its own range (dynamic quantization). Outputs
+// are float, dequantized together with the bias and activation, or, when
+// the next layer is quantized as well, requantized to its input_qparams()
+// in that same epilogue, so a stack of quantized layers passes uint8
+// activations along without float ones in between.
+class Quantized : public Layer<float> {
+ protected:
+  kernels::qweights qkernel;
+  std::vector<float> bias;
+  kernels::activation act;
+  kernels::minmax_observer observer;
+
+  Quantized(const tensor<float> &kernel, const tensor<float> *bias_tensor,
+            size_t k, size_t n, kernels::activation act, std::string name)
+      : Layer<float>(std::move(name)), act(act) {
+    qkernel = kernels::quantize_weights(kernel.raw_data(), k, n);
+    if (bias_tensor)
+      bias.assign(bias_tensor->raw_data(), bias_tensor->raw_data() + n);
+  }
+
+  void build(const shape::Shape &) override {}
+
+  kernels::qparams input_params(const float *x, size_t n) const {
+    if (!observer.empty()) return observer.merged();
+    kernels::minmax_observer batch;
+    batch.observe(x, n);
+    return batch.merged();
+  }
+
+  // output dimensions for inputs of dims, throws for inputs the layer
+  // cannot take
+  virtual std::vector<uint> output_dims(
+      const std::vector<uint> &dims) const = 0;
+
+  // runs the layer on quantized inputs, o writing float or requantized
+  // outputs
+  virtual void run(const quantized_tensor &x,
+                   const kernels::qgemm_output &o) const = 0;
+
+  // runs the GEMM of rows quantized inputs, rows of stride lda, into the
+  // outputs of o from element `at` on
+  void multiply(const uint8_t *x, size_t rows, size_t lda,
+                const kernels::qparams &p, kernels::qgemm_output o,
+                size_t at = 0) const {
+    if (o.real) o.real += at;
+    if (o.quantized) o.quantized += at;
+    o.bias = bias.empty() ? nullptr : bias.data();
+    o.act = act;
+    kernels::qgemm(x, rows, lda, p, qkernel, o);
+  }
+
+  tensor<float> forward(const tensor<float> &input) override {
+    return (*this)(quantize(input));
+  }
+
+ public:
+  // widens the input range seen so far by a sample batch
+  void calibrate(const tensor<float> &sample) {
+    observer.observe(sample.raw_data(), sample.size());
+  }
+
+  inline bool calibrated() const { return !observer.empty(); }
+
+  // the calibrated input parameters, which the previous quantized layer
+  // requantizes its outputs to
+  kernels::qparams input_qparams() const {
+    if (!calibrated())
+      throw exceptions::operation_undefined(
+          "Quantized layer " + this->name() + " is not calibrated");
+    return observer.merged();
+  }
+
+  // the inputs quantized as forward() does, calibrated or dynamically
+  quantized_tensor quantize(const tensor<float> &input) const {
+    quantized_tensor x;
+    x.dims = input.shape().d;
+    output_dims(x.dims);  // rejects the input before quantizing it
+    x.params = input_params(input.raw_data(), input.size());
+    x.values.assign(input.size() + quantized_tensor::padding, 0);
+    kernels::quantize(input.raw_data(), input.size(), x.params,
+                      x.values.data());
+    return x;
+  }
+
+  using Layer<float>::operator();
+
+  // float outputs of already quantized inputs
+  tensor<float> operator()(const quantized_tensor &input) {
+    this->ensure_built(shape::Shape(input.dims));
+    std::vector<uint> dims = output_dims(input.dims);
+    std::vector<float> output(shape::Shape(dims).element_size());
+    kernels::qgemm_output o;
+    o.real = output.data();
+    run(input, o);
+    return tensor<float>(std::move(output), shape::Shape(dims));
+  }
+
+  // outputs requantized with `output` by the qgemm epilogue, for the next
+  // quantized layer
+  quantized_tensor operator()(const quantized_tensor &input,
+                              const kernels::qparams &output) {
+    this->ensure_built(shape::Shape(input.dims));
+    quantized_tensor y;
+    y.dims = output_dims(input.dims);
+    y.params = output;
+    y.values.assign(
+        shape::Shape(y.dims).element_size() + quantized_tensor::padding, 0);
+    kernels::qgemm_output o;
+    o.quantized = y.values.data();
+    o.requantize = &y.params;
+    run(input, o);
+    return y;
+  }
+
+  // the quantized kernel unpacked, [in_features, units] or
+  // [patch_size, filters]
+  tensor<int8_t> kernel() const {
+    size_t k = qkernel.k, n = qkernel.n, groups = qkernel.depth_groups();
+    std::vector<int8_t> w(k * n);
+    for (size_t l = 0; l < k; l++)
+      for (size_t j = 0; j < n; j++)
+        w[l * n + j] =
+            qkernel.packed[((j / 8 * groups + l / 4) * 8 + j % 8) * 4 + l % 4];
+    return tensor<int8_t>(w, shape::Shape({uint(k), uint(n)}));
+  }
+
+  // per output channel scales of kernel()
+  inline const std::vector<float> &kernel_scales() const {
+    return qkernel.scales;
+  }
+};
+
+class QuantizedDense : public Quantized {
+ protected:
+  std::vector<uint> output_dims(
+      const std::vector<uint> &dims) const override {
+    if (dims.empty() || dims.back() != qkernel.k)
+      throw exceptions::operation_undefined(
+          "QuantizedDense layer " + this->name() + " expects " +
+          std::to_string(qkernel.k) + " input features");
+    std::vector<uint> out = dims;
+    out.back() = uint(qkernel.n);
+    return out;
+  }
+
+  void run(const quantized_tensor &x,
+           const kernels::qgemm_output &o) const override {
+    multiply(x.values.data(), x.size() / qkernel.k, qkernel.k, x.params, o);
+  }
+
+ public:
+  // quantizes a built Dense layer, which is not needed afterwards
+  explicit QuantizedDense(Dense<float> &dense,
+                          std::string name = "quantized_dense")
+      : Quantized(source(dense), dense.weights().size() > 1
+                                        ? dense.weights()[1]
+                                        : nullptr,
+                  source(dense).shape().d[0], dense.output_units(),
+                  dense.activation(), std::move(name)) {}
+
+ private:
+  static const tensor<float> &source(Dense<float> &dense) {
+    if (!dense.is_built())
+      throw exceptions::operation_undefined(
+          "Only a built Dense layer can be quantized");
+    return *dense.weights()[0];
+  }
+};
+
+// Quantized Conv2D with a single group, run as im2col on the quantized
+// image followed by qgemm. Padding takes the input zero point, which is
+// exactly 0.0.
+class QuantizedConv2D : public Quantized {
+  Conv2D<float> config;  // the configuration only, it never builds weights
+
+  static const tensor<float> &source(Conv2D<float> &conv) {
+    if (!conv.is_built())
+      throw exceptions::operation_undefined(
+          "Only a built Conv2D layer can be quantized");
+    if (conv.groups != 1)
+      throw exceptions::operation_undefined(
+          "QuantizedConv2D supports a single group only");
+    return *conv.kernel;
+  }
+
+ protected:
+  std::vector<uint> output_dims(
+      const std::vector<uint> &dims) const override {
+    if (dims.size() != 4 || dims[3] != config.in_c)
+      throw exceptions::operation_undefined(
+          "QuantizedConv2D layer " + this->name() + " expects NHWC inputs "
+          "of " + std::to_string(config.in_c) + " channels");
+    kernels::conv2d_params p = config.geometry(shape::Shape(dims));
+    return {uint(p.batch), uint(p.out_h()), uint(p.out_w()),
+            uint(qkernel.n)};
+  }
+
+  void run(const quantized_tensor &x,
+           const kernels::qgemm_output &o) const override {
+    typedef Eigen::TensorMap<const Eigen::Tensor<uint8_t, 4, Eigen::RowMajor>>
+        image_map;
+    typedef Eigen::TensorMap<Eigen::Tensor<uint8_t, 2, Eigen::RowMajor>>
+        matrix_map;
+    kernels::conv2d_params p = config.geometry(shape::Shape(x.dims));
+    size_t pixels = p.out_h() * p.out_w(), k = p.patch_size();
+    size_t image = p.in_h * p.in_w * p.in_c;
+
+    std::vector<uint8_t> cols(pixels * k + quantized_tensor::padding, 0);
+    for (size_t n = 0; n < p.batch; n++) {
+      image_map img(const_cast<uint8_t *>(x.values.data()) + n * image,
+                    Eigen::Index(1), Eigen::Index(p.in_h),
+                    Eigen::Index(p.in_w), Eigen::Index(p.in_c));
+      Eigen::array<Eigen::Index, 2> dims{Eigen::Index(pixels),
+                                         Eigen::Index(k)};
+      // row major NHWC: Eigen's "rows" are the width, see conv2d_im2col
+      matrix_map(cols.data(), Eigen::Index(pixels), Eigen::Index(k)) =
+          img.extract_image_patches(p.kernel_w, p.kernel_h, p.stride_w,
+                                    p.stride_h, p.dilation_w, p.dilation_h, 1,
+                                    1, p.pad_left, p.pad_right, p.pad_top,
+                                    p.pad_bottom, uint8_t(x.params.zero_point))
+              .reshape(dims);
+      multiply(cols.data(), pixels, k, x.params, o, n * pixels * qkernel.n);
+    }
+  }
+
+ public:
+  // quantizes a built Conv2D layer, which is not needed afterwards
+  explicit QuantizedConv2D(Conv2D<float> &conv,
+                           std::string name = "quantized_conv2d")
+      : Quantized(source(conv), conv.bias.get(),
+                  source(conv).size() / conv.filters, conv.filters, conv.act,
+                  std::move(name)),
+        config(conv.filters, conv.kernel_size, conv.strides, conv.padding,
+               conv.dilation, 1, "linear", false) {
+    config.in_c = conv.in_c;
+  }
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,275 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef RECURRENT_LAYERS_HPP
+#define RECURRENT_LAYERS_HPP
+
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/ragged_tensor.hpp"
+#include "tensors++/core/shape.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/kernels/gemm.hpp"
+#include "tensors++/kernels/recurrent.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace layers {
+
+// Shared part of LSTM and GRU. Inputs are [batch, timesteps, features], the
+// output is the last hidden state [batch, units], or every hidden state
+// [batch, timesteps, units] with return_sequences.
+//
+// Weights follow Keras: kernel [features, gates * units], recurrent_kernel
+// [units, gates * units] and the bias. The projection of the inputs of all
+// timesteps is hoisted into one GEMM before the recurrence, every step is
+// then a single GEMM against the hidden state with the gate math fused in,
+// see kernels::run_recurrent. Both run on a packed copy of the weights,
+// made on every call or once by freeze(). A ragged_tensor batch runs
+// without padding: each step only computes the sequences still running.
+template <class dtype = float>
+class Recurrent : public Layer<dtype> {
+ protected:
+  size_t units, gates, bias_rows;
+  bool use_bias, return_sequences;
+  size_t in_features = 0;
+  std::unique_ptr<tensor<dtype>> kernel, recurrent_kernel, bias;
+  std::vector<dtype> packed_kernel, packed_recurrent, packed_bias;
+  bool packed_frozen = false;  // packed from frozen weights, still valid
+
+  // initial value of the (unpacked) bias
+  virtual std::vector<dtype> initial_bias() const {
+    return std::vector<dtype>(bias_rows * gates * units, dtype(0));
+  }
+
+  // runs the recurrence over xproj, leaves the last state in h
+  virtual void run(const dtype *xproj, size_t batch, size_t steps, dtype *h,
+                   dtype *sequence,
+                   const kernels::recurrent_layout &layout) = 0;
+
+  inline const dtype *recurrent_bias() const {
+    return bias_rows == 2 && !packed_bias.empty()
+               ? packed_bias.data() + gates * units
+               : nullptr;
+  }
+
+  void pack() {
+    auto read = [](const std::unique_ptr<tensor<dtype>> &t) {
+      return static_cast<const tensor<dtype> &>(*t).raw_data();
+    };
+    packed_kernel = kernels::pack_gates(read(kernel), in_features, gates,
+                                        units);
+    packed_recurrent = kernels::pack_gates(read(recurrent_kernel), units,
+                                           gates, units);
+    packed_bias.clear();
+    if (bias)
+      packed_bias = kernels::pack_gates(read(bias), bias_rows, gates, units);
+  }
+
+  void build(const shape::Shape &input_shape) override {
+    if (input_shape.dimension() != 3)
+      throw exceptions::operation_undefined(
+          "Recurrent layers expect [batch, timesteps, features] inputs");
+    in_features = input_shape.d[2];
+    size_t cols = gates * units;
+    kernel.reset(new tensor<dtype>(
+        glorot_uniform<dtype>(in_features, cols, in_features * cols),
+        shape::Shape({uint(in_features), uint(cols)})));
+    recurrent_kernel.reset(
+        new tensor<dtype>(glorot_uniform<dtype>(units, cols, units * cols),
+                          shape::Shape({uint(units), uint(cols)})));
+    if (use_bias)
+      bias.reset(new tensor<dtype>(
+          initial_bias(),
+          bias_rows == 1 ? shape::Shape({uint(cols)})
+                         : shape::Shape({uint(bias_rows), uint(cols)})));
+  }
+
+  // inputs are [batch, timesteps, features], ragged values [total, features]
+  void check(shape::Shape s, size_t dimensions) const {
+    if (s.dimension() != dimensions || s.d.back() != in_features)
+      throw exceptions::operation_undefined(
+          "Recurrent layer " + this->name() + " was built for " +
+          std::to_string(in_features) + " input features, got " +
+          std::string(s));
+  }
+
+  // input projections of `rows` rows of features, all steps in one GEMM
+  std::vector<dtype> project(const dtype *input, size_t rows) {
+    if (!packed_frozen) pack();
+    std::vector<dtype> xproj(rows * gates * units);
+    kernels::gemm_bias_activation(
+        input, packed_kernel.data(),
+        packed_bias.empty() ? nullptr : packed_bias.data(), xproj.data(),
+        rows, in_features, gates * units);
+    return xproj;
+  }
+
+  tensor<dtype> forward(const tensor<dtype> &input) override {
+    shape::Shape s = input.shape();
+    check(s, 3);
+    size_t batch = s.d[0], steps = s.d[1];
+    std::vector<dtype> xproj = project(input.raw_data(), batch * steps);
+
+    std::vector<dtype> h(batch * units, dtype(0));
+    kernels::recurrent_layout dense;
+    if (!return_sequences) {
+      run(xproj.data(), batch, steps, h.data(), nullptr, dense);
+      return tensor<dtype>(std::move(h),
+                           shape::Shape({uint(batch), uint(units)}));
+    }
+    std::vector<dtype> output(batch * steps * units);
+    run(xproj.data(), batch, steps, h.data(), output.data(), dense);
+    return tensor<dtype>(std::move(output),
+                         shape::Shape({uint(batch), uint(steps), uint(units)}));
+  }
+
+  Recurrent(size_t units, size_t gates, size_t bias_rows, bool use_bias,
+            bool return_sequences, std::string name)
+      : Layer<dtype>(std::move(name)),
+        units(units),
+        gates(gates),
+        bias_rows(bias_rows),
+        use_bias(use_bias),
+        return_sequences(return_sequences) {
+    if (units == 0)
+      throw exceptions::operation_undefined(
+          "Recurrent layers need at least one unit");
+  }
+
+ public:
+  std::vector<tensor<dtype> *> weights() override {
+    std::vector<tensor<dtype> *> w;
+    if (kernel) w.push_back(kernel.get());
+    if (recurrent_kernel) w.push_back(recurrent_kernel.get());
+    if (bias) w.push_back(bias.get());
+    return w;
+  }
+
+  // packs the frozen weights once for every later call
+  void freeze() override {
+    Layer<dtype>::freeze();
+    packed_frozen = false;
+    if (kernel) {
+      pack();
+      packed_frozen = true;
+    }
+  }
+
+  void unfreeze() override {
+    Layer<dtype>::unfreeze();
+    packed_frozen = false;
+  }
+
+  using Layer<dtype>::operator();
+
+  // Sequences of different lengths, values [total, features]. With
+  // return_sequences the result has the same row splits and the state of
+  // every step, otherwise one row per sequence holding its final state
+  // (values() is then [batch, units]). The input projection covers the
+  // real rows only and the sequences are stepped longest first, so a step
+  // computes just the ones still running; nothing is padded or copied.
+  ragged_tensor<dtype> operator()(const ragged_tensor<dtype> &input) {
+    shape::Shape s = input.values().shape();
+    this->ensure_built(shape::Shape(
+        {uint(input.nrows()), uint(input.max_length()), s.d.back()}));
+    check(s, 2);
+    size_t batch = input.nrows(), total = input.total_rows();
+    std::vector<dtype> xproj = project(input.values().raw_data(), total);
+
+    packed_sequence p = input.packed();
+    kernels::recurrent_layout layout;
+    layout.starts = p.starts.data();
+    layout.active = p.batch_sizes.data();
+    std::vector<dtype> h(batch * units, dtype(0));
+    std::vector<dtype> sequence(return_sequences ? total * units : 0);
+    run(xproj.data(), batch, p.batch_sizes.size(), h.data(),
+        return_sequences ? sequence.data() : nullptr, layout);
+    if (return_sequences)
+      return input.with_values(tensor<dtype>(
+          sequence, shape::Shape({uint(total), uint(units)})));
+
+    // h is in the packed order
+    std::vector<dtype> last(batch * units);
+    for (size_t i = 0; i < batch; i++)
+      std::copy(h.begin() + i * units, h.begin() + (i + 1) * units,
+                last.begin() + p.order[i] * units);
+    std::vector<size_t> splits(batch + 1);
+    std::iota(splits.begin(), splits.end(), 0);
+    return ragged_tensor<dtype>(
+        tensor<dtype>(std::move(last),
+                      shape::Shape({uint(batch), uint(units)})),
+        splits);
+  }
+
+  inline size_t output_units() const { return units; }
+};
+
+// Long short-term memory, gates i, f, c, o with sigmoid and tanh (the Keras
+// defaults). The forget gate bias starts at one (unit_forget_bias).
+template <class dtype = float>
+class LSTM : public Recurrent<dtype> {
+ protected:
+  std::vector<dtype> initial_bias() const override {
+    std::vector<dtype> b(4 * this->units, dtype(0));
+    std::fill(b.begin() + this->units, b.begin() + 2 * this->units, dtype(1));
+    return b;
+  }
+
+  void run(const dtype *xproj, size_t batch, size_t steps, dtype *h,
+           dtype *sequence,
+           const kernels::recurrent_layout &layout) override {
+    std::vector<dtype> c(batch * this->units, dtype(0));
+    kernels::lstm_forward(xproj, this->packed_recurrent.data(), batch, steps,
+                          this->units, h, c.data(), sequence, layout);
+  }
+
+ public:
+  explicit LSTM(size_t units, bool return_sequences = false,
+                bool use_bias = true, std::string name = "lstm")
+      : Recurrent<dtype>(units, 4, 1, use_bias, return_sequences,
+                         std::move(name)) {}
+};
+
+// Gated recurrent unit, gates z, r, h, in the Keras reset_after form (the
+// TensorFlow 2 default): the bias is [2, 3 * units], an input bias and a
+// recurrent bias, and the reset gate scales the recurrent projection.
+template <class dtype = float>
+class GRU : public Recurrent<dtype> {
+ protected:
+  void run(const dtype *xproj, size_t batch, size_t steps, dtype *h,
+           dtype *sequence,
+           const kernels::recurrent_layout &layout) override {
+    kernels::gru_forward(xproj, this->packed_recurrent.data(),
+                         this->recurrent_bias(), batch, steps, this->units, h,
+                         sequence, layout);
+  }
+
+ public:
+  explicit GRU(size_t units, bool return_sequences = false,
+               bool use_bias = true, std::string name = "gru")
+      : Recurrent<dtype>(units, 3, 2, use_bias, return_sequences,
+                         std::move(name)) {}
+};
+
+}  // namespace layers
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef SEQUENTIAL_HPP
+#define SEQUENTIAL_HPP
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/layers/batch_norm.hpp"
+#include "tensors++/layers/layer.hpp"
+
+namespace tensors {
+namespace models {
+
+// A plain stack of layers, each fed the output of the previous one.
+template <class dtype = float>
+class Sequential {
+  std::vector<std::unique_ptr<layers::Layer<dtype>>> stack;
+
+ public:
+  Sequential() = default;
+  Sequential(const Sequential &) = delete;
+  Sequential &operator=(const Sequential &) = delete;
+
+  // builds the layer in place, model.add<layers::Dense<>>(64, "relu")
+  template <class L, class... Args>
+  L &add(Args &&... args) {
+    L *layer = new L(std::forward<Args>(args)...);
+    stack.emplace_back(layer);
+    return *layer;
+  }
+
+  void add(std::unique_ptr<layers::Layer<dtype>> layer) {
+    stack.push_back(std::move(layer));
+  }
+
+  tensor<dtype> operator()(const tensor<dtype> &input) {
+    if (stack.empty()) return input;
+    std::unique_ptr<tensor<dtype>> h(new tensor<dtype>((*stack[0])(input)));
+    for (size_t i = 1; i < stack.size(); i++)
+      h.reset(new tensor<dtype>((*stack[i])(*h)));
+    return *h;
+  }
+
+  inline tensor<dtype> predict(const tensor<dtype> &input) {
+    return (*this)(input);
+  }
+
+  void set_training(bool on) {
+    for (auto &l : stack) l->set_training(on);
+  }
+
+  void freeze() {
+    for (auto &l : stack) l->freeze();
+  }
+
+  void unfreeze() {
+    for (auto &l : stack) l->unfreeze();
+  }
+
+  // Inference optimization: every BatchNormalization directly after a layer
+  // that can absorb it (Conv2D, Conv1D or Dense without an activation) is
+  // folded into that layer's weights and removed, saving a full pass over
+  // its activations. The model has to be built (called once) and is frozen
+  // afterwards. Returns the number of folded layers.
+  size_t fold_batch_norm() {
+    size_t folded = 0;
+    std::vector<std::unique_ptr<layers::Layer<dtype>>> kept;
+    for (auto &l : stack) {
+      auto *bn = dynamic_cast<layers::BatchNormalization<dtype> *>(l.get());
+      if (bn && bn->is_built() && !kept.empty() && kept.back()->is_built()) {
+        std::vector<dtype> scale, shift;
+        bn->inference_affine(scale, shift);
+        if (kept.back()->fold_affine(scale, shift)) {
+          folded++;
+          continue;
+        }
+      }
+      kept.push_back(std::move(l));
+    }
+    stack = std::move(kept);
+    set_training(false);
+    freeze();
+    return folded;
+  }
+
+  inline size_t size() const { return stack.size(); }
+  inline layers::Layer<dtype> &operator[](size_t i) { return *stack[i]; }
+};
+
+}  // namespace models
+}  // namespace tensors
+
+#endif
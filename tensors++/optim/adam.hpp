@@ -0,0 +1,160 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef ADAM_HPP
+#define ADAM_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/kernels/embedding.hpp"
+#include "tensors++/optim/optimizer.hpp"
+
+namespace tensors {
+namespace optim {
+
+// Adam in the Keras formulation, the bias corrections folded into the step
+// size:
+//   m = beta_1 * m + (1 - beta_1) * grad
+//   v = beta_2 * v + (1 - beta_2) * grad^2
+//   param -= lr * sqrt(1 - beta_2^t) / (1 - beta_1^t) * m / (sqrt(v) + eps)
+//
+// apply_sparse_gradient() is the lazy variant for sparse row gradients.
+template <class dtype = float>
+class Adam : public Optimizer<dtype> {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  std::unordered_map<const void *, std::vector<dtype>> ms, vs;
+  std::unordered_map<const void *, std::vector<uint32_t>> row_steps;
+  std::vector<dtype *> m, v;
+  dtype alpha = dtype(0);  // bias corrected step size of the current step
+
+  inline dtype step_size(double t) const {
+    return dtype(this->lr * std::sqrt(1 - std::pow(double(beta_2), t)) /
+                 (1 - std::pow(double(beta_1), t)));
+  }
+
+  // one fused update of n elements
+  void adam(dtype *param, dtype *mean, dtype *variance, const dtype *grad,
+            size_t n, dtype step) const {
+    Eigen::Map<array> p(param, n), mi(mean, n), vi(variance, n);
+    Eigen::Map<const array> g(grad, n);
+    mi = beta_1 * mi + (dtype(1) - beta_1) * g;
+    vi = beta_2 * vi + (dtype(1) - beta_2) * g.square();
+    if (weight_decay != dtype(0))
+      p = p * (dtype(1) - this->lr * weight_decay) -
+          step * mi / (vi.sqrt() + epsilon);
+    else
+      p -= step * mi / (vi.sqrt() + epsilon);
+  }
+
+ protected:
+  dtype beta_1, beta_2, epsilon;
+  dtype weight_decay = dtype(0);  // decoupled, see AdamW
+
+  void prepare(const std::vector<tensor<dtype> *> &params) override {
+    for (const tensor<dtype> *param : params)
+      if (row_steps.count(param))
+        throw exceptions::operation_undefined(
+            "Adam got a dense gradient for a parameter it updates through "
+            "apply_sparse_gradient");
+    m.resize(params.size());
+    v.resize(params.size());
+    for (size_t i = 0; i < params.size(); i++) {
+      m[i] = this->slot(ms, params[i]).data();
+      v[i] = this->slot(vs, params[i]).data();
+    }
+    alpha = step_size(double(this->steps));
+  }
+
+  void update(size_t i, dtype *param, const dtype *grad, size_t begin,
+              size_t end) override {
+    adam(param + begin, m[i] + begin, v[i] + begin, grad + begin,
+         end - begin, alpha);
+  }
+
+ public:
+  explicit Adam(dtype learning_rate = dtype(0.001), dtype beta_1 = dtype(0.9),
+                dtype beta_2 = dtype(0.999), dtype epsilon = dtype(1e-7))
+      : Optimizer<dtype>(learning_rate),
+        beta_1(beta_1),
+        beta_2(beta_2),
+        epsilon(epsilon) {}
+
+  // Lazy Adam step for a sparse row gradient of param ([rows, grad.dim]),
+  // such as Embedding::backward(). Only the listed rows of param and of its
+  // moments are read and written, so the cost follows the batch and not the
+  // table. Every row counts its own steps and is bias corrected for its own
+  // history; rows that are absent keep their moments (and, with weight
+  // decay, their values) untouched instead of decaying every step.
+  //
+  // The row counters are not the global step of apply_gradients(), so a
+  // parameter is updated through one of the two only: mixing them throws.
+  // The indices must be strictly ascending, as scatter_rows produces them.
+  void apply_sparse_gradient(const kernels::sparse_rows<dtype> &grad,
+                             tensor<dtype> &param) {
+    size_t dim = grad.dim;
+    if (dim == 0 || param.size() % dim != 0 ||
+        grad.values.size() != grad.size() * dim)
+      throw exceptions::operation_undefined(
+          "Sparse gradient rows do not divide the parameter");
+    size_t rows = param.size() / dim;
+    kernels::check_row_ids(grad.indices.data(), grad.size(), rows);
+    for (size_t r = 1; r < grad.size(); r++)
+      if (grad.indices[r] <= grad.indices[r - 1])
+        throw exceptions::operation_undefined(
+            "Sparse gradient row indices must be strictly ascending");
+    if (ms.count(&param) && !row_steps.count(&param))
+      throw exceptions::operation_undefined(
+          "Adam got a sparse gradient for a parameter it updates through "
+          "apply_gradients");
+    dtype *p = param.raw_data();  // throws for frozen parameters
+    dtype *mp = this->slot(ms, &param).data();
+    dtype *vp = this->slot(vs, &param).data();
+    std::vector<uint32_t> &t = row_steps[&param];
+    if (t.size() != rows) t.assign(rows, 0);
+
+    size_t grain = std::max<size_t>(1, 8192 / dim);
+    parallel::parallel_for(grad.size(), grain, [&](size_t begin, size_t end) {
+      for (size_t r = begin; r < end; r++) {
+        size_t row = grad.indices[r], at = row * dim;
+        adam(p + at, mp + at, vp + at, grad.row(r), dim,
+             step_size(double(++t[row])));
+      }
+    });
+  }
+};
+
+// Adam with decoupled weight decay (Loshchilov and Hutter), applied to the
+// parameter in the same pass: param -= lr * weight_decay * param.
+template <class dtype = float>
+class AdamW : public Adam<dtype> {
+ public:
+  explicit AdamW(dtype learning_rate = dtype(0.001),
+                 dtype weight_decay = dtype(0.004), dtype beta_1 = dtype(0.9),
+                 dtype beta_2 = dtype(0.999), dtype epsilon = dtype(1e-7))
+      : Adam<dtype>(learning_rate, beta_1, beta_2, epsilon) {
+    this->weight_decay = weight_decay;
+  }
+};
+
+}  // namespace optim
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/core/tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+
+namespace tensors {
+namespace optim {
+
+// Base of the optimizers, which update parameter tensors in place.
+//
+// apply_gradients() cuts every parameter into chunks of chunk_elements and
+// runs all chunks of all parameters in a single parallel launch, so a model
+// of many small tensors costs one trip through the pool instead of one per
+// tensor. Each chunk is updated by one fused pass that reads the parameter,
+// its gradient and its slots once and writes them once; a chunk of four
+// such arrays stays within the L1 cache between the expressions of the
+// update.
+template <class dtype = float>
+class Optimizer {
+  struct chunk {
+    size_t param, begin, end;
+  };
+
+ protected:
+  dtype lr;
+  size_t steps = 0;
+
+  // slot arrays (momentum, ...) of a parameter, created zeroed on first use
+  std::vector<dtype> &slot(std::unordered_map<const void *,
+                                              std::vector<dtype>> &slots,
+                           const tensor<dtype> *param) {
+    std::vector<dtype> &s = slots[param];
+    if (s.size() != param->size()) s.assign(param->size(), dtype(0));
+    return s;
+  }
+
+  // binds the state of the parameters of this step, called once per step
+  // before any update; throwing rejects the step, which is then not counted
+  virtual void prepare(const std::vector<tensor<dtype> *> &params) = 0;
+
+  // updates elements [begin, end) of parameter i of the current step
+  virtual void update(size_t i, dtype *param, const dtype *grad,
+                      size_t begin, size_t end) = 0;
+
+ public:
+  static const size_t chunk_elements = 2048;
+
+  explicit Optimizer(dtype learning_rate) : lr(learning_rate) {}
+  virtual ~Optimizer() = default;
+
+  // param -= update(grad) for every pair, one step
+  void apply_gradients(const std::vector<tensor<dtype> *> &grads,
+                       const std::vector<tensor<dtype> *> &params) {
+    if (grads.size() != params.size())
+      throw exceptions::operation_undefined(
+          "Optimizer needs one gradient per parameter");
+    std::vector<dtype *> p(params.size());
+    std::vector<const dtype *> g(params.size());
+    std::vector<chunk> chunks;
+    for (size_t i = 0; i < params.size(); i++) {
+      if (grads[i]->size() != params[i]->size())
+        throw exceptions::operation_undefined(
+            "Gradient " + std::to_string(i) +
+            " does not match the size of its parameter");
+      p[i] = params[i]->raw_data();  // throws for frozen parameters
+      g[i] = static_cast<const tensor<dtype> &>(*grads[i]).raw_data();
+      for (size_t b = 0; b < params[i]->size(); b += chunk_elements)
+        chunks.push_back(
+            {i, b, std::min(params[i]->size(), b + chunk_elements)});
+    }
+    steps++;
+    try {
+      prepare(params);
+    } catch (...) {
+      steps--;
+      throw;
+    }
+    parallel::parallel_for(chunks.size(), 4, [&](size_t begin, size_t end) {
+      for (size_t c = begin; c < end; c++)
+        update(chunks[c].param, p[chunks[c].param], g[chunks[c].param],
+               chunks[c].begin, chunks[c].end);
+    });
+  }
+
+  inline size_t iterations() const { return steps; }
+  inline dtype learning_rate() const { return lr; }
+  inline void set_learning_rate(dtype rate) { lr = rate; }
+};
+
+}  // namespace optim
+}  // namespace tensors
+
+#endif
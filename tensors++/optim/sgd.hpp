@@ -0,0 +1,77 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef SGD_HPP
+#define SGD_HPP
+
+#include <unordered_map>
+#include <vector>
+
+#include "Eigen/Core"
+#include "tensors++/optim/optimizer.hpp"
+
+namespace tensors {
+namespace optim {
+
+// Stochastic gradient descent with optional (Nesterov) momentum, the Keras
+// formulation:
+//   velocity = momentum * velocity - lr * grad
+//   param += velocity, or momentum * velocity - lr * grad with nesterov
+template <class dtype = float>
+class SGD : public Optimizer<dtype> {
+  typedef Eigen::Array<dtype, Eigen::Dynamic, 1> array;
+  dtype momentum;
+  bool nesterov;
+  std::unordered_map<const void *, std::vector<dtype>> velocities;
+  std::vector<dtype *> velocity;
+
+ protected:
+  void prepare(const std::vector<tensor<dtype> *> &params) override {
+    velocity.assign(params.size(), nullptr);
+    if (momentum == dtype(0)) return;
+    for (size_t i = 0; i < params.size(); i++)
+      velocity[i] = this->slot(velocities, params[i]).data();
+  }
+
+  void update(size_t i, dtype *param, const dtype *grad, size_t begin,
+              size_t end) override {
+    size_t n = end - begin;
+    Eigen::Map<array> p(param + begin, n);
+    Eigen::Map<const array> g(grad + begin, n);
+    if (!velocity[i]) {
+      p -= this->lr * g;
+      return;
+    }
+    Eigen::Map<array> v(velocity[i] + begin, n);
+    v = momentum * v - this->lr * g;
+    if (nesterov)
+      p += momentum * v - this->lr * g;
+    else
+      p += v;
+  }
+
+ public:
+  explicit SGD(dtype learning_rate = dtype(0.01), dtype momentum = dtype(0),
+               bool nesterov = false)
+      : Optimizer<dtype>(learning_rate),
+        momentum(momentum),
+        nesterov(nesterov) {}
+};
+
+}  // namespace optim
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef FEATURE_HASHER_HPP
+#define FEATURE_HASHER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensors++/core/sparse_tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/preprocessing/murmur_hash.hpp"
+
+namespace tensors {
+namespace preprocessing {
+
+// The hashing trick: string features go straight to columns of a sparse
+// [rows, buckets] matrix, without a vocabulary. Hashes follow
+// scikit-learn's FeatureHasher: with the signed 32-bit murmur3 hash h of a
+// feature, the column is |h| mod buckets, and with alternate_sign the value
+// is negated for h < 0, so collisions cancel out in expectation instead of
+// piling up. Models trained on sklearn-hashed features see the same
+// columns.
+//
+// Rows are hashed in parallel, a slice of rows per task into its own
+// csr_builder, and the slices are joined in order (csr_builder::add_rows),
+// so transform() can be fed one batch at a time and the dense matrix never
+// exists.
+template <class dtype = float>
+class feature_hasher {
+  typedef typename sparse_tensor<dtype>::index_type index_type;
+  size_t buckets;
+  bool alternate_sign;
+  uint32_t seed;
+
+ public:
+  explicit feature_hasher(size_t buckets = size_t(1) << 20,
+                          bool alternate_sign = true, uint32_t seed = 0)
+      : buckets(buckets), alternate_sign(alternate_sign), seed(seed) {
+    if (buckets == 0 || buckets > size_t(INT32_MAX))
+      throw exceptions::operation_undefined(
+          "Feature hashing needs between 1 and 2^31 - 1 buckets");
+  }
+
+  // column of a hash, and its sign in *negative
+  inline index_type bucket(uint32_t hash, bool *negative) const {
+    int32_t h = int32_t(hash);
+    *negative = alternate_sign && h < 0;
+    // |INT32_MIN| does not fit, sklearn maps it like this
+    if (h == INT32_MIN)
+      return index_type((size_t(INT32_MAX) - (buckets - 1)) % buckets);
+    return index_type(size_t(h < 0 ? -h : h) % buckets);
+  }
+
+  // column and signed value of a string feature with weight `value`
+  inline void hash(const std::string &feature, dtype value,
+                   index_type *column, dtype *signed_value,
+                   uint32_t feature_seed) const {
+    bool negative;
+    *column = bucket(murmur3_32(feature, feature_seed), &negative);
+    *signed_value = negative ? -value : value;
+  }
+
+  inline void hash(const std::string &feature, dtype value,
+                   index_type *column, dtype *signed_value) const {
+    hash(feature, value, column, signed_value, seed);
+  }
+
+  // Appends one row per element of rows, each a bag of string features of
+  // weight 1 (repeats add up).
+  void transform(const std::vector<std::vector<std::string>> &rows,
+                 csr_builder<dtype> &out) const {
+    out.add_rows(rows.size(), [&](size_t r, std::vector<index_type> &cols,
+                                  std::vector<dtype> &values) {
+      cols.resize(rows[r].size());
+      values.resize(rows[r].size());
+      for (size_t i = 0; i < rows[r].size(); i++)
+        hash(rows[r][i], dtype(1), &cols[i], &values[i], seed);
+    });
+  }
+
+  // Appends one row per element of rows, each a list of (feature, value)
+  // pairs like sklearn's dict input (repeats add up).
+  void transform(
+      const std::vector<std::vector<std::pair<std::string, dtype>>> &rows,
+      csr_builder<dtype> &out) const {
+    out.add_rows(rows.size(), [&](size_t r, std::vector<index_type> &cols,
+                                  std::vector<dtype> &values) {
+      cols.resize(rows[r].size());
+      values.resize(rows[r].size());
+      for (size_t i = 0; i < rows[r].size(); i++)
+        hash(rows[r][i].first, rows[r][i].second, &cols[i], &values[i],
+             seed);
+    });
+  }
+
+  // Appends the rows of a table given column by column (columns[c][r] is
+  // the category of row r in column c). A category is hashed with the hash
+  // of its column name as the seed, so "red" in two columns lands in two
+  // different buckets without building "color=red" strings.
+  void transform_columns(const std::vector<std::vector<std::string>> &columns,
+                         const std::vector<std::string> &names,
+                         csr_builder<dtype> &out) const {
+    if (names.size() != columns.size())
+      throw exceptions::operation_undefined(
+          "Feature hashing got " + std::to_string(columns.size()) +
+          " columns and " + std::to_string(names.size()) + " names");
+    size_t rows = columns.empty() ? 0 : columns[0].size();
+    std::vector<uint32_t> seeds;
+    for (size_t c = 0; c < columns.size(); c++) {
+      if (columns[c].size() != rows)
+        throw exceptions::operation_undefined(
+            "Columns of the table differ in length");
+      seeds.push_back(murmur3_32(names[c], seed));
+    }
+    out.add_rows(rows, [&](size_t r, std::vector<index_type> &cols,
+                           std::vector<dtype> &values) {
+      cols.resize(columns.size());
+      values.resize(columns.size());
+      for (size_t c = 0; c < columns.size(); c++)
+        hash(columns[c][r], dtype(1), &cols[c], &values[c], seeds[c]);
+    });
+  }
+
+  // the whole batch at once
+  template <class Feature>
+  sparse_tensor<dtype> transform(
+      const std::vector<std::vector<Feature>> &rows) const {
+    csr_builder<dtype> out(buckets);
+    transform(rows, out);
+    return out.finish();
+  }
+
+  inline size_t num_buckets() const { return buckets; }
+};
+
+}  // namespace preprocessing
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef MURMUR_HASH_HPP
+#define MURMUR_HASH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace tensors {
+namespace preprocessing {
+
+inline uint32_t rotl32(uint32_t x, int r) { return (x << r) | (x >> (32 - r)); }
+
+// MurmurHash3_x86_32 (Austin Appleby, public domain), the hash of
+// scikit-learn's FeatureHasher and of Spark's HashingTF. Blocks are put
+// together byte by byte (one load once compiled on x86), so any alignment
+// or byte order gives the reference value.
+inline uint32_t murmur3_32(const void *key, size_t len, uint32_t seed = 0) {
+  const uint8_t *data = static_cast<const uint8_t *>(key);
+  const uint32_t c1 = 0xcc9e2d51, c2 = 0x1b873593;
+  uint32_t h = seed;
+  size_t blocks = len / 4;
+  for (size_t i = 0; i < blocks; i++) {
+    const uint8_t *p = data + 4 * i;
+    uint32_t k = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 |
+                 uint32_t(p[3]) << 24;
+    k = rotl32(k * c1, 15) * c2;
+    h = rotl32(h ^ k, 13) * 5 + 0xe6546b64;
+  }
+  const uint8_t *tail = data + 4 * blocks;
+  uint32_t k = 0;
+  switch (len & 3) {
+    case 3:
+      k ^= uint32_t(tail[2]) << 16;
+      // fall through
+    case 2:
+      k ^= uint32_t(tail[1]) << 8;
+      // fall through
+    case 1:
+      k ^= tail[0];
+      h ^= rotl32(k * c1, 15) * c2;
+  }
+  h ^= uint32_t(len);
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+inline uint32_t murmur3_32(const std::string &s, uint32_t seed = 0) {
+  return murmur3_32(s.data(), s.size(), seed);
+}
+
+inline uint32_t murmur3_32(const char *s, uint32_t seed = 0) {
+  return murmur3_32(s, std::strlen(s), seed);
+}
+
+}  // namespace preprocessing
+}  // namespace tensors
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#ifndef VOCABULARY_HPP
+#define VOCABULARY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "tensors++/core/parallel.hpp"
+#include "tensors++/core/sparse_tensor.hpp"
+#include "tensors++/exceptions/tensor_operation.hpp"
+#include "tensors++/preprocessing/murmur_hash.hpp"
+
+namespace tensors {
+namespace preprocessing {
+
+// String to integer id encoder (Keras StringLookup). Ids 0 .. oov_buckets
+// - 1 are the out-of-vocabulary buckets, an unknown string hashing into
+// one of them, and the tokens follow in the order they were added.
+//
+// The table is open addressing with linear probing over a power of two
+// number of slots, at most half full. A slot keeps the token's 32-bit hash
+// next to its id, so a probe compares the strings only when the hashes
+// match and a miss rarely touches the token storage at all; the tokens
+// themselves sit back to back in one character buffer.
+class vocabulary {
+  struct slot {
+    uint32_t hash = 0;
+    uint32_t id = 0;  // token index + 1, 0 for an empty slot
+  };
+  std::vector<slot> slots;
+  std::vector<char> chars;
+  std::vector<size_t> offsets;  // token i is chars[offsets[i], offsets[i+1])
+  size_t oov;
+  uint32_t seed;
+
+  inline size_t token_length(size_t i) const {
+    return offsets[i + 1] - offsets[i];
+  }
+
+  // slot holding the token, or the empty slot where it would go
+  size_t probe(const char *s, size_t len, uint32_t hash) const {
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      const slot &e = slots[i];
+      if (e.id == 0) return i;
+      size_t t = e.id - 1;
+      if (e.hash == hash && token_length(t) == len &&
+          std::equal(s, s + len, chars.data() + offsets[t]))
+        return i;
+    }
+  }
+
+  // returned by find() for an unknown token without out-of-vocabulary
+  // buckets
+  static const size_t missing = size_t(-1);
+
+  // id of the token, an out-of-vocabulary bucket or `missing` for unknown
+  // ones; never throws, so it is safe in parallel tasks
+  size_t find(const std::string &token) const {
+    uint32_t h = murmur3_32(token, seed);
+    const slot &e = slots[probe(token.data(), token.size(), h)];
+    if (e.id != 0) return oov + e.id - 1;
+    return oov ? h % oov : missing;
+  }
+
+  void grow() {
+    std::vector<slot> old(slots.size() * 2);
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    for (const slot &e : old) {
+      if (e.id == 0) continue;
+      size_t i = e.hash & mask;
+      while (slots[i].id != 0) i = (i + 1) & mask;
+      slots[i] = e;
+    }
+  }
+
+ public:
+  explicit vocabulary(size_t oov_buckets = 1, uint32_t seed = 0)
+      : slots(16), offsets(1, 0), oov(oov_buckets), seed(seed) {}
+
+  // id of the token, adding it when new
+  size_t add(const std::string &token) {
+    uint32_t h = murmur3_32(token, seed);
+    size_t i = probe(token.data(), token.size(), h);
+    if (slots[i].id != 0) return oov + slots[i].id - 1;
+    if (offsets.size() >= size_t(UINT32_MAX))
+      throw exceptions::operation_undefined("Vocabulary is full");
+    chars.insert(chars.end(), token.begin(), token.end());
+    offsets.push_back(chars.size());
+    slots[i].hash = h;
+    slots[i].id = uint32_t(offsets.size() - 1);
+    if (2 * (offsets.size() - 1) > slots.size()) grow();
+    return oov + offsets.size() - 2;
+  }
+
+  // id of the token, an out-of-vocabulary bucket for unknown ones
+  size_t lookup(const std::string &token) const {
+    size_t id = find(token);
+    if (id == missing)
+      throw exceptions::operation_undefined(
+          "Token \"" + token + "\" is not in a vocabulary without "
+                               "out-of-vocabulary buckets");
+    return id;
+  }
+
+  inline bool contains(const std::string &token) const {
+    uint32_t h = murmur3_32(token, seed);
+    return slots[probe(token.data(), token.size(), h)].id != 0;
+  }
+
+  // token of a vocabulary id (not an out-of-vocabulary one)
+  std::string token(size_t id) const {
+    if (id < oov || id >= size())
+      throw exceptions::operation_undefined(
+          "Id " + std::to_string(id) + " is not a token of the vocabulary");
+    size_t t = id - oov;
+    return std::string(chars.data() + offsets[t], token_length(t));
+  }
+
+  // Vocabulary of a corpus (Keras adapt): tokens seen at least min_count
+  // times, the most frequent first (ties in order of first appearance),
+  // at most max_tokens of them when that is not 0.
+  static vocabulary build(const std::vector<std::string> &corpus,
+                          size_t max_tokens = 0, size_t min_count = 1,
+                          size_t oov_buckets = 1, uint32_t seed = 0) {
+    vocabulary seen(0, seed);
+    std::vector<size_t> counts;
+    for (const std::string &t : corpus) {
+      size_t id = seen.add(t);
+      if (id == counts.size()) counts.push_back(0);
+      counts[id]++;
+    }
+    std::vector<size_t> order(counts.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&counts](size_t a, size_t b) {
+      return counts[a] > counts[b];
+    });
+    vocabulary v(oov_buckets, seed);
+    for (size_t id : order) {
+      if (counts[id] < min_count || (max_tokens && v.tokens() == max_tokens))
+        break;
+      v.add(seen.token(id));
+    }
+    return v;
+  }
+
+  // Ids of a column of strings, in parallel. Without out-of-vocabulary
+  // buckets the tasks only flag unknown tokens, and the first one is
+  // reported once they have all finished.
+  std::vector<size_t> lookup(const std::vector<std::string> &tokens) const {
+    std::vector<size_t> ids(tokens.size());
+    std::atomic<bool> unknown(false);
+    parallel::parallel_for(tokens.size(), 4096, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++)
+        if ((ids[i] = find(tokens[i])) == missing) unknown = true;
+    });
+    if (unknown)
+      for (const std::string &t : tokens) lookup(t);  // throws
+    return ids;
+  }
+
+  // [n, size()] with a single 1 per row at the id of tokens[r]
+  template <class dtype = float>
+  sparse_tensor<dtype> one_hot(const std::vector<std::string> &tokens) const {
+    std::vector<size_t> ids = lookup(tokens);
+    typedef typename sparse_tensor<dtype>::index_type index_type;
+    std::vector<index_type> outer(ids.size() + 1), inner(ids.size());
+    std::iota(outer.begin(), outer.end(), 0);
+    std::copy(ids.begin(), ids.end(), inner.begin());
+    return sparse_tensor<dtype>(ids.size(), size(), std::move(outer),
+                                std::move(inner),
+                                std::vector<dtype>(ids.size(), dtype(1)));
+  }
+
+  // [rows, size()] token counts of every row (multi-hot bag of words, or
+  // plain multi-hot with binary set). Slices of rows are encoded in
+  // parallel, see csr_builder::add_rows; unknown tokens without
+  // out-of-vocabulary buckets are reported as by lookup(vector).
+  template <class dtype = float>
+  sparse_tensor<dtype> encode(const std::vector<std::vector<std::string>> &rows,
+                              bool binary = false) const {
+    typedef typename sparse_tensor<dtype>::index_type index_type;
+    csr_builder<dtype> out(size());
+    std::atomic<bool> unknown(false);
+    out.add_rows(rows.size(), [&](size_t r, std::vector<index_type> &cols,
+                                  std::vector<dtype> &values) {
+      for (const std::string &t : rows[r]) {
+        size_t id = find(t);
+        if (id == missing)
+          unknown = true;
+        else
+          cols.push_back(index_type(id));
+      }
+      if (binary) {
+        std::sort(cols.begin(), cols.end());
+        cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+      }
+      values.assign(cols.size(), dtype(1));
+    });
+    if (unknown)
+      for (const auto &row : rows)
+        for (const std::string &t : row) lookup(t);  // throws
+    return out.finish();
+  }
+
+  // out-of-vocabulary buckets plus tokens
+  inline size_t size() const { return oov + tokens(); }
+  inline size_t tokens() const { return offsets.size() - 1; }
+  inline size_t oov_buckets() const { return oov; }
+};
+
+}  // namespace preprocessing
+}  // namespace tensors
+
+#endif
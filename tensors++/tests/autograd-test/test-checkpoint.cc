@@ -0,0 +1,150 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "tensors++/autograd/checkpoint.hpp"
+
+using namespace tensors;
+using namespace tensors::autograd;
+
+static tensor<double> filled(std::vector<uint> dims, double phase,
+                             bool grad = true) {
+  shape::Shape s(dims);
+  std::vector<double> v(s.element_size());
+  for (size_t i = 0; i < v.size(); i++)
+    v[i] = 0.6 * std::sin(0.7 * i + phase);
+  config::Config c = config::Config::default_config_instance();
+  c.grad_required = grad;
+  return tensor<double>(v, s, c);
+}
+
+// a chain of tanh(x W + b) layers, each watching its own parameters
+struct chain {
+  std::vector<tensor<double>> weights, biases;
+
+  explicit chain(size_t layers, uint width) {
+    for (size_t l = 0; l < layers; l++) {
+      weights.push_back(filled({width, width}, 0.3 * l));
+      biases.push_back(filled({width}, 1.7 * l));
+    }
+  }
+
+  segment<double> layer(size_t l) {
+    return [this, l](Tape<double> &t, const var<double> &x) {
+      return tanh(add_bias(matmul(x, t.watch(weights[l])), t.watch(biases[l])));
+    };
+  }
+
+  std::vector<segment<double>> layers() {
+    std::vector<segment<double>> all;
+    for (size_t l = 0; l < weights.size(); l++) all.push_back(layer(l));
+    return all;
+  }
+
+  void expect_same_gradients(const Tape<double> &a, const Tape<double> &b) {
+    for (size_t l = 0; l < weights.size(); l++) {
+      for (auto p : {&weights[l], &biases[l]}) {
+        const double *ga = a.grad(*p), *gb = b.grad(*p);
+        ASSERT_NE(ga, nullptr);
+        ASSERT_NE(gb, nullptr);
+        for (size_t i = 0; i < p->size(); i++)
+          EXPECT_NEAR(ga[i], gb[i], 1e-12) << "layer " << l;
+      }
+    }
+  }
+};
+
+TEST(Segment, CHECKPOINT_TEST) {
+  chain net(4, 6);
+  tensor<double> input = filled({5, 6}, 0.9);
+
+  Tape<double> plain;
+  var<double> h = plain.watch(input);
+  for (auto &layer : net.layers()) h = layer(plain, h);
+  plain.backward(mean(h));
+
+  // the middle two layers as one segment
+  Tape<double> tape;
+  segment<double> first = net.layer(1), second = net.layer(2);
+  var<double> c = net.layer(0)(tape, tape.watch(input));
+  c = tape.checkpoint(
+      [&](Tape<double> &t, const var<double> &x) {
+        return second(t, first(t, x));
+      },
+      c);
+  c = net.layer(3)(tape, c);
+  tape.backward(mean(c));
+
+  for (size_t i = 0; i < h.size(); i++)
+    EXPECT_DOUBLE_EQ(h.data()[i], c.data()[i]);
+  net.expect_same_gradients(plain, tape);
+  // the segment kept its output only
+  EXPECT_LT(tape.activation_elements(), plain.activation_elements());
+}
+
+TEST(Sequential, CHECKPOINT_TEST) {
+  chain net(6, 8);
+  tensor<double> input = filled({4, 8}, 0.2);
+
+  Tape<double> plain;
+  var<double> h = plain.watch(input);
+  for (auto &layer : net.layers()) h = layer(plain, h);
+  plain.backward(sum(h));
+
+  // room for the whole chain, no segments
+  sequential_checkpoint<double> roomy(net.layers(), size_t(1) << 30);
+  Tape<double> a;
+  a.backward(sum(roomy(a, a.watch(input))));
+  EXPECT_EQ(roomy.segments(), std::vector<size_t>({0}));
+  net.expect_same_gradients(plain, a);
+
+  // a budget below the plain peak forces several segments
+  size_t peak = plain.activation_elements() * sizeof(double);
+  sequential_checkpoint<double> tight(net.layers(), peak / 2);
+  for (int step = 0; step < 2; step++) {
+    Tape<double> b;
+    var<double> out = tight(b, b.watch(input));
+    b.backward(sum(out));
+    EXPECT_GT(tight.segments().size(), 1u);
+    for (size_t i = 0; i < h.size(); i++)
+      EXPECT_DOUBLE_EQ(h.data()[i], out.data()[i]);
+    net.expect_same_gradients(plain, b);
+  }
+}
+
+TEST(Plan, CHECKPOINT_TEST) {
+  std::vector<size_t> even = {4, 4, 4, 4}, ones = {1, 1, 1, 1};
+  EXPECT_EQ(plan_checkpoints(even, ones, 16), std::vector<size_t>({0}));
+  // two halves keep one output and one half: 1 + 1 + 8
+  EXPECT_EQ(plan_checkpoints(even, ones, 10), std::vector<size_t>({0, 2}));
+  // nothing fits 7, every layer alone has the lowest peak 3 + 1 + 4
+  EXPECT_EQ(plan_checkpoints(even, ones, 7),
+            std::vector<size_t>({0, 1, 2, 3}));
+
+  // the two heavy layers must land in different segments
+  std::vector<size_t> heavy = {1, 8, 1, 1, 8, 1};
+  std::vector<size_t> out(6, 1);
+  EXPECT_EQ(plan_checkpoints(heavy, out, 13), std::vector<size_t>({0, 4}));
+  EXPECT_EQ(plan_checkpoints({}, {}, 0), std::vector<size_t>({0}));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
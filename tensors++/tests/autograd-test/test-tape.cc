@@ -0,0 +1,154 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include "tensors++/autograd/tape.hpp"
+
+using namespace tensors;
+using namespace tensors::autograd;
+
+typedef std::function<var<double>(std::vector<var<double>> &)> graph_fn;
+
+static config::Config trainable() {
+  config::Config c = config::Config::default_config_instance();
+  c.grad_required = true;
+  return c;
+}
+
+// values kept in [low, low + 1] so log, div and relu stay away from their
+// singular points
+static tensor<double> filled(std::vector<uint> dims, double low, double phase,
+                             bool grad = true) {
+  shape::Shape s(dims);
+  std::vector<double> v(s.element_size());
+  for (size_t i = 0; i < v.size(); i++)
+    v[i] = low + 0.5 + 0.5 * std::sin(1.3 * i + phase);
+  return tensor<double>(v, s,
+                        grad ? trainable()
+                             : config::Config::default_config_instance());
+}
+
+// sum(f(x) * w) with fixed weights w, so every output element gets a
+// different seed gradient
+static double run(std::vector<tensor<double> *> &in, const graph_fn &f,
+                  Tape<double> &t) {
+  std::vector<var<double>> x;
+  for (auto p : in) x.push_back(t.watch(*p));
+  var<double> y = f(x);
+  // the tape only borrows w, it has to live through backward
+  tensor<double> w = filled(y.shape().d, -0.5, 0.7, false);
+  y = sum(y * t.watch(w));
+  t.backward(y);
+  return y.data()[0];
+}
+
+// compares the tape gradient of every input with a central difference
+static void check_gradient(std::vector<tensor<double>> in, const graph_fn &f) {
+  std::vector<tensor<double> *> ptr;
+  for (auto &x : in) ptr.push_back(&x);
+  Tape<double> t;
+  run(ptr, f, t);
+  const double h = 1e-6;
+  for (auto &x : in) {
+    const double *g = t.grad(x);
+    ASSERT_NE(g, nullptr);
+    std::vector<double> analytic(g, g + x.size());
+    for (size_t i = 0; i < x.size(); i++) {
+      double keep = x.raw_data()[i];
+      Tape<double> tp, tm;
+      x.raw_data()[i] = keep + h;
+      double fp = run(ptr, f, tp);
+      x.raw_data()[i] = keep - h;
+      double fm = run(ptr, f, tm);
+      x.raw_data()[i] = keep;
+      EXPECT_NEAR(analytic[i], (fp - fm) / (2 * h), 1e-6) << "element " << i;
+    }
+  }
+}
+
+TEST(Binary, TAPE_TEST) {
+  std::vector<tensor<double>> in;
+  in.push_back(filled({3, 4}, -0.5, 0.1));
+  in.push_back(filled({3, 4}, 0.5, 0.9));
+  check_gradient(in, [](std::vector<var<double>> &x) { return x[0] + x[1]; });
+  check_gradient(in, [](std::vector<var<double>> &x) { return x[0] - x[1]; });
+  check_gradient(in, [](std::vector<var<double>> &x) { return x[0] * x[1]; });
+  check_gradient(in, [](std::vector<var<double>> &x) { return x[0] / x[1]; });
+  // an input used twice accumulates both paths
+  check_gradient(in, [](std::vector<var<double>> &x) {
+    return (x[0] * x[0] - x[1] / 3.0) * 2.0 + 1.0;
+  });
+}
+
+TEST(Linear, TAPE_TEST) {
+  std::vector<tensor<double>> in;
+  in.push_back(filled({3, 5}, -0.5, 0.2));
+  in.push_back(filled({5, 2}, -0.5, 1.1));
+  in.push_back(filled({2}, -0.5, 2.3));
+  check_gradient(in, [](std::vector<var<double>> &x) {
+    return add_bias(matmul(x[0], x[1]), x[2]);
+  });
+}
+
+TEST(Unary, TAPE_TEST) {
+  std::vector<tensor<double>> in;
+  in.push_back(filled({2, 7}, -0.5, 0.3));
+  check_gradient(in, [](std::vector<var<double>> &x) { return relu(x[0]); });
+  check_gradient(in, [](std::vector<var<double>> &x) { return sigmoid(x[0]); });
+  check_gradient(in, [](std::vector<var<double>> &x) { return tanh(x[0]); });
+  check_gradient(in, [](std::vector<var<double>> &x) { return exp(x[0]); });
+  check_gradient(in, [](std::vector<var<double>> &x) { return sum(x[0]); });
+  check_gradient(in, [](std::vector<var<double>> &x) { return mean(x[0]); });
+  std::vector<tensor<double>> positive;
+  positive.push_back(filled({2, 7}, 0.5, 0.3));
+  check_gradient(positive,
+                 [](std::vector<var<double>> &x) { return log(x[0]); });
+}
+
+TEST(Watch, TAPE_TEST) {
+  tensor<double> w = filled({4}, 0, 0.4);
+  tensor<double> constant = filled({4}, 0, 0.8, false);
+  tensor<double> frozen = filled({4}, 0, 1.2);
+  frozen.freeze();
+
+  Tape<double> t;
+  var<double> a = t.watch(w), b = t.watch(constant), c = t.watch(frozen);
+  EXPECT_TRUE(a.requires_grad());
+  EXPECT_FALSE(b.requires_grad());
+  EXPECT_FALSE(c.requires_grad());
+  // nothing trainable below, no gradient is recorded
+  EXPECT_FALSE((b * c).requires_grad());
+
+  t.backward(sum(a * b * c));
+  ASSERT_NE(t.grad(w), nullptr);
+  EXPECT_EQ(t.grad(constant), nullptr);
+  EXPECT_EQ(t.grad(frozen), nullptr);
+  const double *g = t.grad(w);
+  for (size_t i = 0; i < 4; i++)
+    EXPECT_DOUBLE_EQ(g[i], static_cast<const tensor<double> &>(constant)
+                                   .raw_data()[i] *
+                               static_cast<const tensor<double> &>(frozen)
+                                   .raw_data()[i]);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
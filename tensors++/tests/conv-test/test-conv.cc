@@ -0,0 +1,196 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "tensors++/kernels/conv.hpp"
+#include "tensors++/layers/conv2d.hpp"
+
+using namespace tensors;
+using namespace tensors::kernels;
+
+static std::vector<float> pattern(size_t n, float scale, float phase) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = scale * std::sin(0.37f * i + phase);
+  return v;
+}
+
+// the convolution by its definition, NHWC input, HWIO filter, in double
+static std::vector<double> reference(const conv2d_params &p,
+                                     const float *x, const float *f,
+                                     const float *bias) {
+  size_t oh = p.out_h(), ow = p.out_w(), ig = p.group_in(),
+         og = p.group_out();
+  std::vector<double> out(p.batch * oh * ow * p.out_c);
+  for (size_t n = 0; n < p.batch; n++)
+    for (size_t y = 0; y < oh; y++)
+      for (size_t xo = 0; xo < ow; xo++)
+        for (size_t o = 0; o < p.out_c; o++) {
+          size_t g = o / og;
+          double s = bias ? bias[o] : 0.0;
+          for (size_t ky = 0; ky < p.kernel_h; ky++)
+            for (size_t kx = 0; kx < p.kernel_w; kx++) {
+              long iy = long(y * p.stride_h + ky * p.dilation_h) -
+                        long(p.pad_top);
+              long ix = long(xo * p.stride_w + kx * p.dilation_w) -
+                        long(p.pad_left);
+              if (iy < 0 || ix < 0 || iy >= long(p.in_h) ||
+                  ix >= long(p.in_w))
+                continue;
+              for (size_t c = 0; c < ig; c++)
+                s += double(x[((n * p.in_h + iy) * p.in_w + ix) * p.in_c +
+                              g * ig + c]) *
+                     f[((ky * p.kernel_w + kx) * ig + c) * p.out_c + o];
+            }
+          out[((n * oh + y) * ow + xo) * p.out_c + o] = s;
+        }
+  return out;
+}
+
+static conv2d_params geometry(size_t batch, size_t h, size_t w, size_t in_c,
+                              size_t out_c, size_t k, size_t stride,
+                              size_t dilation, size_t pad, size_t groups) {
+  conv2d_params p;
+  p.batch = batch;
+  p.in_h = h;
+  p.in_w = w;
+  p.in_c = in_c;
+  p.out_c = out_c;
+  p.kernel_h = p.kernel_w = k;
+  p.stride_h = p.stride_w = stride;
+  p.dilation_h = p.dilation_w = dilation;
+  p.pad_top = p.pad_left = pad;
+  p.pad_bottom = p.pad_right = pad + 1;  // uneven, as "same" can be
+  p.groups = groups;
+  return p;
+}
+
+static void expect_near(const std::vector<float> &got,
+                        const std::vector<double> &expected, double tol) {
+  ASSERT_EQ(got.size(), expected.size());
+  for (size_t i = 0; i < got.size(); i++)
+    ASSERT_NEAR(got[i], expected[i], tol) << "output " << i;
+}
+
+static const std::vector<conv2d_params> cases = {
+    geometry(2, 9, 11, 5, 7, 3, 1, 1, 1, 1),
+    geometry(1, 12, 10, 8, 12, 3, 2, 1, 0, 4),    // strided, groups
+    geometry(2, 13, 13, 6, 9, 3, 1, 2, 2, 3),     // dilated, groups
+    geometry(1, 8, 9, 20, 19, 5, 1, 1, 2, 1),     // long patches
+    geometry(3, 6, 5, 16, 10, 1, 1, 1, 0, 1),     // pointwise GEMM
+    geometry(1, 7, 7, 3, 17, 2, 3, 1, 0, 1)};     // partial channel block
+
+TEST(Im2col, CONV_TEST) {
+  for (auto &p : cases) {
+    std::vector<float> x = pattern(p.batch * p.in_h * p.in_w * p.in_c, 1, .1f);
+    std::vector<float> f = pattern(p.patch_size() * p.out_c, .3f, .7f);
+    std::vector<float> b = pattern(p.out_c, .5f, 1.3f);
+    std::vector<float> out(p.batch * p.out_h() * p.out_w() * p.out_c);
+    std::vector<float> w =
+        p.groups > 1 ? pack_im2col_filter(p, f.data()) : f;
+    conv2d_im2col(p, x.data(), w.data(), b.data(), out.data());
+    expect_near(out, reference(p, x.data(), f.data(), b.data()), 1e-4);
+  }
+}
+
+TEST(Direct, CONV_TEST) {
+  for (auto &p : cases) {
+    std::vector<float> x = pattern(p.batch * p.in_h * p.in_w * p.in_c, 1, .2f);
+    std::vector<float> f = pattern(p.patch_size() * p.out_c, .3f, .4f);
+    std::vector<float> out(p.batch * p.out_h() * p.out_w() * p.out_c);
+    std::vector<float> w = pack_direct_filter(p, f.data());
+    conv2d_direct(p, x.data(), w.data(), (const float *)nullptr, out.data(),
+                  activation::relu);
+    std::vector<double> expected = reference(p, x.data(), f.data(), nullptr);
+    for (auto &e : expected) e = std::max(e, 0.0);
+    expect_near(out, expected, 1e-4);
+  }
+}
+
+TEST(Algorithm, CONV_TEST) {
+  EXPECT_EQ(choose_conv_algorithm(geometry(1, 8, 8, 32, 32, 3, 1, 1, 1, 1)),
+            conv_algorithm::winograd);
+  EXPECT_EQ(choose_conv_algorithm(geometry(1, 8, 8, 3, 32, 3, 2, 1, 1, 1)),
+            conv_algorithm::direct);
+}
+
+// "same" keeps ceil(size / stride) outputs, the odd padding row goes last
+static size_t same_padding(size_t in, size_t span, size_t stride) {
+  long total = long(((in + stride - 1) / stride - 1) * stride + span) -
+               long(in);
+  return size_t(std::max(total, 0L));
+}
+
+TEST(Layer, CONV_TEST) {
+  struct layer_case {
+    size_t filters, k, stride, dilation, groups;
+    std::string padding;
+    conv_algorithm algorithm;
+  };
+  std::vector<layer_case> layer_cases = {
+      {6, 3, 1, 1, 1, "same", conv_algorithm::automatic},
+      {6, 3, 2, 1, 2, "valid", conv_algorithm::im2col},
+      {9, 3, 1, 2, 1, "same", conv_algorithm::direct},
+      {16, 3, 1, 1, 1, "same", conv_algorithm::winograd},
+      {5, 7, 1, 1, 1, "same", conv_algorithm::fft},
+      {4, 2, 2, 1, 1, "same", conv_algorithm::automatic}};
+  for (auto &c : layer_cases) {
+    layers::Conv2D<float> conv(c.filters, c.k, c.stride, c.padding,
+                               c.dilation, c.groups, "tanh", true,
+                               c.algorithm);
+    std::vector<float> xv = pattern(2 * 11 * 10 * 4, 1.f, .3f);
+    tensor<float> x(xv, shape::Shape({2, 11, 10, 4}));
+    tensor<float> y = conv(x);
+    std::vector<tensor<float> *> w = conv.weights();
+    const tensor<float> &f = *w[0], &b = *w[1];
+
+    conv2d_params p = geometry(2, 11, 10, 4, c.filters, c.k, c.stride,
+                               c.dilation, 0, c.groups);
+    p.pad_top = p.pad_bottom = p.pad_left = p.pad_right = 0;
+    if (c.padding == "same") {
+      size_t span = c.dilation * (c.k - 1) + 1;
+      size_t th = same_padding(11, span, c.stride);
+      size_t tw = same_padding(10, span, c.stride);
+      p.pad_top = th / 2;
+      p.pad_bottom = th - th / 2;
+      p.pad_left = tw / 2;
+      p.pad_right = tw - tw / 2;
+    }
+    EXPECT_EQ(y.shape().d, std::vector<uint>({2, uint(p.out_h()),
+                                              uint(p.out_w()),
+                                              uint(c.filters)}));
+    std::vector<double> expected =
+        reference(p, xv.data(), f.raw_data(), b.raw_data());
+    for (auto &e : expected) e = std::tanh(e);
+    std::vector<float> got(y.raw_data(), y.raw_data() + y.size());
+    expect_near(got, expected, 1e-4);
+
+    // frozen weights are packed once, the result does not change
+    conv.freeze();
+    tensor<float> again = conv(x);
+    for (size_t i = 0; i < y.size(); i++)
+      ASSERT_FLOAT_EQ(again.raw_data()[i], y.raw_data()[i]);
+  }
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
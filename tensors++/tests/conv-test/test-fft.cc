@@ -0,0 +1,175 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include "tensors++/kernels/fft_conv.hpp"
+#include "tensors++/layers/conv1d.hpp"
+#include "tensors++/layers/conv2d.hpp"
+
+using namespace tensors;
+using namespace tensors::kernels;
+
+static std::vector<float> pattern(size_t n, float scale, float phase) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = scale * std::sin(0.37f * i + phase);
+  return v;
+}
+
+static conv2d_params geometry(size_t batch, size_t h, size_t w, size_t in_c,
+                              size_t out_c, size_t kh, size_t kw,
+                              size_t stride, size_t dilation, size_t pad) {
+  conv2d_params p;
+  p.batch = batch;
+  p.in_h = h;
+  p.in_w = w;
+  p.in_c = in_c;
+  p.out_c = out_c;
+  p.kernel_h = kh;
+  p.kernel_w = kw;
+  p.stride_h = h > 1 ? stride : 1;
+  p.stride_w = stride;
+  p.dilation_h = h > 1 ? dilation : 1;
+  p.dilation_w = dilation;
+  p.pad_top = p.pad_bottom = h > 1 ? pad : 0;
+  p.pad_left = pad;
+  p.pad_right = pad + 1;
+  return p;
+}
+
+// the direct kernel on the same problem
+static std::vector<float> direct(const conv2d_params &p,
+                                 const std::vector<float> &x,
+                                 const std::vector<float> &f,
+                                 const std::vector<float> &b,
+                                 activation act) {
+  std::vector<float> out(p.batch * p.out_h() * p.out_w() * p.out_c);
+  std::vector<float> packed = pack_direct_filter(p, f.data());
+  conv2d_direct(p, x.data(), packed.data(), b.data(), out.data(), act);
+  return out;
+}
+
+static void expect_close(const std::vector<float> &got,
+                         const std::vector<float> &expected) {
+  ASSERT_EQ(got.size(), expected.size());
+  float scale = 1e-3f;
+  for (auto &e : expected) scale = std::max(scale, std::fabs(e));
+  for (size_t i = 0; i < got.size(); i++)
+    ASSERT_NEAR(got[i], expected[i], 2e-5f * scale) << "output " << i;
+}
+
+TEST(Conv1D, FFT_TEST) {
+  for (auto &p : {geometry(2, 1, 300, 3, 5, 1, 61, 1, 1, 0),
+                  geometry(1, 1, 517, 4, 2, 1, 49, 3, 1, 30),
+                  geometry(3, 1, 200, 2, 3, 1, 17, 1, 4, 5)}) {
+    std::vector<float> x = pattern(p.batch * p.in_w * p.in_c, 1.f, .2f);
+    std::vector<float> f = pattern(p.kernel_w * p.in_c * p.out_c, .1f, .5f);
+    std::vector<float> b = pattern(p.out_c, .5f, .9f);
+    conv1d_spectra<float> s = fft_conv1d_spectra(p, f.data());
+    std::vector<float> out(p.batch * p.out_w() * p.out_c);
+    conv1d_fft(p, s, x.data(), b.data(), out.data(), activation::tanh);
+    expect_close(out, direct(p, x, f, b, activation::tanh));
+  }
+}
+
+TEST(Conv2D, FFT_TEST) {
+  for (auto &p : {geometry(2, 20, 23, 3, 4, 7, 7, 1, 1, 3),
+                  geometry(1, 31, 17, 2, 5, 9, 5, 2, 1, 0),
+                  geometry(1, 25, 25, 4, 3, 7, 7, 1, 2, 1)}) {
+    std::vector<float> x =
+        pattern(p.batch * p.in_h * p.in_w * p.in_c, 1.f, .4f);
+    std::vector<float> f = pattern(
+        p.kernel_h * p.kernel_w * p.in_c * p.out_c, .05f, 1.1f);
+    std::vector<float> b = pattern(p.out_c, .5f, .3f);
+    conv2d_spectra<float> s = fft_conv2d_spectra(p, f.data());
+    EXPECT_TRUE(s.matches(p));
+    std::vector<float> out(p.batch * p.out_h() * p.out_w() * p.out_c);
+    conv2d_fft(p, s, x.data(), b.data(), out.data(), activation::relu);
+    expect_close(out, direct(p, x, f, b, activation::relu));
+  }
+}
+
+TEST(Stream, FFT_TEST) {
+  conv2d_params p = geometry(1, 1, 1000, 3, 4, 1, 33, 1, 2, 0);
+  p.pad_right = 0;  // a stream sees no padding
+  std::vector<float> x = pattern(p.in_w * p.in_c, 1.f, .6f);
+  std::vector<float> f = pattern(p.kernel_w * p.in_c * p.out_c, .1f, .2f);
+  std::vector<float> b = pattern(p.out_c, .5f, .1f);
+  auto s = std::make_shared<const conv1d_spectra<float>>(
+      fft_conv1d_spectra(p, f.data()));
+  std::vector<float> whole(p.out_w() * p.out_c);
+  conv1d_fft(p, *s, x.data(), b.data(), whole.data(), activation::sigmoid);
+
+  // chunks shorter than the filter, longer than a block and in between
+  conv1d_stream<float> stream(s, b.data(), activation::sigmoid);
+  for (int pass = 0; pass < 2; pass++) {
+    std::vector<float> out;
+    size_t sizes[] = {1, 5, 64, 3, s->block + 7, 2 * s->block, 11};
+    size_t at = 0;
+    for (size_t i = 0; at < p.in_w; i++) {
+      size_t n = std::min(sizes[i % 7], p.in_w - at);
+      stream.push(x.data() + at * p.in_c, n, out);
+      at += n;
+      EXPECT_EQ(out.size(), (at >= 65 ? at - 64 : 0) * p.out_c);
+    }
+    expect_close(out, whole);
+    stream.reset();
+  }
+}
+
+TEST(Automatic, FFT_TEST) {
+  // a 9x9 filter picks FFT, which only runs once the layer is frozen; the
+  // result is the same either way
+  layers::Conv2D<float> conv(6, 9, 1, "same");
+  std::vector<float> xv = pattern(2 * 24 * 24 * 3, 1.f, .3f);
+  tensor<float> x(xv, shape::Shape({2, 24, 24, 3}));
+  tensor<float> before = conv(x);
+  EXPECT_EQ(conv.conv_algorithm(), conv_algorithm::fft);
+  conv.freeze();
+  tensor<float> after = conv(x), again = conv(x);
+  for (size_t i = 0; i < before.size(); i++) {
+    ASSERT_NEAR(after.raw_data()[i], before.raw_data()[i], 1e-4);
+    ASSERT_EQ(again.raw_data()[i], after.raw_data()[i]);
+  }
+
+  layers::Conv1D<float> line(4, 65, 1, "causal");
+  std::vector<float> sv = pattern(2 * 400 * 2, 1.f, .8f);
+  tensor<float> signal(sv, shape::Shape({2, 400, 2}));
+  tensor<float> trained = line(signal);
+  EXPECT_EQ(line.conv_algorithm(), conv_algorithm::fft);
+  line.freeze();
+  tensor<float> frozen = line(signal);
+  for (size_t i = 0; i < trained.size(); i++)
+    ASSERT_NEAR(frozen.raw_data()[i], trained.raw_data()[i], 1e-4);
+}
+
+TEST(Sizing, FFT_TEST) {
+  // the filter spectra of this layer take 63 MB in float, twice in double
+  conv2d_params p = geometry(1, 61, 61, 64, 64, 7, 7, 1, 1, 1);
+  EXPECT_EQ(choose_conv_algorithm<float>(p), conv_algorithm::fft);
+  EXPECT_EQ(choose_conv_algorithm<double>(p), conv_algorithm::im2col);
+  EXPECT_EQ(choose_conv_algorithm<float>(p, false), conv_algorithm::im2col);
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
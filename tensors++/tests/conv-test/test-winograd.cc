@@ -0,0 +1,93 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "tensors++/kernels/conv.hpp"
+#include "tensors++/kernels/winograd.hpp"
+
+using namespace tensors::kernels;
+
+static conv2d_params params(size_t batch, size_t h, size_t w, size_t in_c,
+                            size_t out_c, size_t pad) {
+  conv2d_params p;
+  p.batch = batch;
+  p.in_h = h;
+  p.in_w = w;
+  p.in_c = in_c;
+  p.out_c = out_c;
+  p.kernel_h = p.kernel_w = 3;
+  p.pad_top = p.pad_bottom = p.pad_left = p.pad_right = pad;
+  return p;
+}
+
+static std::vector<float> pattern(size_t n, float scale) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = scale * std::sin(0.37f * i + 0.1f);
+  return v;
+}
+
+// largest difference to the direct convolution relative to the largest
+// output magnitude
+static double relative_error(const conv2d_params &p, size_t m,
+                             activation act = activation::linear) {
+  std::vector<float> x = pattern(p.batch * p.in_h * p.in_w * p.in_c, 1.f);
+  std::vector<float> f = pattern(9 * p.in_c * p.out_c, 0.2f);
+  std::vector<float> b = pattern(p.out_c, 0.5f);
+  size_t outputs = p.batch * p.out_h() * p.out_w() * p.out_c;
+  std::vector<float> expected(outputs), actual(outputs);
+
+  std::vector<float> packed = pack_direct_filter(p, f.data());
+  conv2d_direct(p, x.data(), packed.data(), b.data(), expected.data(), act);
+  std::vector<float> u = winograd_filter_transform(p, f.data(), m);
+  conv2d_winograd(p, x.data(), u.data(), b.data(), actual.data(), act, m);
+
+  double diff = 0, scale = 1e-6;
+  for (size_t i = 0; i < outputs; i++) {
+    diff = std::max(diff, double(std::fabs(expected[i] - actual[i])));
+    scale = std::max(scale, double(std::fabs(expected[i])));
+  }
+  return diff / scale;
+}
+
+TEST(F2x2, WINOGRAD_TEST) {
+  EXPECT_LT(relative_error(params(2, 8, 8, 16, 24, 1), 2), 1e-5);
+  EXPECT_LT(relative_error(params(1, 9, 13, 5, 7, 0), 2), 1e-5);
+}
+
+TEST(F4x4, WINOGRAD_TEST) {
+  EXPECT_LT(relative_error(params(2, 16, 16, 32, 32, 1), 4), 1e-4);
+  EXPECT_LT(relative_error(params(1, 11, 17, 8, 12, 0), 4), 1e-4);
+}
+
+TEST(PartialTiles, WINOGRAD_TEST) {
+  // outputs that are no multiple of the tile size and more tiles than one
+  // block
+  EXPECT_LT(relative_error(params(3, 23, 19, 4, 9, 1), 2), 1e-5);
+  EXPECT_LT(relative_error(params(3, 23, 19, 4, 9, 1), 4), 1e-4);
+}
+
+TEST(Activation, WINOGRAD_TEST) {
+  EXPECT_LT(relative_error(params(1, 10, 10, 8, 8, 1), 4, activation::relu),
+            1e-4);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
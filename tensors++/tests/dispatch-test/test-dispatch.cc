@@ -0,0 +1,107 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "tensors++/core/cpu_features.hpp"
+#include "tensors++/kernels/gemm.hpp"
+#include "tensors++/kernels/quantized.hpp"
+
+using namespace tensors;
+using namespace tensors::kernels;
+
+static const cpu::isa levels[] = {cpu::isa::sse2, cpu::isa::avx2,
+                                  cpu::isa::avx512, cpu::isa::avx512_vnni};
+
+static std::vector<float> pattern(size_t n, float scale, float phase) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = scale * std::sin(0.37f * i + phase);
+  return v;
+}
+
+TEST(Detection, DISPATCH_TEST) {
+  cpu::isa best = cpu::host().best();
+  EXPECT_GE(best, cpu::compiled_isa());
+  EXPECT_EQ(cpu::set_isa(cpu::isa::sse2), cpu::isa::sse2);
+  EXPECT_FALSE(cpu::use(cpu::isa::avx2));
+  // never above the host
+  EXPECT_EQ(cpu::set_isa(cpu::isa::avx512_vnni), best);
+  EXPECT_EQ(cpu::isa_from_name("avx2", cpu::isa::sse2), cpu::isa::avx2);
+  EXPECT_EQ(cpu::isa_from_name("neon", cpu::isa::sse2), cpu::isa::sse2);
+}
+
+TEST(FloatKernels, DISPATCH_TEST) {
+  // partial register tiles and panels, several depth blocks
+  const size_t m = 70, k = 600, n = 37;
+  std::vector<float> a = pattern(m * k, 1.f, 0.1f);
+  std::vector<float> b = pattern(k * n, 0.1f, 0.7f);
+  std::vector<float> bias = pattern(n, 1.f, 2.f);
+  for (cpu::isa level : levels) {
+    cpu::set_isa(level);
+    std::vector<float> c(m * n);
+    gemm_bias_activation(a.data(), b.data(), bias.data(), c.data(), m, k, n,
+                         activation::relu);
+    double diff = 0;
+    for (size_t i = 0; i < m; i++)
+      for (size_t j = 0; j < n; j++) {
+        double s = bias[j];
+        for (size_t l = 0; l < k; l++) s += double(a[i * k + l]) * b[l * n + j];
+        diff = std::max(diff, std::fabs(std::max(s, 0.) - c[i * n + j]));
+      }
+    EXPECT_LT(diff, 1e-4) << cpu::isa_name(cpu::active_isa());
+
+    for (size_t len : {0, 7, 33, 1000}) {
+      double s = 0, d = 0;
+      for (size_t i = 0; i < len; i++) {
+        s += a[i];
+        d += double(a[i]) * b[i];
+      }
+      EXPECT_NEAR(sum(a.data(), len), s, 1e-3);
+      EXPECT_NEAR(dot(a.data(), b.data(), len), d, 1e-3);
+    }
+  }
+  cpu::set_isa(cpu::isa::avx512_vnni);
+}
+
+TEST(QuantizedKernels, DISPATCH_TEST) {
+  // int32 accumulation is exact, every level gives the same bits
+  const size_t m = 37, k = 70, n = 19;
+  std::vector<float> w = pattern(k * n, 1.f, 0.2f);
+  qweights q = quantize_weights(w.data(), k, n);
+  std::vector<uint8_t> a(m * k + 3);
+  for (size_t i = 0; i < a.size(); i++) a[i] = uint8_t(i * 37 % 128);
+  qparams p;
+  p.scale = 0.1f;
+  p.zero_point = 5;
+  std::vector<float> expected;
+  for (cpu::isa level : levels) {
+    cpu::set_isa(level);
+    std::vector<float> c(m * n);
+    qgemm_output out;
+    out.real = c.data();
+    qgemm(a.data(), m, k, p, q, out);
+    if (expected.empty()) expected = c;
+    EXPECT_EQ(c, expected) << cpu::isa_name(cpu::active_isa());
+  }
+  cpu::set_isa(cpu::isa::avx512_vnni);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,101 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "tensors++/graph/graph.hpp"
+
+using namespace tensors;
+using namespace tensors::graph;
+
+static std::vector<float> values(const tensor<float> &t) {
+  return std::vector<float>(t.raw_data(), t.raw_data() + t.size());
+}
+
+static tensor<float> filled(size_t n, float scale, float phase) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = scale * std::sin(0.37f * i + phase);
+  return tensor<float>(v, shape::Shape({uint(n)}));
+}
+
+TEST(Fusion, GRAPH_TEST) {
+  const size_t n = 3000;  // several pool tasks and a partial register
+  tensor<float> x = filled(n, 2.f, 0.1f), y = filled(n, 1.f, 0.5f);
+  Graph<float> g;
+  expr<float> a = g.input(x), b = g.input(y);
+  expr<float> e = ((a + b) * 2.f - b / 4.f).clip(1.5f, -1.f);
+  // every intermediate has one consumer, the chain is one pass
+  program<float> p = g.compile({e});
+  EXPECT_EQ(p.group_count(), 1u);
+
+  std::vector<float> got = values(e.evaluate());
+  for (size_t i = 0; i < n; i++) {
+    float xi = x.raw_data()[i], yi = y.raw_data()[i];
+    float r = std::min(std::max((xi + yi) * 2.f - yi / 4.f, -1.f), 1.5f);
+    EXPECT_FLOAT_EQ(got[i], r);
+  }
+
+  // a shared intermediate gets its own buffer, its consumers fuse past it
+  expr<float> s = a * b;
+  expr<float> t = s + s * 3.f;
+  EXPECT_EQ(g.compile({t}).group_count(), 2u);
+  got = values(t.evaluate());
+  for (size_t i = 0; i < n; i++) {
+    float si = x.raw_data()[i] * y.raw_data()[i];
+    EXPECT_FLOAT_EQ(got[i], si + si * 3.f);
+  }
+}
+
+TEST(ConstantFolding, GRAPH_TEST) {
+  const size_t n = 10;
+  tensor<float> x = filled(n, 1.f, 0.f), c1 = filled(n, 3.f, 1.f),
+                c2 = filled(n, 2.f, 2.f);
+  Graph<float> g;
+  expr<float> a = g.input(x), k1 = g.constant(c1), k2 = g.constant(c2);
+  expr<float> k = k1 * k2 + 1.f;
+  expr<float> out = a + k;
+  program<float> p = g.compile({out});
+  // only a + k is left to run
+  EXPECT_EQ(g.at(k.id()).op, graph::constant);
+  EXPECT_EQ(p.group_count(), 1u);
+  std::vector<float> got = values(out.evaluate());
+  for (size_t i = 0; i < n; i++)
+    EXPECT_FLOAT_EQ(got[i], x.raw_data()[i] +
+                                (c1.raw_data()[i] * c2.raw_data()[i] + 1.f));
+}
+
+TEST(DeadCode, GRAPH_TEST) {
+  const size_t n = 10;
+  tensor<float> x = filled(n, 1.f, 0.f), c = filled(n, 1.f, 1.f);
+  Graph<float> g;
+  expr<float> a = g.input(x), k = g.constant(c);
+  expr<float> dead = k * 2.f;        // foldable, but never requested
+  expr<float> unused = a * a - 1.f;  // never requested either
+  expr<float> out = a - 1.f;
+  program<float> p = g.compile({out});
+  EXPECT_EQ(p.group_count(), 1u);
+  EXPECT_EQ(g.at(dead.id()).op, graph::mul_scalar);
+  EXPECT_EQ(g.at(unused.id()).op, graph::sub_scalar);
+  std::vector<float> got = values(out.evaluate());
+  for (size_t i = 0; i < n; i++) EXPECT_FLOAT_EQ(got[i], x.raw_data()[i] - 1.f);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,68 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "tensors++/graph/memory_planner.hpp"
+
+using namespace tensors::graph;
+
+static bool disjoint(const memory_plan &p, const std::vector<lifetime> &b,
+                     size_t i, size_t j) {
+  return p.offsets[i] + b[i].bytes <= p.offsets[j] ||
+         p.offsets[j] + b[j].bytes <= p.offsets[i];
+}
+
+TEST(Overlapping, MEMORY_PLANNER_TEST) {
+  std::vector<lifetime> b = {{100, 0, 2}, {200, 1, 3}, {50, 2, 2}};
+  memory_plan p = plan_memory(b);
+  for (size_t i = 0; i < b.size(); i++)
+    for (size_t j = i + 1; j < b.size(); j++) EXPECT_TRUE(disjoint(p, b, i, j));
+}
+
+TEST(Reuse, MEMORY_PLANNER_TEST) {
+  // a chain where every buffer dies right after the next one is written
+  std::vector<lifetime> b = {{256, 0, 1}, {256, 1, 2}, {256, 2, 3}, {256, 3, 4}};
+  memory_plan p = plan_memory(b);
+  EXPECT_EQ(2 * 256, p.workspace_bytes);
+  EXPECT_EQ(p.offsets[0], p.offsets[2]);
+  EXPECT_EQ(p.offsets[1], p.offsets[3]);
+}
+
+TEST(GapFit, MEMORY_PLANNER_TEST) {
+  // the small late buffer fits into the hole left by the first one
+  std::vector<lifetime> b = {{512, 0, 1}, {512, 0, 5}, {128, 3, 4}};
+  memory_plan p = plan_memory(b);
+  EXPECT_EQ(1024, p.workspace_bytes);
+  EXPECT_TRUE(disjoint(p, b, 1, 2));
+}
+
+TEST(Alignment, MEMORY_PLANNER_TEST) {
+  std::vector<lifetime> b = {{3, 0, 1}, {5, 0, 1}, {7, 1, 2}};
+  memory_plan p = plan_memory(b, 64);
+  for (auto &o : p.offsets) EXPECT_EQ(0, o % 64);
+  workspace ws(p.workspace_bytes);
+  EXPECT_EQ(0, reinterpret_cast<size_t>(ws.at<float>(p.offsets[1])) % 64);
+  ws.reserve(1000);  // a grown block is aligned as well
+  EXPECT_EQ(1000, ws.size());
+  EXPECT_EQ(0, reinterpret_cast<size_t>(ws.at<float>(0)) % 64);
+  *ws.at<unsigned char>(999) = 1;
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
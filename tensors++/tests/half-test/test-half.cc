@@ -0,0 +1,117 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "tensors++/core/half.hpp"
+#include "tensors++/kernels/gemm.hpp"
+
+using namespace tensors;
+using namespace tensors::kernels;
+
+static std::vector<float> pattern(size_t n, float scale, float phase) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = scale * std::sin(0.37f * i + phase);
+  return v;
+}
+
+TEST(BFloat16Rounding, HALF_TEST) {
+  // 1 + 2^-8 is halfway between two bfloat16 values, ties go to even
+  EXPECT_EQ(bfloat16(1.00390625f).x, 0x3f80);
+  EXPECT_EQ(bfloat16(1.01171875f).x, 0x3f82);
+  EXPECT_EQ(bfloat16(-2.f).x, 0xc000);
+  EXPECT_TRUE(std::isnan(float(bfloat16(std::nanf("")))));
+  EXPECT_TRUE(std::isinf(float(bfloat16(INFINITY))));
+  EXPECT_FLOAT_EQ(float(bfloat16(3.f) * bfloat16(0.5f)), 1.5f);
+  EXPECT_TRUE(bfloat16(1.f) < bfloat16(2.f));
+}
+
+TEST(BulkConversion, HALF_TEST) {
+  // more than one vector plus a tail, including NaN and infinities
+  std::vector<float> x = pattern(37, 100.f, 0.3f);
+  x[3] = std::numeric_limits<float>::quiet_NaN();
+  x[9] = INFINITY;
+  x[20] = -INFINITY;
+  std::vector<half> h(x.size());
+  std::vector<bfloat16> b(x.size());
+  std::vector<float> from_h(x.size()), from_b(x.size());
+  from_float(x.data(), h.data(), x.size());
+  from_float(x.data(), b.data(), x.size());
+  to_float(h.data(), from_h.data(), x.size());
+  to_float(b.data(), from_b.data(), x.size());
+  for (size_t i = 0; i < x.size(); i++) {
+    EXPECT_EQ(h[i].x, half(x[i]).x);
+    EXPECT_EQ(b[i].x, bfloat16(x[i]).x);
+    if (std::isnan(x[i])) {
+      EXPECT_TRUE(std::isnan(from_h[i]) && std::isnan(from_b[i]));
+      continue;
+    }
+    EXPECT_EQ(from_h[i], static_cast<float>(h[i]));
+    EXPECT_EQ(from_b[i], static_cast<float>(b[i]));
+  }
+}
+
+template <class dtype>
+static double gemm_error(size_t m, size_t k, size_t n) {
+  std::vector<float> a = pattern(m * k, 1.f, 0.1f);
+  std::vector<float> w = pattern(k * n, 0.1f, 0.7f);
+  std::vector<float> bias = pattern(n, 1.f, 2.f);
+  std::vector<dtype> a16(a.size()), w16(w.size()), b16(n), c16(m * n);
+  from_float(a.data(), a16.data(), a.size());
+  from_float(w.data(), w16.data(), w.size());
+  from_float(bias.data(), b16.data(), n);
+  gemm_bias_activation(a16.data(), w16.data(), b16.data(), c16.data(), m, k,
+                       n, activation::relu);
+  // reference in double from the rounded operands
+  double diff = 0, scale = 1e-6;
+  for (size_t i = 0; i < m; i++)
+    for (size_t j = 0; j < n; j++) {
+      double s = static_cast<float>(b16[j]);
+      for (size_t l = 0; l < k; l++)
+        s += double(static_cast<float>(a16[i * k + l])) *
+             static_cast<float>(w16[l * n + j]);
+      s = std::max(s, 0.);
+      diff = std::max(diff, std::fabs(s - static_cast<float>(c16[i * n + j])));
+      scale = std::max(scale, std::fabs(s));
+    }
+  return diff / scale;
+}
+
+TEST(MixedGemm, HALF_TEST) {
+  // several tiles in every direction and partial ones, only the final
+  // rounding of the output may differ
+  EXPECT_LT(gemm_error<half>(70, 300, 260), 1e-3);
+  EXPECT_LT(gemm_error<bfloat16>(70, 300, 260), 1e-2);
+  EXPECT_LT(gemm_error<half>(1, 5, 3), 1e-3);
+}
+
+TEST(Accumulation, HALF_TEST) {
+  // 4096 ones: a half accumulator would stop at 2048
+  std::vector<half> ones(4096, half(1.f));
+  EXPECT_EQ(sum(ones.data(), ones.size()), 4096.f);
+  std::vector<bfloat16> twos(3000, bfloat16(2.f));
+  EXPECT_EQ(dot(twos.data(), twos.data(), twos.size()), 12000.f);
+  std::vector<double> d = {1.5, 2.5};
+  EXPECT_EQ(sum(d.data(), d.size()), 4.);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,206 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "tensors++/io/npy.hpp"
+
+using namespace tensors;
+
+static std::string temp_path(const std::string &name) {
+  return ::testing::TempDir() + name;
+}
+
+// a .npy file as numpy would write it, version 1.0
+static void write_npy(const std::string &path, const std::string &dict,
+                      const std::vector<char> &data) {
+  std::string header = dict;
+  while ((10 + header.size() + 1) % 64) header += ' ';
+  header += '\n';
+  std::ofstream out(path, std::ios::binary);
+  out.write("\x93NUMPY\x01\x00", 8);
+  out.put(char(header.size() & 0xff)).put(char(header.size() >> 8));
+  out << header;
+  out.write(data.data(), std::streamsize(data.size()));
+}
+
+template <class dtype>
+static std::vector<dtype> values(const tensor<dtype> &t) {
+  return std::vector<dtype>(t.raw_data(), t.raw_data() + t.size());
+}
+
+TEST(NpyRoundTrip, IO_TEST) {
+  std::vector<float> v(4 * 3);
+  for (size_t i = 0; i < v.size(); i++) v[i] = 1.5f * i;
+  tensor<float> t(v, shape::Shape({4, 3}));
+  std::string path = temp_path("a.npy");
+  io::save_npy(t, path);
+
+  io::npy_array a = io::open_npy(path);
+  EXPECT_EQ(a.info().shape, (std::vector<uint64_t>{4, 3}));
+  EXPECT_EQ(a.info().data_offset % 64, 0u);
+  std::unique_ptr<tensor<float>> all = a.read<float>();
+  EXPECT_TRUE(all->frozen());
+  EXPECT_EQ(values<float>(*all), v);
+  // rows 1 and 2 only
+  std::unique_ptr<tensor<float>> part = a.read<float>(1, 2);
+  EXPECT_EQ(part->shape().d, (std::vector<uint>{2, 3}));
+  EXPECT_EQ(values<float>(*part),
+            std::vector<float>(v.begin() + 3, v.begin() + 9));
+  EXPECT_THROW(a.read<float>(3, 2), exceptions::io_error);
+  EXPECT_THROW(a.read<double>(), exceptions::io_error);
+  std::remove(path.c_str());
+}
+
+TEST(NpyLayouts, IO_TEST) {
+  std::string path = temp_path("b.npy");
+  // big endian int32 [1, 256, -2]
+  write_npy(path, "{'descr': '>i4', 'fortran_order': False, 'shape': (3,), }",
+            {0, 0, 0, 1, 0, 0, 1, 0, -1, -1, -1, -2});
+  EXPECT_EQ(values<int32_t>(*io::load_npy<int32_t>(path)),
+            (std::vector<int32_t>{1, 256, -2}));
+
+  // [[0, 1, 2], [3, 4, 5]] stored column major
+  std::vector<char> bytes;
+  for (int16_t x : {0, 3, 1, 4, 2, 5})
+    bytes.insert(bytes.end(), reinterpret_cast<char *>(&x),
+                 reinterpret_cast<char *>(&x) + 2);
+  write_npy(path, "{'descr': '=i2', 'fortran_order': True, 'shape': (2, 3), }",
+            bytes);
+  io::npy_array f = io::open_npy(path);
+  EXPECT_EQ(f.info().strides, (std::vector<uint64_t>{1, 2}));
+  EXPECT_EQ(values<int16_t>(*f.read<int16_t>()),
+            (std::vector<int16_t>{0, 1, 2, 3, 4, 5}));
+  EXPECT_EQ(values<int16_t>(*f.read<int16_t>(1, 1)),
+            (std::vector<int16_t>{3, 4, 5}));
+
+  write_npy(path, "{'descr': [('a', '<f4')], 'fortran_order': False, "
+                  "'shape': (1,), }",
+            {0, 0, 0, 0});
+  EXPECT_THROW(io::open_npy(path), exceptions::io_error);
+  std::remove(path.c_str());
+}
+
+TEST(Npz, IO_TEST) {
+  tensor<float> x(std::vector<float>{1, 2, 3, 4, 5, 6}, shape::Shape({2, 3}));
+  tensor<uint8_t> y(std::vector<uint8_t>{7, 8, 9}, shape::Shape({3}));
+  std::string path = temp_path("c.npz");
+  io::npz_writer w(path);
+  w.add("x", x);
+  w.add("y", y);
+  w.close();
+
+  io::npz_file z(path);
+  EXPECT_EQ(z.names(), (std::vector<std::string>{"x", "y"}));
+  EXPECT_TRUE(z.contains("x.npy"));
+  EXPECT_EQ(values<float>(*z["x"].read<float>(1, 1)),
+            (std::vector<float>{4, 5, 6}));
+  EXPECT_EQ(values<uint8_t>(*z["y"].read<uint8_t>()),
+            (std::vector<uint8_t>{7, 8, 9}));
+  EXPECT_THROW(z["w"], exceptions::io_error);
+  std::remove(path.c_str());
+}
+
+// shapes whose element count or byte size wraps around 64 bits
+TEST(NpyOverflow, IO_TEST) {
+  std::string path = temp_path("overflow.npy");
+  std::vector<char> data(16, 0);
+  for (const char *dict :
+       {"{'descr': '<f4', 'fortran_order': False, "
+        "'shape': (4294967296, 4294967296), }",
+        "{'descr': '<f4', 'fortran_order': True, "
+        "'shape': (4294967296, 4294967297), }",
+        "{'descr': '<f4', 'fortran_order': False, "
+        "'shape': (4611686018427387904,), }",
+        "{'descr': '<f4', 'fortran_order': False, "
+        "'shape': (99999999999999999999,), }"}) {
+    write_npy(path, dict, data);
+    EXPECT_THROW(io::open_npy(path), exceptions::io_error) << dict;
+  }
+  write_npy(path, "{'descr': '<f4', 'fortran_order': False, 'shape': (2, 2), }",
+            data);
+  EXPECT_EQ(io::open_npy(path).info().count(), 4u);
+  std::remove(path.c_str());
+
+  io::npy_info info;
+  info.shape = {uint64_t(1) << 32, uint64_t(1) << 32};
+  EXPECT_EQ(info.count(), UINT64_MAX);
+}
+
+// a zip64 locator in an archive too short to hold the record it points to
+TEST(NpzTruncated, IO_TEST) {
+  std::string path = temp_path("truncated.npz");
+  std::vector<char> bytes(50, 0);
+  auto put = [&](size_t at, uint32_t v) {
+    for (int i = 0; i < 4; i++) bytes[at + i] = char(uint8_t(v >> (8 * i)));
+  };
+  put(0, 0x06064b50);   // zip64 end of central directory
+  put(8, 0x07064b50);   // its locator, pointing at offset 0
+  put(28, 0x06054b50);  // end of central directory
+  std::ofstream(path, std::ios::binary)
+      .write(bytes.data(), std::streamsize(bytes.size()));
+  EXPECT_THROW(io::npz_file z(path), exceptions::io_error);
+  std::remove(path.c_str());
+}
+
+// writers replace the file only once it is complete
+TEST(NpyReplace, IO_TEST) {
+  std::string path = temp_path("replaced.npy");
+  std::vector<float> big(50000, 1.5f);
+  io::save_npy(tensor<float>(big, shape::Shape({50000})), path);
+  std::unique_ptr<tensor<float>> old = io::load_npy<float>(path);
+  io::save_npy(tensor<float>(std::vector<float>({7.f}), shape::Shape({1})),
+               path);
+  EXPECT_EQ(static_cast<const tensor<float> &>(*old).raw_data()[49999], 1.5f);
+  EXPECT_EQ(values<float>(*io::load_npy<float>(path)),
+            (std::vector<float>{7.f}));
+  EXPECT_FALSE(std::ifstream(path + ".tmp").good());
+  std::remove(path.c_str());
+
+  path = temp_path("replaced.npz");
+  tensor<float> x(std::vector<float>{1, 2, 3}, shape::Shape({3}));
+  {
+    io::npz_writer w(path);
+    w.add("x", x);
+  }
+  {
+    io::npz_writer w(path);
+    w.add("y", x);
+    EXPECT_FALSE(io::npz_file(path).contains("y"));
+    w.close();
+  }
+  EXPECT_TRUE(io::npz_file(path).contains("y"));
+  {
+    // a member left short of its size fails the archive
+    io::zip_writer zip(path);
+    zip.begin("z.npy", 10);
+    zip.write("abc", 3);
+  }
+  EXPECT_FALSE(std::ifstream(path + ".tmp").good());
+  EXPECT_EQ(io::npz_file(path).names(), (std::vector<std::string>{"y"}));
+  std::remove(path.c_str());
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,141 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "tensors++/io/tensor_file.hpp"
+
+using namespace tensors;
+
+static std::string temp_path(const std::string &name) {
+  return ::testing::TempDir() + name;
+}
+
+TEST(TensorFile, IO_TEST) {
+  std::vector<float> v(3 * 5 * 7);
+  for (size_t i = 0; i < v.size(); i++) v[i] = 0.5f * i - 3.f;
+  tensor<float> t(v, shape::Shape({3, 5, 7}));
+  std::string path = temp_path("tensor.tns");
+  io::save(t, path);
+
+  io::tensor_file_info info = io::inspect(path);
+  EXPECT_EQ(info.type, io::element_type::float32);
+  EXPECT_EQ(info.dims, (std::vector<uint64_t>{3, 5, 7}));
+  EXPECT_EQ(info.strides, (std::vector<int64_t>{35, 7, 1}));
+  EXPECT_EQ(info.payload_offset % io::tensor_file_page, 0u);
+
+  std::unique_ptr<tensor<float>> loaded = io::load<float>(path, true);
+  EXPECT_TRUE(loaded->frozen());
+  EXPECT_EQ(loaded->shape().d, t.shape().d);
+  const tensor<float> &view = *loaded;
+  EXPECT_EQ(std::vector<float>(view.raw_data(), view.raw_data() + v.size()),
+            v);
+  EXPECT_THROW(loaded->raw_data(), exceptions::frozen_tensor);
+  // a private copy, the file is never written
+  loaded->unfreeze();
+  loaded->raw_data()[0] = 42.f;
+  EXPECT_EQ(io::load<float>(path)->size(), v.size());
+  EXPECT_EQ(static_cast<const tensor<float> &>(*io::load<float>(path))
+                .raw_data()[0],
+            v[0]);
+  std::remove(path.c_str());
+}
+
+TEST(TensorFileErrors, IO_TEST) {
+  std::vector<int8_t> v = {1, -2, 3, -4, 5, -6};
+  tensor<int8_t> t(v, shape::Shape({2, 3}));
+  std::string path = temp_path("small.tns");
+  io::save(t, path, 64);
+  EXPECT_EQ(io::inspect(path).payload_offset, 128u);
+  EXPECT_EQ(static_cast<const tensor<int8_t> &>(*io::load<int8_t>(path))
+                .raw_data()[3],
+            -4);
+  EXPECT_THROW(io::load<float>(path), exceptions::io_error);
+  EXPECT_THROW(io::save(t, path, 48), exceptions::io_error);
+
+  // cut inside the payload
+  std::ifstream in(path, std::ios::binary);
+  std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+      .write(bytes.data(), std::streamsize(bytes.size() - 1));
+  EXPECT_THROW(io::load<int8_t>(path), exceptions::io_error);
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << "not a tensor";
+  EXPECT_THROW(io::inspect(path), exceptions::io_error);
+  std::remove(path.c_str());
+}
+
+// saving over a file that is still mapped replaces it instead of
+// truncating the pages under the mapping
+TEST(TensorFileReplace, IO_TEST) {
+  std::string path = temp_path("replaced.tns");
+  std::vector<float> big(50000, 1.5f);
+  io::save(tensor<float>(big, shape::Shape({50000})), path);
+  std::unique_ptr<tensor<float>> old = io::load<float>(path);
+
+  io::save(tensor<float>(std::vector<float>({7.f}), shape::Shape({1})), path);
+  const tensor<float> &view = *old;
+  EXPECT_EQ(view.raw_data()[49999], 1.5f);
+  EXPECT_EQ(static_cast<const tensor<float> &>(*io::load<float>(path))
+                .raw_data()[0],
+            7.f);
+  EXPECT_FALSE(std::ifstream(path + ".tmp").good());
+  std::remove(path.c_str());
+
+  EXPECT_THROW(io::save(tensor<float>(big, shape::Shape({50000})),
+                        temp_path("missing/dir.tns")),
+               exceptions::io_error);
+}
+
+// a header whose element count or byte size wraps around 64 bits
+TEST(TensorFileOverflow, IO_TEST) {
+  auto parse = [](std::vector<uint64_t> dims, uint32_t element_bytes) {
+    io::tensor_file_header h;
+    std::memcpy(h.magic, io::tensor_file_magic, sizeof(h.magic));
+    h.version = io::tensor_file_version;
+    h.byte_order = io::tensor_file_byte_order;
+    h.type = uint32_t(io::element_type::float32);
+    h.element_bytes = element_bytes;
+    h.rank = uint32_t(dims.size());
+    h.reserved = 0;
+    h.alignment = 64;
+    h.payload_offset = 128;
+    h.payload_bytes = 0;
+    std::vector<char> bytes(128, 0);
+    std::memcpy(bytes.data(), &h, sizeof(h));
+    std::memcpy(bytes.data() + sizeof(h), dims.data(), 8 * dims.size());
+    std::vector<int64_t> strides(dims.size(), 1);
+    std::memcpy(bytes.data() + sizeof(h) + 8 * dims.size(), strides.data(),
+                8 * dims.size());
+    return io::parse_tensor_file(bytes.data(), bytes.size(), "header");
+  };
+  EXPECT_NO_THROW(parse({0, 5}, 4));
+  EXPECT_THROW(parse({uint64_t(1) << 32, uint64_t(1) << 32}, 4),
+               exceptions::io_error);
+  EXPECT_THROW(parse({uint64_t(1) << 62}, 4), exceptions::io_error);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
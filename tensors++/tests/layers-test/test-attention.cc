@@ -0,0 +1,253 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "tensors++/kernels/attention.hpp"
+#include "tensors++/layers/attention.hpp"
+
+using namespace tensors;
+using namespace tensors::layers;
+
+static std::vector<float> wave(size_t n, float phase) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = std::sin(0.61f * i + phase);
+  return v;
+}
+
+static tensor<float> filled(std::vector<uint> dims, float phase) {
+  shape::Shape s(dims);
+  return tensor<float>(wave(s.element_size(), phase), s);
+}
+
+static const float *read(const tensor<float> &t) { return t.raw_data(); }
+
+// softmax(q k^T / sqrt(key_dim)) v in double, holding the whole score row
+static std::vector<double> naive(const kernels::attention_params &p,
+                                 const float *q, const float *k,
+                                 const float *v) {
+  std::vector<double> out(p.batch * p.out_batch, 0.0);
+  double scale = 1 / std::sqrt(double(p.key_dim));
+  for (size_t b = 0; b < p.batch; b++)
+    for (size_t h = 0; h < p.heads; h++)
+      for (size_t i = 0; i < p.q_len; i++) {
+        size_t seen = p.causal ? std::min(p.kv_len, p.q_start + i + 1)
+                               : p.kv_len;
+        const float *qi = q + b * p.q_batch + i * p.q_stride + h * p.key_dim;
+        std::vector<double> s(seen);
+        for (size_t j = 0; j < seen; j++) {
+          const float *kj =
+              k + b * p.k_batch + j * p.k_stride + h * p.key_dim;
+          for (size_t d = 0; d < p.key_dim; d++) s[j] += double(qi[d]) * kj[d];
+          s[j] *= scale;
+        }
+        double m = *std::max_element(s.begin(), s.end()), l = 0;
+        for (double &e : s) l += e = std::exp(e - m);
+        double *o = out.data() + b * p.out_batch + i * p.out_stride +
+                    h * p.value_dim;
+        for (size_t j = 0; j < seen; j++)
+          for (size_t d = 0; d < p.value_dim; d++)
+            o[d] += s[j] / l *
+                    v[b * p.v_batch + j * p.v_stride + h * p.value_dim + d];
+      }
+  return out;
+}
+
+static kernels::attention_params geometry(size_t q_len, size_t kv_len,
+                                          bool causal) {
+  kernels::attention_params p;
+  p.batch = 2;
+  p.heads = 3;
+  p.q_len = q_len;
+  p.kv_len = kv_len;
+  p.key_dim = 5;
+  p.value_dim = 7;
+  p.q_stride = p.k_stride = p.heads * p.key_dim;
+  p.v_stride = p.out_stride = p.heads * p.value_dim;
+  p.q_batch = q_len * p.q_stride;
+  p.k_batch = kv_len * p.k_stride;
+  p.v_batch = kv_len * p.v_stride;
+  p.out_batch = q_len * p.out_stride;
+  p.causal = causal;
+  if (causal) p.q_start = kv_len - q_len;
+  return p;
+}
+
+TEST(Kernel, ATTENTION_TEST) {
+  // lengths around and between the 64 wide tiles
+  for (size_t len : {1, 7, 63, 64, 65, 130, 200})
+    for (bool causal : {false, true}) {
+      kernels::attention_params p = geometry(len, len, causal);
+      std::vector<float> q = wave(p.batch * p.q_batch, 0.1f);
+      std::vector<float> k = wave(p.batch * p.k_batch, 0.7f);
+      std::vector<float> v = wave(p.batch * p.v_batch, 1.3f);
+      std::vector<float> out(p.batch * p.out_batch);
+      kernels::flash_attention(p, q.data(), k.data(), v.data(), out.data());
+      std::vector<double> expected = naive(p, q.data(), k.data(), v.data());
+      for (size_t i = 0; i < out.size(); i++)
+        ASSERT_NEAR(out[i], expected[i], 1e-5)
+            << "length " << len << " causal " << causal << " element " << i;
+    }
+}
+
+TEST(KernelOffset, ATTENTION_TEST) {
+  // fewer queries than keys, the queries being the last positions
+  for (size_t q_len : {1, 5, 70})
+    for (bool causal : {false, true}) {
+      kernels::attention_params p = geometry(q_len, 131, causal);
+      std::vector<float> q = wave(p.batch * p.q_batch, 0.2f);
+      std::vector<float> k = wave(p.batch * p.k_batch, 0.9f);
+      std::vector<float> v = wave(p.batch * p.v_batch, 1.6f);
+      std::vector<float> out(p.batch * p.out_batch);
+      kernels::flash_attention(p, q.data(), k.data(), v.data(), out.data());
+      std::vector<double> expected = naive(p, q.data(), k.data(), v.data());
+      for (size_t i = 0; i < out.size(); i++)
+        ASSERT_NEAR(out[i], expected[i], 1e-5)
+            << "queries " << q_len << " causal " << causal << " element "
+            << i;
+    }
+}
+
+// overwrites the built weights, biases included
+static void randomize(MultiHeadAttention<float> &layer) {
+  float phase = 0.3f;
+  for (tensor<float> *w : layer.weights()) {
+    float *v = w->raw_data();
+    for (size_t i = 0; i < w->size(); i++)
+      v[i] = 0.4f * std::sin(0.37f * i + phase);
+    phase += 1.1f;
+  }
+}
+
+// projections, attention and output projection, all in double
+static std::vector<double> reference(MultiHeadAttention<float> &layer,
+                                     const tensor<float> &x, size_t key_dim,
+                                     size_t value_dim) {
+  std::vector<tensor<float> *> w = layer.weights();
+  size_t batch = x.shape().d[0], seq = x.shape().d[1];
+  size_t e = x.shape().d[2], heads = layer.num_heads();
+  auto dense = [&](const float *in, size_t rows, size_t k, size_t n,
+                   const tensor<float> *kernel, const tensor<float> *bias) {
+    std::vector<float> out(rows * n);
+    for (size_t r = 0; r < rows; r++)
+      for (size_t j = 0; j < n; j++) {
+        double s = read(*bias)[j];
+        for (size_t i = 0; i < k; i++)
+          s += double(in[r * k + i]) * read(*kernel)[i * n + j];
+        out[r * n + j] = float(s);
+      }
+    return out;
+  };
+  size_t qk = heads * key_dim, hv = heads * value_dim;
+  std::vector<float> q = dense(read(x), batch * seq, e, qk, w[0], w[1]);
+  std::vector<float> k = dense(read(x), batch * seq, e, qk, w[2], w[3]);
+  std::vector<float> v = dense(read(x), batch * seq, e, hv, w[4], w[5]);
+
+  kernels::attention_params p;
+  p.batch = batch;
+  p.heads = heads;
+  p.q_len = p.kv_len = seq;
+  p.key_dim = key_dim;
+  p.value_dim = value_dim;
+  p.q_stride = p.k_stride = qk;
+  p.v_stride = p.out_stride = hv;
+  p.q_batch = p.k_batch = seq * qk;
+  p.v_batch = p.out_batch = seq * hv;
+  p.causal = layer.is_causal();
+  std::vector<double> attended = naive(p, q.data(), k.data(), v.data());
+
+  std::vector<double> out(batch * seq * e);
+  for (size_t r = 0; r < batch * seq; r++)
+    for (size_t j = 0; j < e; j++) {
+      double s = read(*w[7])[j];
+      for (size_t i = 0; i < hv; i++)
+        s += attended[r * hv + i] * read(*w[6])[i * e + j];
+      out[r * e + j] = s;
+    }
+  return out;
+}
+
+TEST(Layer, ATTENTION_TEST) {
+  for (bool causal : {false, true}) {
+    MultiHeadAttention<float> layer(3, 5, 4, causal);
+    tensor<float> x = filled({2, 67, 9}, 0.4f);
+    layer(x);  // builds
+    randomize(layer);
+    std::vector<double> expected = reference(layer, x, 5, 4);
+    for (bool frozen : {false, true}) {
+      if (frozen) layer.freeze();
+      tensor<float> y = layer(x);
+      EXPECT_EQ(y.shape().d, std::vector<uint>({2, 67, 9}));
+      for (size_t i = 0; i < expected.size(); i++)
+        ASSERT_NEAR(read(y)[i], expected[i], 1e-4)
+            << "causal " << causal << " frozen " << frozen << " element "
+            << i;
+    }
+  }
+}
+
+// decoding a causal sequence through a kv_cache gives the rows of one
+// forward() over the whole of it, whatever the chunks
+TEST(Step, ATTENTION_TEST) {
+  MultiHeadAttention<float> layer(2, 6, 0, true);
+  tensor<float> x = filled({2, 71, 8}, 0.5f);
+  layer(x);  // builds
+  randomize(layer);
+  tensor<float> full = layer(x);
+
+  for (std::vector<size_t> chunks :
+       {std::vector<size_t>(71, 1), std::vector<size_t>({3, 1, 64, 3})}) {
+    kv_cache<float> cache;
+    size_t at = 0;
+    for (size_t n : chunks) {
+      std::vector<float> part(2 * n * 8);
+      for (size_t b = 0; b < 2; b++)
+        std::copy_n(read(x) + (b * 71 + at) * 8, n * 8,
+                    part.begin() + b * n * 8);
+      tensor<float> y =
+          layer.step(tensor<float>(part, shape::Shape({2, uint(n), 8})),
+                     cache);
+      EXPECT_EQ(y.shape().d, std::vector<uint>({2, uint(n), 8}));
+      for (size_t b = 0; b < 2; b++)
+        for (size_t i = 0; i < n * 8; i++)
+          ASSERT_NEAR(read(y)[b * n * 8 + i],
+                      read(full)[(b * 71 + at) * 8 + i], 1e-5)
+              << "chunk at " << at << " sequence " << b;
+      at += n;
+    }
+    EXPECT_EQ(cache.length(), 71u);
+    EXPECT_GE(cache.capacity(), 71u);
+  }
+
+  // a cache holds one batch until cleared
+  kv_cache<float> cache;
+  layer.step(filled({2, 1, 8}, 0.1f), cache);
+  EXPECT_THROW(layer.step(filled({3, 1, 8}, 0.1f), cache),
+               exceptions::operation_undefined);
+  cache.clear();
+  EXPECT_NO_THROW(layer.step(filled({3, 1, 8}, 0.1f), cache));
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,118 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "tensors++/layers/batch_norm.hpp"
+#include "tensors++/layers/conv2d.hpp"
+#include "tensors++/layers/dense.hpp"
+#include "tensors++/models/sequential.hpp"
+
+using namespace tensors;
+
+static std::vector<float> pattern(size_t n, float scale, float phase) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = scale * std::sin(0.37f * i + phase);
+  return v;
+}
+
+// gives every normalization a non trivial affine transform and moving
+// statistics away from 0 and 1
+static void train(models::Sequential<float> &model, const tensor<float> &x) {
+  for (size_t i = 0; i < model.size(); i++) {
+    std::vector<tensor<float> *> w = model[i].weights();
+    if (w.size() != 4) continue;
+    for (size_t c = 0; c < w[0]->size(); c++) {
+      w[0]->raw_data()[c] = 0.5f + 0.1f * float(c);
+      w[1]->raw_data()[c] = 0.3f - 0.05f * float(c);
+    }
+  }
+  model.set_training(true);
+  for (int step = 0; step < 20; step++) model(x);
+  model.set_training(false);
+}
+
+static void expect_same(const tensor<float> &a, const tensor<float> &b) {
+  ASSERT_EQ(a.shape().d, b.shape().d);
+  for (size_t i = 0; i < a.size(); i++)
+    ASSERT_NEAR(a.raw_data()[i], b.raw_data()[i], 1e-4) << "output " << i;
+}
+
+TEST(FoldConv, BATCH_NORM_TEST) {
+  models::Sequential<float> model;
+  model.add<layers::Conv2D<float>>(6, 3, 1, "same");
+  model.add<layers::BatchNormalization<float>>(0.5f);
+  model.add<layers::Conv2D<float>>(5, 3, 2, "valid", 1, 1, "linear", false);
+  model.add<layers::BatchNormalization<float>>(0.5f);
+  tensor<float> x(pattern(2 * 9 * 8 * 3, 2.f, .4f), shape::Shape({2, 9, 8, 3}));
+  train(model, x);
+
+  tensor<float> before = model(x);
+  EXPECT_EQ(model.fold_batch_norm(), 2u);
+  EXPECT_EQ(model.size(), 2u);
+  expect_same(before, model(x));
+}
+
+TEST(FoldDense, BATCH_NORM_TEST) {
+  models::Sequential<float> model;
+  model.add<layers::Dense<float>>(7);
+  model.add<layers::BatchNormalization<float>>(0.5f);
+  model.add<layers::Dense<float>>(4, "relu");
+  // after an activation the normalization cannot be folded
+  model.add<layers::BatchNormalization<float>>(0.5f);
+  tensor<float> x(pattern(16 * 10, 3.f, .1f), shape::Shape({16, 10}));
+  train(model, x);
+
+  tensor<float> before = model(x);
+  EXPECT_EQ(model.fold_batch_norm(), 1u);
+  EXPECT_EQ(model.size(), 3u);
+  expect_same(before, model(x));
+}
+
+TEST(Moments, BATCH_NORM_TEST) {
+  // a mean far from zero next to a small spread, over more rows than one
+  // block so the partial sums of several tasks are combined
+  for (size_t rows : {1, 7, 5000}) {
+    const size_t channels = 3;
+    std::vector<float> x(rows * channels);
+    for (size_t r = 0; r < rows; r++)
+      for (size_t c = 0; c < channels; c++)
+        x[r * channels + c] = 1e4f * float(c + 1) +
+                              std::sin(0.1f * r + c) * float(c + 1);
+    std::vector<float> mean(channels), variance(channels);
+    kernels::channel_moments(x.data(), rows, channels, mean.data(),
+                             variance.data());
+    for (size_t c = 0; c < channels; c++) {
+      double m = 0, v = 0;
+      for (size_t r = 0; r < rows; r++) m += x[r * channels + c];
+      m /= rows;
+      for (size_t r = 0; r < rows; r++)
+        v += (x[r * channels + c] - m) * (x[r * channels + c] - m);
+      v /= rows;
+      EXPECT_NEAR(mean[c], m, 1e-3 * (c + 1)) << rows << " rows";
+      EXPECT_NEAR(variance[c], v, 1e-3 * v + 1e-6) << rows << " rows";
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,127 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "tensors++/layers/dense.hpp"
+
+using namespace tensors;
+using namespace tensors::layers;
+
+static tensor<float> filled(std::vector<uint> dims, float phase) {
+  shape::Shape s(dims);
+  std::vector<float> v(s.element_size());
+  for (size_t i = 0; i < v.size(); i++) v[i] = std::sin(0.61f * i + phase);
+  return tensor<float>(v, s);
+}
+
+static const float *read(const tensor<float> &t) { return t.raw_data(); }
+
+static double activate(kernels::activation act, double x) {
+  switch (act) {
+    case kernels::activation::relu:
+      return std::max(x, 0.0);
+    case kernels::activation::gelu:
+      return 0.5 * x *
+             (1 + std::tanh(std::sqrt(2 / M_PI) * (x + 0.044715 * x * x * x)));
+    case kernels::activation::sigmoid:
+      return 1 / (1 + std::exp(-x));
+    case kernels::activation::tanh:
+      return std::tanh(x);
+    default:
+      return x;
+  }
+}
+
+// act(x w + b) in double, row by row
+static void expect_dense(Dense<float> &layer, const tensor<float> &x,
+                         const tensor<float> &y) {
+  std::vector<tensor<float> *> w = layer.weights();
+  size_t k = w[0]->shape().d[0], n = layer.output_units();
+  const float *kernel = read(*w[0]);
+  const float *bias = w.size() > 1 ? read(*w[1]) : nullptr;
+  ASSERT_EQ(y.size(), x.size() / k * n);
+  for (size_t r = 0; r < x.size() / k; r++)
+    for (size_t j = 0; j < n; j++) {
+      double s = bias ? bias[j] : 0.0;
+      for (size_t i = 0; i < k; i++)
+        s += double(read(x)[r * k + i]) * kernel[i * n + j];
+      EXPECT_NEAR(read(y)[r * n + j], activate(layer.activation(), s), 1e-4)
+          << "row " << r << " unit " << j;
+    }
+}
+
+TEST(Forward, DENSE_TEST) {
+  for (auto act : {kernels::activation::linear, kernels::activation::relu,
+                   kernels::activation::gelu, kernels::activation::sigmoid,
+                   kernels::activation::tanh}) {
+    Dense<float> layer(21, act);
+    tensor<float> x = filled({3, 13, 37}, 0.2f);  // 39 rows, leading dims
+    tensor<float> y = layer(x);
+    EXPECT_EQ(y.shape().d, std::vector<uint>({3, 13, 21}));
+    expect_dense(layer, x, y);
+  }
+
+  Dense<float> no_bias(5, "relu", false);
+  tensor<float> x = filled({4, 9}, 1.f);
+  EXPECT_EQ(no_bias.weights().size(), 0u);
+  expect_dense(no_bias, x, no_bias(x));
+  EXPECT_EQ(no_bias.weights().size(), 1u);
+  EXPECT_THROW(no_bias(filled({4, 8}, 0.f)), exceptions::operation_undefined);
+}
+
+TEST(Frozen, DENSE_TEST) {
+  Dense<float> layer(40, "tanh");
+  tensor<float> x = filled({64, 300}, 0.4f);
+  tensor<float> before = layer(x);
+  // the kernel is packed once and reused
+  layer.freeze();
+  for (int call = 0; call < 2; call++) {
+    tensor<float> y = layer(x);
+    for (size_t i = 0; i < y.size(); i++)
+      ASSERT_FLOAT_EQ(read(y)[i], read(before)[i]);
+  }
+  expect_dense(layer, x, before);
+
+  // new weights after unfreeze are picked up
+  layer.unfreeze();
+  *layer.weights()[0] *= 0.5f;
+  expect_dense(layer, x, layer(x));
+  layer.freeze();
+  expect_dense(layer, x, layer(x));
+}
+
+TEST(Sparse, DENSE_TEST) {
+  Dense<float> layer(7, "sigmoid");
+  std::vector<float> v(6 * 30, 0.f);
+  for (size_t i = 0; i < v.size(); i += 7) v[i] = float(i % 5) - 2.f;
+  tensor<float> x(v, shape::Shape({6, 30}));
+  tensor<float> dense = layer(x);
+  tensor<float> sparse = layer(sparse_tensor<float>::from_dense(x));
+  EXPECT_EQ(sparse.shape().d, std::vector<uint>({6, 7}));
+  for (size_t i = 0; i < dense.size(); i++)
+    EXPECT_NEAR(read(sparse)[i], read(dense)[i], 1e-6);
+  expect_dense(layer, x, sparse);
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,145 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "tensors++/kernels/embedding.hpp"
+#include "tensors++/layers/embedding.hpp"
+
+using namespace tensors;
+using namespace tensors::layers;
+
+static std::vector<float> table(size_t rows, size_t dim) {
+  std::vector<float> t(rows * dim);
+  for (size_t i = 0; i < t.size(); i++) t[i] = std::sin(0.61f * i + 0.2f);
+  return t;
+}
+
+static const float *read(const tensor<float> &t) { return t.raw_data(); }
+
+template <class index>
+static void expect_gather(const std::vector<index> &ids) {
+  size_t rows = 37, dim = 5;
+  std::vector<float> t = table(rows, dim);
+  std::vector<float> out(ids.size() * dim);
+  kernels::gather_rows(t.data(), rows, dim, ids.data(), ids.size(),
+                       out.data());
+  for (size_t i = 0; i < ids.size(); i++)
+    for (size_t j = 0; j < dim; j++)
+      EXPECT_EQ(out[i * dim + j], t[size_t(ids[i]) * dim + j])
+          << "id " << i;
+}
+
+TEST(Gather, EMBEDDING_TEST) {
+  // enough ids for several parallel chunks
+  std::vector<uint> many(5000);
+  for (size_t i = 0; i < many.size(); i++) many[i] = uint(i * 7 % 37);
+  expect_gather(many);
+  expect_gather(std::vector<int>({0, 36, 3, 3, 12}));
+  expect_gather(std::vector<int64_t>({5, 1}));
+  expect_gather(std::vector<float>({2, 0, 36}));
+  expect_gather(std::vector<uint>());
+
+  std::vector<float> t = table(4, 2), out(4);
+  std::vector<int> negative = {1, -1};
+  std::vector<uint> past = {1, 4};
+  EXPECT_THROW(kernels::gather_rows(t.data(), 4, 2, negative.data(), 2,
+                                    out.data()),
+               exceptions::operation_undefined);
+  EXPECT_THROW(
+      kernels::gather_rows(t.data(), 4, 2, past.data(), 2, out.data()),
+      exceptions::operation_undefined);
+}
+
+TEST(Scatter, EMBEDDING_TEST) {
+  size_t dim = 3;
+  std::vector<int> ids = {4, 1, 4, 9, 1, 4};
+  std::vector<float> grad(ids.size() * dim);
+  for (size_t i = 0; i < grad.size(); i++) grad[i] = float(i + 1);
+  kernels::sparse_rows<float> rows =
+      kernels::scatter_rows(ids.data(), ids.size(), grad.data(), dim);
+  EXPECT_EQ(rows.dim, dim);
+  EXPECT_EQ(rows.indices, std::vector<size_t>({1, 4, 9}));
+  // duplicate ids are summed
+  std::vector<std::vector<size_t>> sources = {{1, 4}, {0, 2, 5}, {3}};
+  for (size_t r = 0; r < rows.size(); r++)
+    for (size_t j = 0; j < dim; j++) {
+      float sum = 0;
+      for (size_t i : sources[r]) sum += grad[i * dim + j];
+      EXPECT_EQ(rows.row(r)[j], sum) << "row " << rows.indices[r];
+    }
+
+  kernels::sparse_rows<float> none =
+      kernels::scatter_rows(ids.data(), 0, grad.data(), dim);
+  EXPECT_EQ(none.size(), 0u);
+  EXPECT_TRUE(none.values.empty());
+}
+
+TEST(Layer, EMBEDDING_TEST) {
+  Embedding<float> layer(10, 4);
+  tensor<uint> ids(std::vector<uint>({3, 7, 3, 0, 9, 3}),
+                   shape::Shape({2, 3}));
+  tensor<float> y = layer(ids);
+  EXPECT_EQ(y.shape().d, std::vector<uint>({2, 3, 4}));
+  const float *w = read(*layer.weights()[0]);
+  for (size_t i = 0; i < 6; i++)
+    for (size_t j = 0; j < 4; j++)
+      EXPECT_EQ(read(y)[i * 4 + j], w[ids.raw_data()[i] * 4 + j]);
+
+  // the same lookup with the ids in dtype
+  tensor<float> float_ids(std::vector<float>({3, 7, 3, 0, 9, 3}),
+                          shape::Shape({2, 3}));
+  tensor<float> z = layer(float_ids);
+  for (size_t i = 0; i < z.size(); i++) EXPECT_EQ(read(z)[i], read(y)[i]);
+  EXPECT_THROW(layer(tensor<float>(std::vector<float>({1.5f}),
+                                   shape::Shape({1}))),
+               exceptions::operation_undefined);
+  EXPECT_THROW(layer(tensor<float>(std::vector<float>({-1}),
+                                   shape::Shape({1}))),
+               exceptions::operation_undefined);
+  EXPECT_THROW(layer(tensor<uint>(std::vector<uint>({10}),
+                                  shape::Shape({1}))),
+               exceptions::operation_undefined);
+
+  // the gradient of the table holds the looked up rows, summed per id
+  std::vector<float> g(24);
+  for (size_t i = 0; i < g.size(); i++) g[i] = float(i);
+  layer(ids);
+  kernels::sparse_rows<float> grad =
+      layer.backward(tensor<float>(g, shape::Shape({2, 3, 4})));
+  EXPECT_EQ(grad.indices, std::vector<size_t>({0, 3, 7, 9}));
+  std::vector<std::vector<size_t>> sources = {{3}, {0, 2, 5}, {1}, {4}};
+  for (size_t r = 0; r < grad.size(); r++)
+    for (size_t j = 0; j < 4; j++) {
+      float sum = 0;
+      for (size_t i : sources[r]) sum += g[i * 4 + j];
+      EXPECT_EQ(grad.row(r)[j], sum) << "row " << grad.indices[r];
+    }
+  EXPECT_THROW(layer.backward(tensor<float>(std::vector<float>(20),
+                                            shape::Shape({5, 4}))),
+               exceptions::operation_undefined);
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,188 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+#include "tensors++/layers/pooling.hpp"
+
+using namespace tensors;
+using namespace tensors::kernels;
+
+// distinct values, so every window has a single maximum
+static std::vector<float> pattern(size_t n) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++)
+    v[i] = std::sin(0.71f * i + 0.2f) + 1e-4f * float(i % 97);
+  return v;
+}
+
+static pool2d_params geometry(size_t batch, size_t h, size_t w, size_t c,
+                              size_t pool, size_t stride, size_t pad) {
+  pool2d_params p;
+  p.batch = batch;
+  p.in_h = h;
+  p.in_w = w;
+  p.channels = c;
+  p.pool_h = pool;
+  p.pool_w = pool + 1;
+  p.stride_h = stride;
+  p.stride_w = stride;
+  p.pad_top = p.pad_left = pad;
+  p.pad_bottom = p.pad_right = pad;
+  return p;
+}
+
+// every window searched and averaged on its own, padding excluded
+static void reference(const pool2d_params &p, const std::vector<float> &x,
+                      std::vector<float> &max, std::vector<size_t> &where,
+                      std::vector<float> &avg) {
+  size_t oh = p.out_h(), ow = p.out_w(), C = p.channels;
+  max.assign(p.batch * oh * ow * C, 0.f);
+  where.assign(max.size(), 0);
+  avg.assign(max.size(), 0.f);
+  for (size_t n = 0; n < p.batch; n++)
+    for (size_t y = 0; y < oh; y++)
+      for (size_t xo = 0; xo < ow; xo++)
+        for (size_t c = 0; c < C; c++) {
+          size_t o = ((n * oh + y) * ow + xo) * C + c;
+          float best = -std::numeric_limits<float>::infinity();
+          double sum = 0;
+          size_t count = 0;
+          for (size_t ky = 0; ky < p.pool_h; ky++)
+            for (size_t kx = 0; kx < p.pool_w; kx++) {
+              long iy = long(y * p.stride_h + ky) - long(p.pad_top);
+              long ix = long(xo * p.stride_w + kx) - long(p.pad_left);
+              if (iy < 0 || ix < 0 || iy >= long(p.in_h) ||
+                  ix >= long(p.in_w))
+                continue;
+              size_t i = ((n * p.in_h + iy) * p.in_w + ix) * C + c;
+              if (x[i] > best) {
+                best = x[i];
+                where[o] = i;
+              }
+              sum += x[i];
+              count++;
+            }
+          max[o] = best;
+          avg[o] = float(sum / count);
+        }
+}
+
+static const std::vector<pool2d_params> cases = {
+    geometry(2, 8, 9, 3, 2, 2, 0),    // stride == pool
+    geometry(1, 11, 10, 5, 3, 2, 1),  // overlapping and padded
+    geometry(3, 7, 13, 2, 2, 3, 0),   // gaps between windows
+    geometry(1, 5, 5, 17, 5, 1, 2)};  // windows mostly padding
+
+TEST(Separable, POOLING_TEST) {
+  for (auto &p : cases) {
+    std::vector<float> x = pattern(p.batch * p.in_h * p.in_w * p.channels);
+    std::vector<float> max, avg;
+    std::vector<size_t> where;
+    reference(p, x, max, where, avg);
+
+    std::vector<float> out(max.size());
+    std::vector<size_t> indices(max.size());
+    max_pool2d(p, x.data(), out.data(), indices.data());
+    EXPECT_EQ(out, max);
+    EXPECT_EQ(indices, where);
+    max_pool2d(p, x.data(), out.data());
+    EXPECT_EQ(out, max);
+    avg_pool2d(p, x.data(), out.data());
+    for (size_t i = 0; i < out.size(); i++)
+      ASSERT_NEAR(out[i], avg[i], 1e-5);
+  }
+}
+
+TEST(Backward, POOLING_TEST) {
+  for (auto &p : cases) {
+    std::vector<float> x = pattern(p.batch * p.in_h * p.in_w * p.channels);
+    std::vector<float> max, avg;
+    std::vector<size_t> where;
+    reference(p, x, max, where, avg);
+    std::vector<float> g(max.size());
+    for (size_t i = 0; i < g.size(); i++) g[i] = 0.5f + float(i % 7);
+
+    // overlapping windows add up at a shared maximum
+    std::vector<float> expected(x.size(), 0.f), got(x.size(), 0.f);
+    for (size_t i = 0; i < g.size(); i++) expected[where[i]] += g[i];
+    max_pool2d_backward(p, where.data(), g.data(), got.data());
+    for (size_t i = 0; i < x.size(); i++) ASSERT_FLOAT_EQ(got[i], expected[i]);
+
+    // the average gradient, by a central difference of the averages
+    std::fill(got.begin(), got.end(), 0.f);
+    avg_pool2d_backward(p, g.data(), got.data());
+    std::vector<float> xp = x, outp(g.size()), outm(g.size());
+    for (size_t i = 0; i < x.size(); i += 5) {
+      xp[i] = x[i] + 0.5f;
+      avg_pool2d(p, xp.data(), outp.data());
+      xp[i] = x[i] - 0.5f;
+      avg_pool2d(p, xp.data(), outm.data());
+      xp[i] = x[i];
+      double d = 0;
+      for (size_t o = 0; o < g.size(); o++) d += g[o] * (outp[o] - outm[o]);
+      ASSERT_NEAR(got[i], d, 1e-4) << "input " << i;
+    }
+  }
+}
+
+TEST(Layers, POOLING_TEST) {
+  std::vector<float> v = pattern(2 * 9 * 7 * 4);
+  tensor<float> x(v, shape::Shape({2, 9, 7, 4}));
+
+  layers::MaxPool2D<float> pool(3, 2, "same", true);
+  tensor<float> y = pool(x);
+  EXPECT_EQ(y.shape().d, std::vector<uint>({2, 5, 4, 4}));
+  for (size_t i = 0; i < y.size(); i++)
+    ASSERT_EQ(y.raw_data()[i], v[pool.indices()[i]]);
+  tensor<float> g = pool.backward(y);
+  EXPECT_EQ(g.shape().d, x.shape().d);
+
+  layers::GlobalAvgPool2D<float> gap;
+  layers::GlobalMaxPool2D<float> gmp;
+  tensor<float> a = gap(x), m = gmp(x);
+  EXPECT_EQ(a.shape().d, std::vector<uint>({2, 4}));
+  for (size_t n = 0; n < 2; n++)
+    for (size_t c = 0; c < 4; c++) {
+      double sum = 0;
+      float best = v[n * 63 * 4 + c];
+      for (size_t i = 0; i < 63; i++) {
+        sum += v[(n * 63 + i) * 4 + c];
+        best = std::max(best, v[(n * 63 + i) * 4 + c]);
+      }
+      EXPECT_NEAR(a.raw_data()[n * 4 + c], sum / 63, 1e-5);
+      EXPECT_EQ(m.raw_data()[n * 4 + c], best);
+    }
+  // built on 4-D images, a later 3-D input is refused instead of read
+  // out of bounds
+  tensor<float> flat(std::vector<float>(24, 1.f), shape::Shape({2, 3, 4}));
+  EXPECT_THROW(gap(flat), exceptions::operation_undefined);
+  EXPECT_THROW(gmp(flat), exceptions::operation_undefined);
+  // another image size is fine
+  tensor<float> small(std::vector<float>(2 * 3 * 3 * 4, 2.f),
+                      shape::Shape({2, 3, 3, 4}));
+  EXPECT_EQ(gap(small).raw_data()[5], 2.f);
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
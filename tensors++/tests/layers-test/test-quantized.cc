@@ -0,0 +1,231 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "tensors++/kernels/quantized.hpp"
+#include "tensors++/layers/quantized.hpp"
+
+using namespace tensors;
+using namespace tensors::layers;
+
+static std::vector<float> wave(size_t n, float phase, float amplitude = 1) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = amplitude * std::sin(0.61f * i + phase);
+  return v;
+}
+
+static tensor<float> filled(std::vector<uint> dims, float phase,
+                            float amplitude = 1) {
+  shape::Shape s(dims);
+  return tensor<float>(wave(s.element_size(), phase, amplitude), s);
+}
+
+static const float *read(const tensor<float> &t) { return t.raw_data(); }
+
+// overwrites the built weights, the (zero) biases included
+static void randomize(Layer<float> &layer) {
+  float phase = 0.3f;
+  for (tensor<float> *w : layer.weights()) {
+    std::vector<float> v = wave(w->size(), phase, 0.3f);
+    std::copy(v.begin(), v.end(), w->raw_data());
+    phase += 1.1f;
+  }
+}
+
+TEST(Qgemm, QUANTIZED_TEST) {
+  size_t m = 13, k = 37, n = 19;  // no multiple of the tiles
+  std::vector<float> w = wave(k * n, 0.5f);
+  kernels::qweights q = kernels::quantize_weights(w.data(), k, n);
+  std::vector<uint8_t> a(m * k + 3, 0);
+  for (size_t i = 0; i < m * k; i++) a[i] = uint8_t(i * 37 % 128);
+  kernels::qparams ap;
+  ap.scale = 0.02f;
+  ap.zero_point = 50;
+  std::vector<float> bias = wave(n, 2.f);
+
+  std::vector<float> real(m * n);
+  kernels::qgemm_output o;
+  o.real = real.data();
+  o.bias = bias.data();
+  kernels::qgemm(a.data(), m, k, ap, q, o);
+
+  // exact int32 products, and within the weight rounding of float weights
+  size_t groups = q.depth_groups();
+  for (size_t r = 0; r < m; r++)
+    for (size_t j = 0; j < n; j++) {
+      int64_t acc = 0;
+      double exact = bias[j];
+      for (size_t l = 0; l < k; l++) {
+        int8_t wq = q.packed[((j / 8 * groups + l / 4) * 8 + j % 8) * 4 +
+                             l % 4];
+        acc += int64_t(a[r * k + l] - ap.zero_point) * wq;
+        exact += ap.scale * double(a[r * k + l] - ap.zero_point) *
+                 w[l * n + j];
+      }
+      double expected = double(ap.scale) * q.scales[j] * acc + bias[j];
+      EXPECT_NEAR(real[r * n + j], expected, 1e-4) << r << ", " << j;
+      EXPECT_NEAR(real[r * n + j], exact,
+                  k * 128 * ap.scale * q.scales[j] / 2 + 1e-4);
+    }
+
+  // the requantizing epilogue stores what quantizing the reals gives
+  kernels::qparams out = kernels::choose_qparams(-3.f, 5.f);
+  std::vector<uint8_t> quantized(m * n);
+  o.real = nullptr;
+  o.quantized = quantized.data();
+  o.requantize = &out;
+  kernels::qgemm(a.data(), m, k, ap, q, o);
+  for (size_t i = 0; i < m * n; i++)
+    EXPECT_EQ(quantized[i], kernels::quantize_value(real[i], out)) << i;
+}
+
+// |quantized - float| for outputs summing k products of inputs up to x_max
+// quantized with step sa and weights up to w_max with steps up to sw
+static double bound(size_t k, double sa, double x_max, double sw,
+                    double w_max) {
+  return k * (sa / 2 * (w_max + sw / 2) + sw / 2 * x_max) + 1e-5;
+}
+
+static double max_scale(const Quantized &q) {
+  return *std::max_element(q.kernel_scales().begin(),
+                           q.kernel_scales().end());
+}
+
+TEST(Dense, QUANTIZED_TEST) {
+  for (auto act : {kernels::activation::linear, kernels::activation::relu}) {
+    Dense<float> dense(23, act);
+    tensor<float> x = filled({4, 9, 41}, 0.2f, 2.f);
+    dense(x);
+    randomize(dense);
+    tensor<float> expected = dense(x);
+
+    QuantizedDense quantized(dense);
+    tensor<float> y = quantized(x);
+    EXPECT_EQ(y.shape().d, std::vector<uint>({4, 9, 23}));
+    double sa = quantized.quantize(x).params.scale;
+    double tolerance = bound(41, sa, 2, max_scale(quantized), 0.3);
+    for (size_t i = 0; i < y.size(); i++)
+      ASSERT_NEAR(read(y)[i], read(expected)[i], tolerance) << i;
+    EXPECT_THROW(quantized(filled({2, 40}, 0)),
+                 exceptions::operation_undefined);
+  }
+}
+
+TEST(Conv2D, QUANTIZED_TEST) {
+  for (std::string padding : {"valid", "same"}) {
+    Conv2D<float> conv(6, window(3, 2), window(2, 1), padding, 1, 1, "relu");
+    tensor<float> x = filled({2, 11, 9, 5}, 0.4f, 1.5f);
+    conv(x);
+    randomize(conv);
+    tensor<float> expected = conv(x);
+
+    QuantizedConv2D quantized(conv);
+    tensor<float> y = quantized(x);
+    EXPECT_EQ(y.shape().d, expected.shape().d);
+    double sa = quantized.quantize(x).params.scale;
+    double tolerance = bound(3 * 2 * 5, sa, 1.5, max_scale(quantized), 0.3);
+    for (size_t i = 0; i < y.size(); i++)
+      ASSERT_NEAR(read(y)[i], read(expected)[i], tolerance)
+          << padding << " " << i;
+    EXPECT_THROW(quantized(filled({2, 11, 9, 4}, 0)),
+                 exceptions::operation_undefined);
+  }
+}
+
+TEST(Calibration, QUANTIZED_TEST) {
+  Dense<float> dense(5);
+  tensor<float> x = filled({6, 8}, 0.1f);
+  dense(x);
+  QuantizedDense quantized(dense);
+
+  // uncalibrated, every batch is quantized with its own range
+  EXPECT_FALSE(quantized.calibrated());
+  EXPECT_THROW(quantized.input_qparams(), exceptions::operation_undefined);
+  const float *v = read(x);
+  kernels::qparams own = kernels::choose_qparams(
+      *std::min_element(v, v + x.size()), *std::max_element(v, v + x.size()));
+  kernels::qparams dynamic = quantized.quantize(x).params;
+  EXPECT_EQ(dynamic.scale, own.scale);
+  EXPECT_EQ(dynamic.zero_point, own.zero_point);
+
+  // calibrated, the range of the samples is used for every batch
+  quantized.calibrate(filled({6, 8}, 0.7f, 3.f));
+  quantized.calibrate(filled({2, 8}, 0.2f, 0.5f));
+  EXPECT_TRUE(quantized.calibrated());
+  kernels::qparams calibrated = quantized.quantize(x).params;
+  EXPECT_EQ(calibrated.scale, quantized.input_qparams().scale);
+  EXPECT_EQ(calibrated.zero_point, quantized.input_qparams().zero_point);
+  EXPECT_GT(calibrated.scale, dynamic.scale);
+  EXPECT_EQ(quantized.quantize(filled({6, 8}, 0.4f, 2.f)).params.scale,
+            calibrated.scale);
+
+  // inputs past the calibrated range saturate
+  tensor<float> wide = filled({1, 8}, 0.2f, 100.f);
+  quantized_tensor q = quantized.quantize(wide);
+  for (size_t i = 0; i < wide.size(); i++)
+    EXPECT_EQ(q.values[i], read(wide)[i] > 0 ? kernels::activation_qmax : 0);
+}
+
+// two quantized layers pass uint8 activations requantized by the first
+// layer's epilogue, as if its float outputs had been quantized
+TEST(Requantize, QUANTIZED_TEST) {
+  Dense<float> first(16, kernels::activation::relu), second(7);
+  tensor<float> x = filled({5, 12}, 0.3f);
+  second(first(x));
+  randomize(first);
+  randomize(second);
+  QuantizedDense q1(first), q2(second);
+  q1.calibrate(x);
+  q2.calibrate(q1(x));
+
+  quantized_tensor hidden = q1(q1.quantize(x), q2.input_qparams());
+  EXPECT_EQ(hidden.dims, std::vector<uint>({5, 16}));
+  EXPECT_EQ(hidden.size(), 5u * 16);
+  quantized_tensor expected = q2.quantize(q1(x));
+  for (size_t i = 0; i < hidden.size(); i++)
+    EXPECT_EQ(hidden.values[i], expected.values[i]) << i;
+
+  tensor<float> y = q2(hidden), z = q2(q1(x));
+  EXPECT_EQ(y.shape().d, std::vector<uint>({5, 7}));
+  for (size_t i = 0; i < y.size(); i++) EXPECT_EQ(read(y)[i], read(z)[i]);
+
+  // the same through a convolution
+  Conv2D<float> conv(4, 3, 1, "same", 1, 1, "relu");
+  tensor<float> image = filled({2, 6, 5, 3}, 0.6f);
+  Dense<float> head(3);
+  head(conv(image));
+  randomize(conv);
+  QuantizedConv2D qc(conv);
+  QuantizedDense qh(head);
+  qh.calibrate(qc(image));
+  quantized_tensor features = qc(qc.quantize(image), qh.input_qparams());
+  EXPECT_EQ(features.dims, std::vector<uint>({2, 6, 5, 4}));
+  tensor<float> a = qh(features), b = qh(qc(image));
+  for (size_t i = 0; i < a.size(); i++) EXPECT_EQ(read(a)[i], read(b)[i]);
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,157 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "tensors++/layers/recurrent.hpp"
+
+using namespace tensors;
+using namespace tensors::layers;
+
+static tensor<float> filled(std::vector<uint> dims, float phase) {
+  shape::Shape s(dims);
+  std::vector<float> v(s.element_size());
+  for (size_t i = 0; i < v.size(); i++)
+    v[i] = 0.8f * std::sin(0.61f * i + phase);
+  return tensor<float>(v, s);
+}
+
+static const float *read(const tensor<float> &t) { return t.raw_data(); }
+
+static double sigmoid(double x) { return 1 / (1 + std::exp(-x)); }
+
+// overwrites the built weights so that every bias entry matters
+static void randomize(Recurrent<float> &layer) {
+  float phase = 0.3f;
+  for (tensor<float> *w : layer.weights()) {
+    float *v = w->raw_data();
+    for (size_t i = 0; i < w->size(); i++)
+      v[i] = 0.5f * std::sin(0.37f * i + phase);
+    phase += 1.1f;
+  }
+}
+
+// The Keras recurrences step by step in double. Returns every hidden state,
+// [batch, steps, units].
+static std::vector<double> reference(Recurrent<float> &layer, bool lstm,
+                                     const tensor<float> &x) {
+  std::vector<tensor<float> *> w = layer.weights();
+  size_t batch = x.shape().d[0], steps = x.shape().d[1];
+  size_t k = x.shape().d[2], units = layer.output_units();
+  size_t gates = lstm ? 4 : 3, cols = gates * units;
+  const float *kernel = read(*w[0]), *recurrent = read(*w[1]);
+  const float *bias = w.size() > 2 ? read(*w[2]) : nullptr;
+
+  std::vector<double> out(batch * steps * units);
+  for (size_t b = 0; b < batch; b++) {
+    std::vector<double> h(units, 0.0), c(units, 0.0);
+    for (size_t t = 0; t < steps; t++) {
+      const float *in = read(x) + (b * steps + t) * k;
+      std::vector<double> xp(cols, 0.0), hp(cols, 0.0);
+      for (size_t j = 0; j < cols; j++) {
+        if (bias) {
+          xp[j] = bias[j];
+          if (!lstm) hp[j] = bias[cols + j];
+        }
+        for (size_t i = 0; i < k; i++)
+          xp[j] += double(in[i]) * kernel[i * cols + j];
+        for (size_t i = 0; i < units; i++)
+          hp[j] += h[i] * recurrent[i * cols + j];
+      }
+      std::vector<double> next(units);
+      for (size_t u = 0; u < units; u++) {
+        if (lstm) {
+          auto z = [&](size_t g) {
+            return xp[g * units + u] + hp[g * units + u];
+          };
+          c[u] = sigmoid(z(1)) * c[u] + sigmoid(z(0)) * std::tanh(z(2));
+          next[u] = sigmoid(z(3)) * std::tanh(c[u]);
+        } else {
+          double zg = sigmoid(xp[u] + hp[u]);
+          double r = sigmoid(xp[units + u] + hp[units + u]);
+          double hh = std::tanh(xp[2 * units + u] + r * hp[2 * units + u]);
+          next[u] = zg * h[u] + (1 - zg) * hh;
+        }
+      }
+      h = next;
+      std::copy(h.begin(), h.end(), out.begin() + (b * steps + t) * units);
+    }
+  }
+  return out;
+}
+
+static void expect_recurrent(Recurrent<float> &layer, bool lstm,
+                             bool return_sequences) {
+  tensor<float> x = filled({3, 7, 5}, 0.4f);
+  layer(x);  // builds
+  randomize(layer);
+  size_t units = layer.output_units();
+  std::vector<double> expected = reference(layer, lstm, x);
+  for (bool frozen : {false, true}) {
+    if (frozen) layer.freeze();
+    tensor<float> y = layer(x);
+    if (return_sequences) {
+      EXPECT_EQ(y.shape().d, std::vector<uint>({3, 7, uint(units)}));
+      for (size_t i = 0; i < expected.size(); i++)
+        EXPECT_NEAR(read(y)[i], expected[i], 1e-5) << "element " << i;
+    } else {
+      EXPECT_EQ(y.shape().d, std::vector<uint>({3, uint(units)}));
+      for (size_t b = 0; b < 3; b++)
+        for (size_t u = 0; u < units; u++)
+          EXPECT_NEAR(read(y)[b * units + u],
+                      expected[(b * 7 + 6) * units + u], 1e-5)
+              << "sequence " << b << " unit " << u;
+    }
+  }
+}
+
+TEST(LSTM, RECURRENT_TEST) {
+  for (bool sequences : {false, true}) {
+    LSTM<float> layer(11, sequences);
+    expect_recurrent(layer, true, sequences);
+  }
+  LSTM<float> unbiased(6, true, false);
+  expect_recurrent(unbiased, true, true);
+}
+
+TEST(GRU, RECURRENT_TEST) {
+  for (bool sequences : {false, true}) {
+    GRU<float> layer(11, sequences);
+    expect_recurrent(layer, false, sequences);
+    EXPECT_EQ(layer.weights()[2]->shape().d, std::vector<uint>({2, 33}));
+  }
+  GRU<float> unbiased(6, true, false);
+  expect_recurrent(unbiased, false, true);
+}
+
+TEST(Shapes, RECURRENT_TEST) {
+  LSTM<float> layer(4);
+  layer(filled({2, 3, 5}, 0.1f));
+  EXPECT_THROW(layer(filled({2, 3, 6}, 0.1f)),
+               exceptions::operation_undefined);
+  EXPECT_THROW(layer(filled({2, 15}, 0.1f)), exceptions::operation_undefined);
+  EXPECT_THROW(LSTM<float>(0), exceptions::operation_undefined);
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
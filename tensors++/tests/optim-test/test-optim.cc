@@ -0,0 +1,218 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "tensors++/optim/adam.hpp"
+#include "tensors++/optim/sgd.hpp"
+
+using namespace tensors;
+
+static std::vector<float> wave(size_t n, float phase) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = std::sin(0.61f * i + phase);
+  return v;
+}
+
+static const float *read(const tensor<float> &t) { return t.raw_data(); }
+
+// One element's update in double. It gets the step t (from 1), the
+// gradient, the parameter and that element's slots, both zero at first.
+typedef std::function<void(size_t t, double g, double &p, double &a,
+                           double &b)>
+    rule;
+
+// A few steps over a parameter larger than chunk_elements and a small one,
+// each element checked against `expected`.
+static void expect_steps(optim::Optimizer<float> &optimizer, rule expected) {
+  std::vector<size_t> sizes = {
+      2 * optim::Optimizer<float>::chunk_elements + 77, 7};
+  std::vector<std::unique_ptr<tensor<float>>> params;
+  std::vector<std::vector<double>> p, a, b;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    std::vector<float> init = wave(sizes[i], 0.3f * i);
+    params.emplace_back(
+        new tensor<float>(init, shape::Shape({uint(sizes[i])})));
+    p.emplace_back(init.begin(), init.end());
+    a.emplace_back(sizes[i], 0.0);
+    b.emplace_back(sizes[i], 0.0);
+  }
+  for (size_t t = 1; t <= 4; t++) {
+    std::vector<std::unique_ptr<tensor<float>>> grads;
+    std::vector<tensor<float> *> g, w;
+    for (size_t i = 0; i < sizes.size(); i++) {
+      grads.emplace_back(new tensor<float>(wave(sizes[i], 1.7f * t + i),
+                                           shape::Shape({uint(sizes[i])})));
+      g.push_back(grads[i].get());
+      w.push_back(params[i].get());
+    }
+    optimizer.apply_gradients(g, w);
+    EXPECT_EQ(optimizer.iterations(), t);
+    for (size_t i = 0; i < sizes.size(); i++)
+      for (size_t e = 0; e < sizes[i]; e++) {
+        expected(t, read(*grads[i])[e], p[i][e], a[i][e], b[i][e]);
+        ASSERT_NEAR(read(*params[i])[e], p[i][e], 1e-5)
+            << "step " << t << " parameter " << i << " element " << e;
+      }
+  }
+}
+
+TEST(SGD, OPTIM_TEST) {
+  optim::SGD<float> plain(0.1f);
+  expect_steps(plain, [](size_t, double g, double &p, double &, double &) {
+    p -= 0.1 * g;
+  });
+
+  optim::SGD<float> momentum(0.1f, 0.9f);
+  expect_steps(momentum,
+               [](size_t, double g, double &p, double &v, double &) {
+                 v = 0.9 * v - 0.1 * g;
+                 p += v;
+               });
+
+  optim::SGD<float> nesterov(0.1f, 0.9f, true);
+  expect_steps(nesterov,
+               [](size_t, double g, double &p, double &v, double &) {
+                 v = 0.9 * v - 0.1 * g;
+                 p += 0.9 * v - 0.1 * g;
+               });
+}
+
+// Keras' Adam, and AdamW decaying the parameter first
+static rule adam(double lr, double decay) {
+  return [lr, decay](size_t t, double g, double &p, double &m, double &v) {
+    double b1 = 0.9, b2 = 0.999, eps = 1e-7;
+    m = b1 * m + (1 - b1) * g;
+    v = b2 * v + (1 - b2) * g * g;
+    double alpha = lr * std::sqrt(1 - std::pow(b2, t)) / (1 - std::pow(b1, t));
+    p = p - lr * decay * p - alpha * m / (std::sqrt(v) + eps);
+  };
+}
+
+TEST(Adam, OPTIM_TEST) {
+  optim::Adam<float> optimizer(0.01f);
+  expect_steps(optimizer, adam(0.01, 0));
+}
+
+TEST(AdamW, OPTIM_TEST) {
+  optim::AdamW<float> optimizer(0.01f, 0.05f);
+  expect_steps(optimizer, adam(0.01, 0.05));
+}
+
+TEST(Errors, OPTIM_TEST) {
+  optim::SGD<float> optimizer(0.1f);
+  tensor<float> p(wave(4, 0), shape::Shape({4}));
+  tensor<float> g(wave(3, 1), shape::Shape({3}));
+  EXPECT_THROW(optimizer.apply_gradients({&g}, {&p}),
+               exceptions::operation_undefined);
+  EXPECT_THROW(optimizer.apply_gradients({&g, &g}, {&p}),
+               exceptions::operation_undefined);
+  EXPECT_EQ(optimizer.iterations(), 0u);
+
+  tensor<float> frozen(wave(3, 0), shape::Shape({3}));
+  frozen.freeze();
+  EXPECT_THROW(optimizer.apply_gradients({&g}, {&frozen}),
+               exceptions::frozen_tensor);
+}
+
+// one dense Adam step of a row in double, for the lazy update
+static void adam_row(size_t t, const float *g, std::vector<double> &p,
+                     std::vector<double> &m, std::vector<double> &v) {
+  rule step = adam(0.01, 0);
+  for (size_t j = 0; j < p.size(); j++) step(t, g[j], p[j], m[j], v[j]);
+}
+
+TEST(SparseAdam, OPTIM_TEST) {
+  size_t rows = 9, dim = 3;
+  std::vector<float> init = wave(rows * dim, 0.4f);
+  tensor<float> table(init, shape::Shape({uint(rows), uint(dim)}));
+  std::vector<std::vector<double>> p(rows), m(rows), v(rows);
+  std::vector<size_t> t(rows, 0);
+  for (size_t r = 0; r < rows; r++) {
+    p[r].assign(init.begin() + r * dim, init.begin() + (r + 1) * dim);
+    m[r].assign(dim, 0.0);
+    v[r].assign(dim, 0.0);
+  }
+
+  // the touched rows follow dense Adam over their own steps, the rest stay
+  optim::Adam<float> optimizer(0.01f);
+  std::vector<std::vector<size_t>> touched = {
+      {0, 4, 8}, {4}, {1, 4, 5}, {0, 1, 2, 3, 4, 5, 6, 7, 8}};
+  for (size_t s = 0; s < touched.size(); s++) {
+    kernels::sparse_rows<float> grad;
+    grad.dim = dim;
+    grad.indices = touched[s];
+    grad.values = wave(touched[s].size() * dim, 2.1f * s);
+    optimizer.apply_sparse_gradient(grad, table);
+    for (size_t i = 0; i < grad.size(); i++) {
+      size_t r = grad.indices[i];
+      adam_row(++t[r], grad.row(i), p[r], m[r], v[r]);
+    }
+    for (size_t r = 0; r < rows; r++)
+      for (size_t j = 0; j < dim; j++)
+        ASSERT_NEAR(read(table)[r * dim + j], p[r][j], 1e-6)
+            << "step " << s << " row " << r;
+  }
+  EXPECT_EQ(optimizer.iterations(), 0u);
+
+  kernels::sparse_rows<float> unsorted;
+  unsorted.dim = dim;
+  unsorted.indices = {2, 1};
+  unsorted.values = wave(2 * dim, 0);
+  EXPECT_THROW(optimizer.apply_sparse_gradient(unsorted, table),
+               exceptions::operation_undefined);
+  unsorted.indices = {1, 1};
+  EXPECT_THROW(optimizer.apply_sparse_gradient(unsorted, table),
+               exceptions::operation_undefined);
+  unsorted.indices = {1, 9};
+  EXPECT_THROW(optimizer.apply_sparse_gradient(unsorted, table),
+               exceptions::operation_undefined);
+  unsorted.indices = {1};
+  EXPECT_THROW(optimizer.apply_sparse_gradient(unsorted, table),
+               exceptions::operation_undefined);
+}
+
+// a parameter is updated either densely or sparsely by one optimizer
+TEST(SparseAdamMixing, OPTIM_TEST) {
+  optim::Adam<float> optimizer(0.01f);
+  tensor<float> sparse(wave(6, 0), shape::Shape({3, 2}));
+  tensor<float> dense(wave(6, 1), shape::Shape({3, 2}));
+  tensor<float> g(wave(6, 2), shape::Shape({3, 2}));
+  kernels::sparse_rows<float> rows;
+  rows.dim = 2;
+  rows.indices = {1};
+  rows.values = wave(2, 3);
+
+  optimizer.apply_sparse_gradient(rows, sparse);
+  optimizer.apply_gradients({&g}, {&dense});
+  EXPECT_THROW(optimizer.apply_gradients({&g}, {&sparse}),
+               exceptions::operation_undefined);
+  EXPECT_EQ(optimizer.iterations(), 1u);  // the rejected step is not counted
+  EXPECT_THROW(optimizer.apply_sparse_gradient(rows, dense),
+               exceptions::operation_undefined);
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
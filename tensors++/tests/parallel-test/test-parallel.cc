@@ -0,0 +1,76 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include "tensors++/core/parallel.hpp"
+
+using namespace tensors;
+
+TEST(Coverage, PARALLEL_TEST) {
+  ASSERT_GT(parallel::thread_pool().NumThreads(), 1);
+  std::vector<int> hits(10007, 0);
+  parallel::parallel_for(hits.size(), 100, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) hits[i]++;
+  });
+  for (int h : hits) EXPECT_EQ(h, 1);
+
+  // nested calls run inline on the workers
+  std::atomic<int> inner(0);
+  parallel::parallel_for(8, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      parallel::parallel_for(100, 1, [&](size_t b, size_t e) {
+        inner += int(e - b);
+      });
+  });
+  EXPECT_EQ(inner.load(), 800);
+}
+
+TEST(Exceptions, PARALLEL_TEST) {
+  // thrown by the block of the calling thread and by a worker block; every
+  // block still runs to the end before the rethrow
+  for (size_t bad : {size_t(0), size_t(999)}) {
+    std::atomic<size_t> done(0);
+    EXPECT_THROW(
+        parallel::parallel_for(1000, 1,
+                               [&](size_t begin, size_t end) {
+                                 for (size_t i = begin; i < end; i++) {
+                                   if (i == bad)
+                                     throw std::runtime_error("bad item");
+                                   done++;
+                                 }
+                               }),
+        std::runtime_error);
+    EXPECT_LT(done.load(), 1000u);
+    // the pool is still usable
+    std::atomic<size_t> after(0);
+    parallel::parallel_for(1000, 1, [&](size_t begin, size_t end) {
+      after += end - begin;
+    });
+    EXPECT_EQ(after.load(), 1000u);
+  }
+}
+
+int main(int argc, char **argv) {
+  // several workers even on a single core machine
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
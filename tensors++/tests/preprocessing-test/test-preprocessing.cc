@@ -0,0 +1,168 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include "tensors++/preprocessing/feature_hasher.hpp"
+#include "tensors++/preprocessing/murmur_hash.hpp"
+#include "tensors++/preprocessing/vocabulary.hpp"
+
+using namespace tensors;
+using namespace tensors::preprocessing;
+
+TEST(MurmurHash, PREPROCESSING_TEST) {
+  // reference values of MurmurHash3_x86_32
+  EXPECT_EQ(murmur3_32("", 0), 0u);
+  EXPECT_EQ(murmur3_32("", 1), 0x514E28B7u);
+  EXPECT_EQ(murmur3_32("", 0xffffffff), 0x81F16F39u);
+  EXPECT_EQ(murmur3_32("hello", 0), 0x248BFA47u);
+  EXPECT_EQ(murmur3_32("The quick brown fox jumps over the lazy dog", 0),
+            0x2E4FF723u);
+}
+
+TEST(FeatureHasher, PREPROCESSING_TEST) {
+  feature_hasher<float> hasher(16);
+  std::vector<std::vector<std::pair<std::string, float>>> rows = {
+      {{"dog", 1.f}, {"cat", 2.f}, {"dog", 3.f}}, {}, {{"fish", 0.5f}}};
+  sparse_tensor<float> x = hasher.transform(rows);
+  ASSERT_EQ(x.rows(), 3u);
+  ASSERT_EQ(x.cols(), 16u);
+  // duplicates are summed into one entry, empty rows stay empty
+  EXPECT_EQ(x.outer_index()[2] - x.outer_index()[1], 0);
+  std::vector<float> dense(3 * 16, 0.f);
+  for (const auto &f : rows[0]) {
+    int col;
+    float v;
+    hasher.hash(f.first, f.second, &col, &v);
+    dense[col] += v;
+  }
+  for (size_t r = 0; r < 1; r++)
+    for (int j = x.outer_index()[r]; j < x.outer_index()[r + 1]; j++)
+      EXPECT_EQ(x.values()[j], dense[r * 16 + x.inner_index()[j]]);
+}
+
+TEST(Vocabulary, PREPROCESSING_TEST) {
+  vocabulary v =
+      vocabulary::build({"b", "a", "c", "a", "b", "a", "d"}, 2, 1, 2);
+  // two out-of-vocabulary buckets, then by frequency
+  EXPECT_EQ(v.size(), 4u);
+  EXPECT_EQ(v.lookup("a"), 2u);
+  EXPECT_EQ(v.lookup("b"), 3u);
+  EXPECT_LT(v.lookup("c"), 2u);
+  EXPECT_EQ(v.token(3), "b");
+  EXPECT_FALSE(v.contains("d"));
+
+  vocabulary grown(0);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ(grown.add(std::to_string(i)), size_t(i));
+  for (int i = 999; i >= 0; i--)
+    EXPECT_EQ(grown.lookup(std::to_string(i)), size_t(i));
+  EXPECT_THROW(grown.lookup("x"), exceptions::operation_undefined);
+
+  sparse_tensor<float> bag = v.encode<float>({{"a", "a", "b"}, {"b"}});
+  EXPECT_EQ(bag.nnz(), 3u);
+  EXPECT_EQ(bag.values()[0], 2.f);
+  sparse_tensor<float> hot = v.encode<float>({{"a", "a", "b"}}, true);
+  EXPECT_EQ(hot.values()[0], 1.f);
+  EXPECT_EQ(v.one_hot<float>({"b", "a"}).inner_index()[0], 3);
+}
+
+// rows of 0 to 4 words, "w0" .. "w29", enough rows for several slices
+static std::vector<std::vector<std::string>> corpus(size_t rows) {
+  std::vector<std::vector<std::string>> c(rows);
+  for (size_t r = 0; r < rows; r++)
+    for (size_t i = 0; i < r % 5; i++)
+      c[r].push_back("w" + std::to_string((r * 7 + i * 13) % 30));
+  return c;
+}
+
+TEST(HasherSlices, PREPROCESSING_TEST) {
+  feature_hasher<float> hasher(64);
+  std::vector<std::vector<std::string>> rows = corpus(5000);
+  sparse_tensor<float> x = hasher.transform(rows);
+  ASSERT_EQ(x.rows(), rows.size());
+  tensor<float> dense = x.to_dense();
+  for (size_t r = 0; r < rows.size(); r++) {
+    std::vector<float> expected(64, 0.f);
+    for (const std::string &f : rows[r]) {
+      int col;
+      float v;
+      hasher.hash(f, 1.f, &col, &v);
+      expected[col] += v;
+    }
+    for (size_t c = 0; c < 64; c++)
+      ASSERT_EQ(dense.raw_data()[r * 64 + c], expected[c]) << "row " << r;
+  }
+}
+
+TEST(VocabularyColumns, PREPROCESSING_TEST) {
+  std::vector<std::vector<std::string>> rows = corpus(5000);
+  std::vector<std::string> words;
+  for (const auto &row : rows)
+    words.insert(words.end(), row.begin(), row.end());
+  vocabulary v = vocabulary::build(words, 20, 1, 3);
+
+  // parallel lookups match the single ones
+  std::vector<size_t> ids = v.lookup(words);
+  ASSERT_EQ(ids.size(), words.size());
+  for (size_t i = 0; i < words.size(); i++)
+    ASSERT_EQ(ids[i], v.lookup(words[i]));
+
+  // sliced encoding matches counting row by row
+  for (bool binary : {false, true}) {
+    sparse_tensor<float> x = v.encode<float>(rows, binary);
+    ASSERT_EQ(x.rows(), rows.size());
+    ASSERT_EQ(x.cols(), v.size());
+    for (size_t r = 0; r < rows.size(); r++) {
+      std::map<int, float> expected;
+      for (const std::string &t : rows[r]) {
+        float &count = expected[int(v.lookup(t))];
+        count = binary ? 1.f : count + 1;
+      }
+      std::map<int, float> got;
+      for (int j = x.outer_index()[r]; j < x.outer_index()[r + 1]; j++)
+        got[x.inner_index()[j]] = x.values()[j];
+      ASSERT_EQ(got, expected) << "row " << r << " binary " << binary;
+    }
+  }
+}
+
+TEST(VocabularyUnknown, PREPROCESSING_TEST) {
+  // without out-of-vocabulary buckets an unknown token throws on the
+  // calling thread, after the parallel tasks
+  vocabulary v = vocabulary::build({"a", "b"}, 0, 1, 0);
+  std::vector<std::string> tokens(10000, "a");
+  EXPECT_EQ(v.lookup(tokens), std::vector<size_t>(10000, 0));
+  tokens[6000] = "x";
+  tokens[9000] = "y";
+  EXPECT_THROW(v.lookup(tokens), exceptions::operation_undefined);
+
+  std::vector<std::vector<std::string>> rows(5000, {"a", "b"});
+  EXPECT_EQ(v.encode<float>(rows).nnz(), 10000u);
+  rows[4500].push_back("z");
+  EXPECT_THROW(v.encode<float>(rows), exceptions::operation_undefined);
+  EXPECT_THROW(v.one_hot<float>(tokens), exceptions::operation_undefined);
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,201 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+#include "tensors++/core/ragged_tensor.hpp"
+#include "tensors++/layers/attention.hpp"
+#include "tensors++/layers/recurrent.hpp"
+
+using namespace tensors;
+
+static std::vector<float> wave(size_t n, float phase) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = std::sin(0.61f * i + phase);
+  return v;
+}
+
+static const float *read(const tensor<float> &t) { return t.raw_data(); }
+
+// sequences of the given lengths with rows of `features` values
+static ragged_tensor<float> sequences(const std::vector<size_t> &lengths,
+                                      uint features, float phase = 0.3f) {
+  size_t total = std::accumulate(lengths.begin(), lengths.end(), size_t(0));
+  return ragged_tensor<float>::from_lengths(
+      tensor<float>(wave(total * features, phase),
+                    shape::Shape({uint(total), features})),
+      lengths);
+}
+
+TEST(Padded, RAGGED_TEST) {
+  std::vector<float> p = wave(3 * 4 * 2, 0.1f);
+  tensor<float> padded(p, shape::Shape({3, 4, 2}));
+  std::vector<size_t> lengths = {2, 0, 4};
+  ragged_tensor<float> r = ragged_tensor<float>::from_padded(padded, lengths);
+  EXPECT_EQ(r.nrows(), 3u);
+  EXPECT_EQ(r.total_rows(), 6u);
+  EXPECT_EQ(r.row_splits(), std::vector<size_t>({0, 2, 2, 6}));
+  EXPECT_EQ(r.values().shape().d, std::vector<uint>({6, 2}));
+  EXPECT_EQ(r.max_length(), 4u);
+  for (size_t b = 0; b < 3; b++)
+    for (size_t i = 0; i < lengths[b] * 2; i++)
+      EXPECT_EQ(r.row_data(b)[i], p[b * 8 + i]);
+
+  tensor<float> back = r.to_padded(-5.f), mask = r.mask();
+  EXPECT_EQ(back.shape().d, std::vector<uint>({3, 4, 2}));
+  EXPECT_EQ(mask.shape().d, std::vector<uint>({3, 4}));
+  for (size_t b = 0; b < 3; b++)
+    for (size_t t = 0; t < 4; t++) {
+      bool real = t < lengths[b];
+      EXPECT_EQ(read(mask)[b * 4 + t], real ? 1.f : 0.f);
+      for (size_t j = 0; j < 2; j++)
+        EXPECT_EQ(read(back)[(b * 4 + t) * 2 + j],
+                  real ? p[(b * 4 + t) * 2 + j] : -5.f);
+    }
+
+  EXPECT_THROW(ragged_tensor<float>::from_padded(padded, {2, 5, 1}),
+               exceptions::operation_undefined);
+  EXPECT_THROW(ragged_tensor<float>::from_padded(padded, {2, 1}),
+               exceptions::operation_undefined);
+  EXPECT_THROW(ragged_tensor<float>(tensor<float>(wave(6, 0),
+                                                  shape::Shape({3, 2})),
+                                    {0, 2, 1, 3}),
+               exceptions::operation_undefined);
+  EXPECT_THROW(ragged_tensor<float>(tensor<float>(wave(6, 0),
+                                                  shape::Shape({3, 2})),
+                                    {0, 2}),
+               exceptions::operation_undefined);
+}
+
+TEST(Packed, RAGGED_TEST) {
+  ragged_tensor<float> r = sequences({2, 0, 4, 3, 4}, 1);
+  packed_sequence p = r.packed();
+  // longest first, ties in their original order
+  EXPECT_EQ(p.order, std::vector<size_t>({2, 4, 3, 0, 1}));
+  EXPECT_EQ(p.starts, std::vector<size_t>({2, 9, 6, 0, 2}));
+  EXPECT_EQ(p.batch_sizes, std::vector<size_t>({4, 4, 3, 2}));
+}
+
+TEST(Segments, RAGGED_TEST) {
+  // enough sequences for several parallel chunks, some empty, rows [2, 3]
+  std::vector<size_t> lengths(300);
+  for (size_t i = 0; i < lengths.size(); i++) lengths[i] = i * 7 % 5;
+  size_t total = std::accumulate(lengths.begin(), lengths.end(), size_t(0));
+  std::vector<float> v = wave(total * 6, 0.7f);
+  ragged_tensor<float> r = ragged_tensor<float>::from_lengths(
+      tensor<float>(v, shape::Shape({uint(total), 2, 3})), lengths);
+
+  tensor<float> sum = r.segment_sum(), mean = r.segment_mean(),
+                max = r.segment_max();
+  for (const tensor<float> *t : {&sum, &mean, &max})
+    EXPECT_EQ(t->shape().d, std::vector<uint>({300, 2, 3}));
+  for (size_t b = 0, row = 0; b < lengths.size(); row += lengths[b++])
+    for (size_t j = 0; j < 6; j++) {
+      double s = 0, m = lengths[b] ? -1e9 : 0;
+      for (size_t i = 0; i < lengths[b]; i++) {
+        s += v[(row + i) * 6 + j];
+        m = std::max<double>(m, v[(row + i) * 6 + j]);
+      }
+      EXPECT_NEAR(read(sum)[b * 6 + j], s, 1e-5) << "sequence " << b;
+      EXPECT_NEAR(read(mean)[b * 6 + j], lengths[b] ? s / lengths[b] : 0,
+                  1e-5)
+          << "sequence " << b;
+      EXPECT_EQ(read(max)[b * 6 + j], float(m)) << "sequence " << b;
+    }
+}
+
+// overwrites the built weights so that every bias entry matters
+static void randomize(layers::Layer<float> &layer) {
+  float phase = 0.3f;
+  for (tensor<float> *w : layer.weights()) {
+    float *v = w->raw_data();
+    for (size_t i = 0; i < w->size(); i++)
+      v[i] = 0.4f * std::sin(0.37f * i + phase);
+    phase += 1.1f;
+  }
+}
+
+// sequence b of r alone, [1, length, features]
+static tensor<float> alone(const ragged_tensor<float> &r, size_t b) {
+  uint features = r.values().shape().d[1];
+  return tensor<float>(
+      std::vector<float>(r.row_data(b),
+                         r.row_data(b) + r.row_length(b) * features),
+      shape::Shape({1, uint(r.row_length(b)), features}));
+}
+
+// the ragged batch against every non-empty sequence run on its own
+template <class Recurrent>
+static void expect_recurrent() {
+  std::vector<size_t> lengths = {3, 7, 0, 1, 7, 4};
+  ragged_tensor<float> r = sequences(lengths, 5);
+  for (bool return_sequences : {false, true}) {
+    Recurrent layer(6, return_sequences);
+    layer(alone(r, 0));  // builds
+    randomize(layer);
+    ragged_tensor<float> y = layer(r);
+    if (return_sequences) {
+      EXPECT_EQ(y.row_splits(), r.row_splits());
+    } else {
+      EXPECT_EQ(y.values().shape().d, std::vector<uint>({6, 6}));
+      for (size_t i = 0; i < 6; i++)  // an empty sequence keeps its zeros
+        EXPECT_EQ(y.row_data(2)[i], 0.f);
+    }
+    for (size_t b = 0; b < lengths.size(); b++) {
+      if (lengths[b] == 0) continue;
+      tensor<float> expected = layer(alone(r, b));
+      ASSERT_EQ(y.row_length(b) * 6, expected.size());
+      for (size_t i = 0; i < expected.size(); i++)
+        ASSERT_NEAR(y.row_data(b)[i], read(expected)[i], 1e-5)
+            << "sequence " << b << " return_sequences " << return_sequences;
+    }
+  }
+}
+
+TEST(LSTM, RAGGED_TEST) { expect_recurrent<layers::LSTM<float>>(); }
+
+TEST(GRU, RAGGED_TEST) { expect_recurrent<layers::GRU<float>>(); }
+
+TEST(Attention, RAGGED_TEST) {
+  std::vector<size_t> lengths = {3, 70, 0, 1, 66};
+  ragged_tensor<float> r = sequences(lengths, 8);
+  for (bool causal : {false, true}) {
+    layers::MultiHeadAttention<float> layer(2, 4, 3, causal);
+    layer(alone(r, 0));  // builds
+    randomize(layer);
+    ragged_tensor<float> y = layer(r);
+    EXPECT_EQ(y.row_splits(), r.row_splits());
+    for (size_t b = 0; b < lengths.size(); b++) {
+      if (lengths[b] == 0) continue;
+      tensor<float> expected = layer(alone(r, b));
+      for (size_t i = 0; i < expected.size(); i++)
+        ASSERT_NEAR(y.row_data(b)[i], read(expected)[i], 1e-5)
+            << "sequence " << b << " causal " << causal;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,142 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "tensors++/kernels/softmax.hpp"
+
+using namespace tensors::kernels;
+
+static std::vector<float> pattern(size_t n, float scale, float offset = 0) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++)
+    v[i] = offset + scale * std::sin(0.37f * i + 0.1f);
+  return v;
+}
+
+// three pass softmax in double precision
+static std::vector<double> reference(const std::vector<float> &x,
+                                     size_t rows, size_t classes) {
+  std::vector<double> p(x.size());
+  for (size_t r = 0; r < rows; r++) {
+    double m = x[r * classes], s = 0;
+    for (size_t c = 0; c < classes; c++)
+      m = std::max(m, double(x[r * classes + c]));
+    for (size_t c = 0; c < classes; c++)
+      s += p[r * classes + c] = std::exp(x[r * classes + c] - m);
+    for (size_t c = 0; c < classes; c++) p[r * classes + c] /= s;
+  }
+  return p;
+}
+
+TEST(Softmax, SOFTMAX_TEST) {
+  // more classes than one chunk, with the maximum late in the row
+  size_t rows = 3, classes = 3000;
+  std::vector<float> x = pattern(rows * classes, 5.f, 1000.f);
+  x[classes + 2500] = 1020.f;
+  std::vector<float> out(x.size()), logs(x.size());
+  softmax(x.data(), rows, classes, out.data());
+  log_softmax(x.data(), rows, classes, logs.data());
+  std::vector<double> p = reference(x, rows, classes);
+  for (size_t i = 0; i < x.size(); i++) {
+    EXPECT_NEAR(out[i], p[i], 1e-6);
+    EXPECT_NEAR(logs[i], std::log(p[i]), 1e-3);
+  }
+}
+
+TEST(SparseCrossEntropy, SOFTMAX_TEST) {
+  size_t rows = 4, classes = 2049;
+  std::vector<float> x = pattern(rows * classes, 8.f);
+  std::vector<int> labels = {0, 17, 2048, 1024};
+  std::vector<float> loss(rows), grad(x.size());
+  sparse_softmax_cross_entropy_with_logits(x.data(), labels.data(), rows,
+                                           classes, loss.data(),
+                                           grad.data());
+  std::vector<double> p = reference(x, rows, classes);
+  for (size_t r = 0; r < rows; r++) {
+    EXPECT_NEAR(loss[r], -std::log(p[r * classes + labels[r]]), 1e-4);
+    for (size_t c = 0; c < classes; c++)
+      EXPECT_NEAR(grad[r * classes + c],
+                  p[r * classes + c] - (int(c) == labels[r]), 1e-6);
+  }
+}
+
+TEST(CrossEntropy, SOFTMAX_TEST) {
+  size_t rows = 2, classes = 1500;
+  std::vector<float> x = pattern(rows * classes, 4.f);
+  std::vector<float> y(x.size(), 0.f);
+  y[10] = 0.25f;
+  y[1400] = 0.75f;
+  y[classes + 3] = 1.f;
+  std::vector<float> loss(rows), grad(x.size());
+  softmax_cross_entropy_with_logits(x.data(), y.data(), rows, classes,
+                                    loss.data(), grad.data());
+  std::vector<double> p = reference(x, rows, classes);
+  for (size_t r = 0; r < rows; r++) {
+    double expected = 0;
+    for (size_t c = 0; c < classes; c++)
+      if (y[r * classes + c] > 0)
+        expected -= y[r * classes + c] * std::log(p[r * classes + c]);
+    EXPECT_NEAR(loss[r], expected, 1e-4);
+  }
+  for (size_t i = 0; i < x.size(); i++)
+    EXPECT_NEAR(grad[i], p[i] - y[i], 1e-6);
+}
+
+TEST(Extremes, SOFTMAX_TEST) {
+  // no overflow for large logits, -inf entries get zero probability
+  std::vector<float> x = {1e4f, 1e4f, -INFINITY, 0.f};
+  std::vector<float> out(4);
+  softmax(x.data(), 1, 4, out.data());
+  EXPECT_FLOAT_EQ(out[0], 0.5f);
+  EXPECT_FLOAT_EQ(out[1], 0.5f);
+  EXPECT_FLOAT_EQ(out[2], 0.f);
+  EXPECT_FLOAT_EQ(out[3], 0.f);
+}
+
+TEST(Labels, SOFTMAX_TEST) {
+  std::vector<float> x = pattern(3 * 5, 1.f), loss(3, -1.f);
+  std::vector<int> negative = {0, -1, 2};
+  std::vector<unsigned> past = {0, 4, 5};
+  EXPECT_THROW(sparse_softmax_cross_entropy_with_logits(
+                   x.data(), negative.data(), 3, 5, loss.data()),
+               tensors::exceptions::operation_undefined);
+  EXPECT_THROW(sparse_softmax_cross_entropy_with_logits(
+                   x.data(), past.data(), 3, 5, loss.data()),
+               tensors::exceptions::operation_undefined);
+  // checked before any row is written
+  for (auto &l : loss) EXPECT_EQ(l, -1.f);
+}
+
+TEST(MaskedClasses, SOFTMAX_TEST) {
+  // a class masked out with -inf and a zero label adds nothing
+  std::vector<float> x = {2.f, -INFINITY, 0.f, 1.f};
+  std::vector<float> y = {0.25f, 0.f, 0.75f, 0.f};
+  std::vector<float> loss(1), grad(4);
+  softmax_cross_entropy_with_logits(x.data(), y.data(), 1, 4, loss.data(),
+                                    grad.data());
+  double lse = std::log(std::exp(2.0) + std::exp(0.0) + std::exp(1.0));
+  EXPECT_NEAR(loss[0], 0.25 * (lse - 2) + 0.75 * lse, 1e-5);
+  EXPECT_EQ(grad[1], 0.f);
+  EXPECT_NEAR(grad[0], std::exp(2.0 - lse) - 0.25, 1e-6);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
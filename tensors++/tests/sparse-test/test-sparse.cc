@@ -0,0 +1,212 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "Eigen/SparseCore"
+#include "tensors++/core/sparse_tensor.hpp"
+#include "tensors++/layers/dense.hpp"
+
+using namespace tensors;
+
+typedef sparse_tensor<float>::index_type index_type;
+
+static const float *read(const tensor<float> &t) { return t.raw_data(); }
+
+// a [rows, cols] dense matrix with about one entry in `every` non-zero
+static std::vector<float> scattered(size_t rows, size_t cols, size_t every) {
+  std::vector<float> x(rows * cols, 0.f);
+  for (size_t i = 0; i < x.size(); i++)
+    if ((i * 7919) % every == 0) x[i] = std::sin(0.61f * i + 0.2f) + 2.f;
+  return x;
+}
+
+TEST(FromCoo, SPARSE_TEST) {
+  // unsorted, with (1, 2) three times and (0, 0) twice
+  std::vector<int> rows = {2, 1, 0, 1, 1, 0, 2, 1};
+  std::vector<int> cols = {3, 2, 0, 0, 2, 0, 1, 2};
+  std::vector<float> vals = {1, 2, 3, 4, 5, 6, 7, 8};
+  sparse_tensor<float> s = sparse_tensor<float>::from_coo(3, 4, rows, cols,
+                                                          vals);
+  EXPECT_EQ(s.nnz(), 5u);
+  EXPECT_EQ(s.outer_index(), std::vector<index_type>({0, 1, 3, 5}));
+  EXPECT_EQ(s.inner_index(), std::vector<index_type>({0, 0, 2, 1, 3}));
+  EXPECT_EQ(s.values(), std::vector<float>({9, 4, 15, 7, 1}));
+
+  // the same as Eigen's setFromTriplets
+  std::vector<Eigen::Triplet<float>> triplets;
+  for (size_t i = 0; i < vals.size(); i++)
+    triplets.emplace_back(rows[i], cols[i], vals[i]);
+  sparse_tensor<float>::matrix m(3, 4);
+  m.setFromTriplets(triplets.begin(), triplets.end());
+  EXPECT_EQ((s.eigen() - m).norm(), 0.f);
+
+  std::vector<uint> urows = {0, 2}, ucols = {1, 1};
+  sparse_tensor<float> u = sparse_tensor<float>::from_coo(
+      3, 2, urows, ucols, std::vector<float>({1, 2}));
+  EXPECT_EQ(u.outer_index(), std::vector<index_type>({0, 1, 1, 2}));
+
+  EXPECT_THROW(sparse_tensor<float>::from_coo(3, 4, std::vector<int>({3}),
+                                              std::vector<int>({0}),
+                                              std::vector<float>({1})),
+               exceptions::operation_undefined);
+  EXPECT_THROW(sparse_tensor<float>::from_coo(3, 4, std::vector<int>({0}),
+                                              std::vector<int>({-1}),
+                                              std::vector<float>({1})),
+               exceptions::operation_undefined);
+  EXPECT_THROW(sparse_tensor<float>::from_coo(3, 4, std::vector<int>({0, 1}),
+                                              std::vector<int>({0}),
+                                              std::vector<float>({1})),
+               exceptions::operation_undefined);
+}
+
+TEST(Csr, SPARSE_TEST) {
+  sparse_tensor<float> s(2, 3, {0, 2, 3}, {0, 2, 1}, {1, 2, 3});
+  EXPECT_EQ(s.nnz(), 3u);
+  EXPECT_NEAR(s.density(), 0.5, 1e-12);
+
+  auto invalid = [](std::vector<index_type> outer,
+                    std::vector<index_type> inner) {
+    std::vector<float> values(inner.size(), 1.f);
+    EXPECT_THROW(sparse_tensor<float>(2, 3, outer, inner, values),
+                 exceptions::operation_undefined);
+  };
+  invalid({0, 2}, {0, 1});           // too few offsets
+  invalid({1, 2, 3}, {0, 1, 2});     // not starting at 0
+  invalid({0, 2, 1}, {0, 1});        // decreasing
+  invalid({0, 1, 3}, {0, 1});        // past the values
+  invalid({0, 2, 3}, {1, 0, 2});     // columns not ascending
+  invalid({0, 2, 3}, {0, 0, 2});     // repeated column
+  invalid({0, 1, 2}, {0, 3});        // column out of range
+  invalid({0, 1, 2}, {-1, 0});       // negative column
+}
+
+TEST(Dense, SPARSE_TEST) {
+  std::vector<float> x = scattered(9, 13, 5);
+  tensor<float> dense(x, shape::Shape({9, 13}));
+  sparse_tensor<float> s = sparse_tensor<float>::from_dense(dense);
+  size_t nonzeros = 0;
+  for (float v : x) nonzeros += v != 0.f;
+  EXPECT_EQ(s.nnz(), nonzeros);
+  tensor<float> back = s.to_dense();
+  EXPECT_EQ(back.shape().d, std::vector<uint>({9, 13}));
+  for (size_t i = 0; i < x.size(); i++) EXPECT_EQ(read(back)[i], x[i]);
+
+  // more dimensions are read as [size / last, last]
+  tensor<float> cube(x, shape::Shape({3, 3, 13}));
+  EXPECT_EQ(sparse_tensor<float>::from_dense(cube).shape().d,
+            std::vector<uint>({9, 13}));
+}
+
+TEST(GatherRows, SPARSE_TEST) {
+  std::vector<float> x = scattered(6, 5, 3);
+  sparse_tensor<float> s =
+      sparse_tensor<float>::from_dense(tensor<float>(x, shape::Shape({6, 5})));
+  std::vector<uint> ids = {5, 0, 5, 2};
+  sparse_tensor<float> g = s.gather_rows(ids.data(), ids.size());
+  EXPECT_EQ(g.shape().d, std::vector<uint>({4, 5}));
+  tensor<float> d = g.to_dense();
+  for (size_t i = 0; i < ids.size(); i++)
+    for (size_t c = 0; c < 5; c++)
+      EXPECT_EQ(read(d)[i * 5 + c], x[ids[i] * 5 + c]);
+  std::vector<int> bad = {1, 6};
+  EXPECT_THROW(s.gather_rows(bad.data(), bad.size()),
+               exceptions::operation_undefined);
+}
+
+TEST(Matmul, SPARSE_TEST) {
+  size_t m = 300, k = 70, n = 19;  // several parallel chunks of rows
+  std::vector<float> a = scattered(m, k, 9);
+  shape::Shape sa({uint(m), uint(k)}), sb({uint(k), uint(n)});
+  sparse_tensor<float> s =
+      sparse_tensor<float>::from_dense(tensor<float>(a, sa));
+  std::vector<float> b(k * n);
+  for (size_t i = 0; i < b.size(); i++) b[i] = std::cos(0.37f * i);
+  tensor<float> c = s.matmul(tensor<float>(b, sb));
+  EXPECT_EQ(c.shape().d, std::vector<uint>({uint(m), uint(n)}));
+  for (size_t r = 0; r < m; r++)
+    for (size_t j = 0; j < n; j++) {
+      double sum = 0;
+      for (size_t l = 0; l < k; l++) sum += double(a[r * k + l]) * b[l * n + j];
+      ASSERT_NEAR(read(c)[r * n + j], sum, 1e-4) << r << ", " << j;
+    }
+  EXPECT_THROW(s.matmul(tensor<float>(b, shape::Shape({uint(n), uint(k)}))),
+               exceptions::operation_undefined);
+}
+
+TEST(Eigen, SPARSE_TEST) {
+  std::vector<float> x = scattered(8, 11, 4);
+  sparse_tensor<float> s =
+      sparse_tensor<float>::from_dense(tensor<float>(x, shape::Shape({8, 11})));
+  // a view over the same arrays, no copy
+  Eigen::Map<const sparse_tensor<float>::matrix> view =
+      static_cast<const sparse_tensor<float> &>(s).eigen();
+  EXPECT_EQ(view.outerIndexPtr(), s.outer_index().data());
+  EXPECT_EQ(view.valuePtr(), s.values().data());
+  for (size_t r = 0; r < 8; r++)
+    for (size_t c = 0; c < 11; c++) EXPECT_EQ(view.coeff(r, c), x[r * 11 + c]);
+
+  // Eigen's own product agrees, and its column major matrices convert
+  Eigen::SparseMatrix<float> column_major = view;
+  Eigen::SparseMatrix<float> product = column_major.transpose() * view;
+  sparse_tensor<float> p(product);
+  EXPECT_EQ(p.shape().d, std::vector<uint>({11, 11}));
+  tensor<float> d = p.to_dense();
+  for (size_t i = 0; i < 11; i++)
+    for (size_t j = 0; j < 11; j++) {
+      double sum = 0;
+      for (size_t r = 0; r < 8; r++)
+        sum += double(x[r * 11 + i]) * x[r * 11 + j];
+      EXPECT_NEAR(read(d)[i * 11 + j], sum, 1e-4);
+    }
+
+  // the mutable view writes the values
+  std::vector<float> before = s.values();
+  s.eigen().coeffs() *= 2.f;
+  for (size_t i = 0; i < before.size(); i++)
+    EXPECT_EQ(s.values()[i], 2 * before[i]);
+}
+
+TEST(DenseLayer, SPARSE_TEST) {
+  std::vector<float> x = scattered(17, 29, 6);
+  tensor<float> dense(x, shape::Shape({17, 29}));
+  sparse_tensor<float> s = sparse_tensor<float>::from_dense(dense);
+  layers::Dense<float> layer(8, kernels::activation::tanh);
+  layer(dense);  // builds
+  float phase = 0.1f;
+  for (tensor<float> *w : layer.weights()) {
+    float *v = w->raw_data();
+    for (size_t i = 0; i < w->size(); i++)
+      v[i] = 0.2f * std::sin(0.7f * i + phase);
+    phase += 1.f;
+  }
+  tensor<float> expected = layer(dense), y = layer(s);
+  EXPECT_EQ(y.shape().d, std::vector<uint>({17, 8}));
+  for (size_t i = 0; i < y.size(); i++)
+    EXPECT_NEAR(read(y)[i], read(expected)[i], 1e-5) << i;
+  EXPECT_THROW(layer(sparse_tensor<float>(3, 28)),
+               exceptions::operation_undefined);
+}
+
+int main(int argc, char **argv) {
+  setenv("TENSORS_NUM_THREADS", "4", 1);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -19,6 +19,26 @@
 
 TEST(FOO, BAR) {}
 
+// products of tensor<bool> are logical ands
+TEST(BoolProduct, TENSOR_TEST) {
+  using tensors::tensor;
+  tensor<bool> a(std::vector<bool>{true, true, false, false},
+                 tensors::shape::Shape({4}));
+  tensor<bool> b(std::vector<bool>{true, false, true, false},
+                 tensors::shape::Shape({4}));
+  tensor<bool> c = a * b;
+  EXPECT_TRUE(c == tensor<bool>(std::vector<bool>{true, false, false, false},
+                                tensors::shape::Shape({4})));
+  EXPECT_TRUE((a * true) == a);
+  a *= b;
+  EXPECT_TRUE(a == c);
+  a *= false;
+  EXPECT_FALSE(a.cumulative_product());
+  EXPECT_FALSE(b.cumulative_product());
+  tensor<bool> ones(std::vector<bool>{true, true}, tensors::shape::Shape({2}));
+  EXPECT_TRUE(ones.cumulative_product());
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,166 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "tensors++/core/tensor.hpp"
+
+using namespace tensors;
+
+static tensor<float> ramp(size_t n) {
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = float(i);
+  return tensor<float>(v, shape::Shape({uint(n)}));
+}
+
+static const float *read(const tensor<float> &t) { return t.raw_data(); }
+
+// permissions of the mapping holding `p` as listed in /proc/self/maps
+static std::string permissions(const void *p) {
+  std::ifstream maps("/proc/self/maps");
+  uintptr_t at = reinterpret_cast<uintptr_t>(p);
+  for (std::string line; std::getline(maps, line);) {
+    std::istringstream in(line);
+    uintptr_t low, high;
+    char dash;
+    std::string perms;
+    in >> std::hex >> low >> dash >> high >> perms;
+    if (at >= low && at < high) return perms;
+  }
+  return "";
+}
+
+TEST(Mutation, FREEZE_TEST) {
+  tensor<float> t = ramp(8), other = ramp(8);
+  t.freeze();
+  EXPECT_TRUE(t.frozen());
+  EXPECT_THROW(t.raw_data(), exceptions::frozen_tensor);
+  EXPECT_THROW(t += other, exceptions::frozen_tensor);
+  EXPECT_THROW(t -= other, exceptions::frozen_tensor);
+  EXPECT_THROW(t *= 2.f, exceptions::frozen_tensor);
+  EXPECT_THROW(t /= other, exceptions::frozen_tensor);
+  EXPECT_THROW(++t, exceptions::frozen_tensor);
+  EXPECT_THROW(--t, exceptions::frozen_tensor);
+  EXPECT_THROW(t.clip(1.f, 0.f), exceptions::frozen_tensor);
+  EXPECT_THROW(t.apply_lambda([](float &e) { e = 0; }),
+               exceptions::frozen_tensor);
+  EXPECT_THROW(other.copy_to(t), exceptions::frozen_tensor);
+  // nothing was written
+  for (size_t i = 0; i < 8; i++) EXPECT_EQ(read(t)[i], float(i));
+
+  // reading and out of place arithmetic still work
+  tensor<float> sum = t + other;
+  EXPECT_FALSE(sum.frozen());
+  EXPECT_EQ(read(sum)[3], 6.f);
+
+  config::Config fixed = config::Config::default_config_instance();
+  fixed.is_freezeable = false;
+  tensor<float> never(std::vector<float>(4, 1.f), shape::Shape({4}), fixed);
+  EXPECT_THROW(never.freeze(), exceptions::operation_undefined);
+}
+
+TEST(Sharing, FREEZE_TEST) {
+  tensor<float> t = ramp(1000);
+  tensor<float> copy(t);
+  EXPECT_NE(read(copy), read(t));  // mutable copies own their elements
+
+  t.freeze();
+  tensor<float> a(t), b(a);
+  EXPECT_TRUE(a.frozen() && b.frozen());
+  EXPECT_EQ(read(a), read(t));
+  EXPECT_EQ(read(b), read(t));
+
+  storage<float> s;
+  s = std::vector<float>(16, 2.f);
+  storage<float> private_copy(s);
+  EXPECT_EQ(s.use_count(), 1);
+  EXPECT_NE(private_copy.data(), s.data());
+  s.freeze();
+  {
+    storage<float> x(s), y(x);
+    EXPECT_EQ(s.use_count(), 3);
+    EXPECT_EQ(x.data(), s.data());
+  }
+  EXPECT_EQ(s.use_count(), 1);
+}
+
+TEST(Unfreeze, FREEZE_TEST) {
+  tensor<float> t = ramp(16);
+  t.freeze();
+  tensor<float> shared(t);
+  t.unfreeze();
+  EXPECT_FALSE(t.frozen());
+  EXPECT_NE(read(t), read(shared));  // detached from the other holder
+  t.raw_data()[0] = 42.f;
+  EXPECT_EQ(read(shared)[0], 0.f);
+  EXPECT_TRUE(shared.frozen());
+
+  // the last holder keeps its block
+  const float *before = read(shared);
+  shared.unfreeze();
+  EXPECT_EQ(read(shared), before);
+  shared.raw_data()[1] = 7.f;
+  EXPECT_EQ(read(shared)[1], 7.f);
+}
+
+// copy_to resizes a mutable target either way, never a frozen one
+TEST(Resize, FREEZE_TEST) {
+  tensor<float> small = ramp(6), large = ramp(16);
+  tensor<float> target = ramp(10);
+  small.copy_to(target, true);
+  EXPECT_EQ(target.size(), 6u);
+  EXPECT_EQ(read(target)[5], 5.f);
+  large.copy_to(target, true);
+  EXPECT_EQ(target.size(), 16u);
+  EXPECT_EQ(read(target)[15], 15.f);
+
+  target.freeze();
+  EXPECT_THROW(small.copy_to(target, true), exceptions::frozen_tensor);
+  EXPECT_EQ(target.size(), 16u);
+}
+
+TEST(ProtectPages, FREEZE_TEST) {
+  tensor<float> t = ramp(3000);
+  t.freeze(true);
+  const float *p = read(t);
+  size_t page = size_t(sysconf(_SC_PAGESIZE));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % page, 0u);
+  for (size_t i = 0; i < 3000; i++) ASSERT_EQ(p[i], float(i));
+
+  // the pages are mapped read-only, a write through a stale pointer faults
+  EXPECT_EQ(permissions(p).substr(0, 2), "r-");
+  EXPECT_EQ(permissions(p + 2999).substr(0, 2), "r-");
+  volatile float *stale = const_cast<float *>(p);
+  EXPECT_DEATH(stale[10] = 1.f, "");
+  EXPECT_EQ(p[10], 10.f);
+
+  // unfreeze copies the elements back onto writable memory
+  t.unfreeze();
+  EXPECT_NE(read(t), p);
+  t.raw_data()[10] = 1.f;
+  EXPECT_EQ(read(t)[10], 1.f);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,45 @@
+/**
+ *   Copyright 2018 Ashar <ashar786khan@gmail.com>
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "tensors++/core/tensor.hpp"
+
+using namespace tensors;
+
+TEST(Gather, INDEX_TEST) {
+  std::vector<float> v(24);
+  for (size_t i = 0; i < v.size(); i++) v[i] = float(i) * 0.5f;
+  tensor<float> t(v, shape::Shape({2, 3, 4}));
+  tensor<uint> idx(std::vector<uint>({23, 0, 7, 7}), shape::Shape({4}));
+  EXPECT_EQ(t[idx], std::vector<float>({11.5f, 0, 3.5f, 3.5f}));
+}
+
+TEST(Errors, INDEX_TEST) {
+  tensor<float> t(std::vector<float>(6), shape::Shape({2, 3}));
+  EXPECT_THROW(t[tensor<uint>(std::vector<uint>({1, 6}), shape::Shape({2}))],
+               exceptions::operation_undefined);
+  EXPECT_THROW(
+      t[tensor<uint>(std::vector<uint>({1, 2}), shape::Shape({1, 2}))],
+      exceptions::operation_undefined);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}